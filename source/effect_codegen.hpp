@@ -7,7 +7,8 @@
 
 #include "effect_module.hpp"
 #include <memory> // std::unique_ptr
-#include <algorithm> // std::find_if
+#include <cassert>
+#include <algorithm> // std::find_if, std::sort
 
 namespace reshadefx
 {
@@ -170,7 +171,7 @@ namespace reshadefx
 		/// <param name="res_type">The data type of the call result.</param>
 		/// <param name="args">A list of SSA IDs representing the call arguments.</param>
 		/// <returns>New SSA ID with the result of the function call.</returns>
-		virtual id emit_call(const location &loc, id function, const type &res_type, const std::vector<expression> &args) = 0;
+		virtual id emit_call(const location &loc, id function, const type &res_type, const expression_list &args) = 0;
 		/// <summary>
 		/// Add an intrinsic function call to the output.
 		/// </summary>
@@ -179,14 +180,14 @@ namespace reshadefx
 		/// <param name="res_type">The data type of the call result.</param>
 		/// <param name="args">A list of SSA IDs representing the call arguments.</param>
 		/// <returns>New SSA ID with the result of the function call.</returns>
-		virtual id emit_call_intrinsic(const location &loc, id function, const type &res_type, const std::vector<expression> &args) = 0;
+		virtual id emit_call_intrinsic(const location &loc, id function, const type &res_type, const expression_list &args) = 0;
 		/// <summary>
 		/// Add a type constructor call to the output.
 		/// </summary>
 		/// <param name="type">The data type to construct.</param>
 		/// <param name="args">A list of SSA IDs representing the scalar constructor arguments.</param>
 		/// <returns>New SSA ID with the constructed value.</returns>
-		virtual id emit_construct(const location &loc, const type &type, const std::vector<expression> &args) = 0;
+		virtual id emit_construct(const location &loc, const type &type, const expression_list &args) = 0;
 
 		/// <summary>
 		/// Add a structured branch control flow to the output.
@@ -282,8 +283,9 @@ namespace reshadefx
 		/// <returns>A reference to the struct description.</returns>
 		struct_info &find_struct(id id)
 		{
-			return *std::find_if(_structs.begin(), _structs.end(),
-				[id](const auto &it) { return it.definition == id; });
+			struct_info &info = _structs[_lookup_index[id]];
+			assert(info.definition == id);
+			return info;
 		}
 		/// <summary>
 		/// Look up an existing texture definition.
@@ -292,18 +294,21 @@ namespace reshadefx
 		/// <returns>A reference to the texture description.</returns>
 		texture_info &find_texture(id id)
 		{
-			return *std::find_if(_module.textures.begin(), _module.textures.end(),
-				[id](const auto &it) { return it.id == id; });
+			texture_info &info = _module.textures[_lookup_index[id]];
+			assert(info.id == id);
+			return info;
 		}
 		sampler_info &find_sampler(id id)
 		{
-			return *std::find_if(_module.samplers.begin(), _module.samplers.end(),
-				[id](const auto &it) { return it.id == id; });
+			sampler_info &info = _module.samplers[_lookup_index[id]];
+			assert(info.id == id);
+			return info;
 		}
 		storage_info &find_storage(id id)
 		{
-			return *std::find_if(_module.storages.begin(), _module.storages.end(),
-				[id](const auto &it) { return it.id == id; });
+			storage_info &info = _module.storages[_lookup_index[id]];
+			assert(info.id == id);
+			return info;
 		}
 		/// <summary>
 		/// Look up an existing function definition.
@@ -312,13 +317,26 @@ namespace reshadefx
 		/// <returns>A reference to the function description.</returns>
 		function_info &find_function(id id)
 		{
-			return *std::find_if(_functions.begin(), _functions.end(),
-				[id](const auto &it) { return it->definition == id; })->get();
+			function_info &info = *_functions[_lookup_index[id]];
+			assert(info.definition == id);
+			return info;
 		}
 
 	protected:
 		id make_id() { return _next_id++; }
 
+		/// <summary>
+		/// Remember the position of a struct, texture, sampler, storage or function definition in its list, so that the "find_*" functions can look it up by ID directly.
+		/// </summary>
+		/// <param name="id">The SSA ID of the definition.</param>
+		/// <param name="index">The index of the definition in the list it was added to.</param>
+		void add_lookup_index(id id, size_t index)
+		{
+			if (id >= _lookup_index.size())
+				_lookup_index.resize(id + 1);
+			_lookup_index[id] = static_cast<uint32_t>(index);
+		}
+
 		static uint32_t align_up(uint32_t size, uint32_t alignment)
 		{
 			alignment -= 1;
@@ -329,9 +347,106 @@ namespace reshadefx
 			return align_up(size, alignment) * (elements - 1) + size;
 		}
 
+		/// <summary>
+		/// Rearrange the uniform variables in memory to reduce the padding between them and update their offsets accordingly.
+		/// Only the offsets are changed, the uniform list itself keeps the declaration order. The previous layout is kept if rearranging does not make it smaller.
+		/// </summary>
+		/// <param name="next_offset">Function returning the offset of an uniform variable placed after another one ending at the specified offset, following the layout rules of the target.</param>
+		/// <returns>Indices into the uniform list, sorted by their offset.</returns>
+		template <typename F>
+		std::vector<size_t> pack_uniforms(F next_offset)
+		{
+			std::vector<uniform_info> &uniforms = _module.uniforms;
+			std::vector<uint32_t> offsets(uniforms.size());
+			std::vector<bool> placed(uniforms.size());
+			std::vector<size_t> order;
+			order.reserve(uniforms.size());
+
+			// Greedily pick the variable which needs the least padding at the current end of the layout, preferring larger ones, so that smaller ones are left to fill gaps later
+			uint32_t total_size = 0;
+			while (order.size() < uniforms.size())
+			{
+				size_t best = uniforms.size();
+				uint32_t best_offset = 0;
+				for (size_t i = 0; i < uniforms.size(); ++i)
+				{
+					if (placed[i])
+						continue;
+
+					const uint32_t offset = next_offset(uniforms[i], total_size);
+					if (best == uniforms.size() || offset < best_offset || (offset == best_offset && uniforms[i].size > uniforms[best].size))
+						best = i, best_offset = offset;
+				}
+
+				order.push_back(best);
+				placed[best] = true;
+				offsets[best] = best_offset;
+				total_size = best_offset + uniforms[best].size;
+			}
+
+			if (total_size < _module.total_uniform_size)
+			{
+				for (size_t i = 0; i < uniforms.size(); ++i)
+					uniforms[i].offset = offsets[i];
+
+				_module.packed_uniform_bytes_saved = _module.total_uniform_size - total_size;
+				_module.total_uniform_size = total_size;
+			}
+			else
+			{
+				std::sort(order.begin(), order.end(),
+					[&uniforms](size_t lhs, size_t rhs) { return uniforms[lhs].offset < uniforms[rhs].offset; });
+			}
+
+			return order;
+		}
+
+		/// <summary>
+		/// Build the line directives that continue the line numbering of the specified code at each of the specified offsets into it, following any line directives in the code before them.
+		/// This keeps the line numbers a compiler reports for code written out in separate ranges the same as those for the complete code.
+		/// </summary>
+		/// <param name="code">The complete code.</param>
+		/// <param name="offsets">Offsets into the code at the start of a line, in ascending order.</param>
+		/// <returns>A line directive (including file name if one was set before) for each offset.</returns>
+		static std::vector<std::string> make_line_directives(const std::string &code, const std::vector<size_t> &offsets)
+		{
+			std::vector<std::string> directives;
+			directives.reserve(offsets.size());
+
+			uint32_t line = 1;
+			size_t line_begin = 0;
+			std::string source;
+
+			for (const size_t offset : offsets)
+			{
+				for (size_t line_end; line_begin < offset && (line_end = code.find('\n', line_begin)) < offset; line_begin = line_end + 1)
+				{
+					if (code.compare(line_begin, 6, "#line ") != 0)
+					{
+						line++;
+						continue;
+					}
+
+					// The directive sets the number of the line following it
+					line = 0;
+					size_t pos = line_begin + 6;
+					for (; pos < line_end && code[pos] >= '0' && code[pos] <= '9'; ++pos)
+						line = line * 10 + (code[pos] - '0');
+
+					if (const size_t quote = code.find('\"', pos); quote < line_end)
+						source.assign(code, quote, line_end - quote);
+				}
+
+				directives.push_back("#line " + std::to_string(line) + (source.empty() ? "\n" : ' ' + source + '\n'));
+			}
+
+			return directives;
+		}
+
 		reshadefx::module _module;
 		std::vector<struct_info> _structs;
 		std::vector<std::unique_ptr<function_info>> _functions;
+		std::vector<uint32_t> _lookup_index;
 		id _next_id = 1;
 		id _last_block = 0;
 		id _current_block = 0;
@@ -345,14 +460,38 @@ namespace reshadefx
 	/// <param name="uniforms_to_spec_constants">Whether to convert uniform variables to specialization constants.</param>
 	/// <param name="enable_16bit_types">Use real 16-bit types for the minimum precision types "min16int", "min16uint" and "min16float".</param>
 	/// <param name="flip_vert_y">Insert code to flip the Y component of the output position in vertex shaders.</param>
-	codegen *create_codegen_glsl(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types = false, bool flip_vert_y = false);
+	/// <param name="pack_uniforms">Rearrange uniform variables in the uniform block to reduce padding, instead of laying them out in declaration order.</param>
+	codegen *create_codegen_glsl(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types = false, bool flip_vert_y = false, bool pack_uniforms = false);
 	/// <summary>
 	/// Create a back-end implementation for HLSL code generation.
 	/// </summary>
 	/// <param name="shader_model">The HLSL shader model version (e.g. 30, 41, 50, 60, ...)</param>
 	/// <param name="debug_info">Whether to append debug information like line directives to the generated code.</param>
 	/// <param name="uniforms_to_spec_constants">Whether to convert uniform variables to specialization constants.</param>
-	codegen *create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants);
+	/// <param name="pack_uniforms">Rearrange uniform variables in the constant buffer to reduce padding, instead of laying them out in declaration order (ignored in shader model 3).</param>
+	codegen *create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants, bool pack_uniforms = false);
+	/// <summary>
+	/// Optimization passes the SPIR-V back-end can run on the generated code. These can be combined.
+	/// </summary>
+	enum class spirv_optimization : uint32_t
+	{
+		none = 0,
+		// Remove functions that are not reachable from any entry point and global variables that are not referenced anymore
+		dead_function_elimination = 1 << 0,
+		// Merge basic blocks with their only successor if that has no other predecessor
+		block_merging = 1 << 1,
+		// Replace loads from function-local variables with the value last stored to them
+		store_forwarding = 1 << 2,
+		// Evaluate instructions with only constant operands
+		constant_folding = 1 << 3,
+		// Remove instructions whose result is unused and variables which are only written to
+		dead_code_elimination = 1 << 4,
+		all = 0xFFFFFFFF
+	};
+
+	constexpr spirv_optimization operator|(spirv_optimization lhs, spirv_optimization rhs) { return static_cast<spirv_optimization>(static_cast<uint32_t>(lhs) | static_cast<uint32_t>(rhs)); }
+	constexpr spirv_optimization operator&(spirv_optimization lhs, spirv_optimization rhs) { return static_cast<spirv_optimization>(static_cast<uint32_t>(lhs) & static_cast<uint32_t>(rhs)); }
+
 	/// <summary>
 	/// Create a back-end implementation for SPIR-V code generation.
 	/// </summary>
@@ -361,5 +500,19 @@ namespace reshadefx
 	/// <param name="uniforms_to_spec_constants">Whether to convert uniform variables to specialization constants.</param>
 	/// <param name="enable_16bit_types">Use real 16-bit types for the minimum precision types "min16int", "min16uint" and "min16float".</param>
 	/// <param name="flip_vert_y">Insert code to flip the Y component of the output position in vertex shaders.</param>
-	codegen *create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types = false, bool flip_vert_y = false);
+	/// <param name="optimization">Optimization passes to run on the generated code (dead code elimination, constant folding, ...).</param>
+	/// <param name="pack_uniforms">Rearrange uniform variables in the uniform block to reduce padding, instead of laying them out in declaration order.</param>
+	codegen *create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types = false, bool flip_vert_y = false, spirv_optimization optimization = spirv_optimization::none, bool pack_uniforms = false);
+	/// <summary>
+	/// Create a back-end implementation which does not generate any code, but records the calls made into it in a compact intermediate representation instead.
+	/// This allows to parse an effect only once and then generate code for several other back-ends from the result using <see cref="replay_codegen_ir"/>.
+	/// </summary>
+	codegen *create_codegen_ir();
+	/// <summary>
+	/// Generate code with a back-end by replaying all calls recorded by a back-end created with <see cref="create_codegen_ir"/> into it.
+	/// The result is the same as if the parser had been called with the target back-end directly. The recording is not modified, so it can be replayed into several back-ends concurrently.
+	/// </summary>
+	/// <param name="ir">The recording back-end to replay.</param>
+	/// <param name="target">The back-end to generate code with.</param>
+	void replay_codegen_ir(const codegen *ir, codegen *target);
 }
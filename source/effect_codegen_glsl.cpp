@@ -8,7 +8,7 @@
 #include <cmath> // signbit, isinf, isnan
 #include <cstdio> // snprintf
 #include <cassert>
-#include <algorithm> // std::find_if, std::max
+#include <algorithm> // std::find_if, std::max, std::sort, std::unique
 #include <unordered_set>
 
 using namespace reshadefx;
@@ -16,8 +16,8 @@ using namespace reshadefx;
 class codegen_glsl final : public codegen
 {
 public:
-	codegen_glsl(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y)
-		: _debug_info(debug_info), _vulkan_semantics(vulkan_semantics), _uniforms_to_spec_constants(uniforms_to_spec_constants), _enable_16bit_types(enable_16bit_types), _flip_vert_y(flip_vert_y)
+	codegen_glsl(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y, bool pack_uniforms)
+		: _debug_info(debug_info), _vulkan_semantics(vulkan_semantics), _uniforms_to_spec_constants(uniforms_to_spec_constants), _enable_16bit_types(enable_16bit_types), _flip_vert_y(flip_vert_y), _pack_uniforms(pack_uniforms)
 	{
 		// Create default block and reserve a memory block to avoid frequent reallocations
 		std::string &block = _blocks.emplace(0, std::string()).first->second;
@@ -38,8 +38,12 @@ private:
 	};
 
 	std::string _ubo_block;
+	// Start of the declaration of each uniform in the uniform block above, in the same order as the uniform list in the module
+	std::vector<size_t> _ubo_declaration_offsets;
 	std::string _compute_block;
 	std::unordered_map<id, std::string> _names;
+	// Reverse lookup of all names defined above (the keys reference the strings in '_names')
+	std::unordered_multimap<std::string_view, id> _name_lookup;
 	std::unordered_map<id, std::string> _blocks;
 	bool _debug_info = false;
 	bool _vulkan_semantics = false;
@@ -47,6 +51,7 @@ private:
 	bool _enable_16bit_types = false;
 	bool _enable_control_flow_attributes = false;
 	bool _flip_vert_y = false;
+	bool _pack_uniforms = false;
 	std::unordered_map<id, id> _remapped_sampler_variables;
 	std::unordered_map<std::string, uint32_t> _semantic_to_location;
 
@@ -56,8 +61,34 @@ private:
 	bool _uses_componentwise_and = false;
 	bool _uses_componentwise_cond = false;
 
+	// Code in the global block is split into consecutive ranges, one for each global definition, which record the other definitions they reference
+	// This is used to only write out the code an entry point can actually reach, rather than the entire module, for every entry point
+	struct global_definition
+	{
+		size_t end = 0;
+		std::vector<id> references;
+	};
+	std::vector<global_definition> _global_definitions;
+	// Index into the definition list above plus one for every ID with a global definition (or zero if there is none)
+	std::vector<uint32_t> _global_definition_index;
+	mutable std::vector<id> _global_references;
+	std::vector<id> _entry_point_definitions;
+
 	void write_result(module &module) override
 	{
+		if (_pack_uniforms)
+		{
+			const std::vector<size_t> order = pack_uniforms([](const uniform_info &info, uint32_t end) { return align_up(end, uniform_alignment(info.type)); });
+
+			// The standard layout of the uniform block is implied by the order of its members, so rearrange the declarations to match the new offsets
+			_ubo_declaration_offsets.push_back(_ubo_block.size());
+			std::string ubo_block;
+			ubo_block.reserve(_ubo_block.size());
+			for (const size_t index : order)
+				ubo_block.append(_ubo_block, _ubo_declaration_offsets[index], _ubo_declaration_offsets[index + 1] - _ubo_declaration_offsets[index]);
+			_ubo_block = std::move(ubo_block);
+		}
+
 		module = std::move(_module);
 
 		if (_enable_16bit_types)
@@ -101,7 +132,67 @@ private:
 			// TODO: This technically only works with square matrices
 			module.hlsl += "layout(std140, column_major, binding = 0) uniform _Globals {\n" + _ubo_block + "};\n";
 
+		// Uniforms are always kept, since the standard layout of the uniform block does not allow leaving out members
+		const size_t preamble_size = module.hlsl.size();
+
 		module.hlsl += _blocks.at(0);
+
+		// Line directives to insert wherever the code written for an entry point skips part of the module, so that compiler messages refer to the same lines as in the complete module
+		std::vector<size_t> definition_offsets(1, preamble_size);
+		for (const global_definition &definition : _global_definitions)
+			definition_offsets.push_back(preamble_size + definition.end);
+		const std::vector<std::string> line_directives = make_line_directives(module.hlsl, definition_offsets);
+
+		assert(_entry_point_definitions.size() == module.entry_points.size());
+
+		for (size_t i = 0; i < module.entry_points.size(); ++i)
+		{
+			// Entry point function may be incomplete if there were errors during parsing, so skip pruning in that case
+			if (const id root = _entry_point_definitions[i];
+				root >= _global_definition_index.size() || _global_definition_index[root] == 0)
+				continue;
+
+			std::vector<bool> reachable(_global_definitions.size());
+			std::vector<id> pending(1, _entry_point_definitions[i]);
+			while (!pending.empty())
+			{
+				const id definition = pending.back();
+				pending.pop_back();
+
+				if (const uint32_t index = _global_definition_index[definition] - 1; !reachable[index])
+				{
+					reachable[index] = true;
+					pending.insert(pending.end(), _global_definitions[index].references.begin(), _global_definitions[index].references.end());
+				}
+			}
+
+			std::string &code = module.entry_points[i].code;
+			code.assign(module.hlsl, 0, preamble_size);
+
+			// Keep definitions in their original order, so that they are still declared before they are used
+			size_t begin = 0;
+			bool continuous = true;
+			for (size_t k = 0; k < _global_definitions.size(); begin = _global_definitions[k++].end)
+			{
+				if (_global_definitions[k].end == begin)
+					continue;
+
+				if (reachable[k])
+				{
+					if (!continuous)
+						code += line_directives[k];
+					code.append(_blocks.at(0), begin, _global_definitions[k].end - begin);
+				}
+
+				continuous = reachable[k];
+			}
+			if (begin < _blocks.at(0).size())
+			{
+				if (!continuous)
+					code += line_directives.back();
+				code.append(_blocks.at(0), begin, std::string::npos);
+			}
+		}
 	}
 
 	template <bool is_param = false, bool is_decl = true, bool is_interface = false>
@@ -310,6 +401,9 @@ private:
 			id = it->second;
 
 		assert(id != 0);
+		// Keep track of all references to global definitions, so they can be associated with the definition currently being written
+		if (id < _global_definition_index.size() && _global_definition_index[id] != 0)
+			_global_references.push_back(id);
 		if (const auto names_it = _names.find(id);
 			names_it != _names.end())
 			return names_it->second;
@@ -326,9 +420,19 @@ private:
 		if constexpr (naming_type != naming::reserved)
 			name = escape_name(std::move(name));
 		if constexpr (naming_type == naming::general)
-			if (std::find_if(_names.begin(), _names.end(), [&name](const auto &it) { return it.second == name; }) != _names.end())
+			if (_name_lookup.find(name) != _name_lookup.end())
 				name += '_' + std::to_string(id); // Append a numbered suffix if the name already exists
-		_names[id] = std::move(name);
+
+		std::string &entry = _names[id];
+		if (!entry.empty())
+		{
+			// Remove the lookup entry referencing the previous name of this ID before it is overwritten
+			const auto [begin, end] = _name_lookup.equal_range(entry);
+			_name_lookup.erase(std::find_if(begin, end, [id](const auto &it) { return it.second == id; }));
+		}
+
+		entry = std::move(name);
+		_name_lookup.emplace(entry, id);
 	}
 
 	uint32_t semantic_to_location(const std::string &semantic, uint32_t max_array_length = 1)
@@ -422,15 +526,53 @@ private:
 		return escape_name(std::move(name));
 	}
 
-	static void increase_indentation_level(std::string &block)
+	static void increase_indentation_level(std::string &block, unsigned int levels = 1)
 	{
 		if (block.empty())
 			return;
 
-		for (size_t pos = 0; (pos = block.find("\n\t", pos)) != std::string::npos; pos += 3)
-			block.replace(pos, 2, "\n\t\t");
+		// Rebuild the block in a single pass, rather than inserting into it for every line
+		std::string result;
+		result.reserve(block.size() + block.size() / 8 * levels);
+		result.append(levels, '\t');
+
+		size_t pos = 0;
+		for (size_t next; (next = block.find("\n\t", pos)) != std::string::npos; pos = next + 1)
+		{
+			result.append(block, pos, next + 1 - pos);
+			result.append(levels, '\t');
+		}
+		result.append(block, pos, std::string::npos);
+
+		block = std::move(result);
+	}
+
+	void add_global_definition(id id)
+	{
+		global_definition &definition = _global_definitions.emplace_back();
+
+		// The definition covers all code written to the global block since the previous one (which includes any temporaries used by its initializer)
+		definition.end = _blocks.at(0).size();
+
+		std::sort(_global_references.begin(), _global_references.end());
+		_global_references.erase(std::unique(_global_references.begin(), _global_references.end()), _global_references.end());
+		definition.references = std::move(_global_references);
+		_global_references.clear();
+
+		if (id >= _global_definition_index.size())
+			_global_definition_index.resize(id + 1);
+		_global_definition_index[id] = static_cast<uint32_t>(_global_definitions.size());
+	}
+
+	void append_block(std::string &code, id block)
+	{
+		std::string &block_data = _blocks.at(block);
 
-		block.insert(block.begin(), '\t');
+		// Avoid copying the block if nothing was written to the current one yet (which is usually the case for merge blocks)
+		if (code.empty())
+			code.swap(block_data);
+		else
+			code += block_data;
 	}
 
 	id   define_struct(const location &loc, struct_info &info) override
@@ -438,6 +580,7 @@ private:
 		info.definition = make_id();
 		define_name<naming::unique>(info.definition, info.unique_name);
 
+		add_lookup_index(info.definition, _structs.size());
 		_structs.push_back(info);
 
 		std::string &code = _blocks.at(_current_block);
@@ -462,6 +605,9 @@ private:
 
 		code += "};\n";
 
+		if (!is_in_block())
+			add_global_definition(info.definition);
+
 		return info.definition;
 	}
 	id   define_texture(const location &, texture_info &info) override
@@ -469,6 +615,7 @@ private:
 		info.id = make_id();
 		info.binding = ~0u;
 
+		add_lookup_index(info.id, _module.textures.size());
 		_module.textures.push_back(info);
 
 		return info.id;
@@ -487,6 +634,9 @@ private:
 
 		code += "layout(binding = " + std::to_string(info.binding) + ") uniform sampler2D " + id_to_name(info.id) + ";\n";
 
+		add_global_definition(info.id);
+
+		add_lookup_index(info.id, _module.samplers.size());
 		_module.samplers.push_back(info);
 
 		return info.id;
@@ -559,6 +709,9 @@ private:
 			code += "writeonly ";
 		code += "image2D " + id_to_name(info.id) + ";\n";
 
+		add_global_definition(info.id);
+
+		add_lookup_index(info.id, _module.storages.size());
 		_module.storages.push_back(info);
 
 		return info.id;
@@ -588,6 +741,8 @@ private:
 				write_type<false, false>(code, info.type);
 			code += "(SPEC_CONSTANT_" + info.name + ");\n";
 
+			add_global_definition(res);
+
 			_module.spec_constants.push_back(info);
 		}
 		else
@@ -600,25 +755,21 @@ private:
 			//    according to rules (1), (2), and (3), and rounded up to the base alignment of a four-component vector.
 			// 7. If the member is a row-major matrix with C columns and R rows, the matrix is stored identically to an array of R row vectors with C components each, according to rule (4).
 			// 8. If the member is an array of S row-major matrices with C columns and R rows, the matrix is stored identically to a row of S*R row vectors with C components each, according to rule (4).
-			uint32_t alignment = (info.type.rows == 3 ? 4 /* (3) */ : info.type.rows /* (2)*/) * 4 /* (1)*/;
+			const uint32_t alignment = uniform_alignment(info.type);
 			info.size = info.type.rows * 4;
 
 			if (info.type.is_matrix())
-			{
-				alignment = 16 /* (4) */;
 				info.size = info.type.rows * alignment /* (7), (8) */;
-			}
 			if (info.type.is_array())
-			{
-				alignment = 16 /* (4) */;
 				info.size = align_up(info.size, alignment) * info.type.array_length;
-			}
 
 			// Adjust offset according to alignment rules from above
 			info.offset = _module.total_uniform_size;
 			info.offset = align_up(info.offset, alignment);
 			_module.total_uniform_size = info.offset + info.size;
 
+			_ubo_declaration_offsets.push_back(_ubo_block.size());
+
 			write_location(_ubo_block, loc);
 
 			_ubo_block += '\t';
@@ -636,6 +787,13 @@ private:
 
 		return res;
 	}
+	static uint32_t uniform_alignment(const type &type)
+	{
+		if (type.is_matrix() || type.is_array())
+			return 16 /* (4) */;
+		return (type.rows == 3 ? 4 /* (3) */ : type.rows /* (2)*/) * 4 /* (1)*/;
+	}
+
 	id   define_variable(const location &loc, const type &type, std::string name, bool global, id initializer_value) override
 	{
 		const id res = make_id();
@@ -668,6 +826,9 @@ private:
 
 		code += ";\n";
 
+		if (!is_in_block())
+			add_global_definition(res);
+
 		return res;
 	}
 	id   define_function(const location &loc, function_info &info) override
@@ -718,6 +879,7 @@ private:
 
 		code += ")\n";
 
+		add_lookup_index(info.definition, _functions.size());
 		_functions.push_back(std::make_unique<function_info>(info));
 
 		return info.definition;
@@ -740,7 +902,7 @@ private:
 				return;
 		}
 
-		_module.entry_points.push_back({ func.unique_name, stype });
+		_module.entry_points.push_back({ func.unique_name, func.name, stype, std::string() });
 
 		_blocks.at(0) += "#ifdef ENTRY_POINT_" + func.unique_name + '\n';
 		if (stype == shader_type::cs)
@@ -1086,6 +1248,10 @@ private:
 		leave_function();
 
 		_blocks.at(0) += "#endif\n";
+
+		// Include the end of the preprocessor conditional in the definition of the new entry point function
+		_global_definitions.back().end = _blocks.at(0).size();
+		_entry_point_definitions.push_back(entry_point.definition);
 	}
 
 	id   emit_load(const expression &exp, bool force_new_id) override
@@ -1473,7 +1639,7 @@ private:
 
 		return res;
 	}
-	id   emit_call(const location &loc, id function, const type &res_type, const std::vector<expression> &args) override
+	id   emit_call(const location &loc, id function, const type &res_type, const expression_list &args) override
 	{
 #ifndef NDEBUG
 		for (const expression &arg : args)
@@ -1513,7 +1679,7 @@ private:
 
 		return res;
 	}
-	id   emit_call_intrinsic(const location &loc, id intrinsic, const type &res_type, const std::vector<expression> &args) override
+	id   emit_call_intrinsic(const location &loc, id intrinsic, const type &res_type, const expression_list &args) override
 	{
 #ifndef NDEBUG
 		for (const expression &arg : args)
@@ -1552,7 +1718,7 @@ private:
 
 		return res;
 	}
-	id   emit_construct(const location &loc, const type &type, const std::vector<expression> &args) override
+	id   emit_construct(const location &loc, const type &type, const expression_list &args) override
 	{
 #ifndef NDEBUG
 		for (const auto &arg : args)
@@ -1606,7 +1772,7 @@ private:
 		increase_indentation_level(true_statement_data);
 		increase_indentation_level(false_statement_data);
 
-		code += _blocks.at(condition_block);
+		append_block(code, condition_block);
 
 		write_location(code, loc);
 
@@ -1655,7 +1821,7 @@ private:
 
 		const id res = make_id();
 
-		code += _blocks.at(condition_block);
+		append_block(code, condition_block);
 
 		code += '\t';
 		write_type(code, type);
@@ -1687,11 +1853,10 @@ private:
 		std::string &loop_data = _blocks.at(loop_block);
 		std::string &continue_data = _blocks.at(continue_block);
 
-		increase_indentation_level(loop_data);
-		increase_indentation_level(loop_data);
+		increase_indentation_level(loop_data, 2);
 		increase_indentation_level(continue_data);
 
-		code += _blocks.at(prev_block);
+		append_block(code, prev_block);
 
 		std::string attributes;
 		if (flags != 0)
@@ -1792,7 +1957,7 @@ private:
 
 		std::string &code = _blocks.at(_current_block);
 
-		code += _blocks.at(selector_block);
+		append_block(code, selector_block);
 
 		write_location(code, loc);
 
@@ -1953,11 +2118,16 @@ private:
 	{
 		assert(_last_block != 0);
 
-		_blocks.at(0) += "{\n" + _blocks.at(_last_block) + "}\n";
+		std::string &code = _blocks.at(0);
+		code += "{\n";
+		code += _blocks.at(_last_block);
+		code += "}\n";
+
+		add_global_definition(_functions.back()->definition);
 	}
 };
 
-codegen *reshadefx::create_codegen_glsl(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y)
+codegen *reshadefx::create_codegen_glsl(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y, bool pack_uniforms)
 {
-	return new codegen_glsl(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y);
+	return new codegen_glsl(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y, pack_uniforms);
 }
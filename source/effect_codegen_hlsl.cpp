@@ -9,15 +9,17 @@
 #include <cstdio> // snprintf
 #include <cassert>
 #include <cstring> // stricmp
-#include <algorithm> // std::find_if, std::max
+#include <algorithm> // std::find_if, std::max, std::sort, std::unique
 
 using namespace reshadefx;
 
 class codegen_hlsl final : public codegen
 {
 public:
-	codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants)
-		: _shader_model(shader_model), _debug_info(debug_info), _uniforms_to_spec_constants(uniforms_to_spec_constants)
+	codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants, bool pack_uniforms)
+		: _shader_model(shader_model), _debug_info(debug_info), _uniforms_to_spec_constants(uniforms_to_spec_constants),
+		// Uniforms are put into separate constant registers in shader model 3, so there is nothing to pack
+		_pack_uniforms(pack_uniforms && shader_model >= 40)
 	{
 		// Create default block and reserve a memory block to avoid frequent reallocations
 		std::string &block = _blocks.emplace(0, std::string()).first->second;
@@ -38,31 +40,141 @@ private:
 	std::string _cbuffer_block;
 	std::string _current_location;
 	std::unordered_map<id, std::string> _names;
+	// Reverse lookup of all names defined above (the keys reference the strings in '_names')
+	std::unordered_multimap<std::string_view, id> _name_lookup;
 	std::unordered_map<id, std::string> _blocks;
 	bool _debug_info = false;
 	bool _uniforms_to_spec_constants = false;
+	bool _pack_uniforms = false;
 	unsigned int _shader_model = 0;
 
 	// Only write compatibility intrinsics to result if they are actually in use
 	bool _uses_bitwise_cast = false;
 
+	// Code in the global block is split into consecutive ranges, one for each global definition, which record the other definitions they reference
+	// This is used to only write out the code an entry point can actually reach, rather than the entire module, for every entry point
+	struct global_definition
+	{
+		size_t end = 0;
+		std::vector<id> references;
+		// Uniform declaration in the constant buffer (since uniforms do not have any code in the global block)
+		std::string cbuffer_declaration;
+	};
+	std::vector<global_definition> _global_definitions;
+	// Index into the definition list above plus one for every ID with a global definition (or zero if there is none)
+	std::vector<uint32_t> _global_definition_index;
+	mutable std::vector<id> _global_references;
+	std::vector<id> _entry_point_definitions;
+	// IDs of all uniforms in the constant buffer, in the same order as the uniform list in the module
+	std::vector<id> _uniform_definitions;
+
 	void write_result(module &module) override
 	{
+		if (_pack_uniforms)
+		{
+			const std::vector<size_t> order = pack_uniforms([](const uniform_info &info, uint32_t end) { return next_uniform_offset(end, info); });
+
+			// Rebuild the constant buffer with the uniforms in their new order and add the final offsets to the declarations for the individual entry points
+			_cbuffer_block.clear();
+			for (const size_t index : order)
+			{
+				std::string &declaration = _global_definitions[_global_definition_index[_uniform_definitions[index]] - 1].cbuffer_declaration;
+				_cbuffer_block += declaration;
+				add_packoffset(declaration, _module.uniforms[index].offset);
+			}
+		}
+
 		module = std::move(_module);
 
+		write_preamble(module.hlsl, _cbuffer_block);
+
+		const size_t preamble_size = module.hlsl.size();
+
+		module.hlsl += _blocks.at(0);
+
+		// Line directives to insert wherever the code written for an entry point skips part of the module, so that compiler messages refer to the same lines as in the complete module
+		std::vector<size_t> definition_offsets(1, preamble_size);
+		for (const global_definition &definition : _global_definitions)
+			definition_offsets.push_back(preamble_size + definition.end);
+		const std::vector<std::string> line_directives = make_line_directives(module.hlsl, definition_offsets);
+
+		if (_shader_model < 40)
+			// Offsets were multiplied in 'define_uniform', so adjust total size here accordingly
+			module.total_uniform_size *= 4;
+
+		assert(_entry_point_definitions.size() == module.entry_points.size());
+
+		for (size_t i = 0; i < module.entry_points.size(); ++i)
+		{
+			// Entry point function may be incomplete if there were errors during parsing, so skip pruning in that case
+			if (const id root = _entry_point_definitions[i];
+				root >= _global_definition_index.size() || _global_definition_index[root] == 0)
+				continue;
+
+			std::vector<bool> reachable(_global_definitions.size());
+			std::vector<id> pending(1, _entry_point_definitions[i]);
+			while (!pending.empty())
+			{
+				const id definition = pending.back();
+				pending.pop_back();
+
+				if (const uint32_t index = _global_definition_index[definition] - 1; !reachable[index])
+				{
+					reachable[index] = true;
+					pending.insert(pending.end(), _global_definitions[index].references.begin(), _global_definitions[index].references.end());
+				}
+			}
+
+			std::string cbuffer_block;
+			for (size_t k = 0; k < _global_definitions.size(); ++k)
+				if (reachable[k])
+					cbuffer_block += _global_definitions[k].cbuffer_declaration;
+
+			std::string &code = module.entry_points[i].code;
+			write_preamble(code, cbuffer_block);
+
+			// Keep definitions in their original order, so that they are still declared before they are used
+			// The constant buffer above differs from the one in the module, so the line numbering needs to be continued right from the start
+			size_t begin = 0;
+			bool continuous = false;
+			for (size_t k = 0; k < _global_definitions.size(); begin = _global_definitions[k++].end)
+			{
+				if (_global_definitions[k].end == begin)
+					continue;
+
+				if (reachable[k])
+				{
+					if (!continuous)
+						code += line_directives[k];
+					code.append(_blocks.at(0), begin, _global_definitions[k].end - begin);
+				}
+
+				continuous = reachable[k];
+			}
+			if (begin < _blocks.at(0).size())
+			{
+				if (!continuous)
+					code += line_directives.back();
+				code.append(_blocks.at(0), begin, std::string::npos);
+			}
+		}
+	}
+
+	void write_preamble(std::string &s, const std::string &cbuffer_block) const
+	{
 		if (_shader_model >= 40)
 		{
-			module.hlsl += "struct __sampler2D { Texture2D t; SamplerState s; };\n";
+			s += "struct __sampler2D { Texture2D t; SamplerState s; };\n";
 
-			if (!_cbuffer_block.empty())
-				module.hlsl += "cbuffer _Globals {\n" + _cbuffer_block + "};\n";
+			if (!cbuffer_block.empty())
+				s += "cbuffer _Globals {\n" + cbuffer_block + "};\n";
 		}
 		else
 		{
-			module.hlsl += "struct __sampler2D { sampler2D s; float2 pixelsize; };\nuniform float2 __TEXEL_SIZE__ : register(c255);\n";
+			s += "struct __sampler2D { sampler2D s; float2 pixelsize; };\nuniform float2 __TEXEL_SIZE__ : register(c255);\n";
 
 			if (_uses_bitwise_cast)
-				module.hlsl +=
+				s +=
 					"int __asint(float v) {"
 					"	if (v == 0) return 0;" // Zero (does not handle negative zero)
 					//	if (isinf(v)) return v < 0 ? 4286578688 : 2139095040; // Infinity
@@ -94,14 +206,8 @@ private:
 					"float3 __asfloat(int3 v) { return float3(__asfloat(v.x), __asfloat(v.y), __asfloat(v.z)); }\n"
 					"float4 __asfloat(int4 v) { return float4(__asfloat(v.x), __asfloat(v.y), __asfloat(v.z), __asfloat(v.w)); }\n";
 
-			if (!_cbuffer_block.empty())
-				module.hlsl += _cbuffer_block;
-
-			// Offsets were multiplied in 'define_uniform', so adjust total size here accordingly
-			module.total_uniform_size *= 4;
+			s += cbuffer_block;
 		}
-
-		module.hlsl += _blocks.at(0);
 	}
 
 	template <bool is_param = false, bool is_decl = true>
@@ -272,11 +378,15 @@ private:
 		// Avoid writing the file name every time to reduce output text size
 		if constexpr (force_source)
 		{
-			s += " \"" + loc.source + '\"';
+			s += " \"";
+			s += loc.source;
+			s += '\"';
 		}
 		else if (loc.source != _current_location)
 		{
-			s += " \"" + loc.source + '\"';
+			s += " \"";
+			s += loc.source;
+			s += '\"';
 
 			_current_location = loc.source;
 		}
@@ -294,6 +404,9 @@ private:
 	std::string id_to_name(id id) const
 	{
 		assert(id != 0);
+		// Keep track of all references to global definitions, so they can be associated with the definition currently being written
+		if (id < _global_definition_index.size() && _global_definition_index[id] != 0)
+			_global_references.push_back(id);
 		if (const auto names_it = _names.find(id);
 			names_it != _names.end())
 			return names_it->second;
@@ -309,9 +422,19 @@ private:
 				return; // Filter out names that may clash with automatic ones
 		name = escape_name(std::move(name));
 		if constexpr (naming_type == naming::general)
-			if (std::find_if(_names.begin(), _names.end(), [&name](const auto &it) { return it.second == name; }) != _names.end())
+			if (_name_lookup.find(name) != _name_lookup.end())
 				name += '_' + std::to_string(id); // Append a numbered suffix if the name already exists
-		_names[id] = std::move(name);
+
+		std::string &entry = _names[id];
+		if (!entry.empty())
+		{
+			// Remove the lookup entry referencing the previous name of this ID before it is overwritten
+			const auto [begin, end] = _name_lookup.equal_range(entry);
+			_name_lookup.erase(std::find_if(begin, end, [id](const auto &it) { return it.second == id; }));
+		}
+
+		entry = std::move(name);
+		_name_lookup.emplace(entry, id);
 	}
 
 	std::string convert_semantic(const std::string &semantic) const
@@ -360,15 +483,64 @@ private:
 		return name;
 	}
 
-	static void increase_indentation_level(std::string &block)
+	static void increase_indentation_level(std::string &block, unsigned int levels = 1)
 	{
 		if (block.empty())
 			return;
 
-		for (size_t pos = 0; (pos = block.find("\n\t", pos)) != std::string::npos; pos += 3)
-			block.replace(pos, 2, "\n\t\t");
+		// Rebuild the block in a single pass, rather than inserting into it for every line
+		std::string result;
+		result.reserve(block.size() + block.size() / 8 * levels);
+		result.append(levels, '\t');
+
+		size_t pos = 0;
+		for (size_t next; (next = block.find("\n\t", pos)) != std::string::npos; pos = next + 1)
+		{
+			result.append(block, pos, next + 1 - pos);
+			result.append(levels, '\t');
+		}
+		result.append(block, pos, std::string::npos);
 
-		block.insert(block.begin(), '\t');
+		block = std::move(result);
+	}
+
+	global_definition &add_global_definition(id id, bool in_global_block = true)
+	{
+		const size_t begin = _global_definitions.empty() ? 0 : _global_definitions.back().end;
+
+		global_definition &definition = _global_definitions.emplace_back();
+
+		if (in_global_block)
+		{
+			// The definition covers all code written to the global block since the previous one (which includes any temporaries used by its initializer)
+			definition.end = _blocks.at(0).size();
+
+			std::sort(_global_references.begin(), _global_references.end());
+			_global_references.erase(std::unique(_global_references.begin(), _global_references.end()), _global_references.end());
+			definition.references = std::move(_global_references);
+			_global_references.clear();
+		}
+		else
+		{
+			definition.end = begin;
+		}
+
+		if (id >= _global_definition_index.size())
+			_global_definition_index.resize(id + 1);
+		_global_definition_index[id] = static_cast<uint32_t>(_global_definitions.size());
+
+		return definition;
+	}
+
+	void append_block(std::string &code, id block)
+	{
+		std::string &block_data = _blocks.at(block);
+
+		// Avoid copying the block if nothing was written to the current one yet (which is usually the case for merge blocks)
+		if (code.empty())
+			code.swap(block_data);
+		else
+			code += block_data;
 	}
 
 	id   define_struct(const location &loc, struct_info &info) override
@@ -376,6 +548,7 @@ private:
 		info.definition = make_id();
 		define_name<naming::unique>(info.definition, info.unique_name);
 
+		add_lookup_index(info.definition, _structs.size());
 		_structs.push_back(info);
 
 		std::string &code = _blocks.at(_current_block);
@@ -398,6 +571,9 @@ private:
 
 		code += "};\n";
 
+		if (!is_in_block())
+			add_global_definition(info.definition);
+
 		return info.definition;
 	}
 	id   define_texture(const location &loc, texture_info &info) override
@@ -418,8 +594,11 @@ private:
 
 			code += "Texture2D __"     + info.unique_name + " : register(t" + std::to_string(info.binding + 0) + ");\n";
 			code += "Texture2D __srgb" + info.unique_name + " : register(t" + std::to_string(info.binding + 1) + ");\n";
+
+			add_global_definition(info.id);
 		}
 
+		add_lookup_index(info.id, _module.textures.size());
 		_module.textures.push_back(info);
 
 		return info.id;
@@ -449,6 +628,9 @@ private:
 			if (existing_sampler != _module.samplers.end())
 			{
 				info.binding = existing_sampler->binding;
+
+				// The sampler state object was declared along with that other sampler
+				_global_references.push_back(existing_sampler->id);
 			}
 			else
 			{
@@ -463,6 +645,9 @@ private:
 			write_location(code, loc);
 
 			code += "static const __sampler2D " + id_to_name(info.id) + " = { " + (info.srgb ? "__srgb" : "__") + info.texture_name + ", __s" + std::to_string(info.binding) + " };\n";
+
+			// Texture is referenced by name above, so add the reference explicitly
+			_global_references.push_back(texture->id);
 		}
 		else
 		{
@@ -483,6 +668,9 @@ private:
 			code += ") }; \n";
 		}
 
+		add_global_definition(info.id);
+
+		add_lookup_index(info.id, _module.samplers.size());
 		_module.samplers.push_back(info);
 
 		return info.id;
@@ -530,8 +718,11 @@ private:
 			}
 
 			code += "> " + info.unique_name + " : register(u" + std::to_string(info.binding) + ");\n";
+
+			add_global_definition(info.id);
 		}
 
+		add_lookup_index(info.id, _module.storages.size());
 		_module.storages.push_back(info);
 
 		return info.id;
@@ -561,6 +752,8 @@ private:
 				write_type<false, false>(code, info.type);
 			code += "(SPEC_CONSTANT_" + info.name + ");\n";
 
+			add_global_definition(res);
+
 			_module.spec_constants.push_back(info);
 		}
 		else
@@ -573,15 +766,11 @@ private:
 			if (info.type.is_array())
 				info.size = align_up(info.size, 16, info.type.array_length);
 
-			// Data is packed into 4-byte boundaries (see https://docs.microsoft.com/windows/win32/direct3dhlsl/dx-graphics-hlsl-packing-rules)
-			// This is already guaranteed, since all types are at least 4-byte in size
-			info.offset = _module.total_uniform_size;
-			// Additionally, HLSL packs data so that it does not cross a 16-byte boundary
-			const uint32_t remaining = 16 - (info.offset & 15);
-			if (remaining != 16 && info.size > remaining)
-				info.offset += remaining;
+			info.offset = next_uniform_offset(_module.total_uniform_size, info);
 			_module.total_uniform_size = info.offset + info.size;
 
+			const size_t declaration_offset = _cbuffer_block.size();
+
 			write_location<true>(_cbuffer_block, loc);
 
 			if (_shader_model >= 40)
@@ -615,11 +804,39 @@ private:
 
 			_cbuffer_block += ";\n";
 
+			std::string &declaration = add_global_definition(res, false).cbuffer_declaration;
+			declaration.assign(_cbuffer_block, declaration_offset, std::string::npos);
+
+			// Uniforms may be left out of the constant buffer for individual entry points, so need explicit offsets to keep the layout intact
+			// The offset is not final yet if the layout is packed later, in which case this is done when writing the result
+			if (_shader_model >= 40 && !_pack_uniforms)
+				add_packoffset(declaration, info.offset);
+
+			_uniform_definitions.push_back(res);
 			_module.uniforms.push_back(info);
 		}
 
 		return res;
 	}
+	static uint32_t next_uniform_offset(uint32_t offset, const uniform_info &info)
+	{
+		// Arrays and matrices always start on a new constant register
+		if (info.type.is_array() || info.type.is_matrix())
+			return align_up(offset, 16);
+
+		// Data is packed into 4-byte boundaries (see https://docs.microsoft.com/windows/win32/direct3dhlsl/dx-graphics-hlsl-packing-rules)
+		// This is already guaranteed, since all types are at least 4-byte in size
+		// Additionally, HLSL packs data so that it does not cross a 16-byte boundary
+		const uint32_t remaining = 16 - (offset & 15);
+		if (remaining != 16 && info.size > remaining)
+			offset += remaining;
+		return offset;
+	}
+	static void add_packoffset(std::string &declaration, uint32_t offset)
+	{
+		declaration.insert(declaration.size() - 2, " : packoffset(c" + std::to_string(offset / 16) + '.' + "xyzw"[(offset % 16) / 4] + ')');
+	}
+
 	id   define_variable(const location &loc, const type &type, std::string name, bool global, id initializer_value) override
 	{
 		const id res = make_id();
@@ -648,6 +865,9 @@ private:
 
 		code += ";\n";
 
+		if (!is_in_block())
+			add_global_definition(res);
+
 		return res;
 	}
 	id   define_function(const location &loc, function_info &info) override
@@ -693,6 +913,7 @@ private:
 
 		code += '\n';
 
+		add_lookup_index(info.definition, _functions.size());
 		_functions.push_back(std::make_unique<function_info>(info));
 
 		return info.definition;
@@ -717,7 +938,8 @@ private:
 				return;
 		}
 
-		_module.entry_points.push_back({ func.unique_name, stype });
+		_module.entry_points.push_back({ func.unique_name, func.name, stype, std::string() });
+		_entry_point_definitions.push_back(func.definition);
 
 		// Only have to rewrite the entry point function signature in shader model 3 and for compute (to write "numthreads" attribute)
 		if (_shader_model >= 40 && stype != shader_type::cs)
@@ -844,6 +1066,9 @@ private:
 
 		leave_block_and_return(func.return_type.is_void() ? 0 : ret);
 		leave_function();
+
+		// The new function is what is actually compiled for this entry point
+		_entry_point_definitions.back() = entry_point.definition;
 	}
 
 	id   emit_load(const expression &exp, bool force_new_id) override
@@ -1140,7 +1365,7 @@ private:
 
 		return res;
 	}
-	id   emit_call(const location &loc, id function, const type &res_type, const std::vector<expression> &args) override
+	id   emit_call(const location &loc, id function, const type &res_type, const expression_list &args) override
 	{
 #ifndef NDEBUG
 		for (const expression &arg : args)
@@ -1180,7 +1405,7 @@ private:
 
 		return res;
 	}
-	id   emit_call_intrinsic(const location &loc, id intrinsic, const type &res_type, const std::vector<expression> &args) override
+	id   emit_call_intrinsic(const location &loc, id intrinsic, const type &res_type, const expression_list &args) override
 	{
 #ifndef NDEBUG
 		for (const expression &arg : args)
@@ -1236,7 +1461,7 @@ private:
 
 		return res;
 	}
-	id   emit_construct(const location &loc, const type &type, const std::vector<expression> &args) override
+	id   emit_construct(const location &loc, const type &type, const expression_list &args) override
 	{
 #ifndef NDEBUG
 		for (const auto &arg : args)
@@ -1293,7 +1518,7 @@ private:
 		increase_indentation_level(true_statement_data);
 		increase_indentation_level(false_statement_data);
 
-		code += _blocks.at(condition_block);
+		append_block(code, condition_block);
 
 		write_location(code, loc);
 
@@ -1332,7 +1557,7 @@ private:
 
 		const id res = make_id();
 
-		code += _blocks.at(condition_block);
+		append_block(code, condition_block);
 
 		code += '\t';
 		write_type(code, type);
@@ -1364,11 +1589,10 @@ private:
 		std::string &loop_data = _blocks.at(loop_block);
 		std::string &continue_data = _blocks.at(continue_block);
 
-		increase_indentation_level(loop_data);
-		increase_indentation_level(loop_data);
+		increase_indentation_level(loop_data, 2);
 		increase_indentation_level(continue_data);
 
-		code += _blocks.at(prev_block);
+		append_block(code, prev_block);
 
 		std::string attributes;
 		if (flags & 0x1)
@@ -1475,7 +1699,7 @@ private:
 
 		std::string &code = _blocks.at(_current_block);
 
-		code += _blocks.at(selector_block);
+		append_block(code, selector_block);
 
 		if (_shader_model >= 40)
 		{
@@ -1698,11 +1922,16 @@ private:
 	{
 		assert(_last_block != 0);
 
-		_blocks.at(0) += "{\n" + _blocks.at(_last_block) + "}\n";
+		std::string &code = _blocks.at(0);
+		code += "{\n";
+		code += _blocks.at(_last_block);
+		code += "}\n";
+
+		add_global_definition(_functions.back()->definition);
 	}
 };
 
-codegen *reshadefx::create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants)
+codegen *reshadefx::create_codegen_hlsl(unsigned int shader_model, bool debug_info, bool uniforms_to_spec_constants, bool pack_uniforms)
 {
-	return new codegen_hlsl(shader_model, debug_info, uniforms_to_spec_constants);
+	return new codegen_hlsl(shader_model, debug_info, uniforms_to_spec_constants, pack_uniforms);
 }
@@ -0,0 +1,924 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "effect_codegen.hpp"
+#include <cstring> // std::memcpy
+#include <unordered_map>
+
+using namespace reshadefx;
+
+/// <summary>
+/// A code generation back-end which does not generate any code, but instead records all calls the parser makes into it.
+/// The recording is a flat stream of 32-bit words (similar to SPIR-V), with larger objects (definitions, constants, names) kept in side tables it indexes into.
+/// </summary>
+class codegen_ir final : public codegen
+{
+	enum class op : uint32_t
+	{
+		define_struct,
+		define_texture,
+		define_sampler,
+		define_storage,
+		define_uniform,
+		define_variable,
+		define_function,
+		define_entry_point,
+		emit_load,
+		emit_store,
+		emit_access_chain,
+		emit_constant,
+		emit_unary_op,
+		emit_binary_op,
+		emit_ternary_op,
+		emit_call,
+		emit_call_intrinsic,
+		emit_construct,
+		emit_if,
+		emit_phi,
+		emit_loop,
+		emit_switch,
+		create_block,
+		set_block,
+		enter_block,
+		leave_block_and_kill,
+		leave_block_and_return,
+		leave_block_and_switch,
+		leave_block_and_branch,
+		leave_block_and_branch_conditional,
+		leave_function,
+	};
+
+	/// <summary>
+	/// State of a single replay of the recording into a target back-end.
+	/// </summary>
+	struct replayer
+	{
+		const codegen_ir &ir;
+		codegen &target;
+		const uint32_t *it;
+		// Translation table from IDs in the recording to the IDs the target back-end returned for the same definitions
+		std::vector<id> remap;
+		std::unordered_map<std::string, std::string> entry_point_names;
+
+		uint32_t read() { return *it++; }
+		id   read_id() { return remap[*it++]; }
+		void read_result(id value) { remap[*it++] = value; }
+		const location &read_location() { return ir._locations[*it++]; }
+
+		void read_type(type &type)
+		{
+			type.base = static_cast<type::datatype>(it[0]);
+			type.rows = it[1];
+			type.cols = it[2];
+			type.qualifiers = it[3];
+			type.array_length = static_cast<int>(it[4]);
+			type.definition = type.base == type::t_struct ? remap[it[5]] : it[5];
+			it += 6;
+		}
+		void remap_type(type &type) const
+		{
+			if (type.is_struct())
+				type.definition = remap[type.definition];
+		}
+
+		void read_expression(expression &exp)
+		{
+			exp.base = read_id();
+			read_type(exp.type);
+			const uint32_t flags = read();
+			exp.is_lvalue = (flags & 1) != 0;
+			exp.is_constant = (flags & 2) != 0;
+			exp.location = read_location();
+			if (exp.is_constant)
+				exp.constant = ir._constants[read()];
+
+			exp.chain.resize(read());
+			for (expression::operation &op : exp.chain)
+			{
+				op.op = static_cast<expression::operation::op_type>(read());
+				read_type(op.from);
+				read_type(op.to);
+				op.index = op.op == expression::operation::op_dynamic_index ? read_id() : read();
+				std::memcpy(op.swizzle, it++, sizeof(op.swizzle));
+			}
+		}
+		void read_expression_list(expression_list &list)
+		{
+			list.resize(read());
+			for (expression &exp : list)
+				read_expression(exp);
+		}
+
+		void run();
+	};
+
+public:
+	void write_result(module &module) override
+	{
+		// There is no generated code, so only the reflection data is available
+		module = _module;
+	}
+
+	void replay(codegen &target) const
+	{
+		replayer r = { *this, target, _code.data(), std::vector<id>(_next_id), {} };
+		r.run();
+	}
+
+private:
+	id   define_struct(const location &loc, struct_info &info) override
+	{
+		info.definition = make_id();
+
+		add_op(op::define_struct, info.definition, loc);
+		add(static_cast<uint32_t>(_structs.size()));
+
+		add_lookup_index(info.definition, _structs.size());
+		_structs.push_back(info);
+
+		return info.definition;
+	}
+	id   define_texture(const location &loc, texture_info &info) override
+	{
+		info.id = make_id();
+
+		add_op(op::define_texture, info.id, loc);
+		add(static_cast<uint32_t>(_module.textures.size()));
+		// The parser changes these after the definition, so save the values at this point separately
+		add(static_cast<uint32_t>(info.render_target) | (static_cast<uint32_t>(info.storage_access) << 1));
+
+		add_lookup_index(info.id, _module.textures.size());
+		_module.textures.push_back(info);
+
+		return info.id;
+	}
+	id   define_sampler(const location &loc, sampler_info &info) override
+	{
+		info.id = make_id();
+
+		add_op(op::define_sampler, info.id, loc);
+		add(static_cast<uint32_t>(_module.samplers.size()));
+
+		add_lookup_index(info.id, _module.samplers.size());
+		_module.samplers.push_back(info);
+
+		return info.id;
+	}
+	id   define_storage(const location &loc, storage_info &info) override
+	{
+		info.id = make_id();
+
+		add_op(op::define_storage, info.id, loc);
+		add(static_cast<uint32_t>(_module.storages.size()));
+
+		add_lookup_index(info.id, _module.storages.size());
+		_module.storages.push_back(info);
+
+		return info.id;
+	}
+	id   define_uniform(const location &loc, uniform_info &info) override
+	{
+		const id res = make_id();
+
+		add_op(op::define_uniform, res, loc);
+		add(static_cast<uint32_t>(_module.uniforms.size()));
+
+		_module.uniforms.push_back(info);
+
+		return res;
+	}
+	id   define_variable(const location &loc, const type &type, std::string name, bool global, id initializer_value) override
+	{
+		const id res = make_id();
+
+		add_op(op::define_variable, res, loc);
+		add(type);
+		add(name.empty() ? ~0u : add_string(std::move(name)));
+		add(global);
+		add(initializer_value);
+
+		return res;
+	}
+	id   define_function(const location &loc, function_info &info) override
+	{
+		info.definition = make_id();
+		for (struct_member_info &param : info.parameter_list)
+			param.definition = make_id();
+
+		add_op(op::define_function, info.definition, loc);
+		add(static_cast<uint32_t>(_functions.size()));
+
+		add_lookup_index(info.definition, _functions.size());
+		_functions.push_back(std::make_unique<function_info>(info));
+
+		_in_function = true;
+
+		return info.definition;
+	}
+
+	void define_entry_point(function_info &func, shader_type stype, int num_threads[3]) override
+	{
+		// Give each entry point a name that is unique for the combination of function and thread group size, like the other back-ends do
+		if (stype == shader_type::cs)
+			func.unique_name = 'E' + func.unique_name +
+				'_' + std::to_string(num_threads[0]) +
+				'_' + std::to_string(num_threads[1]) +
+				'_' + std::to_string(num_threads[2]);
+
+		add_op(op::define_entry_point);
+		add(func.definition);
+		add(static_cast<uint32_t>(stype));
+		for (int i = 0; i < 3; ++i)
+			add(stype == shader_type::cs ? static_cast<uint32_t>(num_threads[i]) : 0);
+		add(add_string(func.unique_name));
+	}
+
+	id   emit_load(const expression &exp, bool force_new_id) override
+	{
+		// Can refer to r-values without access chain directly, all back-ends do the same without generating any code
+		if (!exp.is_constant && !exp.is_lvalue && exp.chain.empty() && !force_new_id)
+			return exp.base;
+
+		const id res = make_id();
+
+		add_op(op::emit_load, res);
+		add(force_new_id);
+		add(exp);
+
+		return res;
+	}
+	void emit_store(const expression &exp, id value) override
+	{
+		add_op(op::emit_store);
+		add(value);
+		add(exp);
+	}
+	id   emit_access_chain(const expression &exp, size_t &chain_index) override
+	{
+		const id res = make_id();
+
+		add_op(op::emit_access_chain, res);
+		add(exp);
+
+		chain_index = exp.chain.size();
+
+		return res;
+	}
+
+	id   emit_constant(const type &type, const constant &data) override
+	{
+		const id res = make_id();
+
+		add_op(op::emit_constant, res);
+		add(type);
+		add(static_cast<uint32_t>(_constants.size()));
+
+		_constants.push_back(data);
+
+		return res;
+	}
+
+	id   emit_unary_op(const location &loc, tokenid op, const type &type, id val) override
+	{
+		const id res = make_id();
+
+		add_op(op::emit_unary_op, res, loc);
+		add(static_cast<uint32_t>(op));
+		add(type);
+		add(val);
+
+		return res;
+	}
+	id   emit_binary_op(const location &loc, tokenid op, const type &res_type, const type &type, id lhs, id rhs) override
+	{
+		const id res = make_id();
+
+		add_op(op::emit_binary_op, res, loc);
+		add(static_cast<uint32_t>(op));
+		add(res_type);
+		add(type);
+		add(lhs);
+		add(rhs);
+
+		return res;
+	}
+	id   emit_ternary_op(const location &loc, tokenid op, const type &type, id condition, id true_value, id false_value) override
+	{
+		const id res = make_id();
+
+		add_op(op::emit_ternary_op, res, loc);
+		add(static_cast<uint32_t>(op));
+		add(type);
+		add(condition);
+		add(true_value);
+		add(false_value);
+
+		return res;
+	}
+	id   emit_call(const location &loc, id function, const type &res_type, const expression_list &args) override
+	{
+		const id res = make_id();
+
+		add_op(op::emit_call, res, loc);
+		add(function);
+		add(res_type);
+		add(args);
+
+		return res;
+	}
+	id   emit_call_intrinsic(const location &loc, id intrinsic, const type &res_type, const expression_list &args) override
+	{
+		const id res = make_id();
+
+		add_op(op::emit_call_intrinsic, res, loc);
+		add(intrinsic);
+		add(res_type);
+		add(args);
+
+		return res;
+	}
+	id   emit_construct(const location &loc, const type &type, const expression_list &args) override
+	{
+		const id res = make_id();
+
+		add_op(op::emit_construct, res, loc);
+		add(type);
+		add(args);
+
+		return res;
+	}
+
+	void emit_if(const location &loc, id condition_value, id condition_block, id true_statement_block, id false_statement_block, unsigned int flags) override
+	{
+		add_op(op::emit_if);
+		add(add_location(loc));
+		add(condition_value);
+		add(condition_block);
+		add(true_statement_block);
+		add(false_statement_block);
+		add(flags);
+	}
+	id   emit_phi(const location &loc, id condition_value, id condition_block, id true_value, id true_statement_block, id false_value, id false_statement_block, const type &type) override
+	{
+		const id res = make_id();
+
+		add_op(op::emit_phi, res, loc);
+		add(condition_value);
+		add(condition_block);
+		add(true_value);
+		add(true_statement_block);
+		add(false_value);
+		add(false_statement_block);
+		add(type);
+
+		return res;
+	}
+	void emit_loop(const location &loc, id condition_value, id prev_block, id header_block, id condition_block, id loop_block, id continue_block, unsigned int flags) override
+	{
+		add_op(op::emit_loop);
+		add(add_location(loc));
+		add(condition_value);
+		add(prev_block);
+		add(header_block);
+		add(condition_block);
+		add(loop_block);
+		add(continue_block);
+		add(flags);
+	}
+	void emit_switch(const location &loc, id selector_value, id selector_block, id default_label, id default_block, const std::vector<id> &case_literal_and_labels, const std::vector<id> &case_blocks, unsigned int flags) override
+	{
+		add_op(op::emit_switch);
+		add(add_location(loc));
+		add(selector_value);
+		add(selector_block);
+		add(default_label);
+		add(default_block);
+		add(static_cast<uint32_t>(case_literal_and_labels.size()));
+		_code.insert(_code.end(), case_literal_and_labels.begin(), case_literal_and_labels.end());
+		add(static_cast<uint32_t>(case_blocks.size()));
+		_code.insert(_code.end(), case_blocks.begin(), case_blocks.end());
+		add(flags);
+	}
+
+	bool is_in_function() const override { return _in_function; }
+
+	id   create_block() override
+	{
+		const id res = make_id();
+
+		add_op(op::create_block, res);
+
+		return res;
+	}
+	id   set_block(id id) override
+	{
+		add_op(op::set_block);
+		add(id);
+
+		_last_block = _current_block;
+		_current_block = id;
+
+		return _last_block;
+	}
+	void enter_block(id id) override
+	{
+		add_op(op::enter_block);
+		add(id);
+
+		_current_block = id;
+	}
+	id   leave_block_and_kill() override
+	{
+		add_op(op::leave_block_and_kill);
+
+		if (!is_in_block())
+			return 0;
+
+		return set_block_silent(0);
+	}
+	id   leave_block_and_return(id value) override
+	{
+		add_op(op::leave_block_and_return);
+		add(value);
+
+		if (!is_in_block())
+			return 0;
+
+		return set_block_silent(0);
+	}
+	id   leave_block_and_switch(id value, id default_target) override
+	{
+		add_op(op::leave_block_and_switch);
+		add(value);
+		add(default_target);
+
+		if (!is_in_block())
+			return _last_block;
+
+		return set_block_silent(0);
+	}
+	id   leave_block_and_branch(id target, unsigned int loop_flow) override
+	{
+		add_op(op::leave_block_and_branch);
+		add(target);
+		add(loop_flow);
+
+		if (!is_in_block())
+			return _last_block;
+
+		return set_block_silent(0);
+	}
+	id   leave_block_and_branch_conditional(id condition, id true_target, id false_target) override
+	{
+		add_op(op::leave_block_and_branch_conditional);
+		add(condition);
+		add(true_target);
+		add(false_target);
+
+		if (!is_in_block())
+			return _last_block;
+
+		return set_block_silent(0);
+	}
+	void leave_function() override
+	{
+		add_op(op::leave_function);
+
+		_in_function = false;
+	}
+
+	id   set_block_silent(id id)
+	{
+		_last_block = _current_block;
+		_current_block = id;
+
+		return _last_block;
+	}
+
+	void add(uint32_t value)
+	{
+		_code.push_back(value);
+	}
+	void add(const type &type)
+	{
+		_code.insert(_code.end(), {
+			static_cast<uint32_t>(type.base),
+			type.rows,
+			type.cols,
+			type.qualifiers,
+			static_cast<uint32_t>(type.array_length),
+			type.definition });
+	}
+	void add(const expression &exp)
+	{
+		add(exp.base);
+		add(exp.type);
+		add(static_cast<uint32_t>(exp.is_lvalue) | (static_cast<uint32_t>(exp.is_constant) << 1));
+		add(add_location(exp.location));
+		if (exp.is_constant)
+		{
+			add(static_cast<uint32_t>(_constants.size()));
+			_constants.push_back(exp.constant);
+		}
+
+		add(static_cast<uint32_t>(exp.chain.size()));
+		for (const expression::operation &op : exp.chain)
+		{
+			add(static_cast<uint32_t>(op.op));
+			add(op.from);
+			add(op.to);
+			add(op.index);
+			uint32_t swizzle;
+			std::memcpy(&swizzle, op.swizzle, sizeof(swizzle));
+			add(swizzle);
+		}
+	}
+	void add(const expression_list &list)
+	{
+		add(static_cast<uint32_t>(list.size()));
+		for (const expression &exp : list)
+			add(exp);
+	}
+	void add_op(op op)
+	{
+		add(static_cast<uint32_t>(op));
+	}
+	void add_op(op op, id result)
+	{
+		add(static_cast<uint32_t>(op));
+		add(result);
+	}
+	void add_op(op op, id result, const location &loc)
+	{
+		add_op(op, result);
+		add(add_location(loc));
+	}
+
+	uint32_t add_location(const location &loc)
+	{
+		// Consecutive operations often share the same location, so only add a new entry when it changed
+		if (_locations.empty() ||
+			_locations.back().line != loc.line ||
+			_locations.back().column != loc.column ||
+			_locations.back().source != loc.source)
+			_locations.push_back(loc);
+
+		return static_cast<uint32_t>(_locations.size() - 1);
+	}
+	uint32_t add_string(std::string str)
+	{
+		_strings.push_back(std::move(str));
+
+		return static_cast<uint32_t>(_strings.size() - 1);
+	}
+
+	std::vector<uint32_t> _code;
+	std::vector<location> _locations;
+	std::vector<constant> _constants;
+	std::vector<std::string> _strings;
+	bool _in_function = false;
+};
+
+void codegen_ir::replayer::run()
+{
+	for (const uint32_t *const end = ir._code.data() + ir._code.size(); it < end;)
+	{
+		switch (static_cast<op>(read()))
+		{
+		case op::define_struct:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			struct_info info = ir._structs[read()];
+			info.definition = 0;
+			for (struct_member_info &member : info.member_list)
+				remap_type(member.type);
+			remap[res] = target.define_struct(loc, info);
+			break;
+		}
+		case op::define_texture:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			texture_info info = ir._module.textures[read()];
+			const uint32_t flags = read();
+			info.id = 0;
+			info.render_target = (flags & 1) != 0;
+			info.storage_access = (flags & 2) != 0;
+			remap[res] = target.define_texture(loc, info);
+			break;
+		}
+		case op::define_sampler:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			sampler_info info = ir._module.samplers[read()];
+			info.id = 0;
+			remap[res] = target.define_sampler(loc, info);
+			break;
+		}
+		case op::define_storage:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			storage_info info = ir._module.storages[read()];
+			info.id = 0;
+			remap[res] = target.define_storage(loc, info);
+			break;
+		}
+		case op::define_uniform:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			uniform_info info = ir._module.uniforms[read()];
+			remap[res] = target.define_uniform(loc, info);
+			break;
+		}
+		case op::define_variable:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			type type;
+			read_type(type);
+			const uint32_t name = read();
+			const bool global = read() != 0;
+			const id initializer_value = read_id();
+			remap[res] = target.define_variable(loc, type, name != ~0u ? ir._strings[name] : std::string(), global, initializer_value);
+			break;
+		}
+		case op::define_function:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			const function_info &recorded_info = *ir._functions[read()];
+			function_info info = recorded_info;
+			info.definition = 0;
+			info.referenced_samplers.clear();
+			info.referenced_storages.clear();
+			remap_type(info.return_type);
+			for (struct_member_info &param : info.parameter_list)
+				param.definition = 0,
+				remap_type(param.type);
+			remap[res] = target.define_function(loc, info);
+			for (size_t i = 0; i < info.parameter_list.size(); ++i)
+				remap[recorded_info.parameter_list[i].definition] = info.parameter_list[i].definition;
+			break;
+		}
+		case op::define_entry_point:
+		{
+			function_info info = target.find_function(read_id());
+			const auto stype = static_cast<shader_type>(read());
+			int num_threads[3];
+			for (int i = 0; i < 3; ++i)
+				num_threads[i] = static_cast<int>(read());
+			target.define_entry_point(info, stype, stype == shader_type::cs ? num_threads : nullptr);
+			entry_point_names[ir._strings[read()]] = info.unique_name;
+			break;
+		}
+		case op::emit_load:
+		{
+			const uint32_t res = read();
+			const bool force_new_id = read() != 0;
+			expression exp;
+			read_expression(exp);
+			remap[res] = target.emit_load(exp, force_new_id);
+			break;
+		}
+		case op::emit_store:
+		{
+			const id value = read_id();
+			expression exp;
+			read_expression(exp);
+			target.emit_store(exp, value);
+			break;
+		}
+		case op::emit_access_chain:
+		{
+			const uint32_t res = read();
+			expression exp;
+			read_expression(exp);
+			size_t chain_index = 0;
+			remap[res] = target.emit_access_chain(exp, chain_index);
+			assert(chain_index == exp.chain.size());
+			break;
+		}
+		case op::emit_constant:
+		{
+			const uint32_t res = read();
+			type type;
+			read_type(type);
+			remap[res] = target.emit_constant(type, ir._constants[read()]);
+			break;
+		}
+		case op::emit_unary_op:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			const auto op = static_cast<tokenid>(read());
+			type type;
+			read_type(type);
+			const id val = read_id();
+			remap[res] = target.emit_unary_op(loc, op, type, val);
+			break;
+		}
+		case op::emit_binary_op:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			const auto op = static_cast<tokenid>(read());
+			type res_type, type;
+			read_type(res_type);
+			read_type(type);
+			const id lhs = read_id();
+			const id rhs = read_id();
+			remap[res] = target.emit_binary_op(loc, op, res_type, type, lhs, rhs);
+			break;
+		}
+		case op::emit_ternary_op:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			const auto op = static_cast<tokenid>(read());
+			type type;
+			read_type(type);
+			const id condition = read_id();
+			const id true_value = read_id();
+			const id false_value = read_id();
+			remap[res] = target.emit_ternary_op(loc, op, type, condition, true_value, false_value);
+			break;
+		}
+		case op::emit_call:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			const id function = read_id();
+			type res_type;
+			read_type(res_type);
+			expression_list args;
+			read_expression_list(args);
+			remap[res] = target.emit_call(loc, function, res_type, args);
+			break;
+		}
+		case op::emit_call_intrinsic:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			const id intrinsic = read();
+			type res_type;
+			read_type(res_type);
+			expression_list args;
+			read_expression_list(args);
+			remap[res] = target.emit_call_intrinsic(loc, intrinsic, res_type, args);
+			break;
+		}
+		case op::emit_construct:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			type type;
+			read_type(type);
+			expression_list args;
+			read_expression_list(args);
+			remap[res] = target.emit_construct(loc, type, args);
+			break;
+		}
+		case op::emit_if:
+		{
+			const location &loc = read_location();
+			const id condition_value = read_id();
+			const id condition_block = read_id();
+			const id true_statement_block = read_id();
+			const id false_statement_block = read_id();
+			target.emit_if(loc, condition_value, condition_block, true_statement_block, false_statement_block, read());
+			break;
+		}
+		case op::emit_phi:
+		{
+			const uint32_t res = read();
+			const location &loc = read_location();
+			const id condition_value = read_id();
+			const id condition_block = read_id();
+			const id true_value = read_id();
+			const id true_statement_block = read_id();
+			const id false_value = read_id();
+			const id false_statement_block = read_id();
+			type type;
+			read_type(type);
+			remap[res] = target.emit_phi(loc, condition_value, condition_block, true_value, true_statement_block, false_value, false_statement_block, type);
+			break;
+		}
+		case op::emit_loop:
+		{
+			const location &loc = read_location();
+			const id condition_value = read_id();
+			const id prev_block = read_id();
+			const id header_block = read_id();
+			const id condition_block = read_id();
+			const id loop_block = read_id();
+			const id continue_block = read_id();
+			target.emit_loop(loc, condition_value, prev_block, header_block, condition_block, loop_block, continue_block, read());
+			break;
+		}
+		case op::emit_switch:
+		{
+			const location &loc = read_location();
+			const id selector_value = read_id();
+			const id selector_block = read_id();
+			const id default_label = read_id();
+			const id default_block = read_id();
+			// Case literals and labels alternate, only the labels are IDs
+			std::vector<id> case_literal_and_labels(read());
+			for (size_t i = 0; i < case_literal_and_labels.size(); ++i)
+				case_literal_and_labels[i] = (i % 2) == 0 ? read() : read_id();
+			std::vector<id> case_blocks(read());
+			for (id &block : case_blocks)
+				block = read_id();
+			target.emit_switch(loc, selector_value, selector_block, default_label, default_block, case_literal_and_labels, case_blocks, read());
+			break;
+		}
+		case op::create_block:
+			read_result(target.create_block());
+			break;
+		case op::set_block:
+			target.set_block(read_id());
+			break;
+		case op::enter_block:
+			target.enter_block(read_id());
+			break;
+		case op::leave_block_and_kill:
+			target.leave_block_and_kill();
+			break;
+		case op::leave_block_and_return:
+			target.leave_block_and_return(read_id());
+			break;
+		case op::leave_block_and_switch:
+		{
+			const id value = read_id();
+			const id default_target = read_id();
+			target.leave_block_and_switch(value, default_target);
+			break;
+		}
+		case op::leave_block_and_branch:
+		{
+			const id branch_target = read_id();
+			target.leave_block_and_branch(branch_target, read());
+			break;
+		}
+		case op::leave_block_and_branch_conditional:
+		{
+			const id condition = read_id();
+			const id true_target = read_id();
+			const id false_target = read_id();
+			target.leave_block_and_branch_conditional(condition, true_target, false_target);
+			break;
+		}
+		case op::leave_function:
+			target.leave_function();
+			break;
+		default:
+			assert(false);
+			return;
+		}
+	}
+
+	// The parser changes texture flags after their definition, so transfer their final state
+	for (const texture_info &recorded_info : ir._module.textures)
+	{
+		texture_info &info = target.find_texture(remap[recorded_info.id]);
+		info.render_target = recorded_info.render_target;
+		info.storage_access = recorded_info.storage_access;
+	}
+
+	// Techniques reference entry points by name and carry copies of the sampler and storage descriptions, all of which are specific to the back-end
+	for (technique_info technique : ir._module.techniques)
+	{
+		for (pass_info &pass : technique.passes)
+		{
+			for (std::string *entry_point_name : { &pass.vs_entry_point, &pass.ps_entry_point, &pass.cs_entry_point })
+				if (const auto entry_point_it = entry_point_names.find(*entry_point_name);
+					entry_point_it != entry_point_names.end())
+					*entry_point_name = entry_point_it->second;
+
+			for (sampler_info &info : pass.samplers)
+				info = target.find_sampler(remap[info.id]);
+			for (storage_info &info : pass.storages)
+				info = target.find_storage(remap[info.id]);
+		}
+
+		target.define_technique(technique);
+	}
+}
+
+codegen *reshadefx::create_codegen_ir()
+{
+	return new codegen_ir();
+}
+
+void reshadefx::replay_codegen_ir(const codegen *ir, codegen *target)
+{
+	assert(dynamic_cast<const codegen_ir *>(ir) != nullptr);
+
+	static_cast<const codegen_ir *>(ir)->replay(*target);
+}
@@ -18,38 +18,27 @@ namespace spv {
 
 using namespace reshadefx;
 
+struct spirv_basic_block;
+
 /// <summary>
-/// A single instruction in a SPIR-V module
+/// A handle to a single instruction that was encoded into a basic block in the SPIR-V module
 /// </summary>
 struct spirv_instruction
 {
-	spv::Op op;
-	spv::Id type;
+	spirv_basic_block *block;
+	size_t offset;
 	spv::Id result;
-	std::vector<spv::Id> operands;
-
-	explicit spirv_instruction(spv::Op op = spv::OpNop) : op(op), type(0), result(0) {}
-	spirv_instruction(spv::Op op, spv::Id result) : op(op), type(result), result(0) {}
-	spirv_instruction(spv::Op op, spv::Id type, spv::Id result) : op(op), type(type), result(result) {}
 
 	/// <summary>
 	/// Add a single operand to the instruction.
 	/// </summary>
-	spirv_instruction &add(spv::Id operand)
-	{
-		operands.push_back(operand);
-		return *this;
-	}
+	inline spirv_instruction &add(spv::Id operand);
 
 	/// <summary>
 	/// Add a range of operands to the instruction.
 	/// </summary>
 	template <typename It>
-	spirv_instruction &add(It begin, It end)
-	{
-		operands.insert(operands.end(), begin, end);
-		return *this;
-	}
+	inline spirv_instruction &add(It begin, It end);
 
 	/// <summary>
 	/// Add a null-terminated literal UTF-8 string to the instruction.
@@ -65,59 +54,138 @@ struct spirv_instruction
 		} while (*string || (word & 0xFF000000));
 		return *this;
 	}
+};
+
+/// <summary>
+/// A list of instructions forming a basic block in the SPIR-V module, stored in their final binary encoding
+/// </summary>
+struct spirv_basic_block
+{
+	// See https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html
+	// 0             | Opcode: The 16 high-order bits are the WordCount of the instruction. The 16 low-order bits are the opcode enumerant.
+	// 1             | Optional instruction type <id>
+	// .             | Optional instruction Result <id>
+	// .             | Operand 1 (if needed)
+	// .             | Operand 2 (if needed)
+	// ...           | ...
+	// WordCount - 1 | Operand N (N is determined by WordCount minus the 1 to 3 words used for the opcode, instruction type <id>, and instruction Result <id>).
+	std::vector<uint32_t> words;
+	// Offset of the first word of the last instruction, or 'npos' if it has to be searched for again after a removal
+	size_t last_instruction = npos;
+
+	static constexpr size_t npos = static_cast<size_t>(-1);
 
 	/// <summary>
-	/// Write this instruction to a SPIR-V module.
+	/// Begin a new instruction at the end of this basic block.
 	/// </summary>
-	/// <param name="output">The output stream to append this instruction to.</param>
-	void write(std::vector<uint32_t> &output) const
+	spirv_instruction add_instruction(spv::Op op, spv::Id type = 0, spv::Id result = 0)
 	{
-		// See https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html
-		// 0             | Opcode: The 16 high-order bits are the WordCount of the instruction. The 16 low-order bits are the opcode enumerant.
-		// 1             | Optional instruction type <id>
-		// .             | Optional instruction Result <id>
-		// .             | Operand 1 (if needed)
-		// .             | Operand 2 (if needed)
-		// ...           | ...
-		// WordCount - 1 | Operand N (N is determined by WordCount minus the 1 to 3 words used for the opcode, instruction type <id>, and instruction Result <id>).
-
-		const uint32_t num_words = 1 + (type != 0) + (result != 0) + static_cast<uint32_t>(operands.size());
-		output.push_back((num_words << spv::WordCountShift) | op);
+		last_instruction = words.size();
+		words.push_back(((1u + (type != 0) + (result != 0)) << spv::WordCountShift) | op);
 
 		// Optional instruction type ID
 		if (type != 0)
-			output.push_back(type);
-
+			words.push_back(type);
 		// Optional instruction result ID
 		if (result != 0)
-			output.push_back(result);
+			words.push_back(result);
 
-		// Write out the operands
-		output.insert(output.end(), operands.begin(), operands.end());
+		return { this, last_instruction, result };
 	}
-};
 
-/// <summary>
-/// A list of instructions forming a basic block in the SPIR-V module
-/// </summary>
-struct spirv_basic_block
-{
-	std::vector<spirv_instruction> instructions;
+	/// <summary>
+	/// Get the offset of the first word of the last instruction in this basic block.
+	/// </summary>
+	size_t back()
+	{
+		assert(!words.empty());
+		if (last_instruction == npos)
+			for (size_t offset = 0; offset < words.size(); offset += words[offset] >> spv::WordCountShift)
+				last_instruction = offset;
+		return last_instruction;
+	}
+	/// <summary>
+	/// Remove the last instruction from this basic block.
+	/// </summary>
+	void pop_back()
+	{
+		words.resize(back());
+		last_instruction = npos;
+	}
+
+	/// <summary>
+	/// Get the opcode of the instruction starting at the specified word offset.
+	/// </summary>
+	spv::Op op(size_t offset) const
+	{
+		return static_cast<spv::Op>(words[offset] & spv::OpCodeMask);
+	}
 
 	/// <summary>
-	/// Append another basic block the end of this one.
+	/// Copy the instruction starting at the specified word offset in another basic block to the end of this one.
 	/// </summary>
-	void append(const spirv_basic_block &block)
+	void append(const spirv_basic_block &block, size_t offset)
 	{
-		instructions.insert(instructions.end(), block.instructions.begin(), block.instructions.end());
+		last_instruction = words.size();
+		words.insert(words.end(), block.words.begin() + offset, block.words.begin() + offset + (block.words[offset] >> spv::WordCountShift));
+	}
+	/// <summary>
+	/// Move all instructions of another basic block to the end of this one.
+	/// </summary>
+	void append(spirv_basic_block &&block)
+	{
+		if (block.words.empty())
+			return;
+
+		last_instruction = block.last_instruction == npos ? npos : words.size() + block.last_instruction;
+
+		if (words.empty())
+			words = std::move(block.words);
+		else
+			words.insert(words.end(), block.words.begin(), block.words.end());
+
+		block.words.clear();
+		block.last_instruction = npos;
 	}
 };
 
+inline spirv_instruction &spirv_instruction::add(spv::Id operand)
+{
+	// Operands can only be added to the last instruction in a basic block
+	assert(block->last_instruction == offset);
+	block->words.push_back(operand);
+	block->words[offset] += 1u << spv::WordCountShift;
+	return *this;
+}
+template <typename It>
+inline spirv_instruction &spirv_instruction::add(It begin, It end)
+{
+	assert(block->last_instruction == offset);
+	block->words.insert(block->words.end(), begin, end);
+	block->words[offset] += static_cast<uint32_t>(std::distance(begin, end)) << spv::WordCountShift;
+	return *this;
+}
+
+static inline size_t hash_combine(size_t seed, size_t value)
+{
+	return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+static inline size_t hash_type(const reshadefx::type &type)
+{
+	// Only hash the members that are compared by the equality operator of the type
+	size_t hash = type.base;
+	hash = hash_combine(hash, type.rows);
+	hash = hash_combine(hash, type.cols);
+	hash = hash_combine(hash, static_cast<size_t>(type.array_length));
+	hash = hash_combine(hash, type.definition);
+	return hash;
+}
+
 class codegen_spirv final : public codegen
 {
 public:
-	codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y)
-		: _debug_info(debug_info), _vulkan_semantics(vulkan_semantics), _uniforms_to_spec_constants(uniforms_to_spec_constants), _enable_16bit_types(enable_16bit_types), _flip_vert_y(flip_vert_y)
+	codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y, spirv_optimization optimization, bool pack_uniforms)
+		: _debug_info(debug_info), _vulkan_semantics(vulkan_semantics), _uniforms_to_spec_constants(uniforms_to_spec_constants), _enable_16bit_types(enable_16bit_types), _flip_vert_y(flip_vert_y), _optimization(optimization), _pack_uniforms(pack_uniforms)
 	{
 		_glsl_ext = make_id();
 	}
@@ -134,6 +202,70 @@ private:
 		{
 			return lhs.type == rhs.type && lhs.is_ptr == rhs.is_ptr && lhs.array_stride == rhs.array_stride && lhs.storage == rhs.storage;
 		}
+
+		struct hash
+		{
+			size_t operator()(const type_lookup &key) const
+			{
+				size_t hash = hash_type(key.type);
+				hash = hash_combine(hash, key.is_ptr);
+				hash = hash_combine(hash, key.array_stride);
+				hash = hash_combine(hash, key.storage.first);
+				hash = hash_combine(hash, key.storage.second);
+				return hash;
+			}
+		};
+	};
+	struct constant_lookup
+	{
+		reshadefx::type type;
+		reshadefx::constant data;
+
+		friend bool operator==(const constant_lookup &lhs, const constant_lookup &rhs)
+		{
+			if (!(lhs.type == rhs.type && std::memcmp(&lhs.data.as_uint[0], &rhs.data.as_uint[0], sizeof(uint32_t) * 16) == 0 && lhs.data.array_data.size() == rhs.data.array_data.size()))
+				return false;
+			for (size_t i = 0; i < lhs.data.array_data.size(); ++i)
+				if (std::memcmp(&lhs.data.array_data[i].as_uint[0], &rhs.data.array_data[i].as_uint[0], sizeof(uint32_t) * 16) != 0)
+					return false;
+			return true;
+		}
+
+		struct hash
+		{
+			size_t operator()(const constant_lookup &key) const
+			{
+				size_t hash = hash_type(key.type);
+				for (uint32_t value : key.data.as_uint)
+					hash = hash_combine(hash, value);
+				hash = hash_combine(hash, key.data.array_data.size());
+				for (const constant &element : key.data.array_data)
+					for (uint32_t value : element.as_uint)
+						hash = hash_combine(hash, value);
+				return hash;
+			}
+		};
+	};
+	struct function_type_lookup
+	{
+		type return_type;
+		std::vector<type> param_types;
+
+		friend bool operator==(const function_type_lookup &lhs, const function_type_lookup &rhs)
+		{
+			return lhs.return_type == rhs.return_type && lhs.param_types == rhs.param_types;
+		}
+
+		struct hash
+		{
+			size_t operator()(const function_type_lookup &key) const
+			{
+				size_t hash = hash_type(key.return_type);
+				for (const type &param_type : key.param_types)
+					hash = hash_combine(hash, hash_type(param_type));
+				return hash;
+			}
+		};
 	};
 	struct function_blocks
 	{
@@ -143,16 +275,6 @@ private:
 		type return_type;
 		std::vector<type> param_types;
 		bool is_entry_point = false;
-
-		friend bool operator==(const function_blocks &lhs, const function_blocks &rhs)
-		{
-			if (lhs.param_types.size() != rhs.param_types.size())
-				return false;
-			for (size_t i = 0; i < lhs.param_types.size(); ++i)
-				if (!(lhs.param_types[i] == rhs.param_types[i]))
-					return false;
-			return lhs.return_type == rhs.return_type;
-		}
 	};
 
 	spirv_basic_block _entries;
@@ -165,10 +287,10 @@ private:
 
 	std::unordered_set<spv::Id> _spec_constants;
 	std::unordered_set<spv::Capability> _capabilities;
-	std::vector<std::pair<type_lookup, spv::Id>> _type_lookup;
-	std::vector<std::tuple<type, constant, spv::Id>> _constant_lookup;
-	std::vector<std::pair<function_blocks, spv::Id>> _function_type_lookup;
-	std::unordered_map<std::string, spv::Id> _string_lookup;
+	std::unordered_map<type_lookup, spv::Id, type_lookup::hash> _type_lookup;
+	std::unordered_map<constant_lookup, spv::Id, constant_lookup::hash> _constant_lookup;
+	std::unordered_map<function_type_lookup, spv::Id, function_type_lookup::hash> _function_type_lookup;
+	std::unordered_map<std::string_view, spv::Id> _string_lookup;
 	std::unordered_map<spv::Id, std::pair<spv::StorageClass, spv::ImageFormat>> _storage_lookup;
 	std::unordered_map<std::string, uint32_t> _semantic_to_location;
 
@@ -181,6 +303,8 @@ private:
 	bool _uniforms_to_spec_constants = false;
 	bool _enable_16bit_types = false;
 	bool _flip_vert_y = false;
+	spirv_optimization _optimization = spirv_optimization::none;
+	bool _pack_uniforms = false;
 	id _glsl_ext = 0;
 	id _global_ubo_type = 0;
 	id _global_ubo_variable = 0;
@@ -199,7 +323,7 @@ private:
 			file = it->second;
 		else {
 			add_instruction(spv::OpString, 0, _debug_a, file)
-				.add_string(loc.source.c_str());
+				.add_string(std::string(loc.source).c_str());
 			_string_lookup.emplace(loc.source, file);
 		}
 
@@ -209,33 +333,978 @@ private:
 			.add(loc.line)
 			.add(loc.column);
 	}
-	inline spirv_instruction &add_instruction(spv::Op op, spv::Id type = 0)
+	inline spirv_instruction add_instruction(spv::Op op, spv::Id type = 0)
 	{
 		assert(is_in_function() && is_in_block());
 		return add_instruction(op, type, *_current_block_data);
 	}
-	inline spirv_instruction &add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block)
+	inline spirv_instruction add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block)
 	{
-		spirv_instruction &instruction = add_instruction_without_result(op, block);
-		instruction.type = type;
-		instruction.result = make_id();
-		return instruction;
+		return block.add_instruction(op, type, make_id());
 	}
-	inline spirv_instruction &add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block, spv::Id &result)
+	inline spirv_instruction add_instruction(spv::Op op, spv::Id type, spirv_basic_block &block, spv::Id &result)
 	{
-		spirv_instruction &instruction = add_instruction_without_result(op, block);
-		instruction.type = type;
-		instruction.result = result = make_id();
-		return instruction;
+		return block.add_instruction(op, type, result = make_id());
 	}
-	inline spirv_instruction &add_instruction_without_result(spv::Op op)
+	inline spirv_instruction add_instruction_without_result(spv::Op op)
 	{
 		assert(is_in_function() && is_in_block());
 		return add_instruction_without_result(op, *_current_block_data);
 	}
-	inline spirv_instruction &add_instruction_without_result(spv::Op op, spirv_basic_block &block)
+	inline spirv_instruction add_instruction_without_result(spv::Op op, spirv_basic_block &block)
+	{
+		return block.add_instruction(op);
+	}
+
+	inline spv::Id remove_merge_label()
+	{
+		// The merge block was already entered when a control flow construct is emitted, but its label has to come after all the blocks of the construct
+		const size_t merge_label_inst = _current_block_data->back();
+		assert(_current_block_data->op(merge_label_inst) == spv::OpLabel);
+		const spv::Id merge_label = _current_block_data->words[merge_label_inst + 1];
+		_current_block_data->pop_back();
+
+		return merge_label;
+	}
+
+	static bool has_result(spv::Op op)
+	{
+		switch (op)
+		{
+		case spv::OpNop:
+		case spv::OpLine:
+		case spv::OpStore:
+		case spv::OpSelectionMerge:
+		case spv::OpLoopMerge:
+		case spv::OpBranch:
+		case spv::OpBranchConditional:
+		case spv::OpSwitch:
+		case spv::OpReturn:
+		case spv::OpReturnValue:
+		case spv::OpKill:
+		case spv::OpImageWrite:
+		case spv::OpControlBarrier:
+		case spv::OpMemoryBarrier:
+		case spv::OpFunctionEnd:
+			return false;
+		default:
+			return true;
+		}
+	}
+	static uint32_t result_offset(spv::Op op)
+	{
+		switch (op)
+		{
+		case spv::OpLabel:
+		case spv::OpString:
+		case spv::OpExtInstImport:
+		case spv::OpTypeArray:
+		case spv::OpTypeBool:
+		case spv::OpTypeFloat:
+		case spv::OpTypeFunction:
+		case spv::OpTypeImage:
+		case spv::OpTypeInt:
+		case spv::OpTypeMatrix:
+		case spv::OpTypePointer:
+		case spv::OpTypeSampledImage:
+		case spv::OpTypeStruct:
+		case spv::OpTypeVector:
+		case spv::OpTypeVoid:
+			return 1;
+		default:
+			return has_result(op) ? 2 : 0;
+		}
+	}
+	static bool has_side_effects(spv::Op op)
+	{
+		switch (op)
+		{
+		case spv::OpLabel:
+		case spv::OpVariable:
+		case spv::OpFunctionParameter:
+		case spv::OpFunctionCall:
+		case spv::OpAtomicAnd:
+		case spv::OpAtomicCompareExchange:
+		case spv::OpAtomicExchange:
+		case spv::OpAtomicIAdd:
+		case spv::OpAtomicOr:
+		case spv::OpAtomicSMax:
+		case spv::OpAtomicSMin:
+		case spv::OpAtomicUMax:
+		case spv::OpAtomicUMin:
+		case spv::OpAtomicXor:
+			return true;
+		default:
+			return !has_result(op);
+		}
+	}
+	static bool has_side_effects(const uint32_t *inst)
+	{
+		const spv::Op op = static_cast<spv::Op>(inst[0] & spv::OpCodeMask);
+
+		// These extended instructions write their second operand through a pointer
+		if (op == spv::OpExtInst && (inst[4] == spv::GLSLstd450Modf || inst[4] == spv::GLSLstd450Frexp))
+			return true;
+
+		return has_side_effects(op);
+	}
+
+	/// <summary>
+	/// Call the specified function with a reference to every operand of the instruction at the specified address that is an ID (not including the result type and ID).
+	/// </summary>
+	template <typename F>
+	static void for_each_id_operand(uint32_t *inst, F func)
+	{
+		const spv::Op op = static_cast<spv::Op>(inst[0] & spv::OpCodeMask);
+		const uint32_t num_words = inst[0] >> spv::WordCountShift;
+
+		uint32_t first = has_result(op) ? 3 : 1, last = num_words, image_operands = 0;
+
+		switch (op)
+		{
+		case spv::OpLabel:
+		case spv::OpFunctionParameter:
+		case spv::OpUndef:
+			return;
+		case spv::OpVariable:
+			first = 4; // Skip storage class
+			break;
+		case spv::OpLine:
+		case spv::OpSelectionMerge:
+			last = 2;
+			break;
+		case spv::OpLoopMerge:
+			last = 3;
+			break;
+		case spv::OpBranchConditional:
+			last = 4; // Skip branch weights
+			break;
+		case spv::OpSwitch:
+			func(inst[1]);
+			func(inst[2]);
+			for (uint32_t i = 4; i < num_words; i += 2)
+				func(inst[i]); // Skip case literals
+			return;
+		case spv::OpCompositeExtract:
+			last = 4;
+			break;
+		case spv::OpCompositeInsert:
+		case spv::OpVectorShuffle:
+			last = 5;
+			break;
+		case spv::OpExtInst:
+			func(inst[3]);
+			first = 5; // Skip extended instruction number
+			break;
+		case spv::OpImageFetch:
+		case spv::OpImageRead:
+		case spv::OpImageSampleExplicitLod:
+		case spv::OpImageSampleImplicitLod:
+			image_operands = 5;
+			break;
+		case spv::OpImageGather:
+			image_operands = 6;
+			break;
+		case spv::OpImageWrite:
+			image_operands = 4;
+			break;
+		default:
+			break;
+		}
+
+		// Skip image operands mask
+		if (image_operands != 0 && image_operands < num_words)
+		{
+			for (uint32_t i = first; i < image_operands; ++i)
+				func(inst[i]);
+			first = image_operands + 1;
+		}
+
+		for (uint32_t i = first; i < last && i < num_words; ++i)
+			func(inst[i]);
+	}
+
+	/// <summary>
+	/// Evaluate the instruction at the specified address if all its operands are constants.
+	/// </summary>
+	/// <returns>The ID of the constant (or other value) the instruction result can be replaced with, or zero if the instruction cannot be folded.</returns>
+	spv::Id fold_constant(const uint32_t *inst, const std::unordered_map<spv::Id, type> &types, std::unordered_map<spv::Id, const constant_lookup *> &constants)
 	{
-		return block.instructions.emplace_back(op);
+		const spv::Op op = static_cast<spv::Op>(inst[0] & spv::OpCodeMask);
+		const uint32_t num_words = inst[0] >> spv::WordCountShift;
+
+		if (!has_result(op) || has_side_effects(op) || num_words < 4)
+			return 0;
+
+		const auto type_it = types.find(inst[1]);
+		if (type_it == types.end())
+			return 0;
+		const type &res_type = type_it->second;
+		if (!res_type.is_numeric() || res_type.is_array() || res_type.is_matrix() || (_enable_16bit_types && res_type.precision() < 32))
+			return 0;
+
+		const constant_lookup *operands[3] = {};
+		const uint32_t num_operands = std::min(num_words - 3, 3u);
+		for (uint32_t i = 0; i < num_operands; ++i)
+			if (const auto it = constants.find(inst[3 + i]); it != constants.end())
+				operands[i] = it->second;
+
+		// The condition is enough to decide which value to select, even if those are not constant
+		if (op == spv::OpSelect)
+			return operands[0] != nullptr && operands[0]->type.is_scalar() ? inst[operands[0]->data.as_uint[0] ? 4 : 5] : 0;
+
+		constant data = {};
+		const unsigned int components = res_type.components();
+
+		switch (op)
+		{
+		case spv::OpCompositeExtract:
+			if (operands[0] == nullptr || !operands[0]->type.is_vector() || num_words != 5 || inst[4] >= operands[0]->type.components())
+				return 0;
+			data.as_uint[0] = operands[0]->data.as_uint[inst[4]];
+			break;
+		case spv::OpCompositeConstruct:
+			for (uint32_t i = 3, k = 0; i < num_words; ++i)
+			{
+				const auto it = constants.find(inst[i]);
+				if (it == constants.end() || it->second->type.is_matrix() || it->second->type.is_array() || k + it->second->type.components() > components)
+					return 0;
+				for (unsigned int c = 0; c < it->second->type.components(); ++c)
+					data.as_uint[k++] = it->second->data.as_uint[c];
+				if (i == num_words - 1 && k != components)
+					return 0;
+			}
+			break;
+		case spv::OpVectorShuffle:
+			if (operands[0] == nullptr || operands[1] == nullptr)
+				return 0;
+			for (uint32_t i = 5; i < num_words; ++i)
+			{
+				const uint32_t index = inst[i], lhs_components = operands[0]->type.components();
+				if (index < lhs_components)
+					data.as_uint[i - 5] = operands[0]->data.as_uint[index];
+				else if (index < lhs_components + operands[1]->type.components())
+					data.as_uint[i - 5] = operands[1]->data.as_uint[index - lhs_components];
+				else
+					return 0; // Undefined component
+			}
+			break;
+		default:
+			for (uint32_t i = 0; i < num_words - 3; ++i)
+				if (i >= 3 || operands[i] == nullptr || operands[i]->type.components() != components || operands[i]->type.is_array() || (_enable_16bit_types && operands[i]->type.precision() < 32))
+					return 0;
+
+			for (unsigned int i = 0; i < components; ++i)
+			{
+				const constant &a = operands[0]->data;
+				const constant &b = num_operands > 1 ? operands[1]->data : a;
+
+				switch (op)
+				{
+				case spv::OpFAdd:
+					data.as_float[i] = a.as_float[i] + b.as_float[i];
+					break;
+				case spv::OpFSub:
+					data.as_float[i] = a.as_float[i] - b.as_float[i];
+					break;
+				case spv::OpFMul:
+					data.as_float[i] = a.as_float[i] * b.as_float[i];
+					break;
+				case spv::OpFDiv:
+					if (b.as_float[i] == 0.0f)
+						return 0;
+					data.as_float[i] = a.as_float[i] / b.as_float[i];
+					break;
+				case spv::OpFNegate:
+					data.as_float[i] = -a.as_float[i];
+					break;
+				case spv::OpIAdd:
+					data.as_uint[i] = a.as_uint[i] + b.as_uint[i];
+					break;
+				case spv::OpISub:
+					data.as_uint[i] = a.as_uint[i] - b.as_uint[i];
+					break;
+				case spv::OpIMul:
+					data.as_uint[i] = a.as_uint[i] * b.as_uint[i];
+					break;
+				case spv::OpSNegate:
+					data.as_uint[i] = 0u - a.as_uint[i];
+					break;
+				case spv::OpSDiv:
+					if (b.as_int[i] == 0 || (a.as_int[i] == INT32_MIN && b.as_int[i] == -1))
+						return 0;
+					data.as_int[i] = a.as_int[i] / b.as_int[i];
+					break;
+				case spv::OpUDiv:
+					if (b.as_uint[i] == 0)
+						return 0;
+					data.as_uint[i] = a.as_uint[i] / b.as_uint[i];
+					break;
+				case spv::OpUMod:
+					if (b.as_uint[i] == 0)
+						return 0;
+					data.as_uint[i] = a.as_uint[i] % b.as_uint[i];
+					break;
+				case spv::OpBitwiseAnd:
+					data.as_uint[i] = a.as_uint[i] & b.as_uint[i];
+					break;
+				case spv::OpBitwiseOr:
+					data.as_uint[i] = a.as_uint[i] | b.as_uint[i];
+					break;
+				case spv::OpBitwiseXor:
+					data.as_uint[i] = a.as_uint[i] ^ b.as_uint[i];
+					break;
+				case spv::OpNot:
+					data.as_uint[i] = ~a.as_uint[i];
+					break;
+				case spv::OpShiftLeftLogical:
+					if (b.as_uint[i] >= 32)
+						return 0;
+					data.as_uint[i] = a.as_uint[i] << b.as_uint[i];
+					break;
+				case spv::OpShiftRightLogical:
+					if (b.as_uint[i] >= 32)
+						return 0;
+					data.as_uint[i] = a.as_uint[i] >> b.as_uint[i];
+					break;
+				case spv::OpShiftRightArithmetic:
+					if (b.as_uint[i] >= 32)
+						return 0;
+					data.as_int[i] = a.as_int[i] >> b.as_uint[i];
+					break;
+				case spv::OpFOrdEqual:
+					data.as_uint[i] = a.as_float[i] == b.as_float[i];
+					break;
+				case spv::OpFOrdNotEqual:
+					data.as_uint[i] = a.as_float[i] != b.as_float[i] && a.as_float[i] == a.as_float[i] && b.as_float[i] == b.as_float[i];
+					break;
+				case spv::OpFOrdLessThan:
+					data.as_uint[i] = a.as_float[i] < b.as_float[i];
+					break;
+				case spv::OpFOrdLessThanEqual:
+					data.as_uint[i] = a.as_float[i] <= b.as_float[i];
+					break;
+				case spv::OpFOrdGreaterThan:
+					data.as_uint[i] = a.as_float[i] > b.as_float[i];
+					break;
+				case spv::OpFOrdGreaterThanEqual:
+					data.as_uint[i] = a.as_float[i] >= b.as_float[i];
+					break;
+				case spv::OpIEqual:
+				case spv::OpLogicalEqual:
+					data.as_uint[i] = (op == spv::OpLogicalEqual ? (a.as_uint[i] != 0) == (b.as_uint[i] != 0) : a.as_uint[i] == b.as_uint[i]);
+					break;
+				case spv::OpINotEqual:
+				case spv::OpLogicalNotEqual:
+					data.as_uint[i] = (op == spv::OpLogicalNotEqual ? (a.as_uint[i] != 0) != (b.as_uint[i] != 0) : a.as_uint[i] != b.as_uint[i]);
+					break;
+				case spv::OpSLessThan:
+					data.as_uint[i] = a.as_int[i] < b.as_int[i];
+					break;
+				case spv::OpSLessThanEqual:
+					data.as_uint[i] = a.as_int[i] <= b.as_int[i];
+					break;
+				case spv::OpSGreaterThan:
+					data.as_uint[i] = a.as_int[i] > b.as_int[i];
+					break;
+				case spv::OpSGreaterThanEqual:
+					data.as_uint[i] = a.as_int[i] >= b.as_int[i];
+					break;
+				case spv::OpULessThan:
+					data.as_uint[i] = a.as_uint[i] < b.as_uint[i];
+					break;
+				case spv::OpULessThanEqual:
+					data.as_uint[i] = a.as_uint[i] <= b.as_uint[i];
+					break;
+				case spv::OpUGreaterThan:
+					data.as_uint[i] = a.as_uint[i] > b.as_uint[i];
+					break;
+				case spv::OpUGreaterThanEqual:
+					data.as_uint[i] = a.as_uint[i] >= b.as_uint[i];
+					break;
+				case spv::OpLogicalAnd:
+					data.as_uint[i] = a.as_uint[i] != 0 && b.as_uint[i] != 0;
+					break;
+				case spv::OpLogicalOr:
+					data.as_uint[i] = a.as_uint[i] != 0 || b.as_uint[i] != 0;
+					break;
+				case spv::OpLogicalNot:
+					data.as_uint[i] = a.as_uint[i] == 0;
+					break;
+				case spv::OpConvertSToF:
+					data.as_float[i] = static_cast<float>(a.as_int[i]);
+					break;
+				case spv::OpConvertUToF:
+					data.as_float[i] = static_cast<float>(a.as_uint[i]);
+					break;
+				case spv::OpConvertFToS:
+					// Conversion of values that do not fit into the result type is undefined, so leave those to the driver
+					if (!(a.as_float[i] > -2147483904.0f && a.as_float[i] < 2147483648.0f))
+						return 0;
+					data.as_int[i] = static_cast<int32_t>(a.as_float[i]);
+					break;
+				case spv::OpConvertFToU:
+					if (!(a.as_float[i] > -1.0f && a.as_float[i] < 4294967296.0f))
+						return 0;
+					data.as_uint[i] = static_cast<uint32_t>(a.as_float[i]);
+					break;
+				case spv::OpBitcast:
+					data.as_uint[i] = a.as_uint[i];
+					break;
+				default:
+					return 0;
+				}
+			}
+			break;
+		}
+
+		const spv::Id result = emit_constant(res_type, data);
+		// Keep track of the new constant, so that it can be used to fold other instructions too
+		constants.emplace(result, &_constant_lookup.find({ res_type, data })->first);
+		return result;
+	}
+
+	/// <summary>
+	/// Merge basic blocks into their predecessor where that is the only one and ends with an unconditional branch to them.
+	/// </summary>
+	void merge_blocks(spirv_basic_block &definition)
+	{
+		struct block_info
+		{
+			size_t begin, terminator, end;
+			uint32_t num_predecessors = 0;
+			bool is_header = false, is_merge_target = false;
+			size_t merge_next = 0;
+		};
+
+		std::vector<block_info> blocks;
+		std::unordered_map<spv::Id, size_t> block_lookup;
+
+		const std::vector<uint32_t> &words = definition.words;
+
+		for (size_t offset = 0; offset < words.size(); offset += words[offset] >> spv::WordCountShift)
+		{
+			switch (definition.op(offset))
+			{
+			case spv::OpLabel:
+				if (!blocks.empty())
+					blocks.back().end = offset;
+				block_lookup.emplace(words[offset + 1], blocks.size());
+				blocks.push_back({ offset, offset, offset });
+				break;
+			case spv::OpFunctionEnd:
+				blocks.back().end = offset;
+				break;
+			case spv::OpSelectionMerge:
+			case spv::OpLoopMerge:
+				blocks.back().is_header = true;
+				break;
+			case spv::OpBranch:
+			case spv::OpBranchConditional:
+			case spv::OpSwitch:
+			case spv::OpReturn:
+			case spv::OpReturnValue:
+			case spv::OpKill:
+				blocks.back().terminator = offset;
+				break;
+			default:
+				break;
+			}
+		}
+
+		const auto find_block = [&](spv::Id label) -> block_info & { return blocks[block_lookup.at(label)]; };
+
+		for (block_info &block : blocks)
+		{
+			const size_t offset = block.terminator;
+
+			switch (definition.op(offset))
+			{
+			case spv::OpBranch:
+				find_block(words[offset + 1]).num_predecessors++;
+				break;
+			case spv::OpBranchConditional:
+				find_block(words[offset + 2]).num_predecessors++;
+				if (words[offset + 3] != words[offset + 2])
+					find_block(words[offset + 3]).num_predecessors++;
+				break;
+			case spv::OpSwitch:
+				// Count every target as separate predecessor, which prevents merging of blocks that are targeted multiple times
+				find_block(words[offset + 2]).num_predecessors++;
+				for (size_t i = offset + 4; i < block.end; i += 2)
+					find_block(words[i]).num_predecessors++;
+				break;
+			default:
+				break;
+			}
+		}
+
+		// Merge and continue targets of structured control flow constructs have to stay separate blocks
+		for (size_t offset = 0; offset < words.size(); offset += words[offset] >> spv::WordCountShift)
+		{
+			if (definition.op(offset) == spv::OpSelectionMerge)
+				find_block(words[offset + 1]).is_merge_target = true;
+			if (definition.op(offset) == spv::OpLoopMerge)
+				find_block(words[offset + 1]).is_merge_target = true,
+				find_block(words[offset + 2]).is_merge_target = true;
+		}
+
+		bool merged_any = false;
+		std::vector<bool> is_merged(blocks.size());
+
+		for (size_t i = 0; i < blocks.size(); ++i)
+		{
+			block_info &block = blocks[i];
+			if (block.is_header || definition.op(block.terminator) != spv::OpBranch)
+				continue;
+
+			const size_t next_index = block_lookup.at(words[block.terminator + 1]);
+			const block_info &next = blocks[next_index];
+			if (next_index == i || next_index == 0 || next.num_predecessors != 1 || next.is_merge_target)
+				continue;
+
+			// Skip over any debug information at the start of the block to check for phi instructions (which would reference the merged predecessor)
+			size_t first = next.begin + (words[next.begin] >> spv::WordCountShift);
+			while (first < next.end && definition.op(first) == spv::OpLine)
+				first += words[first] >> spv::WordCountShift;
+			if (first < next.end && definition.op(first) == spv::OpPhi)
+				continue;
+
+			block.merge_next = next_index;
+			is_merged[next_index] = true;
+			merged_any = true;
+		}
+
+		if (!merged_any)
+			return;
+
+		spirv_basic_block result;
+		result.words.reserve(words.size());
+
+		std::unordered_map<spv::Id, spv::Id> label_remap;
+
+		for (size_t i = 0; i < blocks.size(); ++i)
+		{
+			if (is_merged[i])
+				continue;
+
+			const spv::Id label = words[blocks[i].begin + 1];
+
+			// Append the first block including its label and then all the blocks merged into it without theirs
+			for (size_t k = i, begin = blocks[i].begin; true; k = blocks[k].merge_next)
+			{
+				const block_info &block = blocks[k];
+				if (k != i)
+				{
+					begin = block.begin + (words[block.begin] >> spv::WordCountShift);
+					label_remap.emplace(words[block.begin + 1], label);
+				}
+
+				if (block.merge_next == 0)
+				{
+					result.words.insert(result.words.end(), words.begin() + begin, words.begin() + block.end);
+					break;
+				}
+
+				result.words.insert(result.words.end(), words.begin() + begin, words.begin() + block.terminator);
+			}
+		}
+
+		result.words.insert(result.words.end(), words.begin() + blocks.back().end, words.end());
+
+		// Update parent references of phi instructions to the blocks that now contain the branch to them
+		for (size_t offset = 0; offset < result.words.size(); offset += result.words[offset] >> spv::WordCountShift)
+		{
+			if (result.op(offset) != spv::OpPhi)
+				continue;
+
+			for (size_t i = offset + 4; i < offset + (result.words[offset] >> spv::WordCountShift); i += 2)
+				if (const auto it = label_remap.find(result.words[i]); it != label_remap.end())
+					result.words[i] = it->second;
+		}
+
+		definition = std::move(result);
+	}
+
+	/// <summary>
+	/// Forward stored values to subsequent loads of function-local variables, fold constant expressions and remove code that does not contribute to the result.
+	/// </summary>
+	void optimize_function(function_blocks &function, const std::unordered_map<spv::Id, type> &types, std::unordered_map<spv::Id, const constant_lookup *> &constants, std::vector<spv::Id> &replacements, std::vector<spv::Id> &pointer_roots, std::vector<uint32_t> &uses)
+	{
+		std::vector<uint32_t> &words = function.definition.words;
+
+		const bool store_forwarding = has_optimization(spirv_optimization::store_forwarding);
+		const bool constant_folding = has_optimization(spirv_optimization::constant_folding);
+
+		std::vector<size_t> insts;
+		for (size_t offset = 0; offset < words.size(); offset += words[offset] >> spv::WordCountShift)
+			insts.push_back(offset);
+		std::vector<bool> removed(insts.size());
+
+		// Function-local variables are their own root, while access chains into them reference the variable they are based on
+		std::vector<size_t> variables;
+		for (size_t offset = 0; offset < function.variables.words.size(); offset += function.variables.words[offset] >> spv::WordCountShift)
+			if (function.variables.op(offset) == spv::OpVariable)
+				variables.push_back(offset),
+				pointer_roots[function.variables.words[offset + 2]] = function.variables.words[offset + 2];
+
+		const auto replace = [&replacements](uint32_t &id) {
+			if (id < replacements.size() && replacements[id] != 0)
+				id = replacements[id];
+		};
+		const auto root = [&pointer_roots](spv::Id id) {
+			return id < pointer_roots.size() ? pointer_roots[id] : 0;
+		};
+
+		// Variables that are only written once in the entry block (and only ever loaded from after that) hold the same value everywhere in the function
+		std::unordered_map<spv::Id, spv::Id> entry_values;
+		if (store_forwarding)
+		{
+			std::unordered_map<spv::Id, bool> single_store;
+			for (size_t offset = 0; offset < function.variables.words.size(); offset += function.variables.words[offset] >> spv::WordCountShift)
+				if (function.variables.op(offset) == spv::OpVariable)
+					single_store.emplace(function.variables.words[offset + 2], false);
+
+			bool is_entry_block = true;
+			for (size_t i = 1; i < insts.size(); ++i)
+			{
+				uint32_t *const inst = &words[insts[i]];
+
+				switch (static_cast<spv::Op>(inst[0] & spv::OpCodeMask))
+				{
+				case spv::OpLabel:
+					is_entry_block = false;
+					break;
+				case spv::OpStore:
+					if (const auto it = single_store.find(inst[1]); it != single_store.end())
+					{
+						if (!is_entry_block || it->second)
+							single_store.erase(it);
+						else
+							it->second = true;
+					}
+					break;
+				case spv::OpLoad:
+					// Loading before the store in the entry block would reference the stored value before it is defined
+					if (const auto it = single_store.find(inst[3]); it != single_store.end() && is_entry_block && !it->second)
+						single_store.erase(it);
+					break;
+				default:
+					for_each_id_operand(inst, [&single_store](uint32_t &id) { single_store.erase(id); });
+					break;
+				}
+			}
+
+			for (const auto &[variable, has_store] : single_store)
+				if (has_store)
+					entry_values.emplace(variable, 0);
+		}
+
+		// Values currently stored in each local variable, which are only tracked within a single basic block
+		std::unordered_map<spv::Id, spv::Id> known_values;
+
+		for (size_t i = 0; i < insts.size(); ++i)
+		{
+			uint32_t *const inst = &words[insts[i]];
+
+			for_each_id_operand(inst, replace);
+
+			switch (static_cast<spv::Op>(inst[0] & spv::OpCodeMask))
+			{
+			case spv::OpLabel:
+				known_values.clear();
+				break;
+			case spv::OpStore:
+				if (!store_forwarding)
+					break;
+				if (const auto it = entry_values.find(inst[1]); it != entry_values.end())
+					it->second = inst[2];
+				else if (const spv::Id variable = root(inst[1]); variable == inst[1])
+					known_values[variable] = inst[2];
+				else if (variable != 0)
+					known_values.erase(variable); // Partial store through an access chain
+				break;
+			case spv::OpLoad:
+				if (!store_forwarding)
+					break;
+				if (const auto it = entry_values.find(inst[3]); it != entry_values.end())
+					replacements[inst[2]] = it->second,
+					removed[i] = true;
+				else if (const spv::Id variable = root(inst[3]); variable == inst[3])
+				{
+					if (const auto it = known_values.find(variable); it != known_values.end())
+						replacements[inst[2]] = it->second,
+						removed[i] = true;
+					else
+						known_values.emplace(variable, inst[2]);
+				}
+				break;
+			case spv::OpAccessChain:
+				if (const spv::Id variable = root(inst[3]); variable != 0)
+					pointer_roots[inst[2]] = variable;
+				break;
+			default:
+				// Any other use of a pointer to a local variable (e.g. passing it to a function call) may modify it
+				for_each_id_operand(inst, [&](uint32_t &id) {
+					if (const spv::Id variable = root(id); variable != 0)
+						known_values.erase(variable);
+				});
+
+				if (const spv::Id value = constant_folding ? fold_constant(inst, types, constants) : 0; value != 0)
+				{
+					replacements[inst[2]] = value;
+					removed[i] = true;
+				}
+				break;
+			}
+		}
+
+		// Phi instructions may reference values that are only defined further down, so apply replacements again now that all of them are known
+		for (size_t i = 0; i < insts.size(); ++i)
+			if (!removed[i] && static_cast<spv::Op>(words[insts[i]] & spv::OpCodeMask) == spv::OpPhi)
+				for_each_id_operand(&words[insts[i]], replace);
+
+		// Count uses of all values, so that unused ones can be removed
+		const auto add_uses = [&uses](uint32_t *inst, int delta) {
+			for_each_id_operand(inst, [&uses, delta](uint32_t &id) {
+				if (id < uses.size())
+					uses[id] += delta;
+			});
+		};
+
+		for (size_t i = 0; i < insts.size(); ++i)
+			if (!removed[i])
+				add_uses(&words[insts[i]], 1);
+
+		std::vector<bool> removed_variables(variables.size());
+
+		for (bool changed = has_optimization(spirv_optimization::dead_code_elimination); changed;)
+		{
+			changed = false;
+
+			// Walk backwards, so that chains of unused instructions are removed in a single iteration
+			for (size_t i = insts.size(); i-- > 0;)
+			{
+				uint32_t *const inst = &words[insts[i]];
+				const spv::Op op = static_cast<spv::Op>(inst[0] & spv::OpCodeMask);
+
+				if (removed[i] || has_side_effects(inst) || uses[inst[2]] != 0)
+					continue;
+
+				// Any instruction other than a load that is passed a pointer to a local variable may write to it, so has to be kept even if its result is unused
+				if (op != spv::OpLoad && op != spv::OpAccessChain)
+				{
+					bool writes_variable = false;
+					for_each_id_operand(inst, [&](uint32_t &id) { writes_variable |= root(id) != 0; });
+					if (writes_variable)
+						continue;
+				}
+
+				add_uses(inst, -1);
+				removed[i] = true;
+				changed = true;
+			}
+
+			// Remove variables that are only ever written to, along with all those stores
+			std::unordered_map<spv::Id, uint32_t> num_stores;
+			for (size_t i = 0; i < insts.size(); ++i)
+				if (!removed[i] && static_cast<spv::Op>(words[insts[i]] & spv::OpCodeMask) == spv::OpStore)
+					num_stores[words[insts[i] + 1]]++;
+
+			std::unordered_set<spv::Id> write_only_variables;
+			for (size_t k = 0; k < variables.size(); ++k)
+			{
+				if (removed_variables[k])
+					continue;
+
+				const spv::Id variable = function.variables.words[variables[k] + 2];
+				if (const auto it = num_stores.find(variable); uses[variable] == (it != num_stores.end() ? it->second : 0))
+				{
+					write_only_variables.insert(variable);
+					removed_variables[k] = true;
+					changed = true;
+				}
+			}
+
+			if (write_only_variables.empty())
+				continue;
+
+			for (size_t i = 0; i < insts.size(); ++i)
+			{
+				if (!removed[i] && static_cast<spv::Op>(words[insts[i]] & spv::OpCodeMask) == spv::OpStore && write_only_variables.count(words[insts[i] + 1]))
+				{
+					add_uses(&words[insts[i]], -1);
+					removed[i] = true;
+				}
+			}
+		}
+
+		// Reset use counts, so they can be reused for the next function
+		for (size_t i = 0; i < insts.size(); ++i)
+			if (!removed[i])
+				add_uses(&words[insts[i]], -1);
+
+		spirv_basic_block definition;
+		definition.words.reserve(words.size());
+		for (size_t i = 0; i < insts.size(); ++i)
+			if (!removed[i])
+				definition.append(function.definition, insts[i]);
+		function.definition = std::move(definition);
+
+		spirv_basic_block variables_block;
+		for (size_t offset = 0, k = 0; offset < function.variables.words.size(); offset += function.variables.words[offset] >> spv::WordCountShift)
+		{
+			if (function.variables.op(offset) == spv::OpVariable && removed_variables[k++])
+				continue;
+			variables_block.append(function.variables, offset);
+		}
+		function.variables = std::move(variables_block);
+	}
+
+	bool has_optimization(spirv_optimization pass) const
+	{
+		return (_optimization & pass) != spirv_optimization::none;
+	}
+
+	/// <summary>
+	/// Run the selected optimization passes on the entire module: dead function and variable elimination, block merging, store-to-load forwarding, constant folding and dead code elimination.
+	/// </summary>
+	void optimize()
+	{
+		// Functions are not directly referenced by the list, so look them up by the result of their declaration
+		std::unordered_map<spv::Id, function_blocks *> function_lookup;
+		for (function_blocks &function : _functions_blocks)
+			for (size_t offset = 0; offset < function.declaration.words.size(); offset += function.declaration.words[offset] >> spv::WordCountShift)
+				if (function.declaration.op(offset) == spv::OpFunction)
+					function_lookup.emplace(function.declaration.words[offset + 2], &function);
+
+		// Find all functions that are reachable from an entry point
+		std::vector<spv::Id> pending;
+		std::unordered_set<spv::Id> reachable;
+		for (size_t offset = 0; offset < _entries.words.size(); offset += _entries.words[offset] >> spv::WordCountShift)
+			pending.push_back(_entries.words[offset + 2]);
+
+		while (!pending.empty())
+		{
+			const spv::Id id = pending.back();
+			pending.pop_back();
+
+			if (!reachable.insert(id).second)
+				continue;
+
+			const spirv_basic_block &definition = function_lookup.at(id)->definition;
+			for (size_t offset = 0; offset < definition.words.size(); offset += definition.words[offset] >> spv::WordCountShift)
+				if (definition.op(offset) == spv::OpFunctionCall)
+					pending.push_back(definition.words[offset + 3]);
+		}
+
+		for (const auto &[id, function] : function_lookup)
+		{
+			if (reachable.find(id) != reachable.end() || !has_optimization(spirv_optimization::dead_function_elimination))
+				continue;
+
+			function->declaration.words.clear();
+			function->variables.words.clear();
+			function->definition.words.clear();
+		}
+
+		// Build reverse lookups for types and constants, so that constant expressions can be evaluated
+		std::unordered_map<spv::Id, type> types;
+		for (const auto &[key, id] : _type_lookup)
+			if (!key.is_ptr && key.array_stride == 0)
+				types.emplace(id, key.type);
+		std::unordered_map<spv::Id, const constant_lookup *> constants;
+		for (const auto &[key, id] : _constant_lookup)
+			constants.emplace(id, &key);
+
+		std::vector<spv::Id> replacements(_next_id);
+		std::vector<spv::Id> pointer_roots(_next_id);
+		std::vector<uint32_t> uses(_next_id);
+
+		for (function_blocks &function : _functions_blocks)
+		{
+			if (function.definition.words.empty())
+				continue;
+
+			if (has_optimization(spirv_optimization::block_merging))
+				merge_blocks(function.definition);
+			optimize_function(function, types, constants, replacements, pointer_roots, uses);
+		}
+
+		// Keep track of all IDs that are still defined and referenced after the optimizations above
+		std::vector<bool> defined(_next_id), referenced(_next_id);
+
+		const auto mark_defined = [&defined](const spirv_basic_block &block) {
+			for (size_t offset = 0; offset < block.words.size(); offset += block.words[offset] >> spv::WordCountShift)
+				if (const uint32_t result = result_offset(block.op(offset)); result != 0)
+					defined[block.words[offset + result]] = true;
+		};
+		const auto mark_referenced = [&referenced](spirv_basic_block &block) {
+			for (size_t offset = 0; offset < block.words.size(); offset += block.words[offset] >> spv::WordCountShift)
+				for_each_id_operand(&block.words[offset], [&referenced](uint32_t &id) { referenced[id] = true; });
+		};
+
+		for (function_blocks &function : _functions_blocks)
+		{
+			mark_defined(function.declaration);
+			mark_defined(function.variables);
+			mark_defined(function.definition);
+			mark_referenced(function.variables);
+			mark_referenced(function.definition);
+		}
+
+		// Remove global variables that are no longer referenced by any function (except for inputs and outputs, which are part of the entry point interface)
+		spirv_basic_block variables;
+		for (size_t offset = 0, line = spirv_basic_block::npos; offset < _variables.words.size(); offset += _variables.words[offset] >> spv::WordCountShift)
+		{
+			if (_variables.op(offset) == spv::OpLine)
+			{
+				// Only keep debug information if the variable that follows is kept as well
+				line = offset;
+				continue;
+			}
+
+			if (_variables.op(offset) == spv::OpVariable)
+			{
+				const spv::StorageClass storage = static_cast<spv::StorageClass>(_variables.words[offset + 3]);
+				if (!referenced[_variables.words[offset + 2]] && storage != spv::StorageClassInput && storage != spv::StorageClassOutput && has_optimization(spirv_optimization::dead_function_elimination))
+				{
+					line = spirv_basic_block::npos;
+					continue;
+				}
+			}
+
+			if (line != spirv_basic_block::npos)
+				variables.append(_variables, line);
+			line = spirv_basic_block::npos;
+
+			variables.append(_variables, offset);
+		}
+		_variables = std::move(variables);
+
+		mark_defined(_types_and_constants);
+		mark_defined(_variables);
+
+		// Remove debug names and decorations of everything that was removed above
+		const auto remove_undefined_targets = [&defined](spirv_basic_block &block) {
+			spirv_basic_block result;
+			for (size_t offset = 0; offset < block.words.size(); offset += block.words[offset] >> spv::WordCountShift)
+				if (defined[block.words[offset + 1]])
+					result.append(block, offset);
+			block = std::move(result);
+		};
+
+		remove_undefined_targets(_debug_b);
+		remove_undefined_targets(_annotations);
+
+#ifndef NDEBUG
+		// Validate that all references inside functions still point to a definition
+		mark_defined(_debug_a); // OpString
+		defined[_glsl_ext] = true;
+		for (function_blocks &function : _functions_blocks)
+			for (size_t offset = 0; offset < function.definition.words.size(); offset += function.definition.words[offset] >> spv::WordCountShift)
+				for_each_id_operand(&function.definition.words[offset], [&defined](uint32_t &id) { assert(id < defined.size() && defined[id]); });
+#endif
 	}
 
 	void write_result(module &module) override
@@ -243,97 +1312,115 @@ private:
 		// First initialize the UBO type now that all member types are known
 		if (_global_ubo_type != 0)
 		{
-			spirv_instruction &type_inst = add_instruction_without_result(spv::OpTypeStruct, _types_and_constants);
-			type_inst.add(_global_ubo_types.begin(), _global_ubo_types.end());
-			type_inst.result = _global_ubo_type;
+			if (_pack_uniforms)
+			{
+				pack_uniforms([](const uniform_info &info, uint32_t end) { return align_up(end, uniform_alignment(info.type)); });
+
+				// Members of the UBO type are in the same order as the uniform list, but the layout is decorated explicitly, so their order does not need to match the offsets
+				assert(_global_ubo_types.size() == _module.uniforms.size());
+				for (uint32_t member_index = 0; member_index < _module.uniforms.size(); ++member_index)
+					add_member_decoration(_global_ubo_type, member_index, spv::DecorationOffset, { _module.uniforms[member_index].offset });
+			}
 
-			spirv_instruction &variable_inst = add_instruction_without_result(spv::OpVariable, _variables);
-			variable_inst.add(spv::StorageClassUniform);
-			variable_inst.type = convert_type({ type::t_struct, 0, 0, type::q_uniform, 0, _global_ubo_type }, true, spv::StorageClassUniform);
-			variable_inst.result = _global_ubo_variable;
+			_types_and_constants.add_instruction(spv::OpTypeStruct, 0, _global_ubo_type)
+				.add(_global_ubo_types.begin(), _global_ubo_types.end());
 
-			add_name(variable_inst.result, "$Globals");
+			const spv::Id ubo_ptr_type = convert_type({ type::t_struct, 0, 0, type::q_uniform, 0, _global_ubo_type }, true, spv::StorageClassUniform);
+			_variables.add_instruction(spv::OpVariable, ubo_ptr_type, _global_ubo_variable)
+				.add(spv::StorageClassUniform);
+
+			add_name(_global_ubo_variable, "$Globals");
 		}
 
+		if (_optimization != spirv_optimization::none)
+			optimize();
+
 		module = std::move(_module);
 
-		// Write SPIRV header info
-		module.spirv.push_back(spv::MagicNumber);
-		module.spirv.push_back(0x10300); // Force SPIR-V 1.3
-		module.spirv.push_back(0u); // Generator magic number, see https://www.khronos.org/registry/spir-v/api/spir-v.xml
-		module.spirv.push_back(_next_id); // Maximum ID
-		module.spirv.push_back(0u); // Reserved for instruction schema
+		spirv_basic_block preamble;
 
 		// All capabilities
-		spirv_instruction(spv::OpCapability)
-			.add(spv::CapabilityShader) // Implicitly declares the Matrix capability too
-			.write(module.spirv);
+		preamble.add_instruction(spv::OpCapability)
+			.add(spv::CapabilityShader); // Implicitly declares the Matrix capability too
 
 		for (spv::Capability capability : _capabilities)
-			spirv_instruction(spv::OpCapability)
-				.add(capability)
-				.write(module.spirv);
+			preamble.add_instruction(spv::OpCapability)
+				.add(capability);
 
 		// Optional extension instructions
-		spirv_instruction(spv::OpExtInstImport, _glsl_ext)
-			.add_string("GLSL.std.450") // Import GLSL extension
-			.write(module.spirv);
+		preamble.add_instruction(spv::OpExtInstImport, 0, _glsl_ext)
+			.add_string("GLSL.std.450"); // Import GLSL extension
 
 		// Single required memory model instruction
-		spirv_instruction(spv::OpMemoryModel)
+		preamble.add_instruction(spv::OpMemoryModel)
 			.add(spv::AddressingModelLogical)
-			.add(spv::MemoryModelGLSL450)
-			.write(module.spirv);
+			.add(spv::MemoryModelGLSL450);
+
+		spirv_basic_block source;
+		source.add_instruction(spv::OpSource)
+			.add(spv::SourceLanguageUnknown) // ReShade FX is not a reserved token at the moment
+			.add(0); // Language version, TODO: Maybe fill in ReShade version here?
+
+		size_t num_words = 5 + preamble.words.size() + _entries.words.size() + _execution_modes.words.size() + source.words.size() +
+			_annotations.words.size() + _types_and_constants.words.size() + _variables.words.size();
+		if (_debug_info)
+			num_words += _debug_a.words.size() + _debug_b.words.size();
+		for (const auto &function : _functions_blocks)
+			if (!function.definition.words.empty())
+				num_words += function.declaration.words.size() + function.variables.words.size() + function.definition.words.size();
+
+		module.spirv.reserve(num_words);
+
+		const auto write = [&module](const spirv_basic_block &block) {
+			module.spirv.insert(module.spirv.end(), block.words.begin(), block.words.end());
+		};
+
+		// Write SPIRV header info
+		module.spirv.push_back(spv::MagicNumber);
+		module.spirv.push_back(0x10300); // Force SPIR-V 1.3
+		module.spirv.push_back(0u); // Generator magic number, see https://www.khronos.org/registry/spir-v/api/spir-v.xml
+		module.spirv.push_back(_next_id); // Maximum ID
+		module.spirv.push_back(0u); // Reserved for instruction schema
+
+		write(preamble);
 
 		// All entry point declarations
-		for (const auto &node : _entries.instructions)
-			node.write(module.spirv);
+		write(_entries);
 
 		// All execution mode declarations
-		for (const auto &node : _execution_modes.instructions)
-			node.write(module.spirv);
+		write(_execution_modes);
 
-		spirv_instruction(spv::OpSource)
-			.add(spv::SourceLanguageUnknown) // ReShade FX is not a reserved token at the moment
-			.add(0) // Language version, TODO: Maybe fill in ReShade version here?
-			.write(module.spirv);
+		write(source);
 
 		if (_debug_info)
 		{
 			// All debug instructions
-			for (const auto &node : _debug_a.instructions)
-				node.write(module.spirv);
-			for (const auto &node : _debug_b.instructions)
-				node.write(module.spirv);
+			write(_debug_a);
+			write(_debug_b);
 		}
 
 		// All annotation instructions
-		for (const auto &node : _annotations.instructions)
-			node.write(module.spirv);
+		write(_annotations);
 
 		// All type declarations
-		for (const auto &node : _types_and_constants.instructions)
-			node.write(module.spirv);
-		for (const auto &node : _variables.instructions)
-			node.write(module.spirv);
+		write(_types_and_constants);
+		write(_variables);
 
 		// All function definitions
 		for (const auto &function : _functions_blocks)
 		{
-			if (function.definition.instructions.empty())
+			if (function.definition.words.empty())
 				continue;
 
-			for (const auto &node : function.declaration.instructions)
-				node.write(module.spirv);
+			write(function.declaration);
 
 			// Grab first label and move it in front of variable declarations
-			function.definition.instructions.front().write(module.spirv);
-			assert(function.definition.instructions.front().op == spv::OpLabel);
+			assert(function.definition.op(0) == spv::OpLabel);
+			const auto label_end = function.definition.words.begin() + (function.definition.words[0] >> spv::WordCountShift);
+			module.spirv.insert(module.spirv.end(), function.definition.words.begin(), label_end);
 
-			for (const auto &node : function.variables.instructions)
-				node.write(module.spirv);
-			for (auto it = function.definition.instructions.begin() + 1; it != function.definition.instructions.end(); ++it)
-				it->write(module.spirv);
+			write(function.variables);
+			module.spirv.insert(module.spirv.end(), label_end, function.definition.words.end());
 		}
 	}
 
@@ -356,12 +1443,9 @@ private:
 
 		const type_lookup lookup { info, is_ptr, array_stride, { storage, format } };
 
-		{	const auto it = std::find_if(_type_lookup.begin(), _type_lookup.end(),
-				[&lookup](const auto &lookup_it) {
-					return lookup_it.first == lookup; });
-			if (it != _type_lookup.end())
-				return it->second;
-		}
+		if (const auto it = _type_lookup.find(lookup);
+			it != _type_lookup.end())
+			return it->second;
 
 		spv::Id type, elem_type;
 		if (is_ptr)
@@ -506,18 +1590,17 @@ private:
 			}
 		}
 
-		_type_lookup.push_back({ lookup, type });
+		_type_lookup.emplace(lookup, type);
 
 		return type;
 	}
 	spv::Id convert_type(const function_blocks &info)
 	{
-		{	const auto it = std::find_if(_function_type_lookup.begin(), _function_type_lookup.end(),
-				[&lookup = info](const auto &lookup_it) {
-					return lookup_it.first == lookup; });
-			if (it != _function_type_lookup.end())
-				return it->second;
-		}
+		function_type_lookup lookup { info.return_type, info.param_types };
+
+		if (const auto it = _function_type_lookup.find(lookup);
+			it != _function_type_lookup.end())
+			return it->second;
 
 		auto return_type = convert_type(info.return_type);
 		assert(return_type != 0);
@@ -527,11 +1610,11 @@ private:
 		for (const type &param_type : info.param_types)
 			param_type_ids.push_back(convert_type(param_type, true));
 
-		spirv_instruction &inst = add_instruction(spv::OpTypeFunction, 0, _types_and_constants);
+		spirv_instruction inst = add_instruction(spv::OpTypeFunction, 0, _types_and_constants);
 		inst.add(return_type);
 		inst.add(param_type_ids.begin(), param_type_ids.end());
 
-		_function_type_lookup.push_back({ info, inst.result });;
+		_function_type_lookup.emplace(std::move(lookup), inst.result);
 
 		return inst.result;
 	}
@@ -720,6 +1803,7 @@ private:
 				add_member_decoration(info.definition, index, spv::DecorationRelaxedPrecision);
 		}
 
+		add_lookup_index(info.definition, _structs.size());
 		_structs.push_back(info);
 
 		return info.definition;
@@ -729,6 +1813,7 @@ private:
 		info.id = make_id(); // Need to create an unique ID here too, so that the symbol lookup for textures works
 		info.binding = ~0u;
 
+		add_lookup_index(info.id, _module.textures.size());
 		_module.textures.push_back(info);
 
 		return info.id;
@@ -742,6 +1827,7 @@ private:
 		add_decoration(info.id, spv::DecorationBinding, { info.binding });
 		add_decoration(info.id, spv::DecorationDescriptorSet, { 1 });
 
+		add_lookup_index(info.id, _module.samplers.size());
 		_module.samplers.push_back(info);
 
 		return info.id;
@@ -754,6 +1840,7 @@ private:
 		add_decoration(info.id, spv::DecorationBinding, { info.binding });
 		add_decoration(info.id, spv::DecorationDescriptorSet, { 2 });
 
+		add_lookup_index(info.id, _module.storages.size());
 		_module.storages.push_back(info);
 
 		return info.id;
@@ -766,11 +1853,29 @@ private:
 
 			add_name(res, info.name.c_str());
 
-			const auto add_spec_constant = [this](const spirv_instruction &inst, const uniform_info &info, const constant &initializer_value, size_t initializer_offset) {
-				assert(inst.op == spv::OpSpecConstant || inst.op == spv::OpSpecConstantTrue || inst.op == spv::OpSpecConstantFalse);
+			// Specialization constants are encoded as [opcode][result type][result][operands...]
+			const spirv_basic_block &constants = _types_and_constants;
+			const auto num_operands = [&constants](size_t offset) {
+				return static_cast<size_t>(constants.words[offset] >> spv::WordCountShift) - 3;
+			};
+			const auto find_spec_constant = [&constants](spv::Id result) {
+				size_t offset = 0;
+				for (; offset < constants.words.size(); offset += constants.words[offset] >> spv::WordCountShift)
+				{
+					const spv::Op op = constants.op(offset);
+					if ((op == spv::OpSpecConstant || op == spv::OpSpecConstantTrue || op == spv::OpSpecConstantFalse || op == spv::OpSpecConstantComposite) &&
+						constants.words[offset + 2] == result)
+						break;
+				}
+				assert(offset < constants.words.size());
+				return offset;
+			};
+
+			const auto add_spec_constant = [this, &constants](size_t offset, const uniform_info &info, const constant &initializer_value, size_t initializer_offset) {
+				assert(constants.op(offset) == spv::OpSpecConstant || constants.op(offset) == spv::OpSpecConstantTrue || constants.op(offset) == spv::OpSpecConstantFalse);
 
 				const uint32_t spec_id = static_cast<uint32_t>(_module.spec_constants.size());
-				add_decoration(inst.result, spv::DecorationSpecId, { spec_id });
+				add_decoration(constants.words[offset + 2], spv::DecorationSpecId, { spec_id });
 
 				uniform_info scalar_info = info;
 				scalar_info.type.rows = 1;
@@ -783,8 +1888,8 @@ private:
 				_module.spec_constants.push_back(scalar_info);
 			};
 
-			const spirv_instruction &base_inst = _types_and_constants.instructions.back();
-			assert(base_inst.result == res);
+			const size_t base_inst = _types_and_constants.back();
+			assert(constants.words[base_inst + 2] == res);
 
 			// External specialization constants need to be scalars
 			if (info.type.is_scalar())
@@ -793,38 +1898,35 @@ private:
 			}
 			else
 			{
-				assert(base_inst.op == spv::OpSpecConstantComposite);
+				assert(constants.op(base_inst) == spv::OpSpecConstantComposite);
 
 				// Add each individual scalar component of the constant as a separate external specialization constant
-				for (size_t i = 0; i < (info.type.is_array() ? base_inst.operands.size() : 1); ++i)
+				for (size_t i = 0; i < (info.type.is_array() ? num_operands(base_inst) : 1); ++i)
 				{
 					constant initializer_value = info.initializer_value;
-					spirv_instruction elem_inst = base_inst;
+					size_t elem_inst = base_inst;
 
 					if (info.type.is_array())
 					{
-						elem_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-							[elem = base_inst.operands[i]](const auto &it) { return it.result == elem; });
+						elem_inst = find_spec_constant(constants.words[base_inst + 3 + i]);
 
-						assert(initializer_value.array_data.size() == base_inst.operands.size());
+						assert(initializer_value.array_data.size() == num_operands(base_inst));
 						initializer_value = initializer_value.array_data[i];
 					}
 
-					for (size_t row = 0; row < elem_inst.operands.size(); ++row)
+					for (size_t row = 0; row < num_operands(elem_inst); ++row)
 					{
-						const spirv_instruction &row_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-							[elem = elem_inst.operands[row]](const auto &it) { return it.result == elem; });
+						const size_t row_inst = find_spec_constant(constants.words[elem_inst + 3 + row]);
 
-						if (row_inst.op != spv::OpSpecConstantComposite)
+						if (constants.op(row_inst) != spv::OpSpecConstantComposite)
 						{
 							add_spec_constant(row_inst, info, initializer_value, row);
 							continue;
 						}
 
-						for (size_t col = 0; col < row_inst.operands.size(); ++col)
+						for (size_t col = 0; col < num_operands(row_inst); ++col)
 						{
-							const spirv_instruction &col_inst = *std::find_if(_types_and_constants.instructions.rbegin(), _types_and_constants.instructions.rend(),
-								[elem = row_inst.operands[col]](const auto &it) { return it.result == elem; });
+							const size_t col_inst = find_spec_constant(constants.words[row_inst + 3 + col]);
 
 							add_spec_constant(col_inst, info, initializer_value, row * info.type.cols + col);
 						}
@@ -851,20 +1953,16 @@ private:
 				add_decoration(_global_ubo_variable, spv::DecorationBinding, { 0 });
 			}
 
-			uint32_t alignment = (info.type.rows == 3 ? 4 : info.type.rows) * 4;
+			const uint32_t alignment = uniform_alignment(info.type);
 			info.size = info.type.rows * 4;
 
 			uint32_t array_stride = 16;
 			const uint32_t matrix_stride = 16;
 
 			if (info.type.is_matrix())
-			{
-				alignment = matrix_stride;
 				info.size = info.type.rows * matrix_stride;
-			}
 			if (info.type.is_array())
 			{
-				alignment = array_stride;
 				array_stride = align_up(info.size, array_stride);
 				// Uniform block rules do not permit anything in the padding of an array
 				info.size = array_stride * info.type.array_length;
@@ -887,7 +1985,9 @@ private:
 
 			add_member_name(_global_ubo_type, member_index, info.name.c_str());
 
-			add_member_decoration(_global_ubo_type, member_index, spv::DecorationOffset, { info.offset });
+			// The offset is not final yet if the layout is packed later, in which case this is decorated when writing the result
+			if (!_pack_uniforms)
+				add_member_decoration(_global_ubo_type, member_index, spv::DecorationOffset, { info.offset });
 
 			if (info.type.is_matrix())
 			{
@@ -902,6 +2002,14 @@ private:
 			return 0xF0000000 | member_index;
 		}
 	}
+	static uint32_t uniform_alignment(const type &type)
+	{
+		// Arrays and matrices are aligned to the array and matrix stride, everything else follows the standard uniform buffer layout rules
+		if (type.is_matrix() || type.is_array())
+			return 16;
+		return (type.rows == 3 ? 4 : type.rows) * 4;
+	}
+
 	id   define_variable(const location &loc, const type &type, std::string name, bool global, id initializer_value) override
 	{
 		spv::StorageClass storage = spv::StorageClassFunction;
@@ -923,7 +2031,7 @@ private:
 
 		spv::Id res;
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpVariable
-		spirv_instruction &inst = add_instruction(spv::OpVariable, convert_type(type, true, storage, format), block, res)
+		spirv_instruction inst = add_instruction(spv::OpVariable, convert_type(type, true, storage, format), block, res)
 			.add(storage);
 
 		if (initializer_value != 0)
@@ -983,6 +2091,7 @@ private:
 			add_name(param.definition, param.name.c_str());
 		}
 
+		add_lookup_index(info.definition, _functions.size());
 		_functions.push_back(std::make_unique<function_info>(info));
 
 		return info.definition;
@@ -1004,11 +2113,11 @@ private:
 				return;
 		}
 
-		_module.entry_points.push_back({ func.unique_name, stype });
+		_module.entry_points.push_back({ func.unique_name, func.name, stype, std::string() });
 
 		spv::Id position_variable = 0, point_size_variable = 0;
 		std::vector<spv::Id> inputs_and_outputs;
-		std::vector<expression> call_params;
+		expression_list call_params;
 
 		// Generate the glue entry point function
 		function_info entry_point;
@@ -1332,7 +2441,9 @@ private:
 				it != _storage_lookup.end())
 				storage = it->second;
 
-			spirv_instruction *access_chain = nullptr;
+			// The result type of an access chain is only known after all indices were added, so collect them before emitting the instruction
+			spv::Id access_chain = 0;
+			std::vector<spv::Id> access_chain_operands;
 
 			// Check if this is a uniform variable (see 'define_uniform' function above) and dereference it
 			if (result & 0xF0000000)
@@ -1345,9 +2456,9 @@ private:
 				if (is_uniform_bool)
 					base_type.base = type::t_uint;
 
-				access_chain = &add_instruction(spv::OpAccessChain)
-					.add(_global_ubo_variable)
-					.add(emit_constant(member_index));
+				access_chain = make_id();
+				access_chain_operands.push_back(_global_ubo_variable);
+				access_chain_operands.push_back(emit_constant(member_index));
 			}
 
 			// Any indexing expressions can be resolved during load with an 'OpAccessChain' already
@@ -1356,12 +2467,12 @@ private:
 				exp.chain[0].op == expression::operation::op_dynamic_index ||
 				exp.chain[0].op == expression::operation::op_constant_index))
 			{
-				// Ensure that 'access_chain' cannot get invalidated by calls to 'emit_constant' or 'convert_type'
-				assert(_current_block_data != &_types_and_constants);
-
 				// Use access chain from uniform if possible, otherwise create new one
-				if (access_chain == nullptr) access_chain =
-					&add_instruction(spv::OpAccessChain).add(result); // Base
+				if (access_chain == 0)
+				{
+					access_chain = make_id();
+					access_chain_operands.push_back(result); // Base
+				}
 
 				// Ignore first index into 1xN matrices, since they were translated to a vector type in SPIR-V
 				if (exp.chain[0].from.rows == 1 && exp.chain[0].from.cols > 1)
@@ -1371,18 +2482,20 @@ private:
 					exp.chain[i].op == expression::operation::op_member ||
 					exp.chain[i].op == expression::operation::op_dynamic_index ||
 					exp.chain[i].op == expression::operation::op_constant_index); ++i)
-					access_chain->add(exp.chain[i].op == expression::operation::op_dynamic_index ?
+					access_chain_operands.push_back(exp.chain[i].op == expression::operation::op_dynamic_index ?
 						exp.chain[i].index :
 						emit_constant(exp.chain[i].index)); // Indexes
 
 				base_type = exp.chain[i - 1].to;
-				access_chain->type = convert_type(base_type, true, storage.first, storage.second); // Last type is the result
-				result = access_chain->result;
+				_current_block_data->add_instruction(spv::OpAccessChain, convert_type(base_type, true, storage.first, storage.second), access_chain) // Last type is the result
+					.add(access_chain_operands.begin(), access_chain_operands.end());
+				result = access_chain;
 			}
-			else if (access_chain != nullptr)
+			else if (access_chain != 0)
 			{
-				access_chain->type = convert_type(base_type, true, storage.first, storage.second, base_type.is_array() ? 16u : 0u);
-				result = access_chain->result;
+				_current_block_data->add_instruction(spv::OpAccessChain, convert_type(base_type, true, storage.first, storage.second, base_type.is_array() ? 16u : 0u), access_chain)
+					.add(access_chain_operands.begin(), access_chain_operands.end());
+				result = access_chain;
 			}
 
 			result = add_instruction(spv::OpLoad, convert_type(base_type, false, spv::StorageClassFunction, storage.second))
@@ -1509,7 +2622,7 @@ private:
 							scalar_type.rows = 1;
 							scalar_type.cols = 1;
 
-							spirv_instruction &node = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type))
+							spirv_instruction node = add_instruction(spv::OpCompositeExtract, convert_type(scalar_type))
 								.add(result);
 
 							if (op.from.rows > 1) // Matrix types with a single row are actually vectors, so they don't need the extra index
@@ -1520,7 +2633,7 @@ private:
 							components[c] = node.result;
 						}
 
-						spirv_instruction &node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
+						spirv_instruction node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
 						for (unsigned int c = 0; c < 4 && op.swizzle[c] >= 0; ++c)
 							node.add(components[c]);
 						result = node.result;
@@ -1528,7 +2641,7 @@ private:
 					}
 					else if (op.from.is_vector())
 					{
-						spirv_instruction &node = add_instruction(spv::OpVectorShuffle, convert_type(op.to))
+						spirv_instruction node = add_instruction(spv::OpVectorShuffle, convert_type(op.to))
 							.add(result) // Vector 1
 							.add(result); // Vector 2
 						for (unsigned int c = 0; c < 4 && op.swizzle[c] >= 0; ++c)
@@ -1538,7 +2651,7 @@ private:
 					}
 					else
 					{
-						spirv_instruction &node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
+						spirv_instruction node = add_instruction(spv::OpCompositeConstruct, convert_type(op.to));
 						for (unsigned int c = 0; c < op.to.rows; ++c)
 							node.add(result);
 						result = node.result;
@@ -1549,7 +2662,7 @@ private:
 				{
 					assert(op.swizzle[1] < 0);
 
-					spirv_instruction &node = add_instruction(spv::OpCompositeExtract, convert_type(op.to))
+					spirv_instruction node = add_instruction(spv::OpCompositeExtract, convert_type(op.to))
 						.add(result); // Composite
 					if (op.from.rows > 1)
 					{
@@ -1606,7 +2719,7 @@ private:
 
 					if (base_type.is_vector())
 					{
-						spirv_instruction &node = add_instruction(spv::OpVectorShuffle, convert_type(base_type))
+						spirv_instruction node = add_instruction(spv::OpVectorShuffle, convert_type(base_type))
 							.add(result) // Vector 1
 							.add(value); // Vector 2
 
@@ -1623,7 +2736,7 @@ private:
 					{
 						assert(op.swizzle[1] < 0);
 
-						spirv_instruction &node = add_instruction(spv::OpCompositeInsert, convert_type(base_type))
+						spirv_instruction node = add_instruction(spv::OpCompositeInsert, convert_type(base_type))
 							.add(value) // Object
 							.add(result); // Composite
 
@@ -1672,11 +2785,10 @@ private:
 			it != _storage_lookup.end())
 			storage = it->second;
 
-		// Ensure that 'access_chain' cannot get invalidated by calls to 'emit_constant' or 'convert_type'
-		assert(_current_block_data != &_types_and_constants);
-
-		spirv_instruction *access_chain =
-			&add_instruction(spv::OpAccessChain).add(exp.base); // Base
+		// The result type of an access chain is only known after all indices were added, so collect them before emitting the instruction
+		const spv::Id access_chain = make_id();
+		std::vector<spv::Id> access_chain_operands;
+		access_chain_operands.push_back(exp.base); // Base
 
 		// Ignore first index into 1xN matrices, since they were translated to a vector type in SPIR-V
 		if (exp.chain[0].from.rows == 1 && exp.chain[0].from.cols > 1)
@@ -1686,12 +2798,13 @@ private:
 			exp.chain[i].op == expression::operation::op_member ||
 			exp.chain[i].op == expression::operation::op_dynamic_index ||
 			exp.chain[i].op == expression::operation::op_constant_index); ++i)
-			access_chain->add(exp.chain[i].op == expression::operation::op_dynamic_index ?
+			access_chain_operands.push_back(exp.chain[i].op == expression::operation::op_dynamic_index ?
 				exp.chain[i].index :
 				emit_constant(exp.chain[i].index)); // Indexes
 
-		access_chain->type = convert_type(exp.chain[i - 1].to, true, storage.first, storage.second); // Last type is the result
-		return access_chain->result;
+		_current_block_data->add_instruction(spv::OpAccessChain, convert_type(exp.chain[i - 1].to, true, storage.first, storage.second), access_chain) // Last type is the result
+			.add(access_chain_operands.begin(), access_chain_operands.end());
+		return access_chain;
 	}
 
 	id   emit_constant(uint32_t value)
@@ -1718,16 +2831,9 @@ private:
 	{
 		if (!spec_constant) // Specialization constants cannot reuse other constants
 		{
-			const auto it = std::find_if(_constant_lookup.begin(), _constant_lookup.end(),
-				[&type, &data](auto &x) {
-					if (!(std::get<0>(x) == type && std::memcmp(&std::get<1>(x).as_uint[0], &data.as_uint[0], sizeof(uint32_t) * 16) == 0 && std::get<1>(x).array_data.size() == data.array_data.size()))
-						return false;
-					for (size_t i = 0; i < data.array_data.size(); ++i)
-						if (std::memcmp(&std::get<1>(x).array_data[i].as_uint[0], &data.array_data[i].as_uint[0], sizeof(uint32_t) * 16) != 0)
-							return false;
-					return true; });
-			if (it != _constant_lookup.end())
-				return std::get<2>(*it); // Re-use existing constant instead of duplicating the definition
+			if (const auto it = _constant_lookup.find({ type, data });
+				it != _constant_lookup.end())
+				return it->second; // Re-use existing constant instead of duplicating the definition
 		}
 
 		spv::Id result;
@@ -1784,7 +2890,7 @@ private:
 			}
 			else
 			{
-				spirv_instruction &node = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants);
+				spirv_instruction node = add_instruction(spec_constant ? spv::OpSpecConstantComposite : spv::OpConstantComposite, convert_type(type), _types_and_constants);
 				for (unsigned int i = 0; i < type.rows; ++i)
 					node.add(rows[i]);
 
@@ -1810,7 +2916,7 @@ private:
 		if (spec_constant) // Keep track of all specialization constants
 			_spec_constants.insert(result);
 		else
-			_constant_lookup.push_back({ type, data, result });
+			_constant_lookup.emplace(constant_lookup { type, data }, result);
 
 		return result;
 	}
@@ -1836,7 +2942,7 @@ private:
 
 		add_location(loc, *_current_block_data);
 
-		spirv_instruction &inst = add_instruction(spv_op, convert_type(type));
+		spirv_instruction inst = add_instruction(spv_op, convert_type(type));
 		inst.add(val); // Operand
 
 		return inst.result;
@@ -1946,7 +3052,7 @@ private:
 					.add(row)
 					.result;
 
-				spirv_instruction &inst = add_instruction(spv_op, convert_type(vector_type));
+				spirv_instruction inst = add_instruction(spv_op, convert_type(vector_type));
 				inst.add(lhs_elem); // Operand 1
 				inst.add(rhs_elem); // Operand 2
 
@@ -1958,14 +3064,14 @@ private:
 				ids.push_back(inst.result);
 			}
 
-			spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(res_type));
+			spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(res_type));
 			inst.add(ids.begin(), ids.end());
 
 			return inst.result;
 		}
 		else
 		{
-			spirv_instruction &inst = add_instruction(spv_op, convert_type(res_type));
+			spirv_instruction inst = add_instruction(spv_op, convert_type(res_type));
 			inst.add(lhs); // Operand 1
 			inst.add(rhs); // Operand 2
 
@@ -1984,14 +3090,14 @@ private:
 
 		add_location(loc, *_current_block_data);
 
-		spirv_instruction &inst = add_instruction(spv::OpSelect, convert_type(type));
+		spirv_instruction inst = add_instruction(spv::OpSelect, convert_type(type));
 		inst.add(condition); // Condition
 		inst.add(true_value); // Object 1
 		inst.add(false_value); // Object 2
 
 		return inst.result;
 	}
-	id   emit_call(const location &loc, id function, const type &res_type, const std::vector<expression> &args) override
+	id   emit_call(const location &loc, id function, const type &res_type, const expression_list &args) override
 	{
 #ifndef NDEBUG
 		for (const expression &arg : args)
@@ -2000,14 +3106,14 @@ private:
 		add_location(loc, *_current_block_data);
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpFunctionCall
-		spirv_instruction &inst = add_instruction(spv::OpFunctionCall, convert_type(res_type));
+		spirv_instruction inst = add_instruction(spv::OpFunctionCall, convert_type(res_type));
 		inst.add(function); // Function
 		for (const expression &arg : args)
 			inst.add(arg.base); // Arguments
 
 		return inst.result;
 	}
-	id   emit_call_intrinsic(const location &loc, id intrinsic, const type &res_type, const std::vector<expression> &args) override
+	id   emit_call_intrinsic(const location &loc, id intrinsic, const type &res_type, const expression_list &args) override
 	{
 #ifndef NDEBUG
 		for (const expression &arg : args)
@@ -2029,7 +3135,7 @@ private:
 			return assert(false), 0;
 		}
 	}
-	id   emit_construct(const location &loc, const type &type, const std::vector<expression> &args) override
+	id   emit_construct(const location &loc, const type &type, const expression_list &args) override
 	{
 #ifndef NDEBUG
 		for (const expression &arg : args)
@@ -2050,7 +3156,7 @@ private:
 			// Turn the list of scalar arguments into a list of column vectors
 			for (size_t arg = 0; arg < args.size(); arg += vector_type.rows)
 			{
-				spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(vector_type));
+				spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(vector_type));
 				for (unsigned row = 0; row < vector_type.rows; ++row)
 					inst.add(args[arg + row].base);
 
@@ -2066,7 +3172,7 @@ private:
 				ids.push_back(arg.base);
 		}
 
-		spirv_instruction &inst = add_instruction(spv::OpCompositeConstruct, convert_type(type));
+		spirv_instruction inst = add_instruction(spv::OpCompositeConstruct, convert_type(type));
 		inst.add(ids.begin(), ids.end());
 
 		return inst.result;
@@ -2074,50 +3180,54 @@ private:
 
 	void emit_if(const location &loc, id, id condition_block, id true_statement_block, id false_statement_block, unsigned int selection_control) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = remove_merge_label();
 
 		// Add previous block containing the condition value first
-		_current_block_data->append(_block_data[condition_block]);
+		_current_block_data->append(std::move(_block_data[condition_block]));
 
-		spirv_instruction branch_inst = _current_block_data->instructions.back();
-		assert(branch_inst.op == spv::OpBranchConditional);
-		_current_block_data->instructions.pop_back();
+		// Remove the branch instruction too, since the structured control flow instruction has to be placed in front of it
+		const size_t branch_inst = _current_block_data->back();
+		assert(_current_block_data->op(branch_inst) == spv::OpBranchConditional);
+		const spv::Id condition = _current_block_data->words[branch_inst + 1];
+		const spv::Id true_label = _current_block_data->words[branch_inst + 2];
+		const spv::Id false_label = _current_block_data->words[branch_inst + 3];
+		_current_block_data->pop_back();
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpSelectionMerge)
-			.add(merge_label.result)
+			.add(merge_label)
 			.add(selection_control & 0x3); // 'SelectionControl' happens to match the flags produced by the parser
 
+		add_instruction_without_result(spv::OpBranchConditional)
+			.add(condition)
+			.add(true_label)
+			.add(false_label);
+
 		// Append all blocks belonging to the branch
-		_current_block_data->instructions.push_back(branch_inst);
-		_current_block_data->append(_block_data[true_statement_block]);
-		_current_block_data->append(_block_data[false_statement_block]);
+		_current_block_data->append(std::move(_block_data[true_statement_block]));
+		_current_block_data->append(std::move(_block_data[false_statement_block]));
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->add_instruction(spv::OpLabel, 0, merge_label);
 	}
 	id   emit_phi(const location &loc, id, id condition_block, id true_value, id true_statement_block, id false_value, id false_statement_block, const type &type) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = remove_merge_label();
 
 		// Add previous block containing the condition value first
-		_current_block_data->append(_block_data[condition_block]);
+		_current_block_data->append(std::move(_block_data[condition_block]));
 
 		if (true_statement_block != condition_block)
-			_current_block_data->append(_block_data[true_statement_block]);
+			_current_block_data->append(std::move(_block_data[true_statement_block]));
 		if (false_statement_block != condition_block)
-			_current_block_data->append(_block_data[false_statement_block]);
+			_current_block_data->append(std::move(_block_data[false_statement_block]));
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->add_instruction(spv::OpLabel, 0, merge_label);
 
 		add_location(loc, *_current_block_data);
 
 		// https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#OpPhi
-		spirv_instruction &inst = add_instruction(spv::OpPhi, convert_type(type))
+		spirv_instruction inst = add_instruction(spv::OpPhi, convert_type(type))
 			.add(true_value) // Variable 0
 			.add(true_statement_block) // Parent 0
 			.add(false_value) // Variable 1
@@ -2127,76 +3237,77 @@ private:
 	}
 	void emit_loop(const location &loc, id, id prev_block, id header_block, id condition_block, id loop_block, id continue_block, unsigned int loop_control) override
 	{
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = remove_merge_label();
 
 		// Add previous block first
-		_current_block_data->append(_block_data[prev_block]);
+		_current_block_data->append(std::move(_block_data[prev_block]));
 
 		// Fill header block
-		assert(_block_data[header_block].instructions.size() == 2);
-		_current_block_data->instructions.push_back(_block_data[header_block].instructions[0]);
-		assert(_current_block_data->instructions.back().op == spv::OpLabel);
+		const spirv_basic_block &header_block_data = _block_data[header_block];
+		assert(header_block_data.op(0) == spv::OpLabel);
+		const size_t header_branch_inst = header_block_data.words[0] >> spv::WordCountShift;
+		assert(header_block_data.op(header_branch_inst) == spv::OpBranch);
+		assert(header_branch_inst + (header_block_data.words[header_branch_inst] >> spv::WordCountShift) == header_block_data.words.size());
+
+		_current_block_data->append(header_block_data, 0);
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpLoopMerge)
-			.add(merge_label.result)
+			.add(merge_label)
 			.add(continue_block)
 			.add(loop_control & 0x3); // 'LoopControl' happens to match the flags produced by the parser
 
-		_current_block_data->instructions.push_back(_block_data[header_block].instructions[1]);
-		assert(_current_block_data->instructions.back().op == spv::OpBranch);
+		_current_block_data->append(header_block_data, header_branch_inst);
 
 		// Add condition block if it exists
 		if (condition_block != 0)
-			_current_block_data->append(_block_data[condition_block]);
+			_current_block_data->append(std::move(_block_data[condition_block]));
 
 		// Append loop body block before continue block
-		_current_block_data->append(_block_data[loop_block]);
-		_current_block_data->append(_block_data[continue_block]);
+		_current_block_data->append(std::move(_block_data[loop_block]));
+		_current_block_data->append(std::move(_block_data[continue_block]));
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->add_instruction(spv::OpLabel, 0, merge_label);
 	}
 	void emit_switch(const location &loc, id, id selector_block, id default_label, id default_block, const std::vector<id> &case_literal_and_labels, const std::vector<id> &case_blocks, unsigned int selection_control) override
 	{
 		assert(case_blocks.size() == case_literal_and_labels.size() / 2);
 
-		spirv_instruction merge_label = _current_block_data->instructions.back();
-		assert(merge_label.op == spv::OpLabel);
-		_current_block_data->instructions.pop_back();
+		const spv::Id merge_label = remove_merge_label();
 
 		// Add previous block containing the selector value first
-		_current_block_data->append(_block_data[selector_block]);
+		_current_block_data->append(std::move(_block_data[selector_block]));
 
-		spirv_instruction switch_inst = _current_block_data->instructions.back();
-		assert(switch_inst.op == spv::OpSwitch);
-		_current_block_data->instructions.pop_back();
+		// Remove the switch instruction too, since the structured control flow instruction has to be placed in front of it
+		const size_t switch_inst = _current_block_data->back();
+		assert(_current_block_data->op(switch_inst) == spv::OpSwitch);
+		const spv::Id selector = _current_block_data->words[switch_inst + 1];
+		_current_block_data->pop_back();
 
 		// Add structured control flow instruction
 		add_location(loc, *_current_block_data);
 		add_instruction_without_result(spv::OpSelectionMerge)
-			.add(merge_label.result)
+			.add(merge_label)
 			.add(selection_control & 0x3); // 'SelectionControl' happens to match the flags produced by the parser
 
 		// Update switch instruction to contain all case labels
-		switch_inst.operands[1] = default_label;
-		switch_inst.add(case_literal_and_labels.begin(), case_literal_and_labels.end());
+		add_instruction_without_result(spv::OpSwitch)
+			.add(selector)
+			.add(default_label)
+			.add(case_literal_and_labels.begin(), case_literal_and_labels.end());
 
 		// Append all blocks belonging to the switch
-		_current_block_data->instructions.push_back(switch_inst);
-
 		std::vector<id> blocks = case_blocks;
-		if (default_label != merge_label.result)
+		if (default_label != merge_label)
 			blocks.push_back(default_block);
 		// Eliminate duplicates (because of multiple case labels pointing to the same block)
 		std::sort(blocks.begin(), blocks.end());
 		blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
 		for (const id case_block : blocks)
-			_current_block_data->append(_block_data[case_block]);
+			_current_block_data->append(std::move(_block_data[case_block]));
 
-		_current_block_data->instructions.push_back(merge_label);
+		_current_block_data->add_instruction(spv::OpLabel, 0, merge_label);
 	}
 
 	bool is_in_function() const override { return _current_function != nullptr; }
@@ -2217,8 +3328,7 @@ private:
 
 		set_block(id);
 
-		add_instruction_without_result(spv::OpLabel)
-			.result = id;
+		_current_block_data->add_instruction(spv::OpLabel, 0, id);
 	}
 	id   leave_block_and_kill() override
 	{
@@ -2299,7 +3409,7 @@ private:
 	{
 		assert(is_in_function()); // Can only leave if there was a function to begin with
 
-		_current_function->definition = _block_data[_last_block];
+		_current_function->definition = std::move(_block_data[_last_block]);
 
 		// Append function end instruction
 		add_instruction_without_result(spv::OpFunctionEnd, _current_function->definition);
@@ -2308,7 +3418,7 @@ private:
 	}
 };
 
-codegen *reshadefx::create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y)
+codegen *reshadefx::create_codegen_spirv(bool vulkan_semantics, bool debug_info, bool uniforms_to_spec_constants, bool enable_16bit_types, bool flip_vert_y, spirv_optimization optimization, bool pack_uniforms)
 {
-	return new codegen_spirv(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y);
+	return new codegen_spirv(vulkan_semantics, debug_info, uniforms_to_spec_constants, enable_16bit_types, flip_vert_y, optimization, pack_uniforms);
 }
@@ -10,6 +10,19 @@
 #include <cstring> // memcpy, memset
 #include <algorithm> // std::min, std::max
 
+static thread_local std::pmr::memory_resource *s_parse_memory_resource = nullptr;
+
+std::pmr::memory_resource *reshadefx::get_parse_memory_resource()
+{
+	return s_parse_memory_resource != nullptr ? s_parse_memory_resource : std::pmr::new_delete_resource();
+}
+std::pmr::memory_resource *reshadefx::set_parse_memory_resource(std::pmr::memory_resource *resource)
+{
+	std::pmr::memory_resource *const previous = s_parse_memory_resource;
+	s_parse_memory_resource = resource;
+	return previous;
+}
+
 reshadefx::type reshadefx::type::merge(const type &lhs, const type &rhs)
 {
 	type result = { std::max(lhs.base, rhs.base) };
@@ -228,9 +241,12 @@ void reshadefx::expression::add_cast_operation(const reshadefx::type &cast_type)
 			if (!to.is_floating_point())
 				for (unsigned int i = 0; i < to.components(); ++i)
 					constant.as_uint[i] = static_cast<int>(constant.as_float[i]);
-			else
+			else if (from.is_signed())
 				for (unsigned int i = 0; i < to.components(); ++i)
 					constant.as_float[i] = static_cast<float>(constant.as_int[i]);
+			else
+				for (unsigned int i = 0; i < to.components(); ++i)
+					constant.as_float[i] = static_cast<float>(constant.as_uint[i]);
 		};
 
 		for (auto &element : constant.array_data)
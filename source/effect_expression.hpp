@@ -6,6 +6,7 @@
 #pragma once
 
 #include "effect_token.hpp"
+#include <memory_resource>
 
 namespace reshadefx
 {
@@ -125,6 +126,41 @@ namespace reshadefx
 		std::vector<constant> array_data;
 	};
 
+	/// <summary>
+	/// Get the memory resource that temporary data is allocated from while parsing on the calling thread.
+	/// This is the arena of the active parser, or the default heap resource if there is none.
+	/// </summary>
+	std::pmr::memory_resource *get_parse_memory_resource();
+	/// <summary>
+	/// Change the memory resource that temporary data is allocated from while parsing on the calling thread.
+	/// </summary>
+	/// <returns>The previous memory resource.</returns>
+	std::pmr::memory_resource *set_parse_memory_resource(std::pmr::memory_resource *resource);
+
+	/// <summary>
+	/// Allocator for data that only lives while parsing, which allocates from the memory resource that was active on the calling thread when it was constructed.
+	/// Copies of a container get the memory resource active at the time they are made, so data can be copied out of the parser safely.
+	/// </summary>
+	template <typename T>
+	struct parse_allocator
+	{
+		using value_type = T;
+
+		parse_allocator() : resource(get_parse_memory_resource()) {}
+		template <typename U>
+		parse_allocator(const parse_allocator<U> &other) : resource(other.resource) {}
+
+		T *allocate(size_t n) { return static_cast<T *>(resource->allocate(n * sizeof(T), alignof(T))); }
+		void deallocate(T *p, size_t n) { resource->deallocate(p, n * sizeof(T), alignof(T)); }
+
+		parse_allocator select_on_container_copy_construction() const { return parse_allocator(); }
+
+		friend bool operator==(const parse_allocator &lhs, const parse_allocator &rhs) { return lhs.resource == rhs.resource; }
+		friend bool operator!=(const parse_allocator &lhs, const parse_allocator &rhs) { return lhs.resource != rhs.resource; }
+
+		std::pmr::memory_resource *resource;
+	};
+
 	/// <summary>
 	/// Structures which keeps track of the access chain of an expression
 	/// </summary>
@@ -153,7 +189,7 @@ namespace reshadefx
 		bool is_lvalue = false;
 		bool is_constant = false;
 		reshadefx::location location;
-		std::vector<operation> chain;
+		std::vector<operation, parse_allocator<operation>> chain;
 
 		/// <summary>
 		/// Initialize the expression to a l-value.
@@ -222,4 +258,9 @@ namespace reshadefx
 		/// <param name="rhs">The constant to use as right-hand side of the binary operation.</param>
 		bool evaluate_constant_expression(reshadefx::tokenid op, const reshadefx::constant &rhs);
 	};
+
+	/// <summary>
+	/// List of expressions used for function call arguments and initializer lists.
+	/// </summary>
+	using expression_list = std::vector<expression, parse_allocator<expression>>;
 }
@@ -5,7 +5,18 @@
 
 #include "effect_lexer.hpp"
 #include <cassert>
-#include <unordered_map> // Used for static lookup tables
+#include <algorithm> // std::min
+#include <mutex>
+#include <array> // Used for static lookup tables
+#include <unordered_set>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define RESHADEFX_LEXER_SSE2 1
+	#include <emmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#endif
 
 using namespace reshadefx;
 
@@ -33,8 +44,69 @@ static const unsigned type_lookup[256] = {
 	IDENT, IDENT, IDENT,   '{',   '|',   '}',   '~',  0x00,  0x00,  0x00,
 };
 
+struct token_name
+{
+	tokenid id;
+	std::string_view name;
+};
+struct keyword
+{
+	std::string_view name;
+	tokenid id = tokenid::unknown;
+};
+
+/// <summary>
+/// Hash table that is filled in at compile time and looked up with the character range of an identifier, without allocating a string for it.
+/// </summary>
+template <size_t N>
+class keyword_table
+{
+	// Keep the load factor at or below 50% so that probe sequences stay short
+	static constexpr size_t size = [] { size_t size = 1; while (size < 2 * N) size *= 2; return size; }();
+
+public:
+	constexpr explicit keyword_table(const keyword (&list)[N]) : _entries()
+	{
+		for (const keyword &entry : list)
+		{
+			size_t index = hash(entry.name) & (size - 1);
+			while (!_entries[index].name.empty())
+				index = (index + 1) & (size - 1);
+			_entries[index] = entry;
+		}
+	}
+
+	/// <summary>
+	/// Find the token identifier associated with the specified <paramref name="name"/>.
+	/// </summary>
+	/// <returns>The associated token identifier, or <see cref="tokenid::unknown"/> if no entry matches.</returns>
+	tokenid find(std::string_view name) const
+	{
+		for (size_t index = hash(name) & (size - 1);; index = (index + 1) & (size - 1))
+		{
+			const keyword &entry = _entries[index];
+			if (entry.name.empty())
+				return tokenid::unknown;
+			if (entry.name == name)
+				return entry.id;
+		}
+	}
+
+private:
+	static constexpr uint32_t hash(std::string_view name)
+	{
+		// FNV-1a
+		uint32_t hash = 2166136261u;
+		for (const char c : name)
+			hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+		return hash;
+	}
+
+	std::array<keyword, size> _entries;
+};
+
 // Lookup tables which translate a given string literal to a token and backwards
-static const std::unordered_map<tokenid, std::string> token_lookup = {
+static constexpr token_name token_names[] = {
 	{ tokenid::end_of_file, "end of file" },
 	{ tokenid::exclaim, "!" },
 	{ tokenid::hash, "#" },
@@ -198,7 +270,7 @@ static const std::unordered_map<tokenid, std::string> token_lookup = {
 	{ tokenid::sampler, "sampler" },
 	{ tokenid::storage, "storage" },
 };
-static const std::unordered_map<std::string, tokenid> keyword_lookup = {
+static constexpr keyword keywords[] = {
 	{ "asm", tokenid::reserved },
 	{ "asm_fragment", tokenid::reserved },
 	{ "auto", tokenid::reserved },
@@ -432,7 +504,7 @@ static const std::unordered_map<std::string, tokenid> keyword_lookup = {
 	{ "volatile", tokenid::volatile_ },
 	{ "while", tokenid::while_ }
 };
-static const std::unordered_map<std::string, tokenid> pp_directive_lookup = {
+static constexpr keyword pp_directives[] = {
 	{ "define", tokenid::hash_def },
 	{ "undef", tokenid::hash_undef },
 	{ "if", tokenid::hash_if },
@@ -447,6 +519,16 @@ static const std::unordered_map<std::string, tokenid> pp_directive_lookup = {
 	{ "include", tokenid::hash_include },
 };
 
+// Token identifiers are small integers starting at -1, so the names can be stored in a flat array indexed by them
+static constexpr auto token_name_lookup = [] {
+	std::array<std::string_view, static_cast<size_t>(tokenid::multi_line_comment) + 2> lookup = {};
+	for (const token_name &entry : token_names)
+		lookup[static_cast<size_t>(static_cast<int>(entry.id) + 1)] = entry.name;
+	return lookup;
+}();
+static constexpr keyword_table<std::size(keywords)> keyword_lookup(keywords);
+static constexpr keyword_table<std::size(pp_directives)> pp_directive_lookup(pp_directives);
+
 static inline bool is_octal_digit(char c)
 {
 	return static_cast<unsigned>(c - '0') < 8;
@@ -495,11 +577,143 @@ static long long octal_to_decimal(long long n)
 	return n;
 }
 
-std::string reshadefx::token::id_to_name(tokenid id)
+#if RESHADEFX_LEXER_SSE2
+static inline unsigned int count_trailing_zeros(unsigned int mask)
 {
-	const auto it = token_lookup.find(id);
-	if (it != token_lookup.end())
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<unsigned int>(index);
+#else
+	return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+// The following routines find the end of a run of characters, processing 16 bytes at a time where possible (unless "vectorized" is false)
+// They never read past the specified end pointer, so do not depend on the input being padded
+template <char... chars>
+static inline const char *find_any_of(const char *cur, const char *const end, bool vectorized)
+{
+#if RESHADEFX_LEXER_SSE2
+	for (; vectorized && end - cur >= 16; cur += 16)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+		__m128i match = _mm_setzero_si128();
+		((match = _mm_or_si128(match, _mm_cmpeq_epi8(v, _mm_set1_epi8(chars)))), ...);
+
+		if (const unsigned int mask = _mm_movemask_epi8(match))
+			return cur + count_trailing_zeros(mask);
+	}
+#endif
+	while (cur < end && ((*cur != chars) && ...))
+		cur++;
+	return cur;
+}
+static inline const char *skip_space_characters(const char *cur, const char *const end, bool vectorized)
+{
+	// Most runs are short (a single space between tokens), so check the first few characters individually before switching to vector code
+	for (const char *const prefix_end = cur + std::min<ptrdiff_t>(end - cur, 4); cur < prefix_end; cur++)
+		if (type_lookup[uint8_t(*cur)] != SPACE)
+			return cur;
+
+#if RESHADEFX_LEXER_SSE2
+	for (; vectorized && end - cur >= 16; cur += 16)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+		// Space characters are ' ' and '\t', '\v', '\f', '\r' (which is the range from '\t' to '\r' without '\n')
+		const __m128i control = _mm_andnot_si128(
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+			_mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1))));
+		const __m128i space = _mm_or_si128(control, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+
+		if (const unsigned int mask = _mm_movemask_epi8(space) ^ 0xFFFF)
+			return cur + count_trailing_zeros(mask);
+	}
+#endif
+	while (cur < end && type_lookup[uint8_t(*cur)] == SPACE)
+		cur++;
+	return cur;
+}
+static inline const char *skip_identifier_characters(const char *cur, const char *const end, bool vectorized)
+{
+	for (const char *const prefix_end = cur + std::min<ptrdiff_t>(end - cur, 8); cur < prefix_end; cur++)
+		if (type_lookup[uint8_t(*cur)] != IDENT && type_lookup[uint8_t(*cur)] != DIGIT)
+			return cur;
+
+#if RESHADEFX_LEXER_SSE2
+	for (; vectorized && end - cur >= 16; cur += 16)
+	{
+		const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cur));
+		// Clearing bit 5 maps lower case letters onto upper case ones, so only a single range check is needed for letters
+		// Bytes above 127 are negative in the signed comparisons below and therefore never match
+		const __m128i upper = _mm_and_si128(v, _mm_set1_epi8(~0x20));
+		const __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(upper, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(upper, _mm_set1_epi8('Z' + 1)));
+		const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+		const __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+
+		if (const unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), underscore)) ^ 0xFFFF)
+			return cur + count_trailing_zeros(mask);
+	}
+#endif
+	while (cur < end && (type_lookup[uint8_t(*cur)] == IDENT || type_lookup[uint8_t(*cur)] == DIGIT))
+		cur++;
+	return cur;
+}
+
+std::string_view reshadefx::location::intern_source(std::string_view source)
+{
+	// Names can never be removed again, since any location in the process may still refer to them
+	// So limit the total size, to keep effects with many distinct '#line' file names from growing the pool on every reload
+	constexpr size_t max_total_size = 1024 * 1024;
+
+	static std::mutex s_mutex;
+	// Elements of an unordered set are never moved in memory, so views into them stay valid
+	static std::unordered_set<std::string> s_names;
+	static size_t s_total_size = 0;
+
+	if (source.empty())
+		return {};
+
+	std::string name(source);
+
+	const std::lock_guard<std::mutex> lock(s_mutex);
+
+	if (const auto it = s_names.find(name); it != s_names.end())
+		return *it;
+
+	// Locations without a source name are still valid, they just cannot be attributed to a file anymore
+	if (s_total_size + name.size() > max_total_size)
+		return {};
+
+	s_total_size += name.size();
+	return *s_names.insert(std::move(name)).first;
+}
+
+uint32_t reshadefx::identifier_table::intern(std::string_view name)
+{
+	if (const auto it = _ids.find(name); it != _ids.end())
+		return it->second;
+
+	// Copy the name into storage owned by the table, so that the key and the reverse lookup can be views of it
+	const std::string_view stored_name = _storage.emplace_front(name);
+	const uint32_t id = static_cast<uint32_t>(_names.size());
+	_names.push_back(stored_name);
+	_ids.emplace(stored_name, id);
+	return id;
+}
+uint32_t reshadefx::identifier_table::find(std::string_view name) const
+{
+	if (const auto it = _ids.find(name); it != _ids.end())
 		return it->second;
+	return 0;
+}
+
+std::string reshadefx::token::id_to_name(tokenid id)
+{
+	if (const size_t index = static_cast<size_t>(static_cast<int>(id) + 1);
+		index < token_name_lookup.size() && !token_name_lookup[index].empty())
+		return std::string(token_name_lookup[index]);
 	return "unknown";
 }
 
@@ -514,7 +728,7 @@ next_token:
 	tok.offset = input_offset();
 	tok.length = 1;
 	tok.literal_as_double = 0;
-	tok.literal_as_string.clear();
+	tok.literal_as_string = {};
 
 	assert(_cur <= _end);
 
@@ -650,6 +864,11 @@ next_token:
 		{
 			while (_cur < _end)
 			{
+				// Skip over the comment body up to the next character that needs handling
+				skip(find_any_of<'\n', '*'>(_cur, _end, _vectorized) - _cur);
+				if (_cur >= _end)
+					break;
+
 				if (*_cur == '\n')
 				{
 					_cur_location.line++;
@@ -778,14 +997,12 @@ void reshadefx::lexer::skip(size_t length)
 void reshadefx::lexer::skip_space()
 {
 	// Skip each character until a space is found
-	while (type_lookup[uint8_t(*_cur)] == SPACE && _cur < _end)
-		skip(1);
+	skip(skip_space_characters(_cur, _end, _vectorized) - _cur);
 }
 void reshadefx::lexer::skip_to_next_line()
 {
 	// Skip each character until a new line feed is found
-	while (*_cur != '\n' && _cur < _end)
-		skip(1);
+	skip(find_any_of<'\n'>(_cur, _end, _vectorized) - _cur);
 }
 
 void reshadefx::lexer::reset_to_offset(size_t offset)
@@ -796,22 +1013,27 @@ void reshadefx::lexer::reset_to_offset(size_t offset)
 
 void reshadefx::lexer::parse_identifier(token &tok) const
 {
-	auto *const begin = _cur, *end = begin;
+	auto *const begin = _cur;
 
 	// Skip to the end of the identifier sequence
-	do end++; while (type_lookup[uint8_t(*end)] == IDENT || type_lookup[uint8_t(*end)] == DIGIT);
+	auto *const end = skip_identifier_characters(begin + 1, _end, _vectorized);
 
 	tok.id = tokenid::identifier;
 	tok.offset = input_offset();
 	tok.length = end - begin;
-	tok.literal_as_string.assign(begin, end);
+	tok.literal_as_string = std::string_view(begin, end - begin);
 
-	if (_ignore_keywords)
-		return;
+	if (!_ignore_keywords)
+	{
+		if (const tokenid id = keyword_lookup.find(tok.literal_as_string);
+			id != tokenid::unknown)
+		{
+			tok.id = id;
+			return;
+		}
+	}
 
-	if (const auto it = keyword_lookup.find(tok.literal_as_string);
-		it != keyword_lookup.end())
-		tok.id = it->second;
+	tok.identifier_id = _identifiers != nullptr ? _identifiers->intern(tok.literal_as_string) : 0;
 }
 bool reshadefx::lexer::parse_pp_directive(token &tok)
 {
@@ -819,10 +1041,10 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 	skip_space(); // Skip any space between the '#' and directive
 	parse_identifier(tok);
 
-	if (const auto it = pp_directive_lookup.find(tok.literal_as_string);
-		it != pp_directive_lookup.end())
+	if (const tokenid id = pp_directive_lookup.find(tok.literal_as_string);
+		id != tokenid::unknown)
 	{
-		tok.id = it->second;
+		tok.id = id;
 		return true;
 	}
 	else if (!_ignore_line_directives && tok.literal_as_string == "line") // The #line directive needs special handling
@@ -846,7 +1068,7 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 			token temptok;
 			parse_string_literal(temptok, false);
 
-			_cur_location.source = std::move(temptok.literal_as_string);
+			_cur_location.source = location::intern_source(temptok.literal_as_string);
 		}
 
 		// Do not return the #line directive as token to the caller
@@ -860,8 +1082,22 @@ bool reshadefx::lexer::parse_pp_directive(token &tok)
 void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 {
 	auto *const begin = _cur, *end = begin + 1; // Skip first quote character right away
-
-	for (auto c = *end; c != '"'; c = *++end)
+	auto *value_end = end; // Keeps track of the end of the value independent of adjustments to 'end' below
+
+	// Most string literals are copied verbatim, in which case the token can point into the input string directly
+	// Only once a character is found that changes the value (escape sequence, line continuation, ...) is the value built up in a separate string
+	bool is_verbatim = true;
+	std::string value;
+	const auto begin_value = [&]() {
+		if (is_verbatim)
+			value.assign(begin + 1, end);
+		is_verbatim = false;
+	};
+
+	// Skip over all characters that do not need special handling right away
+	end = value_end = find_any_of<'"', '\\', '\n', '\r'>(end, _end, _vectorized);
+
+	for (auto c = *end; c != '"'; c = *++end, value_end = end)
 	{
 		if (c == '\n' || end >= _end)
 		{
@@ -874,6 +1110,7 @@ void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 		if (c == '\r')
 		{
 			// Silently ignore carriage return characters
+			begin_value();
 			continue;
 		}
 
@@ -881,6 +1118,7 @@ void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 			c == '\\' && end[n] == '\n')
 		{
 			// Escape character found at end of line, the string literal continues on to the next line
+			begin_value();
 			end += n;
 			_cur_location.line++;
 			continue;
@@ -889,6 +1127,8 @@ void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 		// Handle escape sequences
 		if (c == '\\' && escape)
 		{
+			begin_value();
+
 			unsigned int n = 0;
 
 			// Any character following the '\' is not parsed as usual, so increment pointer here (this makes sure '\"' does not abort the outer loop as well)
@@ -951,7 +1191,18 @@ void reshadefx::lexer::parse_string_literal(token &tok, bool escape)
 			}
 		}
 
-		tok.literal_as_string += c;
+		if (!is_verbatim)
+			value += c;
+	}
+
+	if (is_verbatim)
+	{
+		tok.literal_as_string = std::string_view(begin + 1, value_end - (begin + 1));
+	}
+	else
+	{
+		_string_pool.push_front(std::move(value));
+		tok.literal_as_string = _string_pool.front();
 	}
 
 	tok.id = tokenid::string_literal;
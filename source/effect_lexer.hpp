@@ -6,6 +6,9 @@
 #pragma once
 
 #include "effect_token.hpp"
+#include <memory> // std::shared_ptr
+#include <forward_list>
+#include <string_view>
 
 namespace reshadefx
 {
@@ -23,8 +26,45 @@ namespace reshadefx
 			bool ignore_line_directives = false,
 			bool ignore_keywords = false,
 			bool escape_string_literals = true,
-			const location &start_location = location()) :
-			_input(std::move(input)),
+			const location &start_location = location(),
+			identifier_table *identifiers = nullptr) :
+			lexer(std::make_shared<const std::string>(std::move(input)), ignore_comments, ignore_whitespace, ignore_pp_directives, ignore_line_directives, ignore_keywords, escape_string_literals, start_location, identifiers)
+		{
+		}
+		/// <summary>
+		/// Construct a lexer that shares ownership of the input string with other lexers (e.g. all lexers working on the same file).
+		/// </summary>
+		explicit lexer(
+			std::shared_ptr<const std::string> input,
+			bool ignore_comments = true,
+			bool ignore_whitespace = true,
+			bool ignore_pp_directives = true,
+			bool ignore_line_directives = false,
+			bool ignore_keywords = false,
+			bool escape_string_literals = true,
+			const location &start_location = location(),
+			identifier_table *identifiers = nullptr) :
+			lexer(std::string_view(*input), ignore_comments, ignore_whitespace, ignore_pp_directives, ignore_line_directives, ignore_keywords, escape_string_literals, start_location, identifiers)
+		{
+			_input_data = std::move(input);
+		}
+		/// <summary>
+		/// Construct a lexer that borrows the input string without copying it.
+		/// The caller has to keep the memory alive for the lifetime of the lexer and it has to be followed by a null character (like the memory returned by <c>std::string::data</c>).
+		/// If an identifier table is specified, identifier tokens are assigned the index of their name in it.
+		/// </summary>
+		explicit lexer(
+			std::string_view input,
+			bool ignore_comments = true,
+			bool ignore_whitespace = true,
+			bool ignore_pp_directives = true,
+			bool ignore_line_directives = false,
+			bool ignore_keywords = false,
+			bool escape_string_literals = true,
+			const location &start_location = location(),
+			identifier_table *identifiers = nullptr) :
+			_input(input),
+			_identifiers(identifiers),
 			_cur_location(start_location),
 			_ignore_comments(ignore_comments),
 			_ignore_whitespace(ignore_whitespace),
@@ -37,22 +77,15 @@ namespace reshadefx
 			_end = _cur + _input.size();
 		}
 
-		lexer(const lexer &lexer) { operator=(lexer); }
-		lexer &operator=(const lexer &lexer)
-		{
-			_input = lexer._input;
-			_cur_location = lexer._cur_location;
-			reset_to_offset(lexer._cur - lexer._input.data());
-			_end = _input.data() + _input.size();
-			_ignore_comments = lexer._ignore_comments;
-			_ignore_whitespace = lexer._ignore_whitespace;
-			_ignore_pp_directives = lexer._ignore_pp_directives;
-			_ignore_keywords = lexer._ignore_keywords;
-			_escape_string_literals = lexer._escape_string_literals;
-			_ignore_line_directives = lexer._ignore_line_directives;
+		// Copies share the input string, since it is never modified
+		lexer(const lexer &lexer) = default;
+		lexer &operator=(const lexer &lexer) = default;
 
-			return *this;
-		}
+		/// <summary>
+		/// Look at every character individually instead of scanning runs of whitespace, identifier, comment and string characters 16 bytes at a time.
+		/// This produces the same tokens and only exists so that tests can compare both.
+		/// </summary>
+		void disable_vectorized_scanning() { _vectorized = false; }
 
 		/// <summary>
 		/// Get the current position in the input string.
@@ -62,8 +95,8 @@ namespace reshadefx
 		/// <summary>
 		/// Get the input string this lexical analyzer works on.
 		/// </summary>
-		/// <returns>A constant reference to the input string.</returns>
-		const std::string &input_string() const { return _input; }
+		/// <returns>A view of the input string.</returns>
+		std::string_view input_string() const { return _input; }
 
 		/// <summary>
 		/// Perform lexical analysis on the input string and return the next token in sequence.
@@ -86,6 +119,28 @@ namespace reshadefx
 		/// <param name="offset">Offset in characters from the start of the input string.</param>
 		void reset_to_offset(size_t offset);
 
+		/// <summary>
+		/// A position in the input string together with the source location at it.
+		/// </summary>
+		struct position
+		{
+			size_t offset;
+			reshadefx::location location;
+		};
+
+		/// <summary>
+		/// Get the current position, to return to it after looking ahead with <see cref="restore_position"/>.
+		/// </summary>
+		position save_position() const { return { input_offset(), _cur_location }; }
+		/// <summary>
+		/// Reset position and source location to a position returned by <see cref="save_position"/>.
+		/// </summary>
+		void restore_position(const position &position)
+		{
+			_cur = _input.data() + position.offset;
+			_cur_location = position.location;
+		}
+
 	private:
 		/// <summary>
 		/// Skips an arbitrary amount of characters in the input string.
@@ -98,7 +153,11 @@ namespace reshadefx
 		void parse_string_literal(token &tok, bool escape);
 		void parse_numeric_literal(token &tok) const;
 
-		std::string _input;
+		std::string_view _input;
+		std::shared_ptr<const std::string> _input_data;
+		// Storage for string literal values that differ from their representation in the input string
+		std::forward_list<std::string> _string_pool;
+		identifier_table *_identifiers;
 		location _cur_location;
 		const std::string::value_type *_cur, *_end;
 		bool _ignore_comments;
@@ -107,5 +166,6 @@ namespace reshadefx
 		bool _ignore_line_directives;
 		bool _ignore_keywords;
 		bool _escape_string_literals;
+		bool _vectorized = true;
 	};
 }
@@ -246,7 +246,23 @@ namespace reshadefx
 	struct entry_point
 	{
 		std::string name;
+		// Name of the function as written in the effect code (which is not unique, unlike the name above)
+		std::string function_name;
 		shader_type type;
+		// Generated code with only the definitions reachable from this entry point (empty if the code generator does not produce text)
+		std::string code;
+	};
+
+	/// <summary>
+	/// A static estimate of the cost of running a shader function once.
+	/// </summary>
+	struct shader_cost
+	{
+		uint32_t alu_instructions = 0; // Arithmetic operations and intrinsic calls, weighted by the estimated loop trip counts
+		uint32_t texture_fetches = 0; // Texture sample, gather, fetch and store operations, weighted by the estimated loop trip counts
+		uint32_t dependent_fetch_depth = 0; // Longest chain of texture fetches that depend on the result of a previous fetch (1 means there are no dependent fetches)
+		uint32_t loop_iterations = 0; // Estimated total number of loop iterations
+		uint32_t unknown_loop_count = 0; // Number of loops for which the trip count could not be determined and had to be assumed
 	};
 
 	/// <summary>
@@ -262,6 +278,8 @@ namespace reshadefx
 		std::vector<struct_member_info> parameter_list;
 		std::unordered_set<uint32_t> referenced_samplers;
 		std::unordered_set<uint32_t> referenced_storages;
+		bool pointwise = true; // All texture sampling happens at an unmodified 'TEXCOORD' input parameter, no inputs are modified and no pixels are discarded
+		shader_cost cost;
 	};
 
 	/// <summary>
@@ -297,6 +315,9 @@ namespace reshadefx
 		uint32_t viewport_width = 0;
 		uint32_t viewport_height = 0;
 		uint32_t viewport_dispatch_z = 1;
+		bool pointwise = false; // Vertex shader has the signature of one drawing a full-screen triangle, pixel shader samples its inputs only at the texture coordinate passed through and writes straight to the back buffer
+		shader_cost vs_cost, ps_cost, cs_cost;
+		uint32_t render_target_bytes_per_pixel = 0; // Bytes written (and read again when blending) per pixel across all render targets, assuming RGBA8 for the back buffer
 		std::vector<sampler_info> samplers;
 		std::vector<storage_info> storages;
 	};
@@ -327,6 +348,8 @@ namespace reshadefx
 		std::vector<technique_info> techniques;
 
 		uint32_t total_uniform_size = 0;
+		// Number of bytes the uniform storage shrunk by when the code generator rearranged the uniform layout (zero if it was not packed)
+		uint32_t packed_uniform_bytes_saved = 0;
 		uint32_t num_texture_bindings = 0;
 		uint32_t num_sampler_bindings = 0;
 		uint32_t num_storage_bindings = 0;
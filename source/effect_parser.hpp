@@ -34,6 +34,11 @@ namespace reshadefx
 		std::string &errors() { return _errors; }
 		const std::string &errors() const { return _errors; }
 
+		/// <summary>
+		/// Get the number of tokens that were consumed during parsing.
+		/// </summary>
+		size_t token_count() const { return _token_count; }
+
 	private:
 		void error(const location &location, unsigned int code, const std::string &message);
 		void warning(const location &location, unsigned int code, const std::string &message);
@@ -59,6 +64,15 @@ namespace reshadefx
 		bool peek_multary_op(unsigned int &precedence) const;
 		bool accept_assignment_op();
 
+		bool is_texcoord_parameter(uint32_t id) const;
+		bool is_input_parameter(uint32_t id) const;
+
+		uint32_t fetch_depth(const expression &exp) const;
+		void add_cost(uint32_t result, uint32_t fetch_depth, uint32_t alu_instructions, uint32_t texture_fetches = 0);
+		void add_call_cost(uint32_t result, uint32_t fetch_depth, const shader_cost &callee_cost);
+		void enter_loop(uint32_t estimated_trip_count);
+		uint32_t estimate_loop_trip_count();
+
 		void parse_top(bool &parse_success);
 		bool parse_struct();
 		bool parse_function(type type, std::string name);
@@ -80,8 +94,11 @@ namespace reshadefx
 		token _token, _token_next, _token_backup;
 		std::unique_ptr<class lexer> _lexer;
 		size_t _lexer_backup_offset = 0;
+		size_t _token_count = 0;
 		std::vector<uint32_t> _loop_break_target_stack;
 		std::vector<uint32_t> _loop_continue_target_stack;
 		reshadefx::function_info *_current_function = nullptr;
+		uint32_t _loop_trip_multiplier = 1;
+		std::unordered_map<uint32_t, uint32_t> _fetch_depth;
 	};
 }
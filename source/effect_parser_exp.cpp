@@ -7,6 +7,8 @@
 #include "effect_parser.hpp"
 #include "effect_codegen.hpp"
 #include <cassert>
+#include <limits>
+#include <algorithm> // std::all_of, std::any_of, std::find_if, std::max, std::min
 
 reshadefx::parser::parser()
 {
@@ -45,6 +47,7 @@ void reshadefx::parser::restore()
 
 void reshadefx::parser::consume()
 {
+	_token_count++;
 	_token = std::move(_token_next);
 	_token_next = _lexer->lex();
 }
@@ -90,22 +93,25 @@ bool reshadefx::parser::accept_symbol(std::string &identifier, scoped_symbol &sy
 		return false;
 	}
 
-	identifier = std::move(_token.literal_as_string);
+	identifier = _token.literal_as_string;
+	uint32_t identifier_id = _token.identifier_id;
 
 	// Can concatenate multiple '::' to force symbol search for a specific namespace level
 	while (accept(tokenid::colon_colon))
 	{
+		identifier_id = 0;
 		if (!expect(tokenid::identifier))
 			return false;
-		identifier += "::" + std::move(_token.literal_as_string);
+		identifier += "::";
+		identifier += _token.literal_as_string;
 	}
 
 	// Figure out which scope to start searching in
-	struct scope scope = { "::", 0, 0 };
+	struct scope scope = { 0, 0, 0 };
 	if (!exclusive) scope = current_scope();
 
-	// Lookup name in the symbol table
-	symbol = find_symbol(identifier, scope, exclusive);
+	// Lookup name in the symbol table (qualified names were not lexed as a single identifier, so need to be looked up by name)
+	symbol = identifier_id != 0 ? find_symbol(identifier_id, scope, exclusive) : find_symbol(identifier, scope, exclusive);
 
 	return true;
 }
@@ -467,6 +473,106 @@ bool reshadefx::parser::accept_assignment_op()
 	return true;
 }
 
+bool reshadefx::parser::is_texcoord_parameter(uint32_t id) const
+{
+	if (_current_function == nullptr)
+		return false;
+
+	return std::find_if(_current_function->parameter_list.begin(), _current_function->parameter_list.end(),
+		[id](const struct_member_info &param) { return param.definition == id && param.semantic.compare(0, 8, "TEXCOORD") == 0; }) != _current_function->parameter_list.end();
+}
+bool reshadefx::parser::is_input_parameter(uint32_t id) const
+{
+	if (_current_function == nullptr)
+		return false;
+
+	return std::find_if(_current_function->parameter_list.begin(), _current_function->parameter_list.end(),
+		[id](const struct_member_info &param) { return param.definition == id && !param.semantic.empty() && param.type.has(type::q_in); }) != _current_function->parameter_list.end();
+}
+
+uint32_t reshadefx::parser::fetch_depth(const expression &exp) const
+{
+	if (exp.is_constant)
+		return 0;
+
+	if (const auto it = _fetch_depth.find(exp.base); it != _fetch_depth.end())
+		return it->second;
+	return 0;
+}
+
+static uint32_t saturating_add(uint32_t a, uint64_t b)
+{
+	return static_cast<uint32_t>(std::min<uint64_t>(a + b, std::numeric_limits<uint32_t>::max()));
+}
+
+void reshadefx::parser::add_cost(uint32_t result, uint32_t fetch_depth, uint32_t alu_instructions, uint32_t texture_fetches)
+{
+	if (_current_function == nullptr)
+		return;
+
+	// Keep track of how many texture fetches the value depends on, so that dependent fetches can be detected
+	if (fetch_depth != 0 && result != 0)
+		_fetch_depth[result] = fetch_depth;
+
+	shader_cost &cost = _current_function->cost;
+	cost.alu_instructions = saturating_add(cost.alu_instructions, static_cast<uint64_t>(alu_instructions) * _loop_trip_multiplier);
+	cost.texture_fetches = saturating_add(cost.texture_fetches, static_cast<uint64_t>(texture_fetches) * _loop_trip_multiplier);
+	cost.dependent_fetch_depth = std::max(cost.dependent_fetch_depth, fetch_depth);
+}
+void reshadefx::parser::add_call_cost(uint32_t result, uint32_t fetch_depth, const shader_cost &callee_cost)
+{
+	add_cost(result, fetch_depth + callee_cost.dependent_fetch_depth, callee_cost.alu_instructions, callee_cost.texture_fetches);
+
+	if (_current_function == nullptr)
+		return;
+
+	shader_cost &cost = _current_function->cost;
+	cost.loop_iterations = saturating_add(cost.loop_iterations, static_cast<uint64_t>(callee_cost.loop_iterations) * _loop_trip_multiplier);
+	cost.unknown_loop_count = saturating_add(cost.unknown_loop_count, callee_cost.unknown_loop_count);
+}
+
+void reshadefx::parser::enter_loop(uint32_t estimated_trip_count)
+{
+	if (_current_function == nullptr)
+		return;
+
+	shader_cost &cost = _current_function->cost;
+
+	// Assume a moderate amount of iterations for loops where the trip count cannot be determined statically
+	if (estimated_trip_count == 0)
+	{
+		estimated_trip_count = 16;
+		cost.unknown_loop_count = saturating_add(cost.unknown_loop_count, 1);
+	}
+
+	// Everything inside the loop body is executed once per iteration of the loop
+	_loop_trip_multiplier = saturating_add(0, static_cast<uint64_t>(_loop_trip_multiplier) * estimated_trip_count);
+
+	cost.loop_iterations = saturating_add(cost.loop_iterations, _loop_trip_multiplier);
+}
+uint32_t reshadefx::parser::estimate_loop_trip_count()
+{
+	// Look ahead and go back again afterwards, so that the actual parse sees the same tokens and locations
+	const lexer::position position = _lexer->save_position();
+	const token op = _lexer->lex();
+	const token bound = _lexer->lex();
+	const token end = _lexer->lex();
+	_lexer->restore_position(position);
+
+	// Recognize the common 'i < N' and 'i <= N' loop conditions with a literal bound (macros were already expanded by the preprocessor), assuming the loop counts up from zero in steps of one
+	if (_token_next.id != tokenid::identifier || (op.id != tokenid::less && op.id != tokenid::less_equal) || end.id != tokenid::semicolon)
+		return 0;
+
+	const bool inclusive = op.id == tokenid::less_equal;
+
+	if (bound.id == tokenid::int_literal && bound.literal_as_int > 0)
+		return bound.literal_as_int + inclusive;
+	if (bound.id == tokenid::uint_literal && bound.literal_as_uint > 0)
+		return bound.literal_as_uint + inclusive;
+
+	return 0;
+}
+
 bool reshadefx::parser::parse_expression(expression &exp)
 {
 	// Parse first expression
@@ -518,6 +624,11 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 
 			// The "++" and "--" operands modify the source variable, so store result back into it
 			_codegen->emit_store(exp, result);
+
+			if (is_input_parameter(exp.base))
+				_current_function->pointwise = false;
+
+			add_cost(0, 0, 1);
 		}
 		else if (op != tokenid::plus) // Ignore "+" operator since it does not actually do anything
 		{
@@ -534,6 +645,8 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 				const auto value = _codegen->emit_load(exp);
 				const auto result = _codegen->emit_unary_op(location, op, exp.type, value);
 
+				add_cost(result, fetch_depth(exp), 1);
+
 				exp.reset_to_rvalue(location, result, exp.type);
 			}
 		}
@@ -582,7 +695,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 	else if (accept('{'))
 	{
 		bool is_constant = true;
-		std::vector<expression> elements;
+		expression_list elements;
 		type composite_type = { type::t_void, 1, 1 };
 
 		while (!peek('}'))
@@ -628,14 +741,20 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 		{
 			composite_type.array_length = static_cast<int>(elements.size());
 
+			uint32_t elements_fetch_depth = 0;
+
 			// Resolve all access chains
 			for (expression &element : elements)
 			{
+				elements_fetch_depth = std::max(elements_fetch_depth, fetch_depth(element));
+
 				element.reset_to_rvalue(element.location, _codegen->emit_load(element), element.type);
 			}
 
 			const auto result = _codegen->emit_construct(location, composite_type, elements);
 
+			add_cost(result, elements_fetch_depth, 0);
+
 			exp.reset_to_rvalue(location, result, composite_type);
 		}
 
@@ -670,7 +789,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 	}
 	else if (accept(tokenid::string_literal))
 	{
-		std::string value = std::move(_token.literal_as_string);
+		std::string value(_token.literal_as_string);
 
 		// Multiple string literals in sequence are concatenated into a single string literal
 		while (accept(tokenid::string_literal))
@@ -692,7 +811,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 		// Parse entire argument expression list
 		bool is_constant = true;
 		unsigned int num_components = 0;
-		std::vector<expression> arguments;
+		expression_list arguments;
 
 		while (!peek(')'))
 		{
@@ -739,6 +858,10 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 		}
 		else if (arguments.size() > 1)
 		{
+			uint32_t arguments_fetch_depth = 0;
+			for (const expression &argument : arguments)
+				arguments_fetch_depth = std::max(arguments_fetch_depth, fetch_depth(argument));
+
 			// Flatten all arguments to a list of scalars
 			for (auto it = arguments.begin(); it != arguments.end();)
 			{
@@ -771,6 +894,8 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 
 			const auto result = _codegen->emit_construct(location, type, arguments);
 
+			add_cost(result, arguments_fetch_depth, 0);
+
 			exp.reset_to_rvalue(location, result, type);
 		}
 		else // A constructor call with a single argument is identical to a cast
@@ -797,7 +922,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 				return error(location, 3005, "identifier '" + identifier + "' represents a variable, not a function"), false;
 
 			// Parse entire argument expression list
-			std::vector<expression> arguments;
+			expression_list arguments;
 
 			while (!peek(')'))
 			{
@@ -816,10 +941,6 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 			if (!expect(')'))
 				return false;
 
-			// Function calls can only be made from within functions
-			if (!_codegen->is_in_function())
-				return error(location, 3005, "invalid function call outside of a function"), false;
-
 			// Try to resolve the call by searching through both function symbols and intrinsics
 			bool undeclared = !symbol.id, ambiguous = false;
 
@@ -836,91 +957,143 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 
 			assert(symbol.function != nullptr);
 
-			std::vector<expression> parameters(arguments.size());
-
-			// We need to allocate some temporary variables to pass in and load results from pointer parameters
 			for (size_t i = 0; i < arguments.size(); ++i)
+				if (arguments[i].type.components() > symbol.function->parameter_list[i].type.components())
+					warning(arguments[i].location, 3206, "implicit truncation of vector type");
+
+			// Evaluate calls to pure intrinsics at compile-time if all arguments are constant
+			bool is_constant_call = false;
+			if (symbol.op == symbol_type::intrinsic && std::all_of(arguments.begin(), arguments.end(), [](const expression &arg) { return arg.is_constant; }))
 			{
-				const auto &param_type = symbol.function->parameter_list[i].type;
+				expression_list constant_arguments(arguments);
+				for (size_t i = 0; i < constant_arguments.size(); ++i)
+					constant_arguments[i].add_cast_operation(symbol.function->parameter_list[i].type);
+
+				if (constant result; evaluate_intrinsic_call(symbol, constant_arguments, result))
+				{
+					exp.reset_to_rvalue_constant(location, std::move(result), symbol.type);
+					is_constant_call = true;
+				}
+			}
 
-				if (param_type.has(type::q_out) && (arguments[i].type.has(type::q_const) || !arguments[i].is_lvalue))
-					return error(arguments[i].location, 3025, "l-value specifies const object for an 'out' parameter"), false;
+			if (!is_constant_call)
+			{
+				// Function calls can only be made from within functions
+				if (!_codegen->is_in_function())
+					return error(location, 3005, "invalid function call outside of a function"), false;
 
-				if (arguments[i].type.components() > param_type.components())
-					warning(arguments[i].location, 3206, "implicit truncation of vector type");
+				expression_list parameters(arguments.size());
 
-				if (symbol.op == symbol_type::function || param_type.has(type::q_out))
+				// We need to allocate some temporary variables to pass in and load results from pointer parameters
+				for (size_t i = 0; i < arguments.size(); ++i)
 				{
-					if (param_type.is_sampler() || param_type.is_storage() || param_type.has(type::q_groupshared) /* Special case for atomic intrinsics */)
+					const auto &param_type = symbol.function->parameter_list[i].type;
+
+					if (param_type.has(type::q_out) && (arguments[i].type.has(type::q_const) || !arguments[i].is_lvalue))
+						return error(arguments[i].location, 3025, "l-value specifies const object for an 'out' parameter"), false;
+
+					if (symbol.op == symbol_type::function || param_type.has(type::q_out))
 					{
-						if (arguments[i].type != param_type)
-							return error(location, 3004, "no matching intrinsic overload for '" + identifier + '\''), false;
+						if (param_type.is_sampler() || param_type.is_storage() || param_type.has(type::q_groupshared) /* Special case for atomic intrinsics */)
+						{
+							if (arguments[i].type != param_type)
+								return error(location, 3004, "no matching intrinsic overload for '" + identifier + '\''), false;
 
-						assert(arguments[i].is_lvalue);
+							assert(arguments[i].is_lvalue);
 
-						// Do not shadow object or pointer parameters to function calls
-						size_t chain_index = 0;
-						const auto access_chain = _codegen->emit_access_chain(arguments[i], chain_index);
-						parameters[i].reset_to_lvalue(arguments[i].location, access_chain, param_type);
-						assert(chain_index == arguments[i].chain.size());
+							// Do not shadow object or pointer parameters to function calls
+							size_t chain_index = 0;
+							const auto access_chain = _codegen->emit_access_chain(arguments[i], chain_index);
+							parameters[i].reset_to_lvalue(arguments[i].location, access_chain, param_type);
+							assert(chain_index == arguments[i].chain.size());
 
-						// This is referencing a l-value, but want to avoid copying below
-						parameters[i].is_lvalue = false;
+							// This is referencing a l-value, but want to avoid copying below
+							parameters[i].is_lvalue = false;
+						}
+						else
+						{
+							// All user-defined functions actually accept pointers as arguments, same applies to intrinsics with 'out' parameters
+							const auto temp_variable = _codegen->define_variable(arguments[i].location, param_type);
+							parameters[i].reset_to_lvalue(arguments[i].location, temp_variable, param_type);
+						}
 					}
 					else
 					{
-						// All user-defined functions actually accept pointers as arguments, same applies to intrinsics with 'out' parameters
-						const auto temp_variable = _codegen->define_variable(arguments[i].location, param_type);
-						parameters[i].reset_to_lvalue(arguments[i].location, temp_variable, param_type);
-					}
-				}
-				else
-				{
-					expression arg = arguments[i];
-					arg.add_cast_operation(param_type);
-					parameters[i].reset_to_rvalue(arg.location, _codegen->emit_load(arg), param_type);
+						expression arg = arguments[i];
+						arg.add_cast_operation(param_type);
+						parameters[i].reset_to_rvalue(arg.location, _codegen->emit_load(arg), param_type);
 
-					// Keep track of whether the parameter is a constant for code generation (this makes the expression invalid for all other uses)
-					parameters[i].is_constant = arg.is_constant;
+						// Keep track of whether the parameter is a constant for code generation (this makes the expression invalid for all other uses)
+						parameters[i].is_constant = arg.is_constant;
+					}
 				}
-			}
 
-			// Copy in parameters from the argument access chains to parameter variables
-			for (size_t i = 0; i < arguments.size(); ++i)
-			{
-				// Only do this for pointer parameters as discovered above
-				if (parameters[i].is_lvalue && parameters[i].type.has(type::q_in) && !parameters[i].type.is_sampler() && !parameters[i].type.is_storage())
+				// Copy in parameters from the argument access chains to parameter variables
+				for (size_t i = 0; i < arguments.size(); ++i)
 				{
-					expression arg = arguments[i];
-					arg.add_cast_operation(parameters[i].type);
-					_codegen->emit_store(parameters[i], _codegen->emit_load(arg));
+					// Only do this for pointer parameters as discovered above
+					if (parameters[i].is_lvalue && parameters[i].type.has(type::q_in) && !parameters[i].type.is_sampler() && !parameters[i].type.is_storage())
+					{
+						expression arg = arguments[i];
+						arg.add_cast_operation(parameters[i].type);
+						_codegen->emit_store(parameters[i], _codegen->emit_load(arg));
+					}
 				}
-			}
 
-			// Check if the call resolving found an intrinsic or function and invoke the corresponding code
-			const auto result = symbol.op == symbol_type::function ?
-				_codegen->emit_call(location, symbol.id, symbol.type, parameters) :
-				_codegen->emit_call_intrinsic(location, symbol.id, symbol.type, parameters);
+				// Check if the call resolving found an intrinsic or function and invoke the corresponding code
+				const auto result = symbol.op == symbol_type::function ?
+					_codegen->emit_call(location, symbol.id, symbol.type, parameters) :
+					_codegen->emit_call_intrinsic(location, symbol.id, symbol.type, parameters);
 
-			exp.reset_to_rvalue(location, result, symbol.type);
+				exp.reset_to_rvalue(location, result, symbol.type);
 
-			// Copy out parameters from parameter variables back to the argument access chains
-			for (size_t i = 0; i < arguments.size(); ++i)
-			{
-				// Only do this for pointer parameters as discovered above
-				if (parameters[i].is_lvalue && parameters[i].type.has(type::q_out) && !parameters[i].type.is_sampler() && !parameters[i].type.is_storage())
+				uint32_t arguments_fetch_depth = 0;
+				for (const expression &argument : arguments)
+					arguments_fetch_depth = std::max(arguments_fetch_depth, fetch_depth(argument));
+
+				// Calling a function executes everything in it, while any intrinsic operating on a texture object (apart from querying its size) is a texture fetch
+				if (symbol.op == symbol_type::function)
+					add_call_cost(result, arguments_fetch_depth, symbol.function->cost);
+				else if (symbol.function->name != "tex2Dsize" &&
+					std::any_of(arguments.begin(), arguments.end(), [](const expression &arg) { return arg.type.is_sampler() || arg.type.is_storage(); }))
+					add_cost(result, arguments_fetch_depth + 1, 0, 1);
+				else
+					add_cost(result, arguments_fetch_depth, 1);
+
+				// Copy out parameters from parameter variables back to the argument access chains
+				for (size_t i = 0; i < arguments.size(); ++i)
 				{
-					expression arg = parameters[i];
-					arg.add_cast_operation(arguments[i].type);
-					_codegen->emit_store(arguments[i], _codegen->emit_load(arg));
+					// Only do this for pointer parameters as discovered above
+					if (parameters[i].is_lvalue && parameters[i].type.has(type::q_out) && !parameters[i].type.is_sampler() && !parameters[i].type.is_storage())
+					{
+						expression arg = parameters[i];
+						arg.add_cast_operation(arguments[i].type);
+						_codegen->emit_store(arguments[i], _codegen->emit_load(arg));
+
+						if (is_input_parameter(arguments[i].base))
+							_current_function->pointwise = false;
+					}
 				}
-			}
 
-			if (_current_function != nullptr)
-			{
-				// Calling a function makes the caller inherit all sampler and storage object references from the callee
-				_current_function->referenced_samplers.insert(symbol.function->referenced_samplers.begin(), symbol.function->referenced_samplers.end());
-				_current_function->referenced_storages.insert(symbol.function->referenced_storages.begin(), symbol.function->referenced_storages.end());
+				if (_current_function != nullptr)
+				{
+					// Calling a function makes the caller inherit all sampler and storage object references from the callee
+					_current_function->referenced_samplers.insert(symbol.function->referenced_samplers.begin(), symbol.function->referenced_samplers.end());
+					_current_function->referenced_storages.insert(symbol.function->referenced_storages.begin(), symbol.function->referenced_storages.end());
+
+					// Any access to texture objects other than a plain 'tex2D' at an input texture coordinate (or querying the size) makes the caller not pointwise
+					if (!symbol.function->referenced_samplers.empty() || !symbol.function->referenced_storages.empty() ||
+						std::any_of(arguments.begin(), arguments.end(), [](const expression &arg) { return arg.type.is_sampler() || arg.type.is_storage(); }))
+					{
+						if (symbol.op != symbol_type::intrinsic || (symbol.function->name != "tex2Dsize" &&
+							(symbol.function->name != "tex2D" || arguments.size() != 2 || !arguments[1].is_lvalue || !arguments[1].chain.empty() || !is_texcoord_parameter(arguments[1].base))))
+							_current_function->pointwise = false;
+					}
+
+					// So does calling a function that is not pointwise itself (e.g. because it discards pixels)
+					if (symbol.op == symbol_type::function && !symbol.function->pointwise)
+						_current_function->pointwise = false;
+				}
 			}
 		}
 		else if (symbol.op == symbol_type::invalid)
@@ -982,6 +1155,11 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 			// The "++" and "--" operands modify the source variable, so store result back into it
 			_codegen->emit_store(exp, result);
 
+			if (is_input_parameter(exp.base))
+				_current_function->pointwise = false;
+
+			add_cost(0, 0, 1);
+
 			// All postfix operators return a r-value rather than a l-value to the variable
 			exp.reset_to_rvalue(location, value, exp.type);
 		}
@@ -991,7 +1169,7 @@ bool reshadefx::parser::parse_expression_unary(expression &exp)
 				return false;
 
 			location = std::move(_token.location);
-			const auto subscript = std::move(_token.literal_as_string);
+			const std::string subscript(_token.literal_as_string);
 
 			if (accept('(')) // Methods (function calls on types) are not supported right now
 			{
@@ -1312,6 +1490,8 @@ bool reshadefx::parser::parse_expression_multary(expression &lhs, unsigned int l
 
 				const auto result_value = _codegen->emit_phi(lhs.location, condition_value, lhs_block, rhs_value, rhs_block, lhs_value, lhs_block, type);
 
+				add_cost(result_value, std::max(fetch_depth(lhs), fetch_depth(rhs)), 1);
+
 				lhs.reset_to_rvalue(lhs.location, result_value, type);
 				continue;
 			}
@@ -1324,6 +1504,8 @@ bool reshadefx::parser::parse_expression_multary(expression &lhs, unsigned int l
 
 			const auto result_value = _codegen->emit_binary_op(lhs.location, op, type, lhs.type, lhs_value, rhs_value);
 
+			add_cost(result_value, std::max(fetch_depth(lhs), fetch_depth(rhs)), 1);
+
 			lhs.reset_to_rvalue(lhs.location, result_value, type);
 			#pragma endregion
 		}
@@ -1412,6 +1594,8 @@ bool reshadefx::parser::parse_expression_multary(expression &lhs, unsigned int l
 
 			const auto result_value = _codegen->emit_ternary_op(lhs.location, op, type, condition_value, true_value, false_value);
 #endif
+			add_cost(result_value, std::max({ fetch_depth(lhs), fetch_depth(true_exp), fetch_depth(false_exp) }), 1);
+
 			lhs.reset_to_rvalue(lhs.location, result_value, type);
 			#pragma endregion
 		}
@@ -1466,9 +1650,19 @@ bool reshadefx::parser::parse_expression_assignment(expression &lhs)
 			result = _codegen->emit_binary_op(lhs.location, op, lhs.type, value, result);
 		}
 
+		// The variable keeps track of the longest chain of texture fetches any value assigned to it depended on
+		const uint32_t assigned_fetch_depth = std::max(fetch_depth(lhs), fetch_depth(rhs));
+		add_cost(result, assigned_fetch_depth, op != tokenid::equal ? 1 : 0);
+		if (assigned_fetch_depth != 0)
+			_fetch_depth[lhs.base] = assigned_fetch_depth;
+
 		// Write result back to variable
 		_codegen->emit_store(lhs, result);
 
+		// Modifying an input means later samples no longer see the interpolated value
+		if (is_input_parameter(lhs.base))
+			_current_function->pointwise = false;
+
 		// Return the result value since you can write assignments within expressions
 		lhs.reset_to_rvalue(lhs.location, result, lhs.type);
 	}
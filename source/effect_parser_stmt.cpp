@@ -8,6 +8,7 @@
 #include "effect_codegen.hpp"
 #include <cassert>
 #include <functional>
+#include <algorithm> // std::all_of, std::find, std::none_of
 
 struct on_scope_exit
 {
@@ -19,11 +20,20 @@ struct on_scope_exit
 
 bool reshadefx::parser::parse(std::string input, codegen *backend)
 {
-	_lexer.reset(new lexer(std::move(input)));
+	// Identifiers are interned in the symbol table, so that symbols can be looked up by index
+	_lexer.reset(new lexer(std::move(input), true, true, true, false, false, true, location(), &_identifiers));
 
 	// Set backend for subsequent code-generation
 	_codegen = backend;
 
+	_token_count = 0;
+
+	// Allocate temporary data like expression access chains from a single arena that is released all at once when parsing is done
+	// This is a pool rather than a monotonic buffer, so that the memory of the many short-lived expressions is reused
+	std::pmr::unsynchronized_pool_resource arena;
+	std::pmr::memory_resource *const previous_resource = set_parse_memory_resource(&arena);
+	const on_scope_exit _([previous_resource]() { set_parse_memory_resource(previous_resource); });
+
 	consume();
 
 	bool parse_success = true;
@@ -49,7 +59,7 @@ void reshadefx::parser::parse_top(bool &parse_success)
 			return;
 		}
 
-		const auto name = std::move(_token.literal_as_string);
+		const std::string name(_token.literal_as_string);
 
 		if (!expect('{'))
 		{
@@ -93,7 +103,7 @@ void reshadefx::parser::parse_top(bool &parse_success)
 
 			if (peek('('))
 			{
-				const auto name = std::move(_token.literal_as_string);
+				const std::string name(_token.literal_as_string);
 				// This is definitely a function declaration, so parse it
 				if (!parse_function(type, name))
 				{
@@ -113,7 +123,7 @@ void reshadefx::parser::parse_top(bool &parse_success)
 						parse_success = false;
 						return;
 					}
-					const auto name = std::move(_token.literal_as_string);
+					const std::string name(_token.literal_as_string);
 					if (!parse_variable(type, name, true))
 					{
 						// Insert dummy variable into symbol table, so later references can be resolved despite the error
@@ -167,7 +177,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 			switch_call = (0x8 << 4)
 		};
 
-		const auto attribute = std::move(_token_next.literal_as_string);
+		const std::string attribute(_token_next.literal_as_string);
 
 		if (!expect(tokenid::identifier) || !expect(']'))
 			return false;
@@ -382,7 +392,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 				return false;
 
 			enter_scope();
-			on_scope_exit _([this]() { leave_scope(); });
+			on_scope_exit _([this, outer_trip_multiplier = _loop_trip_multiplier]() { leave_scope(); _loop_trip_multiplier = outer_trip_multiplier; });
 
 			// Parse initializer first
 			if (type type; parse_type(type))
@@ -391,7 +401,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 				do { // There may be multiple declarations behind a type, so loop through them
 					if (count++ > 0 && !expect(','))
 						return false;
-					if (!expect(tokenid::identifier) || !parse_variable(type, std::move(_token.literal_as_string)))
+					if (!expect(tokenid::identifier) || !parse_variable(type, std::string(_token.literal_as_string)))
 						return false;
 				} while (!peek(';'));
 			}
@@ -404,6 +414,9 @@ bool reshadefx::parser::parse_statement(bool scoped)
 			if (!expect(';'))
 				return false;
 
+			// Condition, continue expression and body are all executed once per iteration
+			enter_loop(estimate_loop_trip_count());
+
 			const codegen::id merge_block = _codegen->create_block(); // Block that is executed after the loop
 			const codegen::id header_label = _codegen->create_block(); // Pointer to the loop merge instruction
 			const codegen::id continue_label = _codegen->create_block(); // Pointer to the continue block
@@ -488,7 +501,9 @@ bool reshadefx::parser::parse_statement(bool scoped)
 		if (accept(tokenid::while_))
 		{
 			enter_scope();
-			on_scope_exit _([this]() { leave_scope(); });
+			on_scope_exit _([this, outer_trip_multiplier = _loop_trip_multiplier]() { leave_scope(); _loop_trip_multiplier = outer_trip_multiplier; });
+
+			enter_loop(0);
 
 			const codegen::id merge_block = _codegen->create_block();
 			const codegen::id header_label = _codegen->create_block();
@@ -559,6 +574,10 @@ bool reshadefx::parser::parse_statement(bool scoped)
 		#pragma region DoWhile
 		if (accept(tokenid::do_))
 		{
+			on_scope_exit _([this, outer_trip_multiplier = _loop_trip_multiplier]() { _loop_trip_multiplier = outer_trip_multiplier; });
+
+			enter_loop(0);
+
 			const codegen::id merge_block = _codegen->create_block();
 			const codegen::id header_label = _codegen->create_block();
 			const codegen::id continue_label = _codegen->create_block();
@@ -696,6 +715,9 @@ bool reshadefx::parser::parse_statement(bool scoped)
 		#pragma region Discard
 		if (accept(tokenid::discard_))
 		{
+			// Discarded pixels keep what was in the back buffer before, so the output no longer replaces it as is
+			_current_function->pointwise = false;
+
 			// Leave the current function block
 			_codegen->leave_block_and_kill();
 
@@ -713,7 +735,7 @@ bool reshadefx::parser::parse_statement(bool scoped)
 			if (count++ > 0 && !expect(','))
 				// Try to consume the rest of the declaration so that parsing may continue despite the error
 				return consume_until(';'), false;
-			if (!expect(tokenid::identifier) || !parse_variable(type, std::move(_token.literal_as_string)))
+			if (!expect(tokenid::identifier) || !parse_variable(type, std::string(_token.literal_as_string)))
 				return consume_until(';'), false;
 		} while (!peek(';'));
 
@@ -843,7 +865,7 @@ bool reshadefx::parser::parse_annotations(std::vector<annotation> &annotations)
 		if (!expect(tokenid::identifier))
 			return consume_until('>'), false;
 
-		auto name = std::move(_token.literal_as_string);
+		std::string name(_token.literal_as_string);
 
 		if (expression expression; !expect('=') || !parse_expression_multary(expression) || !expect(';'))
 			return consume_until('>'), false;
@@ -864,11 +886,11 @@ bool reshadefx::parser::parse_struct()
 	struct_info info;
 	// The structure name is optional
 	if (accept(tokenid::identifier))
-		info.name = std::move(_token.literal_as_string);
+		info.name = _token.literal_as_string;
 	else
 		info.name = "_anonymous_struct_" + std::to_string(location.line) + '_' + std::to_string(location.column);
 
-	info.unique_name = 'S' + current_scope().name + info.name;
+	info.unique_name = 'S' + current_scope_name() + info.name;
 	std::replace(info.unique_name.begin(), info.unique_name.end(), ':', '_');
 
 	if (!expect('{'))
@@ -891,7 +913,7 @@ bool reshadefx::parser::parse_struct()
 			if (!expect(tokenid::identifier))
 				return consume_until('}'), accept(';'), false;
 
-			member.name = std::move(_token.literal_as_string);
+			member.name = _token.literal_as_string;
 			member.location = std::move(_token.location);
 
 			if (member.type.is_void())
@@ -933,7 +955,7 @@ bool reshadefx::parser::parse_struct()
 				if (!expect(tokenid::identifier))
 					return consume_until('}'), accept(';'), false;
 
-				member.semantic = std::move(_token.literal_as_string);
+				member.semantic = _token.literal_as_string;
 				// Make semantic upper case to simplify comparison later on
 				std::transform(member.semantic.begin(), member.semantic.end(), member.semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
@@ -986,12 +1008,15 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 
 	function_info info;
 	info.name = name;
-	info.unique_name = 'F' + current_scope().name + name;
+	info.unique_name = 'F' + current_scope_name() + name;
 	std::replace(info.unique_name.begin(), info.unique_name.end(), ':', '_');
 
 	info.return_type = type;
 	_current_function = &info;
 
+	_fetch_depth.clear();
+	_loop_trip_multiplier = 1;
+
 	bool parse_success = true;
 	bool expect_parenthesis = true;
 
@@ -1032,7 +1057,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 			break;
 		}
 
-		param.name = std::move(_token.literal_as_string);
+		param.name = _token.literal_as_string;
 		param.location = std::move(_token.location);
 
 		if (param.type.is_void())
@@ -1082,7 +1107,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 				break;
 			}
 
-			param.semantic = std::move(_token.literal_as_string);
+			param.semantic = _token.literal_as_string;
 			// Make semantic upper case to simplify comparison later on
 			std::transform(param.semantic.begin(), param.semantic.end(), param.semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
@@ -1114,7 +1139,7 @@ bool reshadefx::parser::parse_function(type type, std::string name)
 		if (type.is_void())
 			return error(_token.location, 3076, '\'' + name + "': void function cannot have a semantic"), false;
 
-		info.return_semantic = std::move(_token.literal_as_string);
+		info.return_semantic = _token.literal_as_string;
 		// Make semantic upper case to simplify comparison later on
 		std::transform(info.return_semantic.begin(), info.return_semantic.end(), info.return_semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 	}
@@ -1221,7 +1246,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 			return error(_token.location, 3043, '\'' + name + "': local variables cannot have semantics"), false;
 
 		std::string &semantic = texture_info.semantic;
-		semantic = std::move(_token.literal_as_string);
+		semantic = _token.literal_as_string;
 
 		// Make semantic upper case to simplify comparison later on
 		std::transform(semantic.begin(), semantic.end(), semantic.begin(), [](char c) { return static_cast<char>(toupper(c)); });
@@ -1281,7 +1306,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 				if (!expect(tokenid::identifier))
 					return consume_until('}'), false;
 
-				const auto property_name = std::move(_token.literal_as_string);
+				const std::string property_name(_token.literal_as_string);
 				const auto property_location = std::move(_token.location);
 
 				if (!expect('='))
@@ -1294,7 +1319,8 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 				if (accept(tokenid::identifier)) // Handle special enumeration names for property values
 				{
 					// Transform identifier to uppercase to do case-insensitive comparison
-					std::transform(_token.literal_as_string.begin(), _token.literal_as_string.end(), _token.literal_as_string.begin(), [](char c) { return static_cast<char>(toupper(c)); });
+					std::string identifier(_token.literal_as_string);
+					std::transform(identifier.begin(), identifier.end(), identifier.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
 					static const std::unordered_map<std::string, uint32_t> s_values = {
 						{ "NONE", 0 }, { "POINT", 0 },
@@ -1319,7 +1345,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 					};
 
 					// Look up identifier in list of possible enumeration names
-					if (const auto it = s_values.find(_token.literal_as_string);
+					if (const auto it = s_values.find(identifier);
 						it != s_values.end())
 						expression.reset_to_rvalue_constant(_token.location, it->second);
 					else // No match found, so rewind to parser state before the identifier was consumed and try parsing it as a normal expression
@@ -1421,7 +1447,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 
 		texture_info.name = name;
 		// Add namespace scope to avoid name clashes
-		texture_info.unique_name = 'V' + current_scope().name + name;
+		texture_info.unique_name = 'V' + current_scope_name() + name;
 		std::replace(texture_info.unique_name.begin(), texture_info.unique_name.end(), ':', '_');
 
 		texture_info.annotations = std::move(sampler_info.annotations);
@@ -1441,11 +1467,12 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 
 		sampler_info.name = name;
 		// Add namespace scope to avoid name clashes
-		sampler_info.unique_name = 'V' + current_scope().name + name;
+		sampler_info.unique_name = 'V' + current_scope_name() + name;
 		std::replace(sampler_info.unique_name.begin(), sampler_info.unique_name.end(), ':', '_');
 
 		symbol = { symbol_type::variable, 0, type };
 		symbol.id = _codegen->define_sampler(location, sampler_info);
+
 	}
 	else if (type.is_storage())
 	{
@@ -1456,7 +1483,7 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 
 		storage_info.name = name;
 		// Add namespace scope to avoid name clashes
-		storage_info.unique_name = 'V' + current_scope().name + name;
+		storage_info.unique_name = 'V' + current_scope_name() + name;
 		std::replace(storage_info.unique_name.begin(), storage_info.unique_name.end(), ':', '_');
 
 		storage_info.format = texture_info.format;
@@ -1485,13 +1512,16 @@ bool reshadefx::parser::parse_variable(type type, std::string name, bool global)
 	else
 	{
 		// Update global variable names to contain the namespace scope to avoid name clashes
-		std::string unique_name = global ? 'V' + current_scope().name + name : name;
+		std::string unique_name = global ? 'V' + current_scope_name() + name : name;
 		std::replace(unique_name.begin(), unique_name.end(), ':', '_');
 
 		symbol = { symbol_type::variable, 0, type };
 		symbol.id = _codegen->define_variable(location, type, std::move(unique_name), global,
 			// Shared variables cannot have an initializer
 			type.has(type::q_groupshared) ? 0 : _codegen->emit_load(initializer));
+
+		if (!global)
+			add_cost(symbol.id, fetch_depth(initializer), 0);
 	}
 
 	// Insert the symbol into the symbol table
@@ -1507,7 +1537,7 @@ bool reshadefx::parser::parse_technique()
 		return false;
 
 	technique_info info;
-	info.name = std::move(_token.literal_as_string);
+	info.name = _token.literal_as_string;
 
 	bool parse_success = parse_annotations(info.annotations);
 
@@ -1529,6 +1559,28 @@ bool reshadefx::parser::parse_technique()
 
 	return expect('}') && parse_success;
 }
+static const reshadefx::struct_member_info *find_fullscreen_triangle_texcoord(const reshadefx::function_info &info)
+{
+	// Vertex shaders drawing a full-screen triangle (like 'PostProcessVS' in 'ReShade.fxh') only take the vertex index and output the position and a single texture coordinate
+	if (!info.return_type.is_void() || !info.pointwise)
+		return nullptr;
+
+	const reshadefx::struct_member_info *vertex_id = nullptr, *position = nullptr, *texcoord = nullptr;
+	for (const reshadefx::struct_member_info &param : info.parameter_list)
+	{
+		if (vertex_id == nullptr && param.semantic == "SV_VERTEXID" && param.type.is_scalar() && param.type.is_integral() && !param.type.has(reshadefx::type::q_out))
+			vertex_id = &param;
+		else if (position == nullptr && param.semantic == "SV_POSITION" && param.type == reshadefx::type { reshadefx::type::t_float, 4, 1 } && !param.type.has(reshadefx::type::q_in))
+			position = &param;
+		else if (texcoord == nullptr && param.semantic.compare(0, 8, "TEXCOORD") == 0 && param.type == reshadefx::type { reshadefx::type::t_float, 2, 1 } && !param.type.has(reshadefx::type::q_in))
+			texcoord = &param;
+		else
+			return nullptr;
+	}
+
+	return vertex_id != nullptr && position != nullptr ? texcoord : nullptr;
+}
+
 bool reshadefx::parser::parse_technique_pass(pass_info &info)
 {
 	if (!expect(tokenid::pass))
@@ -1538,11 +1590,12 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 
 	// Passes can have an optional name
 	if (accept(tokenid::identifier))
-		info.name = std::move(_token.literal_as_string);
+		info.name = _token.literal_as_string;
 
 	bool parse_success = true;
 	bool targets_support_srgb = true;
 	function_info vs_info, ps_info, cs_info;
+	uint32_t render_target_pixel_sizes[8] = {};
 
 	if (!expect('{'))
 		return false;
@@ -1554,7 +1607,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 			return consume_until('}'), false;
 
 		auto location = std::move(_token.location);
-		const auto state = std::move(_token.literal_as_string);
+		const std::string state(_token.literal_as_string);
 
 		if (!expect('='))
 			return consume_until('}'), false;
@@ -1663,6 +1716,12 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 						const auto target_index = state.size() > 12 ? (state[12] - '0') : 0;
 						info.render_target_names[target_index] = target_info.unique_name;
 
+						static constexpr uint32_t s_pixel_sizes[] = {
+							0,
+							1 /*R8*/, 2 /*R16*/, 2 /*R16F*/, 4 /*R32F*/, 2 /*RG8*/, 4 /*RG16*/, 4 /*RG16F*/, 8 /*RG32F*/, 4 /*RGBA8*/, 8 /*RGBA16*/, 8 /*RGBA16F*/, 16 /*RGBA32F*/, 4 /*RGB10A2*/
+						};
+						render_target_pixel_sizes[target_index] = s_pixel_sizes[static_cast<uint32_t>(target_info.format)];
+
 						// Only RGBA8 format supports sRGB writes across all APIs
 						if (target_info.format != texture_format::rgba8)
 							targets_support_srgb = false;
@@ -1683,7 +1742,8 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 			if (accept(tokenid::identifier)) // Handle special enumeration names for pass states
 			{
 				// Transform identifier to uppercase to do case-insensitive comparison
-				std::transform(_token.literal_as_string.begin(), _token.literal_as_string.end(), _token.literal_as_string.begin(), [](char c) { return static_cast<char>(toupper(c)); });
+				std::string identifier(_token.literal_as_string);
+				std::transform(identifier.begin(), identifier.end(), identifier.begin(), [](char c) { return static_cast<char>(toupper(c)); });
 
 				static const std::unordered_map<std::string, uint32_t> s_enum_values = {
 					{ "NONE", 0 }, { "ZERO", 0 }, { "ONE", 1 },
@@ -1726,7 +1786,7 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 				};
 
 				// Look up identifier in list of possible enumeration names
-				if (const auto it = s_enum_values.find(_token.literal_as_string);
+				if (const auto it = s_enum_values.find(identifier);
 					it != s_enum_values.end())
 					expression.reset_to_rvalue_constant(_token.location, it->second);
 				else // No match found, so rewind to parser state before the identifier was consumed and try parsing it as a normal expression
@@ -1823,6 +1883,8 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 				info.samplers.push_back(_codegen->find_sampler(id));
 			for (codegen::id id : cs_info.referenced_storages)
 				info.storages.push_back(_codegen->find_storage(id));
+
+			info.cs_cost = cs_info.cost;
 		}
 		else if (info.vs_entry_point.empty() || info.ps_entry_point.empty())
 		{
@@ -1911,6 +1973,25 @@ bool reshadefx::parser::parse_technique_pass(pass_info &info)
 				parse_success = false;
 				error(pass_location, 3667, "storage writes are only valid in compute shaders");
 			}
+
+			// A pass is pointwise if the vertex shader has the signature of one drawing a full-screen triangle, the pixel shader only samples at the texture coordinate it passes through and the output replaces the back buffer as is
+			const struct_member_info *const vs_texcoord = find_fullscreen_triangle_texcoord(vs_info);
+			info.pointwise = ps_info.pointwise && vs_texcoord != nullptr &&
+				std::all_of(ps_info.parameter_list.begin(), ps_info.parameter_list.end(),
+					[vs_texcoord](const struct_member_info &param) { return param.semantic.compare(0, 8, "TEXCOORD") != 0 || (param.semantic == vs_texcoord->semantic && param.type == vs_texcoord->type); }) &&
+				info.render_target_names[0].empty() && !info.blend_enable[0] && !info.stencil_enable &&
+				info.topology == primitive_topology::triangle_list && info.num_vertices == 3;
+
+			info.vs_cost = vs_info.cost;
+			info.ps_cost = ps_info.cost;
+
+			// Without any render targets the pass writes to the back buffer instead, which is assumed to be RGBA8
+			if (info.render_target_names[0].empty())
+				render_target_pixel_sizes[0] = 4;
+
+			// Blending has to read the previous value as well, which doubles the bandwidth for that render target
+			for (int i = 0; i < 8; ++i)
+				info.render_target_bytes_per_pixel += render_target_pixel_sizes[i] * (info.blend_enable[i] ? 2 : 1);
 		}
 
 		// Verify render target format supports sRGB writes if enabled
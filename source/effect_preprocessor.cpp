@@ -6,6 +6,8 @@
 #include "effect_lexer.hpp"
 #include "effect_preprocessor.hpp"
 #include <cassert>
+#include <mutex>
+#include <cstring> // std::memcpy
 #include <algorithm> // std::find_if
 
 #ifndef _WIN32
@@ -54,6 +56,16 @@ enum macro_replacement
 	macro_replacement_expand = '\xFB',
 };
 
+// Identifiers that every preprocessor instance interns first, so that they can be compared by index
+enum builtin_identifier : uint32_t
+{
+	identifier_defined = 1,
+	identifier_line,
+	identifier_file,
+	identifier_file_stem,
+	identifier_file_name,
+};
+
 static const int precedence_lookup[] = {
 	0, 1, 2, 3, 4, // bitwise operators
 	5, 6, 7, 7, 7, 7, // logical operators
@@ -96,6 +108,99 @@ static bool read_file(const std::filesystem::path &path, std::string &data)
 	return true;
 }
 
+static bool write_file(const std::filesystem::path &path, const std::string &data)
+{
+#ifdef _WIN32
+	FILE *file = nullptr;
+	if (_wfopen_s(&file, path.c_str(), L"wb") != 0)
+		return false;
+#else
+	FILE *const file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+#endif
+
+	const size_t written = fwrite(data.data(), 1, data.size(), file);
+
+	fclose(file);
+
+	return written == data.size();
+}
+
+static std::string find_include_guard(std::string_view data)
+{
+	// Check whether the entire file is wrapped in a '#ifndef X ... #endif' block, in which case including it again has no effect while 'X' is defined
+	// Directives in a skipped block are still checked for errors and '#if' expressions are still evaluated, so only accept blocks where that cannot fail
+	reshadefx::lexer lexer(
+		data,
+		true  /* ignore_comments */,
+		false /* ignore_whitespace */,
+		false /* ignore_pp_directives */,
+		false /* ignore_line_directives */,
+		true  /* ignore_keywords */,
+		false /* escape_string_literals */);
+
+	// Space tokens are skipped, but line feeds are needed to detect the end of directives
+	const auto lex = [&lexer]() {
+		reshadefx::token tok;
+		do tok = lexer.lex();
+		while (tok == reshadefx::tokenid::space);
+		return tok;
+	};
+
+	reshadefx::token tok;
+	while ((tok = lex()) == reshadefx::tokenid::end_of_line)
+		continue;
+
+	if (tok != reshadefx::tokenid::hash_ifndef || (tok = lex()) != reshadefx::tokenid::identifier)
+		return std::string();
+	std::string guard(tok.literal_as_string);
+	if (lex() != reshadefx::tokenid::end_of_line)
+		return std::string();
+
+	// Keep track of whether an '#else' was found for every nested block
+	std::vector<bool> else_stack(1, false);
+	while (!else_stack.empty())
+	{
+		switch (tok = lex())
+		{
+		case reshadefx::tokenid::end_of_file:
+		case reshadefx::tokenid::hash_if:
+		case reshadefx::tokenid::hash_elif:
+			return std::string();
+		case reshadefx::tokenid::hash_ifdef:
+		case reshadefx::tokenid::hash_ifndef:
+			if (lex() != reshadefx::tokenid::identifier || lex() != reshadefx::tokenid::end_of_line)
+				return std::string();
+			else_stack.push_back(false);
+			break;
+		case reshadefx::tokenid::hash_else:
+			// An '#else' belonging to the guard itself would make part of the file visible while the guard is defined
+			if (else_stack.size() == 1 || else_stack.back() || lex() != reshadefx::tokenid::end_of_line)
+				return std::string();
+			else_stack.back() = true;
+			break;
+		case reshadefx::tokenid::hash_endif:
+			if (lex() != reshadefx::tokenid::end_of_line)
+				return std::string();
+			else_stack.pop_back();
+			break;
+		case reshadefx::tokenid::string_literal:
+			if (data[tok.offset + tok.length - 1] != '\"')
+				return std::string(); // Unterminated string literals are reported even when skipped
+			break;
+		default:
+			break;
+		}
+	}
+
+	// Nothing but empty lines may follow the closing '#endif'
+	while ((tok = lex()) == reshadefx::tokenid::end_of_line)
+		continue;
+
+	return tok == reshadefx::tokenid::end_of_file ? guard : std::string();
+}
+
 static std::string escape_string(std::string s)
 {
 	for (size_t offset = 0; (offset = s.find('\\', offset)) != std::string::npos; offset += 2)
@@ -103,8 +208,474 @@ static std::string escape_string(std::string s)
 	return '\"' + s + '\"';
 }
 
+// Check whether a token can be put after a piece of text that ends in a token of the specified type, without changing how either of them is split into tokens
+// This errs on the side of caution, since a false negative only means the combined text is lexed again
+static bool is_token_boundary(std::string_view left, reshadefx::tokenid left_id, std::string_view right)
+{
+	if (left.empty() || right.empty())
+		return true;
+
+	const char a = left.back();
+	const char b = right.front();
+	const auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+	const auto is_word = [&](char c) { return is_digit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; };
+
+	// Identifiers and numeric literals would continue (e.g. "a" "b", "1" "2")
+	if (is_word(a) && is_word(b))
+		return false;
+	// Numeric literals would continue with a fraction or suffix (e.g. "1" ".5", "1." "f")
+	if ((left_id == reshadefx::tokenid::int_literal || left_id == reshadefx::tokenid::uint_literal || left_id == reshadefx::tokenid::float_literal || left_id == reshadefx::tokenid::double_literal) &&
+		(b == '.' || is_word(b)))
+		return false;
+	// A dot would start a numeric literal or an ellipsis (e.g. "." "5", ".." ".")
+	if (a == '.' && (is_digit(b) || b == '.'))
+		return false;
+	// Operators would be merged (e.g. "<" "=", "+" "+", "-" ">", "/" "*")
+	if ((b == '=' && std::string_view("!%&*+-/<=>^|").find(a) != std::string_view::npos) ||
+		(a == b && std::string_view("&+-|:<>/").find(a) != std::string_view::npos) ||
+		(a == '-' && b == '>') || (a == '/' && b == '*'))
+		return false;
+	// Exponent of a floating-point literal would continue (e.g. "1e" "+5", "1e+" "5")
+	if (left.size() > 1 && (
+		((a == 'e' || a == 'E') && (b == '+' || b == '-') && (is_digit(left[left.size() - 2]) || left[left.size() - 2] == '.')) ||
+		((a == '+' || a == '-') && is_digit(b) && (left[left.size() - 2] == 'e' || left[left.size() - 2] == 'E'))))
+		return false;
+
+	return true;
+}
+
+/// <summary>
+/// A string together with the tokens it consists of, so that it can be pushed as input without having to lex it again.
+/// </summary>
+struct reshadefx::preprocessor::token_list
+{
+	// Tokens are stored back to back, so only their type and length are needed to find them in the text
+	// Values of numeric literals and identifier indices are stored separately, since most tokens do not have one
+	struct list_token
+	{
+		tokenid id;
+		uint32_t length;
+	};
+
+	explicit token_list(identifier_table &identifiers) : identifiers(&identifiers) {}
+
+	// Table that the identifier indices of the tokens refer to
+	identifier_table *identifiers;
+	std::string text;
+	std::vector<list_token> tokens;
+	std::vector<uint64_t> literals;
+	// Set when the tokens are not guaranteed to be the same as what lexing the text would produce, after which only the text is kept up to date and lexed again when pushed
+	bool relex = false;
+	// Set by the ## operator, so that the next token is merged with the last one
+	bool concat_next = false;
+	// Set after tokens were merged, since those were lexed without knowing what follows them
+	bool check_next = false;
+	// Input level and end offset of the last token appended from the input, to skip checks between tokens that already followed each other there
+	size_t source_id = 0, source_end = 0;
+
+	static bool has_literal(tokenid id)
+	{
+		return id == tokenid::identifier || id == tokenid::int_literal || id == tokenid::uint_literal || id == tokenid::float_literal || id == tokenid::double_literal;
+	}
+
+	token next(token_list_cursor &cursor, const location &start_location) const
+	{
+		token tok;
+		tok.offset = cursor.offset;
+		tok.literal_as_double = 0;
+
+		if (cursor.index < tokens.size())
+		{
+			tok.id = tokens[cursor.index].id;
+			tok.length = tokens[cursor.index].length;
+			if (tok.id == tokenid::identifier)
+			{
+				tok.identifier_id = static_cast<uint32_t>(literals[cursor.literal_index++]);
+				tok.literal_as_string = std::string_view(text).substr(tok.offset, tok.length);
+			}
+			else if (has_literal(tok.id))
+				std::memcpy(&tok.literal_as_double, &literals[cursor.literal_index++], sizeof(uint64_t));
+			else if (tok.id == tokenid::string_literal)
+				tok.literal_as_string = std::string_view(text).substr(tok.offset + 1, tok.length - 2);
+
+			cursor.index++;
+			cursor.offset += tok.length;
+		}
+		else
+		{
+			tok.id = tokenid::end_of_file;
+			tok.length = 1;
+		}
+
+		// The text contains no new lines, so the location only depends on the offset
+		tok.location = start_location;
+		tok.location.column += static_cast<uint32_t>(tok.offset);
+		return tok;
+	}
+
+	void append(const token &tok, std::string_view data, bool adjacent)
+	{
+		if (!relex && concat_next && !tokens.empty())
+		{
+			// Only the two tokens around the ## operator are lexed again, instead of the entire expansion
+			const size_t last_offset = text.size() - tokens.back().length;
+			pop_back();
+			std::string merged = text.substr(last_offset);
+			merged += data;
+			text.resize(last_offset);
+			concat_next = false;
+			append_text(merged);
+			check_next = true;
+			return;
+		}
+
+		// Whitespace is lexed as a single token, so is merged with any whitespace before it
+		const bool extends_space = tok == tokenid::space && !tokens.empty() && tokens.back().id == tokenid::space;
+
+		if ((!adjacent || check_next) && !extends_space && !is_token_boundary(text, tokens.empty() ? tokenid::unknown : tokens.back().id, data))
+			relex = true;
+		if ((tok == tokenid::space || tok == tokenid::end_of_line || tok == tokenid::string_literal) && data.find_first_of("\r\n") != std::string_view::npos)
+			relex = true;
+		if (tok == tokenid::string_literal && (data.size() < 2 || data.back() != '\"'))
+			relex = true;
+
+		concat_next = false;
+		check_next = false;
+
+		if (!relex && extends_space)
+		{
+			tokens.back().length += static_cast<uint32_t>(data.size());
+		}
+		else if (!relex)
+		{
+			tokens.push_back({ tok.id, static_cast<uint32_t>(data.size()) });
+			if (tok.id == tokenid::identifier)
+				literals.push_back(tok.identifier_id);
+			else if (has_literal(tok.id))
+				std::memcpy(&literals.emplace_back(), &tok.literal_as_double, sizeof(uint64_t));
+		}
+
+		text += data;
+	}
+	void append(const token_list &list)
+	{
+		append(list, token_list_cursor(), token_list_cursor { list.tokens.size(), list.text.size(), list.literals.size() });
+	}
+	void append(const token_list &list, token_list_cursor begin, const token_list_cursor &end)
+	{
+		if (relex || list.relex)
+		{
+			// Tokens are no longer kept up to date, so only need to append the text
+			relex = true;
+			concat_next = false;
+			check_next = false;
+			text.append(list.text, begin.offset, end.offset - begin.offset);
+			return;
+		}
+
+		// The first tokens are appended individually, since they may have to be merged with or checked against what comes before them
+		for (bool adjacent = false; begin.index < end.index && (!adjacent || concat_next || check_next); adjacent = true)
+		{
+			const token tok = list.next(begin, location());
+			append(tok, std::string_view(list.text).substr(tok.offset, tok.length), adjacent);
+		}
+
+		if (begin.index == end.index)
+			return;
+
+		if (relex)
+		{
+			text.append(list.text, begin.offset, end.offset - begin.offset);
+			return;
+		}
+
+		// The remaining tokens followed each other in the list already, so can be copied over as is
+		tokens.insert(tokens.end(), list.tokens.begin() + begin.index, list.tokens.begin() + end.index);
+		literals.insert(literals.end(), list.literals.begin() + begin.literal_index, list.literals.begin() + end.literal_index);
+		text.append(list.text, begin.offset, end.offset - begin.offset);
+	}
+	void append_from_input(const token &tok, std::string_view data, size_t input_id)
+	{
+		const bool adjacent = input_id == source_id && tok.offset == source_end;
+		source_id = input_id;
+		source_end = tok.offset + tok.length;
+		append(tok, data, adjacent);
+	}
+	void append_text(const std::string &data)
+	{
+		if (relex)
+		{
+			text += data;
+			return;
+		}
+
+		lexer lexer(
+			std::string_view(data),
+			true  /* ignore_comments */,
+			false /* ignore_whitespace */,
+			false /* ignore_pp_directives */,
+			false /* ignore_line_directives */,
+			true  /* ignore_keywords */,
+			false /* escape_string_literals */,
+			location(1, 2), // Start after the beginning of a line, which is checked for when pushing
+			identifiers);
+
+		const size_t text_offset = text.size();
+		size_t offset = 0;
+		for (token tok; (tok = lexer.lex()) != tokenid::end_of_file && tok.offset == offset; offset += tok.length)
+			append(tok, std::string_view(data).substr(tok.offset, tok.length), offset != 0);
+
+		// Tokens do not cover the text if it contains comments for example
+		if (offset != data.size())
+		{
+			relex = true;
+			text.resize(text_offset);
+			text += data;
+		}
+	}
+	void append_stringized(const token_list &argument)
+	{
+		token tok;
+		tok.id = tokenid::string_literal;
+		tok.literal_as_double = 0;
+
+		std::string data;
+		data.reserve(2 + argument.text.size());
+		data += '"';
+		// The last character of an argument is the replacement marker, which is not part of the string
+		for (size_t i = 0; i + 1 < argument.text.size(); ++i)
+		{
+			// Adds backslashes to escape quotes
+			if (argument.text[i] == '"')
+			{
+				data += '\\';
+				// The lexer does not handle escape sequences in the preprocessor, so this ends up as multiple tokens
+				relex = true;
+			}
+			data += argument.text[i];
+		}
+		data += '"';
+
+		append(tok, data, false);
+	}
+
+	void pop_back()
+	{
+		if (has_literal(tokens.back().id))
+			literals.pop_back();
+		tokens.pop_back();
+	}
+	void erase_trailing_whitespace()
+	{
+		const size_t last = text.find_last_not_of(" \t");
+		if (last == std::string::npos || last + 1 == text.size())
+			return;
+
+		if (!relex)
+		{
+			size_t end = text.size();
+			for (; !tokens.empty() && end - tokens.back().length > last; pop_back())
+				end -= tokens.back().length;
+			if (end != last + 1)
+				relex = true;
+		}
+
+		text.resize(last + 1);
+	}
+};
+
+/// <summary>
+/// The replacement list of a macro split into text that was lexed already and the replacement operations in between.
+/// </summary>
+struct reshadefx::preprocessor::macro_expansion
+{
+	struct element
+	{
+		explicit element(identifier_table &identifiers) : text(identifiers) {}
+
+		char type;
+		size_t index;
+		token_list text;
+	};
+
+	std::vector<element> elements;
+	// Object-like macros expand to the same tokens every time, so their expansion is only built once
+	std::shared_ptr<const token_list> result;
+};
+
+/// <summary>
+/// The state of a preprocessor after parsing the #include directives at the beginning of a file.
+/// </summary>
+struct reshadefx::preprocessor::precompiled_header
+{
+	struct file
+	{
+		std::string path;
+		uintmax_t size;
+		std::filesystem::file_time_type last_write_time;
+		// This is empty when loaded from disk, in which case the contents are read through the file cache again (unless they were cleared by '#pragma once')
+		std::shared_ptr<const std::string> data;
+	};
+
+	std::string key;
+	std::unordered_map<std::string, macro_definition> macros;
+	std::string output;
+	location output_location;
+	std::vector<std::string> used_macros;
+	std::vector<std::pair<std::string, std::vector<std::string>>> used_pragmas;
+	std::vector<file> files;
+
+	static std::filesystem::path cache_file_path(const std::filesystem::path &cache_path, const std::string &key)
+	{
+		return cache_path / std::filesystem::u8path("reshade-" + std::to_string(std::hash<std::string>()(key)) + ".pch");
+	}
+
+	std::string serialize() const
+	{
+		std::string data = "RSPCH001";
+
+		const auto write_value = [&data](uint64_t value) {
+			data.append(reinterpret_cast<const char *>(&value), sizeof(value));
+		};
+		const auto write_string = [&data, &write_value](std::string_view value) {
+			write_value(value.size());
+			data.append(value);
+		};
+
+		write_string(key);
+
+		write_value(macros.size());
+		for (const auto &[name, macro] : macros)
+		{
+			write_string(name);
+			write_string(macro.replacement_list);
+			write_value(macro.parameters.size());
+			for (const std::string &parameter : macro.parameters)
+				write_string(parameter);
+			write_value((macro.is_variadic ? 1 : 0) | (macro.is_function_like ? 2 : 0));
+		}
+
+		write_string(output);
+		write_string(output_location.source);
+		write_value(output_location.line);
+
+		write_value(used_macros.size());
+		for (const std::string &name : used_macros)
+			write_string(name);
+
+		write_value(used_pragmas.size());
+		for (const auto &[pragma, args] : used_pragmas)
+		{
+			write_string(pragma);
+			write_value(args.size());
+			for (const std::string &arg : args)
+				write_string(arg);
+		}
+
+		write_value(files.size());
+		for (const file &file : files)
+		{
+			write_string(file.path);
+			write_value(file.size);
+			write_value(static_cast<uint64_t>(file.last_write_time.time_since_epoch().count()));
+			write_value(file.data->empty() ? 1 : 0);
+		}
+
+		return data;
+	}
+	bool deserialize(const std::string &data)
+	{
+		if (data.compare(0, 8, "RSPCH001") != 0)
+			return false;
+
+		size_t offset = 8;
+		const auto read_value = [&data, &offset](auto &value) {
+			if (data.size() - offset < sizeof(uint64_t))
+				return false;
+			uint64_t temp;
+			std::memcpy(&temp, data.data() + offset, sizeof(temp));
+			offset += sizeof(temp);
+			value = static_cast<std::remove_reference_t<decltype(value)>>(temp);
+			return true;
+		};
+		const auto read_string = [&data, &offset, &read_value](std::string &value) {
+			size_t size;
+			if (!read_value(size) || data.size() - offset < size)
+				return false;
+			value.assign(data, offset, size);
+			offset += size;
+			return true;
+		};
+
+		if (!read_string(key))
+			return false;
+
+		size_t count;
+		if (!read_value(count))
+			return false;
+		for (size_t i = 0; i < count; ++i)
+		{
+			std::string name;
+			macro macro;
+			size_t num_parameters, flags;
+			if (!read_string(name) || !read_string(macro.replacement_list) || !read_value(num_parameters))
+				return false;
+			for (size_t k = 0; k < num_parameters; ++k)
+				if (!read_string(macro.parameters.emplace_back()))
+					return false;
+			if (!read_value(flags))
+				return false;
+			macro.is_variadic = (flags & 1) != 0;
+			macro.is_function_like = (flags & 2) != 0;
+			macros.emplace(std::move(name), macro);
+		}
+
+		std::string source;
+		if (!read_string(output) || !read_string(source) || !read_value(output_location.line))
+			return false;
+		output_location = location(source, output_location.line);
+
+		if (!read_value(count))
+			return false;
+		for (size_t i = 0; i < count; ++i)
+			if (!read_string(used_macros.emplace_back()))
+				return false;
+
+		if (!read_value(count))
+			return false;
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto &[pragma, args] = used_pragmas.emplace_back();
+			size_t num_args;
+			if (!read_string(pragma) || !read_value(num_args))
+				return false;
+			for (size_t k = 0; k < num_args; ++k)
+				if (!read_string(args.emplace_back()))
+					return false;
+		}
+
+		if (!read_value(count))
+			return false;
+		for (size_t i = 0; i < count; ++i)
+		{
+			file &file = files.emplace_back();
+			uint64_t last_write_time, cleared;
+			if (!read_string(file.path) || !read_value(file.size) || !read_value(last_write_time) || !read_value(cleared))
+				return false;
+			file.last_write_time = std::filesystem::file_time_type(std::filesystem::file_time_type::duration(static_cast<std::filesystem::file_time_type::rep>(last_write_time)));
+			if (cleared)
+				file.data = std::make_shared<const std::string>();
+		}
+
+		return true;
+	}
+};
+
 reshadefx::preprocessor::preprocessor()
 {
+	for (const char *const name : { "defined", "__LINE__", "__FILE__", "__FILE_STEM__", "__FILE_NAME__" })
+		_identifiers.intern(name);
+	assert(_identifiers.find("__FILE_NAME__") == identifier_file_name);
 }
 reshadefx::preprocessor::~preprocessor()
 {
@@ -118,20 +689,34 @@ void reshadefx::preprocessor::add_include_path(const std::filesystem::path &path
 bool reshadefx::preprocessor::add_macro_definition(const std::string &name, const macro &macro)
 {
 	assert(!name.empty());
-	return _macros.emplace(name, macro).second;
+
+	const uint32_t identifier_id = _identifiers.intern(name);
+	if (identifier_id >= _macros.size())
+		_macros.resize(_identifiers.size());
+	else if (_macros[identifier_id] != nullptr)
+		return false;
+
+	_macros[identifier_id] = std::make_unique<macro_definition>(macro);
+	return true;
 }
 
 bool reshadefx::preprocessor::append_file(const std::filesystem::path &path)
 {
-	std::string data;
-	if (!read_file(path, data))
+	std::shared_ptr<const std::string> data = read_file_shared(path);
+	if (data == nullptr)
 		return false;
 
 	_success = true; // Clear success flag before parsing a new file
 
+	if (_use_precompiled_headers)
+		_precompiled_header_key = precompiled_header_key(path);
+
 	push(std::move(data), path.u8string());
 	parse();
 
+	_precompiled_header_key.clear();
+	_pending_precompiled_header.key.clear();
+
 	return _success;
 }
 bool reshadefx::preprocessor::append_string(const std::string &source_code)
@@ -150,6 +735,24 @@ bool reshadefx::preprocessor::append_string(const std::string &source_code)
 	return _success;
 }
 
+std::shared_ptr<const std::string> reshadefx::preprocessor::read_file_shared(const std::filesystem::path &path) const
+{
+	if (_include_cache != nullptr)
+		return _include_cache->read_file(path);
+
+	std::string data;
+	if (!read_file(path, data))
+		return nullptr;
+
+	return std::make_shared<const std::string>(std::move(data));
+}
+
+void reshadefx::preprocessor::enable_precompiled_headers(const std::filesystem::path &cache_path)
+{
+	_use_precompiled_headers = true;
+	_precompiled_header_path = cache_path;
+}
+
 std::vector<std::filesystem::path> reshadefx::preprocessor::included_files() const
 {
 	std::vector<std::filesystem::path> files;
@@ -161,26 +764,31 @@ std::vector<std::filesystem::path> reshadefx::preprocessor::included_files() con
 std::vector<std::pair<std::string, std::string>> reshadefx::preprocessor::used_macro_definitions() const
 {
 	std::vector<std::pair<std::string, std::string>> defines;
-	defines.reserve(_used_macros.size());
-	for (const std::string &name : _used_macros)
-		if (const auto it = _macros.find(name);
+	for (uint32_t identifier_id = 0; identifier_id < _used_macros.size(); ++identifier_id)
+		if (const macro_definition *const macro = find_macro(identifier_id);
 			// Do not include function-like macros, since they are more likely to contain a complex replacement list
-			it != _macros.end() && !it->second.is_function_like)
-			defines.push_back({ name, it->second.replacement_list });
+			_used_macros[identifier_id] && macro != nullptr && !macro->is_function_like)
+			defines.push_back({ std::string(_identifiers.name(identifier_id)), macro->replacement_list });
 	return defines;
 }
 
 void reshadefx::preprocessor::error(const location &location, const std::string &message)
 {
-	_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor error: " + message + '\n';
+	_errors += location.source;
+	_errors += '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor error: " + message + '\n';
 	_success = false; // Unset success flag
 }
 void reshadefx::preprocessor::warning(const location &location, const std::string &message)
 {
-	_errors += location.source + '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor warning: " + message + '\n';
+	_errors += location.source;
+	_errors += '(' + std::to_string(location.line) + ", " + std::to_string(location.column) + ')' + ": preprocessor warning: " + message + '\n';
 }
 
 void reshadefx::preprocessor::push(std::string input, const std::string &name)
+{
+	push(std::make_shared<const std::string>(std::move(input)), name);
+}
+void reshadefx::preprocessor::push(std::shared_ptr<const std::string> input, const std::string &name)
 {
 	location start_location = !name.empty() ?
 		// Start at the beginning of the file when pushing a new file
@@ -188,7 +796,10 @@ void reshadefx::preprocessor::push(std::string input, const std::string &name)
 		// Start with last known token location when pushing an unnamed string
 		_token.location;
 
-	input_level level = { name };
+	input_level level;
+	level.id = ++_next_input_id;
+	if (!name.empty())
+		level.name = start_location.source; // Use the pooled name, since it needs to stay valid after the input level is popped
 	level.lexer.reset(new lexer(
 		std::move(input),
 		true  /* ignore_comments */,
@@ -197,11 +808,49 @@ void reshadefx::preprocessor::push(std::string input, const std::string &name)
 		false /* ignore_line_directives */,
 		true  /* ignore_keywords */,
 		false /* escape_string_literals */,
-		start_location));
+		start_location,
+		&_identifiers));
 	level.next_token.id = tokenid::unknown;
 	level.next_token.location = start_location; // This is used in 'consume' to initialize the output location
+	level.next_token.offset = 0;
+	level.next_token.length = 0;
 
-	// Inherit hidden macros from parent
+	// Share hidden macros with parent
+	if (!_input_stack.empty())
+		level.hidden_macros = _input_stack.back().hidden_macros;
+
+	_input_stack.push_back(std::move(level));
+	_next_input_index = _input_stack.size() - 1;
+
+	// Advance into the input stack to update next token
+	consume();
+}
+void reshadefx::preprocessor::push(std::shared_ptr<const token_list> input)
+{
+	// Start with last known token location, like when pushing an unnamed string
+	const location &start_location = _token.location;
+
+	// Whitespace at the beginning of a line is skipped by the lexer and a '#' would start a preprocessor directive there
+	token_list_cursor first_token;
+	if (start_location.column <= 1)
+		for (; first_token.index < input->tokens.size() && input->tokens[first_token.index].id == tokenid::space; first_token.index++)
+			first_token.offset += input->tokens[first_token.index].length;
+
+	if (input->relex || start_location.column == 0 ||
+		(start_location.column == 1 && first_token.offset < input->text.size() && input->text[first_token.offset] == '#'))
+		return push(input->text);
+
+	input_level level;
+	level.id = ++_next_input_id;
+	level.tokens = std::move(input);
+	level.next_token_cursor = first_token;
+	level.start_location = start_location;
+	level.next_token.id = tokenid::unknown;
+	level.next_token.location = start_location;
+	level.next_token.offset = 0;
+	level.next_token.length = 0;
+
+	// Share hidden macros with parent
 	if (!_input_stack.empty())
 		level.hidden_macros = _input_stack.back().hidden_macros;
 
@@ -235,17 +884,34 @@ bool reshadefx::preprocessor::consume()
 	input_level &input = _input_stack[_current_input_index];
 	if (!input.name.empty() && input.name != _output_location.source)
 	{
-		_output += "#line " + std::to_string(input.next_token.location.line) + " \"" + input.name + "\"\n";
+		// Remember the output before switching files, so that it can be saved as a precompiled header when switching back from an included file (see 'update_precompiled_header')
+		_pending_precompiled_header.return_output_offset = _output.size();
+		_pending_precompiled_header.return_location = _output_location;
+
+		_output += "#line " + std::to_string(input.next_token.location.line) + " \"";
+		_output += input.name;
+		_output += "\"\n";
 		_output_location.line = input.next_token.location.line;
 		_output_location.source = input.name;
+
+		_pending_precompiled_header.return_output_end = _output.size();
+		_pending_precompiled_header.return_token_offset = input.next_token.offset;
 	}
 
 	// Set current token
 	_token = std::move(input.next_token);
-	_current_token_raw_data = input.lexer->input_string().substr(_token.offset, _token.length);
 
 	// Get the next token
-	input.next_token = input.lexer->lex();
+	if (input.tokens != nullptr)
+	{
+		_current_token_raw_data = std::string_view(input.tokens->text).substr(_token.offset, _token.length);
+		input.next_token = input.tokens->next(input.next_token_cursor, input.start_location);
+	}
+	else
+	{
+		_current_token_raw_data = input.lexer->input_string().substr(_token.offset, _token.length);
+		input.next_token = input.lexer->lex();
+	}
 
 	// Verify string literals (since the lexer cannot throw errors itself)
 	if (_token == tokenid::string_literal && _current_token_raw_data.back() != '\"')
@@ -300,14 +966,15 @@ bool reshadefx::preprocessor::expect(tokenid token)
 {
 	if (!accept(token))
 	{
-		auto actual_token = _input_stack[_next_input_index].next_token;
+		const input_level &input = _input_stack[_next_input_index];
+		auto actual_token = input.next_token;
 		actual_token.location.source = _output_location.source;
 
 		if (actual_token == tokenid::end_of_line)
 			error(actual_token.location, "syntax error: unexpected new line");
 		else
 			error(actual_token.location, "syntax error: unexpected token '" +
-				_input_stack[_next_input_index].lexer->input_string().substr(actual_token.offset, actual_token.length) + '\'');
+				std::string((input.tokens != nullptr ? std::string_view(input.tokens->text) : input.lexer->input_string()).substr(actual_token.offset, actual_token.length)) + '\'');
 
 		return false;
 	}
@@ -323,6 +990,10 @@ void reshadefx::preprocessor::parse()
 	{
 		_recursion_count = 0;
 
+		// Keep track of whether the current file only contained #include directives so far
+		if (!_precompiled_header_key.empty() && _current_input_index == 0)
+			update_precompiled_header(line.empty());
+
 		const bool skip = !_if_stack.empty() && _if_stack.back().skipping;
 
 		switch (_token)
@@ -396,7 +1067,7 @@ void reshadefx::preprocessor::parse()
 			parse_include();
 			continue;
 		case tokenid::hash_unknown:
-			error(_token.location, "unrecognized preprocessing directive '" + _token.literal_as_string + '\'');
+			error(_token.location, "unrecognized preprocessing directive '" + std::string(_token.literal_as_string) + '\'');
 			consume_until(tokenid::end_of_line);
 			continue;
 		case tokenid::end_of_line:
@@ -436,11 +1107,12 @@ void reshadefx::preprocessor::parse_def()
 
 	macro m;
 	const auto location = std::move(_token.location);
-	const auto macro_name = std::move(_token.literal_as_string);
+	const std::string macro_name(_token.literal_as_string);
 	const auto macro_name_end_offset = _token.offset + _token.length;
 
 	// Check input string here directly to ensure the parenthesis follows the macro name without any whitespace between
-	if (_input_stack[_current_input_index].lexer->input_string()[macro_name_end_offset] == '(')
+	if (const input_level &input = _input_stack[_current_input_index];
+		input.tokens == nullptr && input.lexer->input_string()[macro_name_end_offset] == '(')
 	{
 		accept(tokenid::parenthesis_open);
 
@@ -448,7 +1120,7 @@ void reshadefx::preprocessor::parse_def()
 
 		while (accept(tokenid::identifier))
 		{
-			m.parameters.push_back(_token.literal_as_string);
+			m.parameters.emplace_back(_token.literal_as_string);
 
 			if (!accept(tokenid::comma))
 				break;
@@ -480,7 +1152,8 @@ void reshadefx::preprocessor::parse_undef()
 	else if (_token.literal_as_string == "defined")
 		return warning(_token.location, "macro name 'defined' is reserved");
 
-	_macros.erase(_token.literal_as_string);
+	if (find_macro(_token.identifier_id) != nullptr)
+		_macros[_token.identifier_id].reset();
 }
 
 void reshadefx::preprocessor::parse_if()
@@ -506,19 +1179,16 @@ void reshadefx::preprocessor::parse_ifdef()
 	if (!expect(tokenid::identifier))
 		return;
 
-	level.value = _macros.find(_token.literal_as_string) != _macros.end() ||
+	level.value = find_macro(_token.identifier_id) != nullptr ||
 		// Check built-in macros as well
-		_token.literal_as_string == "__LINE__" ||
-		_token.literal_as_string == "__FILE__" ||
-		_token.literal_as_string == "__FILE_NAME__" ||
-		_token.literal_as_string == "__FILE_STEM__";
+		(_token.identifier_id >= identifier_line && _token.identifier_id <= identifier_file_name);
 
 	const bool parent_skipping = !_if_stack.empty() && _if_stack.back().skipping;
 	level.skipping = parent_skipping || !level.value;
 
 	_if_stack.push_back(std::move(level));
 	if (!parent_skipping) // Only add if this #ifdef is active
-		_used_macros.emplace(_token.literal_as_string);
+		mark_macro_used(_token.identifier_id);
 }
 void reshadefx::preprocessor::parse_ifndef()
 {
@@ -529,18 +1199,15 @@ void reshadefx::preprocessor::parse_ifndef()
 	if (!expect(tokenid::identifier))
 		return;
 
-	level.value = _macros.find(_token.literal_as_string) == _macros.end() &&
-		_token.literal_as_string != "__LINE__" &&
-		_token.literal_as_string != "__FILE__" &&
-		_token.literal_as_string != "__FILE_NAME__" &&
-		_token.literal_as_string != "__FILE_STEM__";
+	level.value = find_macro(_token.identifier_id) == nullptr &&
+		(_token.identifier_id < identifier_line || _token.identifier_id > identifier_file_name);
 
 	const bool parent_skipping = !_if_stack.empty() && _if_stack.back().skipping;
 	level.skipping = parent_skipping || !level.value;
 
 	_if_stack.push_back(std::move(level));
 	if (!parent_skipping) // Only add if this #ifndef is active
-		_used_macros.emplace(_token.literal_as_string);
+		mark_macro_used(_token.identifier_id);
 }
 void reshadefx::preprocessor::parse_elif()
 {
@@ -591,14 +1258,14 @@ void reshadefx::preprocessor::parse_error()
 	const auto keyword_location = std::move(_token.location);
 	if (!expect(tokenid::string_literal))
 		return;
-	error(keyword_location, _token.literal_as_string);
+	error(keyword_location, std::string(_token.literal_as_string));
 }
 void reshadefx::preprocessor::parse_warning()
 {
 	const auto keyword_location = std::move(_token.location);
 	if (!expect(tokenid::string_literal))
 		return;
-	warning(keyword_location, _token.literal_as_string);
+	warning(keyword_location, std::string(_token.literal_as_string));
 }
 
 void reshadefx::preprocessor::parse_pragma()
@@ -607,7 +1274,7 @@ void reshadefx::preprocessor::parse_pragma()
 	if (!expect(tokenid::identifier))
 		return;
 
-	std::string pragma = std::move(_token.literal_as_string);
+	std::string pragma(_token.literal_as_string);
 	std::vector<std::string> pragma_args;
 	int parentheses_level = accept(tokenid::parenthesis_open) ? 1 : 0;
 
@@ -632,8 +1299,9 @@ void reshadefx::preprocessor::parse_pragma()
 
 	if (pragma == "once")
 	{
-		if (const auto it = _file_cache.find(_output_location.source); it != _file_cache.end())
-			it->second.clear();
+		// Replace the cached contents rather than modifying them, since the lexer of the current file still shares the original data
+		if (const auto it = _file_cache.find(std::string(_output_location.source)); it != _file_cache.end())
+			it->second = std::make_shared<const std::string>();
 		return;
 	}
 
@@ -685,15 +1353,52 @@ void reshadefx::preprocessor::parse_include()
 		return;
 	}
 
-	std::string data;
+	// Restore the state after this include from a precompiled header, or else save it after parsing the file (see 'update_precompiled_header')
+	std::string precompiled_header_key;
+	if (!_precompiled_header_key.empty() && _pending_precompiled_header.key.empty())
+	{
+		// Only consider includes directly in the current file, not ones whose file name is the result of a macro expansion
+		if (_current_input_index != 0)
+		{
+			_precompiled_header_key.clear();
+		}
+		else
+		{
+			precompiled_header_key = _precompiled_header_key + '\n' + file_path_string;
+
+			if (restore_precompiled_header(precompiled_header_key))
+			{
+				_precompiled_header_key = std::move(precompiled_header_key);
+				return;
+			}
+		}
+	}
+
+	// All inclusions of a file share the same data, so it does not need to be copied for every lexer
+	std::shared_ptr<const std::string> data;
 	if (auto it = _file_cache.find(file_path_string);
 		it != _file_cache.end())
 	{
 		data = it->second;
+
+		// Skip files that were included before and whose include guard is still defined, without parsing them again
+		auto guard_it = _include_guards.find(file_path_string);
+		if (guard_it == _include_guards.end())
+			guard_it = _include_guards.emplace(file_path_string, find_include_guard(*data)).first;
+
+		if (const std::string &guard = guard_it->second;
+			!guard.empty() && find_macro(_identifiers.find(guard)) != nullptr)
+		{
+			// Parsing the file would have evaluated the '#ifndef' of the guard
+			mark_macro_used(_identifiers.find(guard));
+			// Still push an empty input, so that the output contains the same line information as when the file was parsed
+			data = std::make_shared<const std::string>();
+		}
 	}
 	else
 	{
-		if (!read_file(file_path, data))
+		data = read_file_shared(file_path);
+		if (data == nullptr)
 		{
 			error(keyword_location, "could not open included file '" + file_path_string + '\'');
 			consume_until(tokenid::end_of_line);
@@ -706,9 +1411,194 @@ void reshadefx::preprocessor::parse_include()
 	// Clear out input stack before pushing include so that hidden macros do not bleed into the include
 	while (_input_stack.size() > (_next_input_index + 1))
 		_input_stack.pop_back();
+
+	if (!precompiled_header_key.empty())
+	{
+		_pending_precompiled_header.key = std::move(precompiled_header_key);
+		_pending_precompiled_header.output_offset = _output.size();
+		_pending_precompiled_header.errors_size = _errors.size();
+	}
+
 	push(std::move(data), file_path_string);
 }
 
+std::string reshadefx::preprocessor::precompiled_header_key(const std::filesystem::path &path) const
+{
+	// The state after the includes depends on everything that affects how they are parsed, which is the directory of the file (used to look up includes), the include paths, the macros defined and the files included before
+	std::string key = path.parent_path().u8string() + '\n';
+
+	for (const std::filesystem::path &include_path : _include_paths)
+		key += include_path.u8string() + '\n';
+
+	// Identifier indices depend on the order in which names were encountered, so sort by name instead
+	std::vector<std::pair<std::string_view, const macro_definition *>> macros;
+	for (uint32_t identifier_id = 0; identifier_id < _macros.size(); ++identifier_id)
+		if (const macro_definition *const macro = _macros[identifier_id].get())
+			macros.emplace_back(_identifiers.name(identifier_id), macro);
+	std::sort(macros.begin(), macros.end(),
+		[](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+
+	for (const auto &[name, macro] : macros)
+	{
+		key += name;
+		if (macro->is_function_like)
+		{
+			key += '(';
+			for (const std::string &parameter : macro->parameters)
+				key += parameter + ',';
+			key += ')';
+		}
+		// Replacement lists can contain any character, so prefix them with their size
+		key += ' ' + std::to_string(macro->replacement_list.size()) + ':';
+		key += macro->replacement_list;
+		key += '\n';
+	}
+
+	for (const auto &it : _file_cache)
+		key += it.first + (it.second->empty() ? " once\n" : "\n");
+
+	return key;
+}
+std::shared_ptr<const reshadefx::preprocessor::precompiled_header> reshadefx::preprocessor::find_precompiled_header(const std::string &key) const
+{
+	if (_include_cache != nullptr)
+	{
+		const std::lock_guard<std::mutex> lock(_include_cache->_mutex);
+
+		if (const auto it = _include_cache->_precompiled_headers.find(key); it != _include_cache->_precompiled_headers.end())
+			return it->second;
+	}
+
+	if (_precompiled_header_path.empty())
+		return nullptr;
+
+	std::string data;
+	if (!read_file(precompiled_header::cache_file_path(_precompiled_header_path, key), data))
+		return nullptr;
+
+	// Different keys can map to the same file name, so need to compare the full key too
+	const auto header = std::make_shared<precompiled_header>();
+	if (!header->deserialize(data) || header->key != key)
+		return nullptr;
+
+	if (_include_cache != nullptr)
+	{
+		const std::lock_guard<std::mutex> lock(_include_cache->_mutex);
+		return _include_cache->_precompiled_headers.emplace(key, header).first->second;
+	}
+
+	return header;
+}
+void reshadefx::preprocessor::store_precompiled_header(std::shared_ptr<const precompiled_header> header) const
+{
+	if (_include_cache != nullptr)
+	{
+		const std::lock_guard<std::mutex> lock(_include_cache->_mutex);
+
+		std::shared_ptr<const precompiled_header> &entry = _include_cache->_precompiled_headers[header->key];
+		// Another instance may have stored the same state in the meantime, which then was saved to disk already
+		const bool is_same = entry != nullptr && std::equal(entry->files.begin(), entry->files.end(), header->files.begin(), header->files.end(),
+			[](const precompiled_header::file &lhs, const precompiled_header::file &rhs) { return lhs.path == rhs.path && lhs.size == rhs.size && lhs.last_write_time == rhs.last_write_time; });
+		entry = header;
+
+		if (is_same)
+			return;
+	}
+
+	if (!_precompiled_header_path.empty())
+		write_file(precompiled_header::cache_file_path(_precompiled_header_path, header->key), header->serialize());
+}
+void reshadefx::preprocessor::update_precompiled_header(bool line_empty)
+{
+	if (!_pending_precompiled_header.key.empty())
+	{
+		// Only save the state if this is the first token after switching back from the included file and parsing it did not report anything
+		if (line_empty &&
+			_token.offset == _pending_precompiled_header.return_token_offset &&
+			_output.size() == _pending_precompiled_header.return_output_end &&
+			_errors.size() == _pending_precompiled_header.errors_size &&
+			_if_stack.empty())
+		{
+			const auto header = std::make_shared<precompiled_header>();
+			header->key = _pending_precompiled_header.key;
+			// Prepared expansions refer to the identifier indices of this instance, so only the definitions are kept
+			for (uint32_t identifier_id = 0; identifier_id < _macros.size(); ++identifier_id)
+				if (const macro_definition *const definition = _macros[identifier_id].get())
+					header->macros.emplace(_identifiers.name(identifier_id), static_cast<const preprocessor::macro &>(*definition));
+			header->output = _output.substr(_pending_precompiled_header.output_offset, _pending_precompiled_header.return_output_offset - _pending_precompiled_header.output_offset);
+			header->output_location = _pending_precompiled_header.return_location;
+			for (uint32_t identifier_id = 0; identifier_id < _used_macros.size(); ++identifier_id)
+				if (_used_macros[identifier_id])
+					header->used_macros.emplace_back(_identifiers.name(identifier_id));
+			header->used_pragmas.assign(_used_pragmas.begin(), _used_pragmas.end());
+
+			bool valid = true;
+			for (const auto &[path, data] : _file_cache)
+			{
+				std::error_code ec;
+				precompiled_header::file &file = header->files.emplace_back();
+				file.path = path;
+				file.size = std::filesystem::file_size(std::filesystem::u8path(path), ec);
+				valid &= !ec;
+				file.last_write_time = std::filesystem::last_write_time(std::filesystem::u8path(path), ec);
+				valid &= !ec;
+				file.data = data;
+			}
+
+			if (valid)
+				store_precompiled_header(header);
+
+			_precompiled_header_key = std::move(_pending_precompiled_header.key);
+		}
+		else
+		{
+			_precompiled_header_key.clear();
+		}
+
+		_pending_precompiled_header.key.clear();
+	}
+
+	// Any other directive or token ends the sequence of includes at the beginning of the file
+	if ((_token != tokenid::space && _token != tokenid::end_of_line && _token != tokenid::hash_include) || (_token == tokenid::hash_include && !line_empty))
+		_precompiled_header_key.clear();
+}
+bool reshadefx::preprocessor::restore_precompiled_header(const std::string &key)
+{
+	const std::shared_ptr<const precompiled_header> header = find_precompiled_header(key);
+	if (header == nullptr)
+		return false;
+
+	// Check that none of the included files changed since the state was saved
+	std::vector<std::shared_ptr<const std::string>> file_data;
+	file_data.reserve(header->files.size());
+	for (const precompiled_header::file &file : header->files)
+	{
+		std::error_code ec;
+		if (std::filesystem::file_size(std::filesystem::u8path(file.path), ec) != file.size || ec ||
+			std::filesystem::last_write_time(std::filesystem::u8path(file.path), ec) != file.last_write_time || ec)
+			return false;
+
+		std::shared_ptr<const std::string> data = file.data != nullptr ? file.data : read_file_shared(std::filesystem::u8path(file.path));
+		if (data == nullptr)
+			return false;
+		file_data.push_back(std::move(data));
+	}
+
+	_macros.clear();
+	for (const auto &[name, macro] : header->macros)
+		add_macro_definition(name, macro);
+	_output += header->output;
+	_output_location = header->output_location;
+	for (const std::string &name : header->used_macros)
+		mark_macro_used(_identifiers.intern(name));
+	_used_pragmas.insert(header->used_pragmas.begin(), header->used_pragmas.end());
+
+	for (size_t i = 0; i < header->files.size(); ++i)
+		_file_cache[header->files[i].path] = std::move(file_data[i]);
+
+	return true;
+}
+
 bool reshadefx::preprocessor::evaluate_expression()
 {
 	struct rpn_token
@@ -885,16 +1775,16 @@ bool reshadefx::preprocessor::evaluate_expression()
 				rpn[rpn_index++] = { std::filesystem::exists(file_path, ec) ? 1 : 0, false };
 				continue;
 			}
-			if (_token.literal_as_string == "defined")
+			if (_token.identifier_id == identifier_defined)
 			{
 				const bool has_parentheses = accept(tokenid::parenthesis_open);
 				if (!expect(tokenid::identifier))
 					return false;
-				const std::string macro_name = std::move(_token.literal_as_string);
+				const bool is_defined = find_macro(_token.identifier_id) != nullptr;
 				if (has_parentheses && !expect(tokenid::parenthesis_close))
 					return false;
 
-				rpn[rpn_index++] = { _macros.find(macro_name) != _macros.end() ? 1 : 0, false };
+				rpn[rpn_index++] = { is_defined ? 1 : 0, false };
 				continue;
 			}
 
@@ -1050,36 +1940,37 @@ bool reshadefx::preprocessor::evaluate_expression()
 
 bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 {
-	if (_token.literal_as_string == "__LINE__")
+	if (_token.identifier_id == identifier_line)
 	{
 		push(std::to_string(_token.location.line));
 		return true;
 	}
-	if (_token.literal_as_string == "__FILE__")
+	if (_token.identifier_id == identifier_file)
 	{
-		push(escape_string(_token.location.source));
+		push(escape_string(std::string(_token.location.source)));
 		return true;
 	}
-	if (_token.literal_as_string == "__FILE_STEM__")
+	if (_token.identifier_id == identifier_file_stem)
 	{
 		const std::filesystem::path file_stem = std::filesystem::u8path(_token.location.source).stem();
 		push(escape_string(file_stem.u8string()));
 		return true;
 	}
-	if (_token.literal_as_string == "__FILE_NAME__")
+	if (_token.identifier_id == identifier_file_name)
 	{
 		const std::filesystem::path file_name = std::filesystem::u8path(_token.location.source).filename();
 		push(escape_string(file_name.u8string()));
 		return true;
 	}
 
-	const auto it = _macros.find(_token.literal_as_string);
-	if (it == _macros.end())
+	const uint32_t macro_id = _token.identifier_id;
+	macro_definition *const macro = find_macro(macro_id);
+	if (macro == nullptr)
 		return false;
 
-	const std::unordered_set<std::string> &hidden_macros = _input_stack[_current_input_index].hidden_macros;
-	if (hidden_macros.find(_token.literal_as_string) != hidden_macros.end())
-		return false;
+	for (const hidden_macro *hidden = _input_stack[_current_input_index].hidden_macros.get(); hidden != nullptr; hidden = hidden->next.get())
+		if (hidden->macro_id == macro_id)
+			return false;
 
 	const auto macro_location = _token.location;
 	if (_recursion_count++ >= 256)
@@ -1088,8 +1979,8 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 		return false;
 	}
 
-	std::vector<std::string> arguments;
-	if (it->second.is_function_like)
+	std::vector<std::shared_ptr<const token_list>> arguments;
+	if (macro->is_function_like)
 	{
 		if (!accept(tokenid::parenthesis_open))
 			return false;
@@ -1097,7 +1988,7 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 		while (true)
 		{
 			int parentheses_level = 0;
-			std::string argument;
+			const auto argument = std::make_shared<token_list>(_identifiers);
 
 			while (true)
 			{
@@ -1115,106 +2006,180 @@ bool reshadefx::preprocessor::evaluate_identifier_as_macro()
 				if (_token == tokenid::parenthesis_close && --parentheses_level < 0)
 					break;
 
-				// Collapse all whitespace down to a single space
-				if (_token == tokenid::space)
-					argument += ' ';
-				else
-					argument += _current_token_raw_data;
+				// Collapse all whitespace down to a single space and trim it from the start of the argument
+				if (_token == tokenid::space && argument->text.empty())
+					continue;
+				argument->append_from_input(_token, _token == tokenid::space ? std::string_view(" ") : std::string_view(_current_token_raw_data), _input_stack[_current_input_index].id);
 			}
 
-			// Trim whitespace from argument
-			const size_t first = argument.find_first_not_of(" \t");
-			if (first == std::string::npos)
-			{
-				argument.clear();
-			}
-			else
-			{
-				const size_t last = argument.find_last_not_of(" \t");
-				argument = argument.substr(first, last - first + 1);
-			}
-			arguments.push_back(std::move(argument));
+			// Trim whitespace from the end of the argument
+			argument->erase_trailing_whitespace();
+
+			// Terminate the argument with a marker, so that its end can be detected after pushing it as input (see 'expand_macro')
+			token marker;
+			marker.id = tokenid::unknown;
+			marker.literal_as_double = 0;
+			const char marker_data = macro_replacement_argument;
+			argument->append(marker, std::string_view(&marker_data, 1), true);
+
+			arguments.push_back(argument);
 
 			if (parentheses_level < 0)
 				break;
 		}
 	}
 
-	std::string input;
-	expand_macro(it->first, it->second, arguments, input);
+	_macro_expansion_count++;
+
+	const macro_expansion &expansion = prepare_macro_expansion(*macro);
+
+	std::shared_ptr<const token_list> input = expansion.result;
+	if (input == nullptr)
+	{
+		const auto list = std::make_shared<token_list>(_identifiers);
+		expand_macro(_identifiers.name(macro_id), expansion, arguments, *list);
+		input = list;
+	}
 
-	if (!input.empty())
+	if (!input->text.empty())
 	{
 		push(std::move(input));
 
-		_input_stack[_current_input_index].hidden_macros.insert(it->first);
+		std::shared_ptr<const hidden_macro> &hidden_macros = _input_stack[_current_input_index].hidden_macros;
+		hidden_macros = std::make_shared<const hidden_macro>(hidden_macro { macro_id, std::move(hidden_macros) });
 	}
 
 	return true;
 }
 
-void reshadefx::preprocessor::expand_macro(const std::string &name, const macro &macro, const std::vector<std::string> &arguments, std::string &out)
+void reshadefx::preprocessor::expand_macro(std::string_view name, const macro_expansion &expansion, const std::vector<std::shared_ptr<const token_list>> &arguments, token_list &out)
 {
-	for (size_t offset = 0; offset < macro.replacement_list.size(); ++offset)
+	for (const macro_expansion::element &element : expansion.elements)
 	{
-		if (macro.replacement_list[offset] != macro_replacement_start)
+		if (element.type == macro_replacement_start)
 		{
-			out += macro.replacement_list[offset];
+			out.append(element.text);
 			continue;
 		}
-
-		// This is a special replacement sequence
-		const auto type = macro.replacement_list[++offset];
-		if (type == macro_replacement_concat)
+		if (element.type == macro_replacement_concat)
 		{
-			// Remove any whitespace preceeding or following the concatenation operator (so "a ## b" becomes "ab")
-			if (const size_t last = out.find_last_not_of(" \t");
-				last != std::string::npos && last + 1 < out.size())
-				out.erase(last + 1);
-			while (offset + 1 != macro.replacement_list.size() &&
-				(macro.replacement_list[offset + 1] == ' ' || macro.replacement_list[offset + 1] == '\t'))
-				++offset;
+			// Remove any whitespace preceeding the concatenation operator (so "a ## b" becomes "ab")
+			out.erase_trailing_whitespace();
+			out.concat_next = true;
 			continue;
 		}
 
-		const auto index = macro.replacement_list[++offset];
-		if (static_cast<size_t>(index) >= arguments.size())
+		if (element.index >= arguments.size())
 		{
-			warning(_token.location, "not enough arguments for function-like macro invocation '" + name + "'");
+			warning(_token.location, "not enough arguments for function-like macro invocation '" + std::string(name) + "'");
 			continue;
 		}
 
-		switch (type)
+		switch (element.type)
 		{
 		case macro_replacement_stringize:
-			out.reserve(out.size() + 2 + arguments[index].size());
-			out += '"';
-			for (const char c : arguments[index])
-			{
-				// Adds backslashes to escape quotes
-				if (c == '"')
-					out += '\\';
-				out += c;
-			}
-			out += '"';
+			out.append_stringized(*arguments[element.index]);
 			break;
 		case macro_replacement_argument:
-			push(arguments[index] + static_cast<char>(macro_replacement_argument));
+			push(arguments[element.index]);
 			while (true)
 			{
+				// Tokens that cannot start another macro expansion are copied over as a whole, rather than consuming them one by one
+				// The last token of a list is always consumed, so that switching to the next input level happens as usual
+				if (input_level &input = _input_stack[_next_input_index];
+					input.tokens != nullptr && input.next_token != tokenid::identifier && input.next_token != tokenid::unknown)
+				{
+					const token_list &list = *input.tokens;
+
+					token_list_cursor begin = input.next_token_cursor;
+					begin.index -= 1;
+					begin.offset = input.next_token.offset;
+					begin.literal_index -= token_list::has_literal(input.next_token) ? 1 : 0;
+
+					token_list_cursor end = begin;
+					for (; end.index + 1 < list.tokens.size() && list.tokens[end.index].id != tokenid::identifier && list.tokens[end.index].id != tokenid::unknown; end.index++)
+					{
+						end.offset += list.tokens[end.index].length;
+						end.literal_index += token_list::has_literal(list.tokens[end.index].id) ? 1 : 0;
+					}
+
+					if (end.index > begin.index + 1)
+					{
+						out.append(list, begin, end);
+						out.source_id = input.id;
+						out.source_end = end.offset;
+
+						input.next_token_cursor = end;
+						input.next_token = list.next(input.next_token_cursor, input.start_location);
+					}
+				}
+
 				// Consume all tokens here, so spaces are added to the output too
 				consume();
 				if (_token == tokenid::unknown) // 'macro_replacement_argument' is 'tokenid::unknown'
 					break;
 				if (_token == tokenid::identifier && evaluate_identifier_as_macro())
 					continue;
-				out += _current_token_raw_data;
+				out.append_from_input(_token, _current_token_raw_data, _input_stack[_current_input_index].id);
 			}
 			assert(_current_token_raw_data[0] == macro_replacement_argument);
 			break;
 		}
 	}
 }
+const reshadefx::preprocessor::macro_expansion &reshadefx::preprocessor::prepare_macro_expansion(macro_definition &macro)
+{
+	if (macro.expansion != nullptr)
+		return *macro.expansion;
+
+	const auto expansion = std::make_shared<macro_expansion>();
+	bool depends_on_arguments = false;
+
+	for (size_t offset = 0, text_offset = 0; offset <= macro.replacement_list.size(); ++offset)
+	{
+		if (offset != macro.replacement_list.size() && macro.replacement_list[offset] != macro_replacement_start)
+			continue;
+
+		// Lex the text between the special replacement sequences only once here, rather than every time the macro is expanded
+		if (offset != text_offset)
+		{
+			macro_expansion::element &element = expansion->elements.emplace_back(_identifiers);
+			element.type = macro_replacement_start;
+			element.text.append_text(macro.replacement_list.substr(text_offset, offset - text_offset));
+		}
+
+		if (offset == macro.replacement_list.size())
+			break;
+
+		// This is a special replacement sequence
+		macro_expansion::element &element = expansion->elements.emplace_back(_identifiers);
+		element.type = macro.replacement_list[++offset];
+		if (element.type == macro_replacement_concat)
+		{
+			// Skip any whitespace following the concatenation operator
+			while (offset + 1 != macro.replacement_list.size() &&
+				(macro.replacement_list[offset + 1] == ' ' || macro.replacement_list[offset + 1] == '\t'))
+				++offset;
+		}
+		else
+		{
+			element.index = static_cast<size_t>(macro.replacement_list[++offset]);
+			depends_on_arguments = true;
+		}
+
+		text_offset = offset + 1;
+	}
+
+	if (!macro.is_function_like && !depends_on_arguments)
+	{
+		const auto result = std::make_shared<token_list>(_identifiers);
+		expand_macro(std::string_view(), *expansion, {}, *result);
+		expansion->result = result;
+	}
+
+	macro.expansion = expansion;
+	return *expansion;
+}
 void reshadefx::preprocessor::create_macro_replacement_list(macro &macro)
 {
 	// Since the number of parameters is encoded in the string, it may not exceed the available size of a char
@@ -1281,3 +2246,39 @@ void reshadefx::preprocessor::create_macro_replacement_list(macro &macro)
 		macro.replacement_list += _current_token_raw_data;
 	}
 }
+
+std::shared_ptr<const std::string> reshadefx::include_cache::read_file(const std::filesystem::path &path)
+{
+	// Entries are validated against the size and modification time of the file on every lookup, so changes on disk are picked up while the cache is in use
+	std::error_code ec;
+	const uintmax_t size = std::filesystem::file_size(path, ec);
+	if (ec)
+		return nullptr;
+	const std::filesystem::file_time_type last_write_time = std::filesystem::last_write_time(path, ec);
+	if (ec)
+		return nullptr;
+
+	// Different relative paths can refer to the same file, so use the canonical path as key
+	const std::filesystem::path canonical_path = std::filesystem::weakly_canonical(path, ec);
+	const std::string key = ec ? path.u8string() : canonical_path.u8string();
+
+	{
+		const std::lock_guard<std::mutex> lock(_mutex);
+
+		if (const auto it = _files.find(key);
+			it != _files.end() && it->second.size == size && it->second.last_write_time == last_write_time)
+			return it->second.data;
+	}
+
+	// Read file outside the lock, so that threads loading different files do not have to wait on each other
+	std::string file_data;
+	if (!::read_file(path, file_data))
+		return nullptr;
+
+	auto data = std::make_shared<const std::string>(std::move(file_data));
+
+	const std::lock_guard<std::mutex> lock(_mutex);
+	_files[key] = { size, last_write_time, data };
+
+	return data;
+}
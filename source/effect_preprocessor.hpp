@@ -6,13 +6,16 @@
 #pragma once
 
 #include "effect_token.hpp"
-#include <memory> // std::unique_ptr
+#include <mutex>
+#include <memory> // std::unique_ptr, std::shared_ptr
 #include <filesystem>
 #include <unordered_map>
 #include <unordered_set>
 
 namespace reshadefx
 {
+	class include_cache;
+
 	/// <summary>
 	/// A C-style preprocessor implementation.
 	/// </summary>
@@ -68,6 +71,19 @@ namespace reshadefx
 		/// <returns>A boolean value indicating whether parsing was successful or not.</returns>
 		bool append_string(const std::string &source_code);
 
+		/// <summary>
+		/// Share the state after the #include directives at the beginning of a file between all preprocessor instances using the same include cache (see <see cref="set_include_cache"/>).
+		/// Files that start with the same includes and are parsed with the same macro definitions then restore that state instead of parsing the included files again.
+		/// </summary>
+		/// <param name="cache_path">An optional directory to also save the state to, so that it can be restored by later processes.</param>
+		void enable_precompiled_headers(const std::filesystem::path &cache_path = std::filesystem::path());
+
+		/// <summary>
+		/// Read files through the specified cache, so that files that were already read by another preprocessor instance using the same cache are not read again.
+		/// </summary>
+		/// <param name="cache">The cache to use, which has to stay alive as long as this preprocessor instance, or <see langword="nullptr"/> to read all files from disk.</param>
+		void set_include_cache(include_cache *cache) { _include_cache = cache; }
+
 		/// <summary>
 		/// Get the list of error messages.
 		/// </summary>
@@ -95,6 +111,11 @@ namespace reshadefx
 		/// </summary>
 		const std::unordered_map<std::string, std::vector<std::string>> &used_pragmas() const { return _used_pragmas; }
 
+		/// <summary>
+		/// Get the number of macros that were expanded.
+		/// </summary>
+		size_t macro_expansion_count() const { return _macro_expansion_count; }
+
 	private:
 		struct if_level
 		{
@@ -103,18 +124,46 @@ namespace reshadefx
 			token pp_token;
 			size_t input_index;
 		};
+		struct token_list;
+		struct token_list_cursor
+		{
+			size_t index = 0, offset = 0, literal_index = 0;
+		};
+		struct macro_expansion;
+		struct macro_definition : macro
+		{
+			macro_definition(const macro &definition) : macro(definition) {}
+
+			// Replacement list split into pre-lexed pieces, which is built when the macro is first expanded
+			std::shared_ptr<const macro_expansion> expansion;
+		};
+		struct precompiled_header;
+		// Linked list of macros that are not expanded again, since the input is part of their expansion
+		// Input levels share the list of the level they were pushed from and only prepend the macros they add
+		struct hidden_macro
+		{
+			uint32_t macro_id;
+			std::shared_ptr<const hidden_macro> next;
+		};
 		struct input_level
 		{
-			std::string name;
+			size_t id;
+			std::string_view name;
 			std::unique_ptr<class lexer> lexer;
+			// Macro expansions are played back from a list of tokens instead of being lexed again
+			std::shared_ptr<const token_list> tokens;
+			token_list_cursor next_token_cursor;
+			location start_location;
 			token next_token;
-			std::unordered_set<std::string> hidden_macros;
+			std::shared_ptr<const hidden_macro> hidden_macros;
 		};
 
 		void error(const location &location, const std::string &message);
 		void warning(const location &location, const std::string &message);
 
 		void push(std::string input, const std::string &name = std::string());
+		void push(std::shared_ptr<const std::string> input, const std::string &name);
+		void push(std::shared_ptr<const token_list> input);
 
 		bool peek(tokenid token) const;
 		bool consume();
@@ -136,11 +185,30 @@ namespace reshadefx
 		void parse_pragma();
 		void parse_include();
 
+		std::shared_ptr<const std::string> read_file_shared(const std::filesystem::path &path) const;
+
 		bool evaluate_expression();
 		bool evaluate_identifier_as_macro();
 
-		void expand_macro(const std::string &name, const macro &macro, const std::vector<std::string> &arguments, std::string &out);
+		void expand_macro(std::string_view name, const macro_expansion &expansion, const std::vector<std::shared_ptr<const token_list>> &arguments, token_list &out);
+		const macro_expansion &prepare_macro_expansion(macro_definition &macro);
 		void create_macro_replacement_list(macro &macro);
+		macro_definition *find_macro(uint32_t identifier_id) const
+		{
+			return identifier_id < _macros.size() ? _macros[identifier_id].get() : nullptr;
+		}
+		void mark_macro_used(uint32_t identifier_id)
+		{
+			if (identifier_id >= _used_macros.size())
+				_used_macros.resize(_identifiers.size());
+			_used_macros[identifier_id] = true;
+		}
+
+		std::string precompiled_header_key(const std::filesystem::path &path) const;
+		std::shared_ptr<const precompiled_header> find_precompiled_header(const std::string &key) const;
+		void store_precompiled_header(std::shared_ptr<const precompiled_header> header) const;
+		void update_precompiled_header(bool line_empty);
+		bool restore_precompiled_header(const std::string &key);
 
 		bool _success = true;
 		std::string _output, _errors;
@@ -150,12 +218,67 @@ namespace reshadefx
 		std::vector<input_level> _input_stack;
 		size_t _next_input_index = 0;
 		size_t _current_input_index = 0;
+		size_t _next_input_id = 0;
 		unsigned short _recursion_count = 0;
+		size_t _macro_expansion_count = 0;
 		location _output_location;
-		std::unordered_set<std::string> _used_macros;
-		std::unordered_map<std::string, macro> _macros;
+		// Identifiers of all tokens are interned, so that macros can be looked up by index instead of by name
+		identifier_table _identifiers;
+		std::vector<bool> _used_macros;
+		std::vector<std::unique_ptr<macro_definition>> _macros;
 		std::vector<std::filesystem::path> _include_paths;
-		std::unordered_map<std::string, std::string> _file_cache;
+		include_cache *_include_cache = nullptr;
+		// Files included by this instance, sharing their contents with the include cache
+		std::unordered_map<std::string, std::shared_ptr<const std::string>> _file_cache;
+		// Include guard macro names of files that were included more than once (empty if a file has none)
+		std::unordered_map<std::string, std::string> _include_guards;
 		std::unordered_map<std::string, std::vector<std::string>> _used_pragmas;
+		bool _use_precompiled_headers = false;
+		std::filesystem::path _precompiled_header_path;
+		// Identifies the state after the #include directives at the beginning of the current file, or is empty once anything else was encountered
+		std::string _precompiled_header_key;
+		// State of the precompiled header that is built while parsing an included file
+		struct
+		{
+			std::string key;
+			size_t output_offset = 0;
+			size_t errors_size = 0;
+			// Output before the #line directive that was written when switching back to the including file
+			size_t return_output_offset = 0;
+			size_t return_output_end = 0;
+			size_t return_token_offset = 0;
+			location return_location;
+		} _pending_precompiled_header;
+
+		friend class include_cache;
+	};
+
+	/// <summary>
+	/// Contents of files and precompiled headers shared between preprocessor instances, so that files included by many of them are only read and parsed once.
+	/// This keeps everything that was read alive, so should only exist while a batch of files is parsed (e.g. during one reload of all effects).
+	/// </summary>
+	class include_cache
+	{
+	public:
+		/// <summary>
+		/// Get the contents of the specified file, which are only read from disk again if the file changed since it was last read.
+		/// </summary>
+		/// <param name="path">The path to the file to read.</param>
+		/// <returns>The file contents, or <see langword="nullptr"/> if the file could not be read.</returns>
+		std::shared_ptr<const std::string> read_file(const std::filesystem::path &path);
+
+	private:
+		struct cached_file
+		{
+			uintmax_t size;
+			std::filesystem::file_time_type last_write_time;
+			std::shared_ptr<const std::string> data;
+		};
+
+		std::mutex _mutex;
+		std::unordered_map<std::string, cached_file> _files;
+		std::unordered_map<std::string, std::shared_ptr<const preprocessor::precompiled_header>> _precompiled_headers;
+
+		friend class preprocessor;
 	};
 }
@@ -4,10 +4,12 @@
  */
 
 #include "effect_symbol_table.hpp"
+#include <cmath>
 #include <cassert>
 #include <malloc.h> // alloca
-#include <algorithm> // std::upper_bound, std::sort
+#include <algorithm> // std::find_if, std::upper_bound, std::sort
 #include <functional> // std::greater
+#include <iterator> // std::size
 
 #pragma region Import intrinsic functions
 
@@ -100,7 +102,7 @@ static const intrinsic s_intrinsics[] =
 #undef uint2
 #undef uint3
 #undef uint4
-#undef float1
+#undef float
 #undef float2
 #undef float3
 #undef float4
@@ -114,6 +116,22 @@ static const intrinsic s_intrinsics[] =
 #undef sampler
 #undef storage
 
+// Overloads of the same intrinsic are defined next to each other, so each name maps to a contiguous range in the intrinsic list
+static const std::unordered_map<std::string_view, std::pair<uint32_t, uint32_t>> &intrinsic_ranges()
+{
+	static const std::unordered_map<std::string_view, std::pair<uint32_t, uint32_t>> s_ranges = []() {
+		std::unordered_map<std::string_view, std::pair<uint32_t, uint32_t>> ranges;
+		for (uint32_t i = 0; i < static_cast<uint32_t>(std::size(s_intrinsics)); ++i)
+		{
+			auto &range = ranges.try_emplace(s_intrinsics[i].function.name, i, i).first->second;
+			assert(range.second == i);
+			range.second = i + 1;
+		}
+		return ranges;
+	}();
+	return s_ranges;
+}
+
 #pragma endregion
 
 unsigned int reshadefx::type::rank(const type &src, const type &dst)
@@ -158,9 +176,13 @@ unsigned int reshadefx::type::rank(const type &src, const type &dst)
 
 reshadefx::symbol_table::symbol_table()
 {
-	_current_scope.name = "::";
+	_current_scope.namespace_id = 0;
 	_current_scope.level = 0;
 	_current_scope.namespace_level = 0;
+
+	// The global namespace always has index zero
+	_namespaces.push_back({ "::", 0 });
+	_namespace_lookup.emplace("::", 0);
 }
 
 void reshadefx::symbol_table::enter_scope()
@@ -169,7 +191,13 @@ void reshadefx::symbol_table::enter_scope()
 }
 void reshadefx::symbol_table::enter_namespace(const std::string &name)
 {
-	_current_scope.name += name + "::";
+	// Namespaces can be reopened, so reuse the index of a namespace with the same full name
+	std::string full_name = _namespaces[_current_scope.namespace_id].name + name + "::";
+	const auto it = _namespace_lookup.try_emplace(std::move(full_name), static_cast<uint32_t>(_namespaces.size())).first;
+	if (it->second == _namespaces.size())
+		_namespaces.push_back({ it->first, _current_scope.namespace_id });
+
+	_current_scope.namespace_id = it->second;
 	_current_scope.level++;
 	_current_scope.namespace_level++;
 }
@@ -177,22 +205,20 @@ void reshadefx::symbol_table::leave_scope()
 {
 	assert(_current_scope.level > 0);
 
-	for (auto &symbol : _symbol_stack)
+	// Only the local symbols that were declared in this scope have to be removed, which are the last ones in the list
+	while (!_local_symbols.empty() && _local_symbols.back().second >= _current_scope.level)
 	{
-		std::vector<scoped_symbol> &scope_list = symbol.second;
+		const auto [identifier_id, level] = _local_symbols.back();
+		_local_symbols.pop_back();
 
-		for (auto scope_it = scope_list.begin(); scope_it != scope_list.end();)
-		{
-			if (scope_it->scope.level > scope_it->scope.namespace_level &&
-				scope_it->scope.level >= _current_scope.level)
-			{
-				scope_it = scope_list.erase(scope_it);
-			}
-			else
-			{
-				++scope_it;
-			}
-		}
+		std::vector<scoped_symbol> &scope_list = _symbol_stack[identifier_id];
+
+		const auto scope_it = std::find_if(scope_list.rbegin(), scope_list.rend(),
+			[level = level](const scoped_symbol &symbol) {
+				return symbol.scope.level > symbol.scope.namespace_level && symbol.scope.level == level;
+			});
+		assert(scope_it != scope_list.rend());
+		scope_list.erase(std::next(scope_it).base());
 	}
 
 	_current_scope.level--;
@@ -202,7 +228,7 @@ void reshadefx::symbol_table::leave_namespace()
 	assert(_current_scope.level > 0);
 	assert(_current_scope.namespace_level > 0);
 
-	_current_scope.name.erase(_current_scope.name.substr(0, _current_scope.name.size() - 2).rfind("::") + 2);
+	_current_scope.namespace_id = _namespaces[_current_scope.namespace_id].parent;
 	_current_scope.level--;
 	_current_scope.namespace_level--;
 }
@@ -216,37 +242,47 @@ bool reshadefx::symbol_table::insert_symbol(const std::string &name, const symbo
 		return false;
 
 	// Insertion routine which keeps the symbol stack sorted by namespace level
-	const auto insert_sorted = [](auto &vec, const auto &item) {
-		return vec.insert(
+	const auto insert_sorted = [this](std::string_view name, const scoped_symbol &item) {
+		const uint32_t identifier_id = _identifiers.intern(name);
+		if (identifier_id >= _symbol_stack.size())
+			_symbol_stack.resize(_identifiers.size());
+		auto &vec = _symbol_stack[identifier_id];
+		vec.insert(
 			std::upper_bound(vec.begin(), vec.end(), item,
-				[](auto lhs, auto rhs) {
+				[](const scoped_symbol &lhs, const scoped_symbol &rhs) {
 					return lhs.scope.namespace_level < rhs.scope.namespace_level;
 				}), item);
+		return identifier_id;
 	};
 
 	// Global symbols are accessible from every scope
 	if (global)
 	{
-		scope scope = { "", 0, 0 };
+		const std::string &current_name = _namespaces[_current_scope.namespace_id].name;
 
-		// Walk scope chain from global scope back to current one
-		for (size_t pos = 0; pos != std::string::npos; pos = _current_scope.name.find("::", pos))
+		// Walk scope chain from current scope back to the global one and insert the symbol qualified with the namespaces in between
+		struct scope scope = { _current_scope.namespace_id, _current_scope.namespace_level, _current_scope.namespace_level };
+		while (true)
 		{
-			// Extract scope name
-			scope.name = _current_scope.name.substr(0, pos += 2);
-			const auto previous_scope_name = _current_scope.name.substr(pos);
+			const std::string &scope_name = _namespaces[scope.namespace_id].name;
+
+			insert_sorted(current_name.substr(scope_name.size()) + name, scoped_symbol { symbol, scope });
 
-			// Insert symbol into this scope
-			insert_sorted(_symbol_stack[previous_scope_name + name], scoped_symbol { symbol, scope });
+			if (scope.namespace_level == 0)
+				break;
 
-			// Continue walking up the scope chain
-			scope.level = ++scope.namespace_level;
+			scope.namespace_id = _namespaces[scope.namespace_id].parent;
+			scope.level = --scope.namespace_level;
 		}
 	}
 	else
 	{
 		// This is a local symbol so it's sufficient to update the symbol stack with just the current scope
-		insert_sorted(_symbol_stack[name], scoped_symbol { symbol, _current_scope });
+		const uint32_t identifier_id = insert_sorted(name, scoped_symbol { symbol, _current_scope });
+
+		// Keep track of symbols that have to be removed again when leaving the current scope
+		if (_current_scope.level > _current_scope.namespace_level)
+			_local_symbols.emplace_back(identifier_id, _current_scope.level);
 	}
 
 	return true;
@@ -259,19 +295,23 @@ reshadefx::scoped_symbol reshadefx::symbol_table::find_symbol(const std::string
 }
 reshadefx::scoped_symbol reshadefx::symbol_table::find_symbol(const std::string &name, const scope &scope, bool exclusive) const
 {
-	const auto stack_it = _symbol_stack.find(name);
-
+	return find_symbol(_identifiers.find(name), scope, exclusive);
+}
+reshadefx::scoped_symbol reshadefx::symbol_table::find_symbol(uint32_t identifier_id, const scope &scope, bool exclusive) const
+{
 	// Check if symbol does exist
-	if (stack_it == _symbol_stack.end() || stack_it->second.empty())
+	if (identifier_id >= _symbol_stack.size() || _symbol_stack[identifier_id].empty())
 		return {};
 
+	const std::vector<scoped_symbol> &scope_list = _symbol_stack[identifier_id];
+
 	// Walk up the scope chain starting at the requested scope level and find a matching symbol
 	scoped_symbol result = {};
 
-	for (auto it = stack_it->second.rbegin(), end = stack_it->second.rend(); it != end; ++it)
+	for (auto it = scope_list.rbegin(), end = scope_list.rend(); it != end; ++it)
 	{
 		if (it->scope.level > scope.level ||
-			it->scope.namespace_level > scope.namespace_level || (it->scope.namespace_level == scope.namespace_level && it->scope.name != scope.name))
+			it->scope.namespace_level > scope.namespace_level || (it->scope.namespace_level == scope.namespace_level && it->scope.namespace_id != scope.namespace_id))
 			continue;
 		if (exclusive && it->scope.level < scope.level)
 			continue;
@@ -285,7 +325,7 @@ reshadefx::scoped_symbol reshadefx::symbol_table::find_symbol(const std::string
 	return result;
 }
 
-static int compare_functions(const std::vector<reshadefx::expression> &arguments, const reshadefx::function_info *function1, const reshadefx::function_info *function2)
+static int compare_functions(const reshadefx::expression_list &arguments, const reshadefx::function_info *function1, const reshadefx::function_info *function2)
 {
 	const size_t num_arguments = arguments.size();
 
@@ -334,7 +374,7 @@ static int compare_functions(const std::vector<reshadefx::expression> &arguments
 	return 0; // Both functions are equally viable
 }
 
-bool reshadefx::symbol_table::resolve_function_call(const std::string &name, const std::vector<expression> &arguments, const scope &scope, symbol &out_data, bool &is_ambiguous) const
+bool reshadefx::symbol_table::resolve_function_call(const std::string &name, const expression_list &arguments, const scope &scope, symbol &out_data, bool &is_ambiguous) const
 {
 	out_data.op = symbol_type::function;
 
@@ -343,16 +383,17 @@ bool reshadefx::symbol_table::resolve_function_call(const std::string &name, con
 	unsigned int overload_namespace = scope.namespace_level;
 
 	// Look up function name in the symbol stack and loop through the associated symbols
-	const auto stack_it = _symbol_stack.find(name);
-
-	if (stack_it != _symbol_stack.end() && !stack_it->second.empty())
+	if (const uint32_t identifier_id = _identifiers.find(name);
+		identifier_id < _symbol_stack.size() && !_symbol_stack[identifier_id].empty())
 	{
-		for (auto it = stack_it->second.rbegin(), end = stack_it->second.rend(); it != end; ++it)
+		const std::vector<scoped_symbol> &scope_list = _symbol_stack[identifier_id];
+
+		for (auto it = scope_list.rbegin(), end = scope_list.rend(); it != end; ++it)
 		{
 			if (it->op != symbol_type::function)
 				continue;
 			if (it->scope.level > scope.level ||
-				it->scope.namespace_level > scope.namespace_level || (it->scope.namespace_level == scope.namespace_level && it->scope.name != scope.name))
+				it->scope.namespace_level > scope.namespace_level || (it->scope.namespace_level == scope.namespace_level && it->scope.namespace_id != scope.namespace_id))
 				continue;
 
 			const function_info *const function = it->function;
@@ -401,26 +442,59 @@ bool reshadefx::symbol_table::resolve_function_call(const std::string &name, con
 	// Try matching against intrinsic functions if no matching user-defined function was found up to this point
 	if (num_overloads == 0)
 	{
-		for (const intrinsic &intrinsic : s_intrinsics)
+		const auto &ranges = intrinsic_ranges();
+
+		if (const auto range_it = ranges.find(name);
+			range_it != ranges.end())
 		{
-			if (intrinsic.function.name != name || intrinsic.function.parameter_list.size() != arguments.size())
-				continue;
+			// The best overload only depends on the argument types, so look it up in the cache first
+			std::string signature(reinterpret_cast<const char *>(&range_it->second.first), sizeof(uint32_t));
+			for (const expression &argument : arguments)
+			{
+				const uint32_t type_key[] = { argument.type.base, argument.type.rows, argument.type.cols, static_cast<uint32_t>(argument.type.array_length), argument.type.definition };
+				signature.append(reinterpret_cast<const char *>(type_key), sizeof(type_key));
+			}
 
-			// A new possibly-matching intrinsic function was found, compare it against the current result
-			const int comparison = compare_functions(arguments, &intrinsic.function, result);
+			auto cache_it = _intrinsic_overload_cache.find(signature);
+			if (cache_it == _intrinsic_overload_cache.end())
+			{
+				intrinsic_overload overload = { UINT32_MAX, 0 };
 
-			if (comparison < 0) // The new function is a better match
+				for (uint32_t i = range_it->second.first; i < range_it->second.second; ++i)
+				{
+					const intrinsic &intrinsic = s_intrinsics[i];
+
+					if (intrinsic.function.parameter_list.size() != arguments.size())
+						continue;
+
+					// A new possibly-matching intrinsic function was found, compare it against the current result
+					const int comparison = compare_functions(arguments, &intrinsic.function, overload.index != UINT32_MAX ? &s_intrinsics[overload.index].function : nullptr);
+
+					if (comparison < 0) // The new function is a better match
+					{
+						overload.index = i;
+						overload.num_overloads = 1;
+					}
+					else if (comparison == 0) // Both functions are equally viable
+					{
+						++overload.num_overloads;
+					}
+				}
+
+				cache_it = _intrinsic_overload_cache.emplace(std::move(signature), overload).first;
+			}
+
+			if (const intrinsic_overload &overload = cache_it->second;
+				overload.index != UINT32_MAX)
 			{
+				const intrinsic &intrinsic = s_intrinsics[overload.index];
+
 				out_data.op = symbol_type::intrinsic;
 				out_data.id = static_cast<uint32_t>(intrinsic.id);
 				out_data.type = intrinsic.function.return_type;
 				out_data.function = &intrinsic.function;
-				result = out_data.function;
-				num_overloads = 1;
-			}
-			else if (comparison == 0 && overload_namespace == 0) // Both functions are equally viable, so the call is ambiguous (intrinsics are always in the global namespace)
-			{
-				++num_overloads;
+				// The call is ambiguous if several overloads are equally viable (intrinsics are always in the global namespace)
+				num_overloads = overload_namespace == 0 ? overload.num_overloads : 1;
 			}
 		}
 	}
@@ -429,3 +503,311 @@ bool reshadefx::symbol_table::resolve_function_call(const std::string &name, con
 
 	return num_overloads == 1;
 }
+
+static bool evaluate_intrinsic_component(intrinsic_id id, const reshadefx::constant *args, unsigned int i, reshadefx::constant &res)
+{
+	const reshadefx::constant &x = args[0], &y = args[1], &z = args[2];
+
+	switch (id)
+	{
+	case intrinsic_id::abs0:
+		res.as_uint[i] = x.as_int[i] < 0 ? 0u - x.as_uint[i] : x.as_uint[i];
+		break;
+	case intrinsic_id::abs1:
+		res.as_float[i] = std::abs(x.as_float[i]);
+		break;
+	case intrinsic_id::asin0:
+		if (std::abs(x.as_float[i]) > 1.0f)
+			return false;
+		res.as_float[i] = std::asin(x.as_float[i]);
+		break;
+	case intrinsic_id::acos0:
+		if (std::abs(x.as_float[i]) > 1.0f)
+			return false;
+		res.as_float[i] = std::acos(x.as_float[i]);
+		break;
+	case intrinsic_id::atan0:
+		res.as_float[i] = std::atan(x.as_float[i]);
+		break;
+	case intrinsic_id::atan20:
+		if (x.as_float[i] == 0.0f && y.as_float[i] == 0.0f)
+			return false;
+		res.as_float[i] = std::atan2(x.as_float[i], y.as_float[i]);
+		break;
+	case intrinsic_id::sin0:
+		res.as_float[i] = std::sin(x.as_float[i]);
+		break;
+	case intrinsic_id::sinh0:
+		res.as_float[i] = std::sinh(x.as_float[i]);
+		break;
+	case intrinsic_id::cos0:
+		res.as_float[i] = std::cos(x.as_float[i]);
+		break;
+	case intrinsic_id::cosh0:
+		res.as_float[i] = std::cosh(x.as_float[i]);
+		break;
+	case intrinsic_id::tan0:
+		res.as_float[i] = std::tan(x.as_float[i]);
+		break;
+	case intrinsic_id::tanh0:
+		res.as_float[i] = std::tanh(x.as_float[i]);
+		break;
+	case intrinsic_id::asint0:
+	case intrinsic_id::asuint0:
+	case intrinsic_id::asfloat0:
+	case intrinsic_id::asfloat1:
+		// Reinterpreting the bits is already handled by the constant union
+		res.as_uint[i] = x.as_uint[i];
+		break;
+	case intrinsic_id::firstbitlow0:
+		res.as_uint[i] = 0xFFFFFFFF;
+		for (uint32_t bit = 0; bit < 32; ++bit)
+			if (x.as_uint[i] & (1u << bit)) {
+				res.as_uint[i] = bit;
+				break;
+			}
+		break;
+	case intrinsic_id::firstbithigh0:
+	case intrinsic_id::firstbithigh1:
+		res.as_uint[i] = 0xFFFFFFFF;
+		// The signed version looks for the first bit that differs from the sign bit
+		for (uint32_t bit = 32, value = (id == intrinsic_id::firstbithigh0 && x.as_int[i] < 0) ? ~x.as_uint[i] : x.as_uint[i]; bit-- > 0;)
+			if (value & (1u << bit)) {
+				res.as_uint[i] = bit;
+				break;
+			}
+		break;
+	case intrinsic_id::countbits0:
+		res.as_uint[i] = 0;
+		for (uint32_t value = x.as_uint[i]; value != 0; value &= value - 1)
+			res.as_uint[i]++;
+		break;
+	case intrinsic_id::reversebits0:
+		res.as_uint[i] = 0;
+		for (uint32_t bit = 0; bit < 32; ++bit)
+			res.as_uint[i] |= ((x.as_uint[i] >> bit) & 1u) << (31 - bit);
+		break;
+	case intrinsic_id::ceil0:
+		res.as_float[i] = std::ceil(x.as_float[i]);
+		break;
+	case intrinsic_id::floor0:
+		res.as_float[i] = std::floor(x.as_float[i]);
+		break;
+	case intrinsic_id::clamp0:
+		if (y.as_int[i] > z.as_int[i])
+			return false;
+		res.as_int[i] = std::min(std::max(x.as_int[i], y.as_int[i]), z.as_int[i]);
+		break;
+	case intrinsic_id::clamp1:
+		if (y.as_uint[i] > z.as_uint[i])
+			return false;
+		res.as_uint[i] = std::min(std::max(x.as_uint[i], y.as_uint[i]), z.as_uint[i]);
+		break;
+	case intrinsic_id::clamp2:
+		if (y.as_float[i] > z.as_float[i])
+			return false;
+		res.as_float[i] = std::min(std::max(x.as_float[i], y.as_float[i]), z.as_float[i]);
+		break;
+	case intrinsic_id::saturate0:
+		res.as_float[i] = std::min(std::max(x.as_float[i], 0.0f), 1.0f);
+		break;
+	case intrinsic_id::mad0:
+		res.as_float[i] = x.as_float[i] * y.as_float[i] + z.as_float[i];
+		break;
+	case intrinsic_id::rcp0:
+		res.as_float[i] = 1.0f / x.as_float[i];
+		break;
+	case intrinsic_id::pow0:
+		// The result is undefined for negative bases and for zero to the power of zero or less
+		if (x.as_float[i] < 0.0f || (x.as_float[i] == 0.0f && y.as_float[i] <= 0.0f))
+			return false;
+		res.as_float[i] = std::pow(x.as_float[i], y.as_float[i]);
+		break;
+	case intrinsic_id::exp0:
+		res.as_float[i] = std::exp(x.as_float[i]);
+		break;
+	case intrinsic_id::exp20:
+		res.as_float[i] = std::exp2(x.as_float[i]);
+		break;
+	case intrinsic_id::log0:
+	case intrinsic_id::log20:
+	case intrinsic_id::log100:
+		if (x.as_float[i] <= 0.0f)
+			return false;
+		res.as_float[i] = id == intrinsic_id::log0 ? std::log(x.as_float[i]) : id == intrinsic_id::log20 ? std::log2(x.as_float[i]) : std::log10(x.as_float[i]);
+		break;
+	case intrinsic_id::sign0:
+		res.as_int[i] = (x.as_int[i] > 0) - (x.as_int[i] < 0);
+		break;
+	case intrinsic_id::sign1:
+		res.as_float[i] = static_cast<float>((x.as_float[i] > 0.0f) - (x.as_float[i] < 0.0f));
+		break;
+	case intrinsic_id::sqrt0:
+		if (x.as_float[i] < 0.0f)
+			return false;
+		res.as_float[i] = std::sqrt(x.as_float[i]);
+		break;
+	case intrinsic_id::rsqrt0:
+		if (x.as_float[i] <= 0.0f)
+			return false;
+		res.as_float[i] = 1.0f / std::sqrt(x.as_float[i]);
+		break;
+	case intrinsic_id::lerp0:
+		res.as_float[i] = x.as_float[i] + z.as_float[i] * (y.as_float[i] - x.as_float[i]);
+		break;
+	case intrinsic_id::step0:
+		res.as_float[i] = y.as_float[i] >= x.as_float[i] ? 1.0f : 0.0f;
+		break;
+	case intrinsic_id::smoothstep0:
+		if (x.as_float[i] >= y.as_float[i])
+			return false;
+		res.as_float[i] = std::min(std::max((z.as_float[i] - x.as_float[i]) / (y.as_float[i] - x.as_float[i]), 0.0f), 1.0f);
+		res.as_float[i] = res.as_float[i] * res.as_float[i] * (3.0f - 2.0f * res.as_float[i]);
+		break;
+	case intrinsic_id::frac0:
+		res.as_float[i] = x.as_float[i] - std::floor(x.as_float[i]);
+		break;
+	case intrinsic_id::ldexp0:
+		res.as_float[i] = std::ldexp(x.as_float[i], y.as_int[i]);
+		break;
+	case intrinsic_id::trunc0:
+		res.as_float[i] = std::trunc(x.as_float[i]);
+		break;
+	case intrinsic_id::round0:
+		// Rounds halfway cases to the nearest even value, like the 'round_ne' instruction does
+		res.as_float[i] = std::nearbyint(x.as_float[i]);
+		break;
+	case intrinsic_id::min0:
+		res.as_int[i] = std::min(x.as_int[i], y.as_int[i]);
+		break;
+	case intrinsic_id::min1:
+		res.as_float[i] = std::min(x.as_float[i], y.as_float[i]);
+		break;
+	case intrinsic_id::max0:
+		res.as_int[i] = std::max(x.as_int[i], y.as_int[i]);
+		break;
+	case intrinsic_id::max1:
+		res.as_float[i] = std::max(x.as_float[i], y.as_float[i]);
+		break;
+	case intrinsic_id::degrees0:
+		res.as_float[i] = x.as_float[i] * 57.29577951f;
+		break;
+	case intrinsic_id::radians0:
+		res.as_float[i] = x.as_float[i] * 0.01745329252f;
+		break;
+	case intrinsic_id::isinf0:
+		res.as_uint[i] = std::isinf(x.as_float[i]);
+		break;
+	case intrinsic_id::isnan0:
+		res.as_uint[i] = std::isnan(x.as_float[i]);
+		break;
+	default:
+		// Everything else is either not a pure function or not evaluated at compile-time
+		return false;
+	}
+
+	return true;
+}
+
+bool reshadefx::symbol_table::evaluate_intrinsic_call(const symbol &data, const expression_list &arguments, constant &result)
+{
+	assert(data.op == symbol_type::intrinsic && arguments.size() == data.function->parameter_list.size());
+
+	// All pure intrinsics take between one and three arguments
+	if (arguments.empty() || arguments.size() > 3)
+		return false;
+
+	const intrinsic_id id = static_cast<intrinsic_id>(data.id);
+	// These only look at the bits of their argument, so work with any value
+	const bool is_bit_cast = id == intrinsic_id::asint0 || id == intrinsic_id::asuint0 || id == intrinsic_id::asfloat0 || id == intrinsic_id::asfloat1 || id == intrinsic_id::isinf0 || id == intrinsic_id::isnan0;
+
+	constant args[3] = {};
+	for (size_t i = 0; i < arguments.size(); ++i)
+	{
+		if (!arguments[i].is_constant || arguments[i].type.is_array())
+			return false;
+
+		// GPUs do not have to follow IEEE 754 rules for infinities and NaN, so only fold calls with finite floating-point arguments
+		if (arguments[i].type.is_floating_point() && !is_bit_cast)
+			for (unsigned int k = 0; k < arguments[i].type.components(); ++k)
+				if (!std::isfinite(arguments[i].constant.as_float[k]))
+					return false;
+
+		args[i] = arguments[i].constant;
+	}
+
+	const auto dot = [](const constant &a, const constant &b, unsigned int components) {
+		float sum = 0.0f;
+		for (unsigned int i = 0; i < components; ++i)
+			sum += a.as_float[i] * b.as_float[i];
+		return sum;
+	};
+
+	result = {};
+	const unsigned int components = arguments[0].type.components();
+
+	switch (id)
+	{
+	case intrinsic_id::all0:
+	case intrinsic_id::all1:
+		result.as_uint[0] = 1;
+		for (unsigned int i = 0; i < components; ++i)
+			result.as_uint[0] &= args[0].as_uint[i] != 0;
+		break;
+	case intrinsic_id::any0:
+	case intrinsic_id::any1:
+		result.as_uint[0] = 0;
+		for (unsigned int i = 0; i < components; ++i)
+			result.as_uint[0] |= args[0].as_uint[i] != 0;
+		break;
+	case intrinsic_id::dot0:
+		result.as_float[0] = dot(args[0], args[1], components);
+		break;
+	case intrinsic_id::cross0:
+		result.as_float[0] = args[0].as_float[1] * args[1].as_float[2] - args[0].as_float[2] * args[1].as_float[1];
+		result.as_float[1] = args[0].as_float[2] * args[1].as_float[0] - args[0].as_float[0] * args[1].as_float[2];
+		result.as_float[2] = args[0].as_float[0] * args[1].as_float[1] - args[0].as_float[1] * args[1].as_float[0];
+		break;
+	case intrinsic_id::distance0:
+		for (unsigned int i = 0; i < components; ++i)
+			args[0].as_float[i] -= args[1].as_float[i];
+		[[fallthrough]];
+	case intrinsic_id::length0:
+		result.as_float[0] = std::sqrt(dot(args[0], args[0], components));
+		break;
+	case intrinsic_id::normalize0:
+		if (const float length = std::sqrt(dot(args[0], args[0], components)); length != 0.0f)
+			for (unsigned int i = 0; i < components; ++i)
+				result.as_float[i] = args[0].as_float[i] / length;
+		else
+			return false;
+		break;
+	case intrinsic_id::reflect0:
+	{
+		const float d = dot(args[1], args[0], components);
+		for (unsigned int i = 0; i < components; ++i)
+			result.as_float[i] = args[0].as_float[i] - 2.0f * d * args[1].as_float[i];
+		break;
+	}
+	case intrinsic_id::faceforward0:
+	{
+		const bool is_front_facing = dot(args[2], args[1], components) < 0.0f;
+		for (unsigned int i = 0; i < components; ++i)
+			result.as_float[i] = is_front_facing ? args[0].as_float[i] : -args[0].as_float[i];
+		break;
+	}
+	default:
+		for (unsigned int i = 0; i < data.type.components(); ++i)
+			if (!evaluate_intrinsic_component(id, args, i, result))
+				return false;
+		break;
+	}
+
+	// Do not fold results that overflowed either (this includes bit casts to infinities or NaN)
+	if (data.type.is_floating_point())
+		for (unsigned int i = 0; i < data.type.components(); ++i)
+			if (!std::isfinite(result.as_float[i]))
+				return false;
+
+	return true;
+}
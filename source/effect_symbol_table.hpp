@@ -6,7 +6,8 @@
 #pragma once
 
 #include "effect_module.hpp"
-#include <unordered_map> // Used for symbol lookup table
+#include "effect_token.hpp"
+#include <unordered_map> // Used for namespace lookup and intrinsic overload cache
 
 namespace reshadefx
 {
@@ -15,7 +16,8 @@ namespace reshadefx
 	/// </summary>
 	struct scope
 	{
-		std::string name;
+		// Index of the namespace this scope is in, with zero being the global namespace
+		uint32_t namespace_id;
 		uint32_t level, namespace_level;
 	};
 
@@ -78,6 +80,10 @@ namespace reshadefx
 		/// </summary>
 		/// <returns></returns>
 		const scope &current_scope() const { return _current_scope; }
+		/// <summary>
+		/// Get the full name of the namespace the symbol table currently operates in (e.g. "::A::B::").
+		/// </summary>
+		const std::string &current_scope_name() const { return _namespaces[_current_scope.namespace_id].name; }
 
 		/// <summary>
 		/// Insert an new symbol in the symbol table. Returns <c>false</c> if a symbol by that name and type already exists.
@@ -89,15 +95,48 @@ namespace reshadefx
 		/// </summary>
 		scoped_symbol find_symbol(const std::string &name) const;
 		scoped_symbol find_symbol(const std::string &name, const scope &scope, bool exclusive) const;
+		scoped_symbol find_symbol(uint32_t identifier_id, const scope &scope, bool exclusive) const;
 
 		/// <summary>
 		/// Search for the best function or intrinsic overload matching the argument list.
 		/// </summary>
-		bool resolve_function_call(const std::string &name, const std::vector<expression> &args, const scope &scope, symbol &data, bool &ambiguous) const;
+		bool resolve_function_call(const std::string &name, const expression_list &args, const scope &scope, symbol &data, bool &ambiguous) const;
+
+		/// <summary>
+		/// Evaluate a call to a pure math intrinsic at compile-time, given that all arguments are constant and already converted to the parameter types.
+		/// </summary>
+		/// <param name="data">The intrinsic symbol the call was resolved to.</param>
+		/// <param name="args">The constant arguments.</param>
+		/// <param name="result">The constant result of the call.</param>
+		/// <returns><see langword="true"/> if the call was evaluated, <see langword="false"/> if it has to be evaluated at runtime instead.</returns>
+		static bool evaluate_intrinsic_call(const symbol &data, const expression_list &args, constant &result);
+
+	protected:
+		// Names of all symbols, which identifier tokens can be interned in as well to look up symbols without hashing their name again
+		identifier_table _identifiers;
 
 	private:
+		struct namespace_info
+		{
+			std::string name;
+			uint32_t parent;
+		};
+
 		scope _current_scope;
-		// Lookup table from name to matching symbols
-		std::unordered_map<std::string, std::vector<scoped_symbol>> _symbol_stack;
+		// Tree of all namespaces, indexed by their namespace id, and a lookup table from full name to index
+		std::vector<namespace_info> _namespaces;
+		std::unordered_map<std::string, uint32_t> _namespace_lookup;
+		// Identifier and scope level of all local symbols in the current scope chain, in the order they were declared
+		std::vector<std::pair<uint32_t, uint32_t>> _local_symbols;
+		// Lookup table from interned name to matching symbols
+		std::vector<std::vector<scoped_symbol>> _symbol_stack;
+
+		struct intrinsic_overload
+		{
+			uint32_t index;
+			uint32_t num_overloads;
+		};
+		// Best intrinsic overload for each combination of intrinsic name and argument types that was resolved before
+		mutable std::unordered_map<std::string, intrinsic_overload> _intrinsic_overload_cache;
 	};
 }
@@ -6,7 +6,10 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <forward_list>
+#include <unordered_map>
 
 namespace reshadefx
 {
@@ -17,9 +20,17 @@ namespace reshadefx
 	{
 		location() : line(1), column(1) {}
 		explicit location(uint32_t line, uint32_t column = 1) : line(line), column(column) {}
-		explicit location(std::string source, uint32_t line, uint32_t column = 1) : source(std::move(source)), line(line), column(column) {}
+		explicit location(std::string_view source, uint32_t line, uint32_t column = 1) : source(intern_source(source)), line(line), column(column) {}
 
-		std::string source;
+		/// <summary>
+		/// Add a source file name to a process-wide pool of names, so that locations can refer to it without having to own a copy.
+		/// Names are never removed from the pool, so its total size is limited to 1 MB. Once that is reached, names that are not in it yet are replaced with an empty name.
+		/// </summary>
+		/// <param name="source">The source file name to look up.</param>
+		/// <returns>A view of the pooled name, which stays valid until the process exits, or an empty view if the pool is full.</returns>
+		static std::string_view intern_source(std::string_view source);
+
+		std::string_view source;
 		uint32_t line, column;
 	};
 
@@ -228,6 +239,8 @@ namespace reshadefx
 	struct token
 	{
 		tokenid id;
+		// Index of the name in the identifier table passed to the lexer (only valid for identifier tokens)
+		uint32_t identifier_id;
 		reshadefx::location location;
 		size_t offset, length;
 		union
@@ -237,10 +250,50 @@ namespace reshadefx
 			float literal_as_float;
 			double literal_as_double;
 		};
-		std::string literal_as_string;
+		// Points into the input string or into memory owned by the lexer, so is only valid for as long as the lexer that produced this token
+		std::string_view literal_as_string;
 
 		inline operator tokenid() const { return id; }
 
 		static std::string id_to_name(tokenid id);
 	};
+
+	/// <summary>
+	/// A table that assigns each unique identifier name a small integer index, so that names can be compared and used as keys without hashing them again.
+	/// </summary>
+	class identifier_table
+	{
+	public:
+		identifier_table() : _names(1) {}
+
+		// Names are referenced by views into the table, so it cannot be copied
+		identifier_table(const identifier_table &) = delete;
+		identifier_table &operator=(const identifier_table &) = delete;
+
+		/// <summary>
+		/// Get the index of the specified <paramref name="name"/>, adding it to the table if it does not exist yet.
+		/// </summary>
+		/// <returns>The index of the name, which is never zero.</returns>
+		uint32_t intern(std::string_view name);
+		/// <summary>
+		/// Get the index of the specified <paramref name="name"/>.
+		/// </summary>
+		/// <returns>The index of the name, or zero if it does not exist in the table.</returns>
+		uint32_t find(std::string_view name) const;
+
+		/// <summary>
+		/// Get the name with the specified index.
+		/// </summary>
+		std::string_view name(uint32_t id) const { return _names[id]; }
+
+		/// <summary>
+		/// Get the number of indices in use, which is one more than the number of names, since zero is reserved.
+		/// </summary>
+		size_t size() const { return _names.size(); }
+
+	private:
+		std::forward_list<std::string> _storage;
+		std::vector<std::string_view> _names;
+		std::unordered_map<std::string_view, uint32_t> _ids;
+	};
 }
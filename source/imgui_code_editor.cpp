@@ -1656,8 +1656,9 @@ void reshade::imgui::code_editor::colorize()
 		for (size_t k = 0; k < _lines[l].size(); ++k)
 			input_string.push_back(_lines[l][k].c);
 
+	// The input string outlives the lexer, so it can borrow it instead of creating a copy
 	reshadefx::lexer lexer(
-		input_string,
+		std::string_view(input_string),
 		false /* ignore_comments */,
 		true  /* ignore_whitespace */,
 		false /* ignore_pp_directives */,
@@ -705,6 +705,7 @@ void reshade::runtime::load_config()
 	config.get("GENERAL", "NoReloadOnInitForNonVR", _no_reload_for_non_vr);
 
 	config.get("GENERAL", "EffectSearchPaths", _effect_search_paths);
+	config.get("GENERAL", "OptimizeSPIRV", _optimize_spirv);
 	config.get("GENERAL", "PerformanceMode", _performance_mode);
 	config.get("GENERAL", "PreprocessorDefinitions", _global_preprocessor_definitions);
 	config.get("GENERAL", "SkipLoadingDisabledEffects", _effect_load_skipping);
@@ -772,6 +773,7 @@ void reshade::runtime::save_config() const
 	config.set("GENERAL", "NoReloadOnInitForNonVR", _no_reload_for_non_vr);
 
 	config.set("GENERAL", "EffectSearchPaths", _effect_search_paths);
+	config.set("GENERAL", "OptimizeSPIRV", _optimize_spirv);
 	config.set("GENERAL", "PerformanceMode", _performance_mode);
 	config.set("GENERAL", "PreprocessorDefinitions", _global_preprocessor_definitions);
 	config.set("GENERAL", "SkipLoadingDisabledEffects", _effect_load_skipping);
@@ -1098,7 +1100,7 @@ bool reshade::runtime::switch_to_next_preset(std::filesystem::path filter_path,
 	return true;
 }
 
-bool reshade::runtime::load_effect(const std::filesystem::path &source_file, const ini_file &preset, size_t effect_index, bool preprocess_required)
+bool reshade::runtime::load_effect(const std::filesystem::path &source_file, const ini_file &preset, size_t effect_index, bool preprocess_required, reshadefx::include_cache *include_cache)
 {
 	// Generate a unique string identifying this effect
 	std::string attributes;
@@ -1212,6 +1214,14 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 		for (const std::filesystem::path &include_path : include_paths)
 			pp.add_include_path(include_path);
 
+		pp.set_include_cache(include_cache);
+
+		// Share the state after common headers like 'ReShade.fxh' were included between all effects
+		if (_no_effect_cache)
+			pp.enable_precompiled_headers();
+		else
+			pp.enable_precompiled_headers(g_reshade_base_path / _intermediate_cache_path);
+
 		// Add some conversion macros for compatibility with older versions of ReShade
 		pp.append_string(
 			"#define tex2Doffset(s, coords, offset) tex2D(s, coords, offset)\n"
@@ -1290,11 +1300,11 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 
 		std::unique_ptr<reshadefx::codegen> codegen;
 		if ((_renderer_id & 0xF0000) == 0)
-			codegen.reset(reshadefx::create_codegen_hlsl(shader_model, !_no_debug_info, _performance_mode));
+			codegen.reset(reshadefx::create_codegen_hlsl(shader_model, !_no_debug_info, _performance_mode, true));
 		else if (_renderer_id < 0x20000)
-			codegen.reset(reshadefx::create_codegen_glsl(false, !_no_debug_info, _performance_mode, false, true));
+			codegen.reset(reshadefx::create_codegen_glsl(false, !_no_debug_info, _performance_mode, false, true, true));
 		else // Vulkan uses SPIR-V input
-			codegen.reset(reshadefx::create_codegen_spirv(true, !_no_debug_info, _performance_mode, false, false));
+			codegen.reset(reshadefx::create_codegen_spirv(true, !_no_debug_info, _performance_mode, false, false, _optimize_spirv ? reshadefx::spirv_optimization::all : reshadefx::spirv_optimization::none, true));
 
 		reshadefx::parser parser;
 
@@ -1309,6 +1319,9 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 
 		if (effect.compiled)
 		{
+			if (effect.module.packed_uniform_bytes_saved != 0)
+				LOG(DEBUG) << "Rearranged uniform variables in " << source_file << " to save " << effect.module.packed_uniform_bytes_saved << " bytes of uniform storage.";
+
 			effect.uniforms.clear();
 
 			// Create space for all variables (aligned to 16 bytes)
@@ -1360,11 +1373,11 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 				effect.uniforms.push_back(std::move(variable));
 			}
 
+			effect.preamble.clear();
+
 			// Fill all specialization constants with values from the current preset
 			if (_performance_mode)
 			{
-				std::string preamble;
-
 				for (reshadefx::uniform_info &constant : effect.module.spec_constants)
 				{
 					switch (constant.type.base)
@@ -1388,34 +1401,32 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 					if (effect.module.hlsl.empty())
 						continue;
 
-					preamble += "#define SPEC_CONSTANT_" + constant.name + ' ';
+					effect.preamble += "#define SPEC_CONSTANT_" + constant.name + ' ';
 
 					for (unsigned int i = 0; i < constant.type.components(); ++i)
 					{
 						switch (constant.type.base)
 						{
 						case reshadefx::type::t_bool:
-							preamble += constant.initializer_value.as_uint[i] ? "true" : "false";
+							effect.preamble += constant.initializer_value.as_uint[i] ? "true" : "false";
 							break;
 						case reshadefx::type::t_int:
-							preamble += std::to_string(constant.initializer_value.as_int[i]);
+							effect.preamble += std::to_string(constant.initializer_value.as_int[i]);
 							break;
 						case reshadefx::type::t_uint:
-							preamble += std::to_string(constant.initializer_value.as_uint[i]);
+							effect.preamble += std::to_string(constant.initializer_value.as_uint[i]);
 							break;
 						case reshadefx::type::t_float:
-							preamble += std::to_string(constant.initializer_value.as_float[i]);
+							effect.preamble += std::to_string(constant.initializer_value.as_float[i]);
 							break;
 						}
 
 						if (i + 1 < constant.type.components())
-							preamble += ", ";
+							effect.preamble += ", ";
 					}
 
-					preamble += '\n';
+					effect.preamble += '\n';
 				}
-
-				effect.module.hlsl = preamble + effect.module.hlsl;
 			}
 		}
 	}
@@ -1446,9 +1457,10 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 					"#define COLOR_PIXEL_SIZE 1.0 / " + std::to_string(_width) + ", 1.0 / " + std::to_string(_height) + "\n"
 					"#define DEPTH_PIXEL_SIZE COLOR_PIXEL_SIZE\n"
 					"#define SV_DEPTH_PIXEL_SIZE DEPTH_PIXEL_SIZE\n"
-					"#define SV_TARGET_PIXEL_SIZE COLOR_PIXEL_SIZE\n"
-					"#line 1\n" + // Reset line number, so it matches what is shown when viewing the generated code
-					effect.module.hlsl;
+					"#define SV_TARGET_PIXEL_SIZE COLOR_PIXEL_SIZE\n" +
+					effect.preamble +
+					"#line 1\n" + // Reset line number, so it matches what is shown when viewing the generated code (the code generator keeps the numbering of the module in the code of each entry point)
+					(entry_point.code.empty() ? effect.module.hlsl : entry_point.code); // Only compile the code this entry point can actually reach
 
 				// Overwrite position semantic in pixel shaders
 				const D3D_SHADER_MACRO ps_defines[] = {
@@ -1613,8 +1625,9 @@ bool reshade::runtime::load_effect(const std::filesystem::path &source_file, con
 					cso += "#define groupMemoryBarrier()\n";
 				}
 
-				cso += "#line 1 0\n"; // Reset line number, so it matches what is shown when viewing the generated code
-				cso += effect.module.hlsl;
+				cso += effect.preamble;
+				cso += "#line 1 0\n"; // Reset line number, so it matches what is shown when viewing the generated code (the code generator keeps the numbering of the module in the code of each entry point)
+				cso += entry_point.code.empty() ? effect.module.hlsl : entry_point.code;
 
 				cso_text = cso;
 			}
@@ -2367,6 +2380,10 @@ bool reshade::runtime::create_effect(size_t effect_index)
 
 					if (!texture->semantic.empty())
 					{
+						// Only passes that read the back buffer need the implicit copy of it to be up to date
+						if (texture->semantic == "COLOR")
+							pass_data.samples_back_buffer = true;
+
 						if (const auto it = _texture_semantic_bindings.find(texture->semantic); it != _texture_semantic_bindings.end())
 							srv = info.srgb ? it->second.second : it->second.first;
 						else
@@ -2771,14 +2788,18 @@ void reshade::runtime::load_effects()
 	// Split workload into batches instead of launching a thread for every file to avoid launch overhead and stutters due to too many threads being in flight
 	const size_t num_splits = std::min<size_t>(effect_files.size(), std::max<size_t>(std::thread::hardware_concurrency(), 2u) - 1);
 
+	// Share file contents between all effects of this reload, so that common headers are only read once
+	// The cache is released together with the last worker thread, so that nothing is kept alive after loading finished
+	const auto include_cache = std::make_shared<reshadefx::include_cache>();
+
 	// Keep track of the spawned threads, so the runtime cannot be destroyed while they are still running
 	for (size_t n = 0; n < num_splits; ++n)
 		// Create copy of preset instead of reference, so it stays valid even if 'ini_file::load_cache' is called while effects are still being loaded
-		_worker_threads.emplace_back([this, effect_files, offset, num_splits, n, preset]() {
+		_worker_threads.emplace_back([this, effect_files, offset, num_splits, n, preset, include_cache]() {
 			// Abort loading when initialization state changes (indicating that 'on_reset' was called in the meantime)
 			for (size_t i = 0; i < effect_files.size() && _is_initialized; ++i)
 				if (i * num_splits / effect_files.size() == n)
-					load_effect(effect_files[i], preset, offset + i);
+					load_effect(effect_files[i], preset, offset + i, false, include_cache.get());
 		});
 }
 void reshade::runtime::load_textures()
@@ -2942,7 +2963,7 @@ void reshade::runtime::clear_effect_cache()
 
 		const std::filesystem::path filename = entry.path().filename();
 		const std::filesystem::path extension = entry.path().extension();
-		if (filename.native().compare(0, 8, L"reshade-") != 0 || (extension != L".i" && extension != L".cso" && extension != L".asm"))
+		if (filename.native().compare(0, 8, L"reshade-") != 0 || (extension != L".i" && extension != L".cso" && extension != L".asm" && extension != L".pch"))
 			continue;
 
 		std::filesystem::remove(entry.path());
@@ -3458,12 +3479,18 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 	const bool sampler_with_resource_view = _device->check_capability(api::device_caps::sampler_with_resource_view);
 
 	bool is_effect_stencil_cleared = false;
-	bool needs_implicit_back_buffer_copy = true; // First pass always needs the back buffer updated
+	bool needs_implicit_back_buffer_copy = true; // First pass to read the back buffer always needs it updated
 
 	for (size_t pass_index = 0; pass_index < tech.passes.size(); ++pass_index)
 	{
-		if (needs_implicit_back_buffer_copy)
+		const reshadefx::pass_info &pass_info = tech.passes[pass_index];
+		const technique::pass_data &pass_data = tech.passes_data[pass_index];
+
+		// Defer the copy until a pass actually samples the back buffer, so that chains of passes which do not (e.g. ones that only write to it) skip the full-screen copy in between
+		if (needs_implicit_back_buffer_copy && pass_data.samples_back_buffer)
 		{
+			needs_implicit_back_buffer_copy = false;
+
 			// Save back buffer of previous pass
 			const api::resource resources[2] = { back_buffer_resource, _effect_color_tex };
 			const api::resource_usage state_old[2] = { api::resource_usage::render_target, api::resource_usage::shader_resource };
@@ -3474,9 +3501,6 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 			cmd_list->barrier(2, resources, state_new, state_old);
 		}
 
-		const reshadefx::pass_info &pass_info = tech.passes[pass_index];
-		const technique::pass_data &pass_data = tech.passes_data[pass_index];
-
 #ifndef NDEBUG
 		cmd_list->begin_debug_event((pass_info.name.empty() ? "Pass " + std::to_string(pass_index) : pass_info.name).c_str(), debug_event_col);
 #endif
@@ -3485,9 +3509,6 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 
 		if (!pass_info.cs_entry_point.empty())
 		{
-			// Compute shaders do not write to the back buffer, so no update necessary
-			needs_implicit_back_buffer_copy = false;
-
 			cmd_list->bind_pipeline(api::pipeline_stage::all_compute, pass_data.pipeline);
 
 			std::vector<api::resource_usage> state_old(num_barriers, api::resource_usage::shader_resource);
@@ -3547,8 +3568,6 @@ void reshade::runtime::render_technique(technique &tech, api::command_list *cmd_
 			}
 			else
 			{
-				needs_implicit_back_buffer_copy = false;
-
 				if (pass_info.stencil_enable &&
 					pass_info.viewport_width == _width &&
 					pass_info.viewport_height == _height)
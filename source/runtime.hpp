@@ -19,6 +19,7 @@
 #endif
 
 class ini_file;
+namespace reshadefx { class include_cache; }
 
 namespace reshade
 {
@@ -279,7 +280,7 @@ namespace reshade
 
 		bool switch_to_next_preset(std::filesystem::path filter_path, bool reversed = false);
 
-		bool load_effect(const std::filesystem::path &source_file, const ini_file &preset, size_t effect_index, bool preprocess_required = false);
+		bool load_effect(const std::filesystem::path &source_file, const ini_file &preset, size_t effect_index, bool preprocess_required = false, reshadefx::include_cache *include_cache = nullptr);
 		bool create_effect(size_t effect_index);
 		bool create_effect_sampler_state(const api::sampler_desc &desc, api::sampler &sampler);
 		void destroy_effect(size_t effect_index);
@@ -365,6 +366,7 @@ namespace reshade
 		bool _no_reload_on_init = false;
 		bool _no_reload_for_non_vr = false;
 		bool _performance_mode = false;
+		bool _optimize_spirv = false;
 		bool _effect_load_skipping = false;
 		bool _load_option_disable_skipping = false;
 		unsigned int _reload_key_data[4] = {};
@@ -1868,6 +1868,33 @@ void reshade::runtime::draw_gui_statistics()
 				ImGui::Text("%s (%zu passes)", tech.name.c_str(), tech.passes.size());
 			else
 				ImGui::TextUnformatted(tech.name.c_str());
+
+			// Show the static cost estimate the compiler calculated for each pass
+			if (ImGui::IsItemHovered())
+			{
+				ImGui::BeginTooltip();
+
+				for (size_t pass_index = 0; pass_index < tech.passes.size(); ++pass_index)
+				{
+					const reshadefx::pass_info &pass_info = tech.passes[pass_index];
+					const reshadefx::shader_cost &cost = pass_info.cs_entry_point.empty() ? pass_info.ps_cost : pass_info.cs_cost;
+
+					ImGui::Text("%s: %u ALU, %u texture fetches (dependent depth %u), ~%u loop iterations",
+						pass_info.name.empty() ? ("Pass " + std::to_string(pass_index)).c_str() : pass_info.name.c_str(),
+						cost.alu_instructions, cost.texture_fetches, cost.dependent_fetch_depth, cost.loop_iterations);
+
+					if (pass_info.cs_entry_point.empty())
+					{
+						const uint64_t width = pass_info.viewport_width != 0 ? pass_info.viewport_width : _width;
+						const uint64_t height = pass_info.viewport_height != 0 ? pass_info.viewport_height : _height;
+
+						ImGui::Text("    %u bytes per pixel, %.2f MiB written per frame%s", pass_info.render_target_bytes_per_pixel,
+							(width * height * pass_info.render_target_bytes_per_pixel) / (1024.0f * 1024.0f), pass_info.pointwise ? " (pointwise)" : "");
+					}
+				}
+
+				ImGui::EndTooltip();
+			}
 		}
 
 		ImGui::EndGroup();
@@ -236,6 +236,7 @@ namespace reshade
 			api::descriptor_set storage_set = {};
 			std::vector<api::resource> modified_resources;
 			std::vector<api::resource_view> generate_mipmap_views;
+			bool samples_back_buffer = false;
 		};
 
 		std::vector<pass_data> passes_data;
@@ -250,6 +251,8 @@ namespace reshade
 		bool preprocessed = false;
 		std::string errors;
 		reshadefx::module module;
+		// Specialization constant definitions added in front of the generated code when compiling it (kept separate, so that line numbers still match the generated code)
+		std::string preamble;
 		size_t source_hash = 0;
 		std::filesystem::path source_file;
 		std::vector<std::filesystem::path> included_files;
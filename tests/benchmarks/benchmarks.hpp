@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <string>
+#include <functional>
+
+/// <summary>
+/// Check whether a benchmark was selected on the command line (all are if none were).
+/// </summary>
+/// <param name="name">The name of the benchmark.</param>
+bool is_selected(const std::string &name);
+
+/// <summary>
+/// Run a benchmark several times and print the time of the fastest run, along with the number and total size of the heap allocations a run makes.
+/// </summary>
+/// <param name="name">The name of the benchmark.</param>
+/// <param name="runs">How often to run the benchmark.</param>
+/// <param name="run">Function that runs the benchmark once.</param>
+void measure(const std::string &name, unsigned int runs, const std::function<void()> &run);
+
+/// <summary>
+/// Measure how long compiling generated effects with every code generator takes, both with a full compile for each and by replaying a single recording into them.
+/// </summary>
+void run_codegen_benchmarks();
+
+/// <summary>
+/// Measure how long lexical analysis of keywords, identifiers and preprocessor directives takes.
+/// </summary>
+void run_lexer_benchmarks();
+
+/// <summary>
+/// Measure how long preprocessing takes for generated effects that make heavy use of macros.
+/// </summary>
+void run_preprocessor_benchmarks();
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "benchmarks.hpp"
+#include "effect_parser.hpp"
+#include "effect_codegen.hpp"
+#include <memory>
+#include <iostream>
+
+static reshadefx::codegen *create_codegen(const std::string &language)
+{
+	if (language == "hlsl")
+		return reshadefx::create_codegen_hlsl(50, false, false);
+	if (language == "glsl")
+		return reshadefx::create_codegen_glsl(false, false, false);
+	return reshadefx::create_codegen_spirv(true, false, false);
+}
+
+/// <summary>
+/// Generate an effect with many textures, samplers, structs and functions, which are referenced from a pixel shader used in many passes.
+/// </summary>
+static std::string generate_many_definitions_effect(int count, int passes)
+{
+	std::string source;
+	for (int i = 0; i < count; ++i)
+	{
+		const std::string n = std::to_string(i);
+		source +=
+			"texture2D Tex" + n + " { Width = 64; Height = 64; };\n"
+			"sampler2D Samp" + n + " { Texture = Tex" + n + "; };\n"
+			"struct S" + n + " { float4 color; float weight; };\n"
+			"float4 Helper" + n + "(float2 uv) { S" + n + " s; s.color = tex2D(Samp" + n + ", uv); s.weight = " + n + ".0; return s.color * s.weight; }\n";
+	}
+
+	// Call every helper function several times, so that function and sampler lookups happen for every call
+	source += "float4 PS(float4 pos : SV_Position, float2 uv : TEXCOORD) : SV_Target\n{\n\tfloat4 result = 0;\n";
+	for (int i = 0; i < count; ++i)
+		for (int k = 0; k < 4; ++k)
+			source += "\tresult += Helper" + std::to_string(i) + "(uv + " + std::to_string(k) + ".0);\n";
+	source += "\treturn result;\n}\n";
+
+	source += "void VS(uint id : SV_VertexID, out float4 pos : SV_Position, out float2 uv : TEXCOORD) { uv.x = (id == 2) ? 2.0 : 0.0; uv.y = (id == 1) ? 2.0 : 0.0; pos = float4(uv * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0); }\n";
+
+	// Every pass looks up the samplers its shaders use again
+	source += "technique T\n{\n";
+	for (int i = 0; i < passes; ++i)
+		source += "\tpass { VertexShader = VS; PixelShader = PS; }\n";
+	source += "}\n";
+
+	return source;
+}
+
+void run_codegen_benchmarks()
+{
+	const std::string many_definitions_source = generate_many_definitions_effect(1000, 50);
+
+	if (reshadefx::parser parser; !parser.parse(many_definitions_source, std::unique_ptr<reshadefx::codegen>(create_codegen("hlsl")).get()))
+	{
+		std::cout << "FAILED  generated effect with 1000 definitions: " << parser.errors() << std::endl;
+		return;
+	}
+
+	for (const std::string language : { "hlsl", "glsl", "spirv" })
+	{
+		measure("compile 1000 definitions with 50 passes (" + language + ')', 15, [&many_definitions_source, &language]() {
+			const std::unique_ptr<reshadefx::codegen> backend(create_codegen(language));
+			reshadefx::parser parser;
+			parser.parse(many_definitions_source, backend.get());
+			reshadefx::module module;
+			backend->write_result(module);
+		});
+	}
+
+	// Generating code for several back-ends by parsing once and replaying the recorded calls into each, compared to a full compile for each of them
+	measure("compile 1000 definitions separately for all back-ends", 10, [&many_definitions_source]() {
+		for (const char *const language : { "hlsl", "glsl", "spirv" })
+		{
+			const std::unique_ptr<reshadefx::codegen> backend(create_codegen(language));
+			reshadefx::parser parser;
+			parser.parse(many_definitions_source, backend.get());
+			reshadefx::module module;
+			backend->write_result(module);
+		}
+	});
+	measure("compile 1000 definitions once and replay into all back-ends", 10, [&many_definitions_source]() {
+		const std::unique_ptr<reshadefx::codegen> ir(reshadefx::create_codegen_ir());
+		reshadefx::parser parser;
+		parser.parse(many_definitions_source, ir.get());
+
+		for (const char *const language : { "hlsl", "glsl", "spirv" })
+		{
+			const std::unique_ptr<reshadefx::codegen> backend(create_codegen(language));
+			reshadefx::replay_codegen_ir(ir.get(), backend.get());
+			reshadefx::module module;
+			backend->write_result(module);
+		}
+	});
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "benchmarks.hpp"
+#include "effect_lexer.hpp"
+#include <iterator> // std::size
+
+void run_lexer_benchmarks()
+{
+	// Mix of keywords, reserved words and identifiers, which all go through the keyword lookup
+	{
+		static const char *const words[] = {
+			"float4", "return", "if", "sampler2D", "technique", "pass", "color", "texcoord", "uniform", "static",
+			"const", "for", "position", "matrix", "half3", "result", "namespace", "discard", "value", "packoffset" };
+
+		std::string source;
+		for (size_t i = 0; i < 1200000; ++i)
+		{
+			source += words[i % std::size(words)];
+			source += (i % 16) == 15 ? '\n' : ' ';
+		}
+
+		measure("lex 1.2M keywords and identifiers", 10, [&source]() {
+			reshadefx::lexer lexer { std::string_view(source) };
+			while (lexer.lex().id != reshadefx::tokenid::end_of_file)
+				continue;
+		});
+	}
+
+	// Preprocessor directives, which are looked up in a separate table
+	{
+		static const char *const directives[] = {
+			"#define", "#undef", "#if", "#ifdef", "#ifndef", "#elif", "#else", "#endif", "#include", "#pragma", "#error", "#warning" };
+
+		std::string source;
+		for (size_t i = 0; i < 400000; ++i)
+		{
+			source += directives[i % std::size(directives)];
+			source += " X\n";
+		}
+
+		measure("lex 400k preprocessor directives", 10, [&source]() {
+			reshadefx::lexer lexer { std::string_view(source), true, true, false };
+			while (lexer.lex().id != reshadefx::tokenid::end_of_file)
+				continue;
+		});
+	}
+}
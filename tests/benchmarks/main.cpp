@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "benchmarks.hpp"
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <vector>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <algorithm> // std::min
+
+// Keep track of all heap allocations, so that the memory a benchmark allocates can be reported alongside its time
+static std::atomic<size_t> s_allocation_count = 0;
+static std::atomic<size_t> s_allocated_bytes = 0;
+
+void *operator new(size_t size)
+{
+	void *const block = std::malloc(size != 0 ? size : 1);
+	if (block == nullptr)
+		throw std::bad_alloc();
+
+	s_allocation_count++;
+	s_allocated_bytes += size;
+
+	return block;
+}
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+void operator delete[](void *ptr) noexcept
+{
+	operator delete(ptr);
+}
+void operator delete(void *ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+void operator delete[](void *ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+static std::vector<std::string> s_selected_names;
+
+bool is_selected(const std::string &name)
+{
+	return s_selected_names.empty() || std::any_of(s_selected_names.begin(), s_selected_names.end(),
+		[&name](const std::string &selected_name) { return name.find(selected_name) != std::string::npos; });
+}
+
+void measure(const std::string &name, unsigned int runs, const std::function<void()> &run)
+{
+	if (!is_selected(name))
+		return;
+
+	double best_duration = std::numeric_limits<double>::max();
+	size_t allocation_count = 0;
+	size_t allocated_bytes = 0;
+
+	for (unsigned int i = 0; i < runs; ++i)
+	{
+		const size_t allocation_count_before = s_allocation_count;
+		const size_t allocated_bytes_before = s_allocated_bytes;
+		const auto start_time = std::chrono::steady_clock::now();
+
+		run();
+
+		best_duration = std::min(best_duration, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count());
+		// Every run does the same work, so the allocations are the same too
+		allocation_count = s_allocation_count - allocation_count_before;
+		allocated_bytes = s_allocated_bytes - allocated_bytes_before;
+	}
+
+	std::cout << std::left << std::setw(56) << name << std::right << std::fixed << std::setprecision(3) << std::setw(12) << best_duration << std::setw(13) << allocation_count << std::setw(18) << allocated_bytes << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	// Only run the benchmarks whose name contains one of the arguments
+	for (int i = 1; i < argc; ++i)
+		s_selected_names.push_back(argv[i]);
+
+	std::cout << std::left << std::setw(56) << "benchmark" << std::right << std::setw(12) << "best (ms)" << std::setw(13) << "allocations" << std::setw(18) << "allocated bytes" << std::endl;
+
+	run_lexer_benchmarks();
+	run_preprocessor_benchmarks();
+	run_codegen_benchmarks();
+
+	return 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "benchmarks.hpp"
+#include "effect_preprocessor.hpp"
+#include <fstream>
+#include <iostream>
+
+/// <summary>
+/// Preprocess the source code once to check that it is valid and then measure how long preprocessing it takes.
+/// </summary>
+static void measure_preprocessing(const std::string &name, const std::string &source, unsigned int runs = 10)
+{
+	if (!is_selected(name))
+		return;
+
+	if (reshadefx::preprocessor pp; !pp.append_string(source))
+	{
+		std::cout << "FAILED  " << name << ": " << pp.errors() << std::endl;
+		return;
+	}
+
+	measure(name, runs, [&source]() {
+		reshadefx::preprocessor pp;
+		pp.append_string(source);
+	});
+}
+
+void run_preprocessor_benchmarks()
+{
+	// Large header with an include guard that is included many times, which should not cause its contents to be copied every time
+	// The header consists of comments, so that skipping over it once it was included is cheap and copying it would dominate the time
+	if (const std::string name = "include guarded 2 MB header 200 times"; is_selected(name))
+	{
+		const std::filesystem::path directory = std::filesystem::temp_directory_path() / "reshadefx_benchmarks";
+		std::filesystem::create_directories(directory);
+
+		{
+			std::ofstream header(directory / "header.fxh");
+			header << "#ifndef HEADER_FXH\n#define HEADER_FXH\n";
+			for (int i = 0; header.tellp() < 2 * 1024 * 1024; ++i)
+				header << "// Line " << i << " of a long description of the functions declared in this header, which is skipped by the lexer\n";
+			header << "#endif\n";
+
+			std::ofstream main(directory / "main.fx");
+			for (int i = 0; i < 200; ++i)
+				main << "#include \"header.fxh\"\n";
+		}
+
+		if (reshadefx::preprocessor pp; !pp.append_file(directory / "main.fx"))
+			std::cout << "FAILED  " << name << ": " << pp.errors() << std::endl;
+		else
+			measure(name, 5, [&directory]() {
+				reshadefx::preprocessor pp;
+				pp.append_file(directory / "main.fx");
+			});
+
+		std::filesystem::remove_all(directory);
+	}
+
+	// Function-like macros nested several levels deep, which pass long argument lists on to each other
+	{
+		std::string source =
+			"#define ADD4(a, b, c, d) ((a) + (b) + (c) + (d))\n"
+			"#define MUL4(a, b, c, d) ADD4((a) * (b), (b) * (c), (c) * (d), (d) * (a))\n"
+			"#define MIX4(a, b, c, d) MUL4(ADD4(a, b, c, d), (a) - (b), (c) - (d), lerp(a, b, 0.5))\n"
+			"#define BLEND(a, b, c, d) MIX4(MUL4(a, b, c, d), MIX4(d, c, b, a), a, b)\n";
+		for (int i = 0; i < 500; ++i)
+		{
+			const std::string n = std::to_string(i);
+			source += "static const float v" + n + " = BLEND(float(" + n + ") * 0.5, sin(" + n + ".0 + 1.0), cos(" + n + ".0 * 2.0), max(" + n + ".0, 3.0));\n";
+		}
+
+		measure_preprocessing("macro expansion (nested, large argument lists)", source);
+	}
+
+	// Many small function-like and object-like macros, including stringizing and token pasting
+	{
+		std::string source =
+			"#define PI 3.14159265\n"
+			"#define TWO_PI (2.0 * PI)\n"
+			"#define SQR(x) ((x) * (x))\n"
+			"#define LEN2(x, y) sqrt(SQR(x) + SQR(y))\n"
+			"#define CAT(a, b) a##b\n"
+			"#define STR(x) #x\n";
+		for (int i = 0; i < 20000; ++i)
+		{
+			const std::string n = std::to_string(i);
+			source += "float CAT(f, " + n + ")(float a, float b) < string name = STR(f" + n + "); > { return LEN2(a, b) * TWO_PI + SQR(" + n + ".0); }\n";
+		}
+
+		measure_preprocessing("macro expansion (small macros)", source);
+	}
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "tests.hpp"
+#include "effect_parser.hpp"
+#include "effect_codegen.hpp"
+#include <cmath>
+#include <memory>
+
+/// <summary>
+/// Compile a uniform variable initialized with the specified expression, which only succeeds if the expression was folded into a constant.
+/// </summary>
+static std::string compile_initializer(const std::string &type, const std::string &expression, reshadefx::uniform_info &uniform)
+{
+	std::unique_ptr<reshadefx::codegen> backend(reshadefx::create_codegen_hlsl(50, false, false));
+
+	reshadefx::parser parser;
+	if (!parser.parse("uniform " + type + " Value = " + expression + ";\n", backend.get()))
+		return parser.errors();
+
+	reshadefx::module module;
+	backend->write_result(module);
+
+	if (module.uniforms.size() != 1 || !module.uniforms[0].has_initializer_value)
+		return "uniform variable has no initial value";
+
+	uniform = module.uniforms[0];
+	return std::string();
+}
+
+/// <summary>
+/// Check that an expression with a floating-point result is folded into the expected components.
+/// </summary>
+static void test_folded_float(const std::string &type, const std::string &expression, const std::vector<float> &expected)
+{
+	reshadefx::uniform_info uniform;
+	std::string error = compile_initializer(type, expression, uniform);
+
+	for (size_t i = 0; error.empty() && i < expected.size(); ++i)
+		// Allow for rounding differences of the standard library functions, but nothing more
+		if (const float value = uniform.initializer_value.as_float[i];
+			std::abs(value - expected[i]) > 1e-6f * std::max(1.0f, std::abs(expected[i])))
+			error = "component " + std::to_string(i) + " is " + std::to_string(value) + " instead of " + std::to_string(expected[i]);
+
+	report("folding " + expression, error);
+}
+
+/// <summary>
+/// Check that an expression with an integer result is folded into the expected bits.
+/// </summary>
+static void test_folded_bits(const std::string &type, const std::string &expression, uint32_t expected)
+{
+	reshadefx::uniform_info uniform;
+	std::string error = compile_initializer(type, expression, uniform);
+
+	if (error.empty() && uniform.initializer_value.as_uint[0] != expected)
+		error = "value is " + std::to_string(uniform.initializer_value.as_uint[0]) + " instead of " + std::to_string(expected);
+
+	report("folding " + expression, error);
+}
+
+/// <summary>
+/// Check that a call with arguments for which the result is undefined on the GPU is not folded and stays a call that is evaluated at runtime.
+/// </summary>
+static void test_not_folded(const std::string &type, const std::string &expression)
+{
+	std::unique_ptr<reshadefx::codegen> backend(reshadefx::create_codegen_hlsl(50, false, false));
+
+	reshadefx::parser parser;
+	if (!parser.parse(type + " Value() { return " + expression + "; }\n", backend.get()))
+	{
+		report("not folding " + expression, "compilation failed\n" + parser.errors());
+		return;
+	}
+
+	reshadefx::module module;
+	backend->write_result(module);
+
+	// The generated code contains the call to the intrinsic only if it was not replaced with its result
+	const std::string call = expression.substr(0, expression.find('(') + 1);
+	report("not folding " + expression, module.hlsl.find(call) != std::string::npos ? std::string() : "call was folded into a constant");
+}
+
+void run_constant_folding_tests()
+{
+	test_folded_float("float", "sqrt(2.0)", { 1.41421356f });
+	test_folded_float("float2", "sqrt(float2(16.0, 0.25))", { 4.0f, 0.5f });
+	test_folded_float("float", "pow(2.0, 10.0)", { 1024.0f });
+	test_folded_float("float2", "pow(float2(4.0, 0.0), float2(0.5, 2.0))", { 2.0f, 0.0f });
+	test_folded_float("float3", "normalize(float3(3.0, 0.0, -4.0))", { 0.6f, 0.0f, -0.8f });
+	test_folded_float("float2", "lerp(float2(2.0, -1.0), float2(4.0, 1.0), 0.25)", { 2.5f, -0.5f });
+	test_folded_float("float", "dot(float3(1.0, 2.0, 3.0), float3(4.0, 5.0, 6.0))", { 32.0f });
+	// Halfway cases are rounded to the nearest even value
+	test_folded_float("float4", "round(float4(0.5, 1.5, 2.5, -2.5))", { 0.0f, 2.0f, 2.0f, -2.0f });
+	test_folded_float("float2", "round(float2(2.4, -2.6))", { 2.0f, -3.0f });
+
+	test_folded_bits("uint", "asuint(1.0)", 0x3F800000u);
+	test_folded_bits("int", "asint(-2.0)", 0xC0000000u);
+	test_folded_bits("float", "asfloat(0x40400000u)", 0x40400000u);
+	test_folded_bits("float", "asfloat(asuint(0.15625))", 0x3E200000u);
+
+	test_not_folded("float", "pow(-1.0, 0.5)");
+	test_not_folded("float", "log(0.0)");
+	test_not_folded("float", "asin(2.0)");
+	test_not_folded("float", "clamp(0.5, 1.0, 0.0)");
+	test_not_folded("float", "sqrt(-1.0)");
+	test_not_folded("float3", "normalize(float3(0.0, 0.0, 0.0))");
+	// Infinities are not guaranteed to be preserved on the GPU
+	test_not_folded("float", "asfloat(0x7F800000u)");
+}
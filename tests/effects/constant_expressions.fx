@@ -0,0 +1,76 @@
+// Constant expressions that can be folded and code that is not reachable from any entry point
+
+uniform float scale = 1.0;
+uniform float unused_uniform = 2.0;
+
+texture2D tex { Width = BUFFER_WIDTH; Height = BUFFER_HEIGHT; };
+sampler2D samp { Texture = tex; };
+
+static const float K = 2.0 + 3.0 * 4.0;
+static const float3 N = float3(3.0, 0.0, 4.0) / 5.0;
+static const int2 I = int2(7 / 2, -7 % 3);
+
+static float unused_global = 1.0;
+
+float unused_function(float x)
+{
+	return x * unused_global;
+}
+
+float helper(float x)
+{
+	float y = x;
+	y += 1.0;
+	return y * (2.0 + 3.0);
+}
+
+void PostProcessVS(uint id : SV_VertexID, out float4 position : SV_Position, out float2 texcoord : TEXCOORD)
+{
+	texcoord.x = (id == 2) ? 2.0 : 0.0;
+	texcoord.y = (id == 1) ? 2.0 : 0.0;
+	position = float4(texcoord * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+}
+
+float4 ArithmeticPS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	const float a = 1.0 + 2.0;
+	const float b = a * scale;
+	const int c = (0xF0 >> 4) | (1 << 3) ^ 0x3;
+	const uint d = (~0u) / 3u;
+	const bool e = a > 2.0 && c != 0;
+
+	float4 v = float4(a, K, N.x, N.z);
+	v.xy = v.yx * float2(I);
+	v.z += e ? helper(b) : -helper(b);
+	v.w += d % 7u;
+
+	return v * tex2D(samp, texcoord).r + float4(BUFFER_RCP_WIDTH, BUFFER_RCP_HEIGHT, 0.0, 0.0);
+}
+
+float4 SelectPS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	const float3 folded = true ? float3(1.0, 2.0, 3.0) : float3(4.0, 5.0, 6.0);
+	const float4 swizzled = float4(folded.zyx, folded.y).wzyx;
+
+	float result = 0.0;
+	if (swizzled.x > 1.0)
+		result = swizzled.y;
+	else
+		result = tex2D(samp, texcoord).g;
+
+	return result;
+}
+
+technique ConstantExpressions
+{
+	pass
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = ArithmeticPS;
+	}
+	pass
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = SelectPS;
+	}
+}
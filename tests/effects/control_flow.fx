@@ -0,0 +1,126 @@
+// Branches, loops and switch statements, which exercise block merging and the forwarding of stores across basic blocks
+
+uniform int mode < ui_type = "combo"; > = 1;
+uniform bool flag = true;
+uniform float4 tint = float4(1.0, 0.5, 0.25, 1.0);
+
+texture2D tex { Width = 8; Height = 8; Format = RGBA16F; };
+sampler2D samp { Texture = tex; };
+
+static const float table[4] = { 1.0, 2.0, 3.0, 4.0 };
+
+void PostProcessVS(uint id : SV_VertexID, out float4 position : SV_Position, out float2 texcoord : TEXCOORD)
+{
+	texcoord.x = (id == 2) ? 2.0 : 0.0;
+	texcoord.y = (id == 1) ? 2.0 : 0.0;
+	position = float4(texcoord * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+}
+
+float4 BranchesPS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	float4 color = tex2D(samp, texcoord);
+
+	if (flag && color.r > 0.5)
+	{
+		color *= 2.0;
+		if (color.g < 0.1 || mode == 2)
+			color.b = 1.0;
+		else
+			color.b = 0.0;
+	}
+	else if (mode > 3)
+	{
+		color = 0.0;
+	}
+
+	const float value = (color.r > 0.5 ? color.g : color.b) + (flag ? 1.0 : 0.0);
+	const bool both = color.r > 0.0 && (color.g > 0.0 || color.b > 0.0);
+	color.rgb += value + both;
+
+	if (color.r > 100.0)
+		discard;
+
+	return color;
+}
+
+float4 LoopsPS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	float4 color = 0.0;
+
+	[unroll] for (int i = 0; i < 4; ++i)
+	{
+		if (i == 2)
+			continue;
+		color.rgb += table[i] * tint.rgb;
+		if (color.a > 10.0)
+			break;
+	}
+
+	[loop] for (int k = 0; k < mode; ++k)
+		color += tex2D(samp, texcoord + k * 0.01);
+
+	int counter = 0;
+	while (counter < mode)
+	{
+		counter++;
+		if (counter == 5)
+			break;
+	}
+	do
+	{
+		counter--;
+	}
+	while (counter > 0);
+
+	color.a = counter;
+	return color;
+}
+
+float4 SwitchPS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	float4 color = tint;
+
+	switch (mode)
+	{
+	case 0:
+		color.r = 0.0;
+		break;
+	case 1:
+	case 2:
+		color.g = 1.0;
+		break;
+	default:
+		color.b = 0.5;
+		break;
+	}
+
+	[branch] switch (mode * 2)
+	{
+	case 4:
+		return 1.0;
+	default:
+		color.a += 1.0;
+		break;
+	}
+
+	return color;
+}
+
+technique ControlFlow
+{
+	pass
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = BranchesPS;
+	}
+	pass
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = LoopsPS;
+	}
+	pass
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = SwitchPS;
+	}
+}
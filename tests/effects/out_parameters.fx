@@ -0,0 +1,82 @@
+// Values written through pointers (out parameters of functions and intrinsics, partial writes to composites), which must not be forwarded or removed
+
+texture2D tex { Width = 8; Height = 8; };
+sampler2D samp { Texture = tex; };
+
+void PostProcessVS(uint id : SV_VertexID, out float4 position : SV_Position, out float2 texcoord : TEXCOORD)
+{
+	texcoord.x = (id == 2) ? 2.0 : 0.0;
+	texcoord.y = (id == 1) ? 2.0 : 0.0;
+	position = float4(texcoord * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+}
+
+void split(float value, out float integral, out float fractional)
+{
+	fractional = modf(value, integral);
+}
+
+void accumulate(inout float4 sum, float4 value)
+{
+	sum += value;
+}
+
+float4 IntrinsicsPS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	// The result of these calls is unused, only the out parameter is
+	float integral;
+	modf(texcoord.x * 10.0, integral);
+	int exponent;
+	frexp(texcoord.y * 10.0, exponent);
+
+	float s, c;
+	sincos(texcoord.x, s, c);
+
+	return float4(integral, exponent, s, c);
+}
+
+float4 FunctionsPS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	float integral, fractional;
+	split(texcoord.x * 4.0, integral, fractional);
+
+	float4 sum = 0.0;
+	accumulate(sum, tex2D(samp, texcoord));
+	accumulate(sum, float4(integral, fractional, 0.0, 1.0));
+
+	return sum;
+}
+
+float4 PartialWritesPS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	float4 color = tex2D(samp, texcoord);
+	color.x = 1.0;
+	color.yz = texcoord;
+
+	float values[3] = { 1.0, 2.0, 3.0 };
+	values[1] = color.w;
+
+	float3x3 m = float3x3(1, 0, 0, 0, 1, 0, 0, 0, 1);
+	m[1][2] = color.x;
+	m[0] = color.yzw;
+
+	return float4(mul(m, color.rgb), values[0] + values[1] + values[2]);
+}
+
+technique OutParameters
+{
+	pass
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = IntrinsicsPS;
+	}
+	pass
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = FunctionsPS;
+	}
+	pass
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = PartialWritesPS;
+	}
+}
@@ -0,0 +1,80 @@
+// Textures, storage and compute shaders with shared memory, atomics and barriers
+
+uniform float4x4 transform;
+uniform float2 offsets[3] = { float2(1, 2), float2(3, 4), float2(5, 6) };
+
+texture2D BackBufferTex : COLOR;
+sampler2D BackBuffer { Texture = BackBufferTex; };
+
+texture2D ColorTex { Width = 64; Height = 64; Format = RGBA16F; MipLevels = 2; };
+sampler2D Color { Texture = ColorTex; MagFilter = POINT; };
+storage2D ColorStorage { Texture = ColorTex; };
+
+texture2D CounterTex { Width = 1; Height = 1; Format = R32F; };
+storage2D CounterStorage { Texture = CounterTex; };
+
+struct Light
+{
+	float3 direction;
+	float power;
+};
+
+float shade(Light light, float3 normal)
+{
+	return saturate(dot(light.direction, normal)) * light.power;
+}
+
+void PostProcessVS(uint id : SV_VertexID, out float4 position : SV_Position, out float2 texcoord : TEXCOORD)
+{
+	texcoord.x = (id == 2) ? 2.0 : 0.0;
+	texcoord.y = (id == 1) ? 2.0 : 0.0;
+	position = float4(texcoord * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+	position = mul(position, transform);
+}
+
+float4 SamplePS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+{
+	float4 color = tex2D(BackBuffer, texcoord);
+	color += tex2Dlod(Color, float4(texcoord, 0, 1));
+	color += tex2Dfetch(Color, int2(position.xy) % 64);
+	color += tex2DgatherR(Color, texcoord);
+	color.xy += tex2Dsize(Color, 0) * offsets[1];
+
+	Light light;
+	light.direction = normalize(float3(1.0, 1.0, 0.0));
+	light.power = 2.0;
+	color.a = shade(light, color.xyz);
+
+	return color;
+}
+
+groupshared uint counter;
+
+void ClearCS(uint3 id : SV_DispatchThreadID, uint3 tid : SV_GroupThreadID)
+{
+	if (tid.x == 0 && tid.y == 0)
+		counter = 0;
+	barrier();
+
+	const uint index = atomicAdd(counter, 1u);
+	tex2Dstore(ColorStorage, id.xy, float4(index, id.x, id.y, 1.0));
+
+	memoryBarrier();
+	if (index == 0)
+		tex2Dstore(CounterStorage, int2(0, 0), counter);
+}
+
+technique Resources
+{
+	pass
+	{
+		ComputeShader = ClearCS<8, 8>;
+		DispatchSizeX = 8;
+		DispatchSizeY = 8;
+	}
+	pass
+	{
+		VertexShader = PostProcessVS;
+		PixelShader = SamplePS;
+	}
+}
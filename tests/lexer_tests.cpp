@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "tests.hpp"
+#include "effect_lexer.hpp"
+#include <cstring> // std::memcmp
+#include <fstream>
+#include <sstream>
+#include <iterator> // std::size
+#include <algorithm> // std::sort
+
+static const char *const s_flag_names[] = { "ignore_comments", "ignore_whitespace", "ignore_pp_directives", "ignore_line_directives", "ignore_keywords", "escape_string_literals", "identifier_table" };
+static constexpr unsigned int s_num_flag_combinations = 1u << std::size(s_flag_names);
+
+static std::string describe_flags(unsigned int flags)
+{
+	std::string description;
+	for (size_t i = 0; i < std::size(s_flag_names); ++i)
+		if (flags & (1u << i))
+			description += (description.empty() ? "" : ", ") + std::string(s_flag_names[i]);
+	return description.empty() ? "no flags" : description;
+}
+
+/// <summary>
+/// Compare every field of a token produced by the vectorized scanning code with the one produced by looking at every character individually.
+/// </summary>
+static std::string compare_tokens(const reshadefx::token &expected, const reshadefx::token &actual, bool compare_identifier_ids)
+{
+	const std::string at = " at offset " + std::to_string(expected.offset) + " (" + reshadefx::token::id_to_name(expected.id) + ")";
+
+	if (actual.id != expected.id)
+		return "token is " + reshadefx::token::id_to_name(actual.id) + at;
+	if (actual.offset != expected.offset || actual.length != expected.length)
+		return "token spans " + std::to_string(actual.offset) + '+' + std::to_string(actual.length) + " instead of " + std::to_string(expected.offset) + '+' + std::to_string(expected.length) + at;
+	if (actual.location.source != expected.location.source || actual.location.line != expected.location.line || actual.location.column != expected.location.column)
+		return "token is at " + std::to_string(actual.location.line) + ':' + std::to_string(actual.location.column) + " instead of " + std::to_string(expected.location.line) + ':' + std::to_string(expected.location.column) + at;
+	// The lexer clears all bytes of the literal value before every token
+	if (std::memcmp(&actual.literal_as_double, &expected.literal_as_double, sizeof(expected.literal_as_double)) != 0)
+		return "literal value differs" + at;
+	if (actual.literal_as_string != expected.literal_as_string)
+		return "literal string is \"" + std::string(actual.literal_as_string) + "\" instead of \"" + std::string(expected.literal_as_string) + '\"' + at;
+	// Identifier indices are only assigned to identifiers (not to keywords)
+	if (compare_identifier_ids && expected.id == reshadefx::tokenid::identifier && actual.identifier_id != expected.identifier_id)
+		return "identifier index is " + std::to_string(actual.identifier_id) + " instead of " + std::to_string(expected.identifier_id) + at;
+
+	return std::string();
+}
+
+/// <summary>
+/// Lex the source code with every combination of lexer flags, once with vectorized scanning and once without, and check that both produce the same tokens.
+/// </summary>
+/// <returns>A description of the first difference that was found, or an empty string if there was none.</returns>
+static std::string compare_lexers(const std::string &name, const std::string &source)
+{
+	std::string error;
+
+	for (unsigned int flags = 0; error.empty() && flags < s_num_flag_combinations; ++flags)
+	{
+		reshadefx::identifier_table vectorized_identifiers, scalar_identifiers;
+		const bool use_identifier_table = (flags & (1u << 6)) != 0;
+
+		const auto create_lexer = [&](reshadefx::identifier_table &identifiers) {
+			return reshadefx::lexer(
+				std::string_view(source),
+				(flags & (1u << 0)) != 0,
+				(flags & (1u << 1)) != 0,
+				(flags & (1u << 2)) != 0,
+				(flags & (1u << 3)) != 0,
+				(flags & (1u << 4)) != 0,
+				(flags & (1u << 5)) != 0,
+				reshadefx::location(name, 1),
+				use_identifier_table ? &identifiers : nullptr);
+		};
+
+		reshadefx::lexer vectorized_lexer = create_lexer(vectorized_identifiers);
+		reshadefx::lexer scalar_lexer = create_lexer(scalar_identifiers);
+		scalar_lexer.disable_vectorized_scanning();
+
+		// Every token but the last consumes at least one character, so this bounds the loop should a lexer get stuck
+		for (size_t num_tokens = 0; error.empty(); ++num_tokens)
+		{
+			if (num_tokens > source.size())
+			{
+				error = "lexer did not reach the end of the input";
+				break;
+			}
+
+			const reshadefx::token expected = scalar_lexer.lex();
+			const reshadefx::token actual = vectorized_lexer.lex();
+
+			error = compare_tokens(expected, actual, use_identifier_table);
+
+			if (expected.id == reshadefx::tokenid::end_of_file)
+				break;
+		}
+
+		if (!error.empty())
+			error += " with " + describe_flags(flags);
+	}
+
+	return error;
+}
+
+/// <summary>
+/// Generate source code that places runs of characters the vectorized scanning code handles at every alignment relative to 16 byte blocks and ends them with characters next to the ranges it checks for.
+/// </summary>
+static void generate_edge_cases(std::vector<std::pair<std::string, std::string>> &cases)
+{
+	// Characters right next to the ranges that are checked for (e.g. '@' and '[' around 'A' to 'Z', '\b' and '\x0E' around the space characters),
+	// characters that end scanning, characters that map onto letters when bit 5 is cleared and bytes that are negative when compared as signed values
+	static const char terminators[] = { '@', '[', '`', '{', '/', ':', '_', '^', '~', '\x7F', '\x80', '\xC3', '\xA4', '\xDF', '\xFF', '\b', '\x0E', '\t', '\v', '\f', '\r', '\n', ' ', '*', '\"', '\\', '#', '0', '9', 'A', 'z' };
+
+	std::string identifiers, whitespace, block_comments, line_comments, string_literals, escaped_string_literals, directives;
+
+	for (size_t length = 0; length <= 40; ++length)
+	{
+		for (const char terminator : terminators)
+		{
+			std::string run;
+			for (size_t i = 0; i < length; ++i)
+				run += "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789"[(i * 7 + length) % 63];
+			identifiers += 'x' + run + terminator + "y\n";
+
+			std::string spaces;
+			for (size_t i = 0; i < length; ++i)
+				spaces += " \t\v\f\r"[(i + length) % 5];
+			whitespace += 'x' + spaces + terminator + "y\n";
+
+			block_comments += "/*" + run + terminator + run + "*/x\n";
+			block_comments += "/*" + spaces + '*' + terminator + "*/x\n";
+			line_comments += "//" + run + terminator + run + '\n';
+
+			string_literals += '\"' + run + terminator + run + "\"\n";
+			escaped_string_literals += '\"' + run + '\\' + terminator + run + "\"\n";
+
+			directives += "#define " + run.substr(0, length / 2) + 'x' + terminator + '\n';
+			directives += "#line " + std::to_string(length) + " \"" + run + "\"" + terminator + '\n';
+		}
+	}
+
+	cases.emplace_back("generated identifiers", identifiers);
+	cases.emplace_back("generated whitespace", whitespace);
+	cases.emplace_back("generated block comments", block_comments);
+	cases.emplace_back("generated line comments", line_comments);
+	cases.emplace_back("generated string literals", string_literals);
+	cases.emplace_back("generated escaped string literals", escaped_string_literals);
+	cases.emplace_back("generated preprocessor directives", directives);
+}
+
+void run_lexer_tests(const std::filesystem::path &corpus_path)
+{
+	std::vector<std::pair<std::string, std::string>> cases;
+
+	// Every effect in the corpus directory
+	std::vector<std::filesystem::path> effects;
+	if (std::error_code ec; std::filesystem::is_directory(corpus_path, ec))
+		for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(corpus_path, ec))
+			if (entry.path().extension() == ".fx")
+				effects.push_back(entry.path());
+	std::sort(effects.begin(), effects.end());
+
+	for (const std::filesystem::path &path : effects)
+	{
+		std::stringstream source;
+		source << std::ifstream(path, std::ios::binary).rdbuf();
+		cases.emplace_back(path.filename().u8string(), source.str());
+	}
+
+	generate_edge_cases(cases);
+
+	for (const auto &[name, source] : cases)
+		report("lexing " + name, compare_lexers(name, source));
+
+	// Tokens that are cut off by the end of the input at every distance from the end of a 16 byte block, which the vectorized code must not read past
+	for (const char *const prefix : { "x", " ", "/*", "//", "\"", "#line 1 \"" })
+	{
+		std::string error;
+		for (size_t length = 0; error.empty() && length <= 40; ++length)
+		{
+			std::string source = prefix;
+			source.append(length, prefix[0] == ' ' ? '\t' : 'a');
+			error = compare_lexers(prefix, source);
+		}
+
+		report("lexing unterminated \"" + std::string(prefix) + "\" at the end of the input", error);
+	}
+}
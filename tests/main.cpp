@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "tests.hpp"
+#include <iostream>
+
+static size_t s_num_passed = 0;
+static size_t s_num_failed = 0;
+static size_t s_num_skipped = 0;
+
+void report(const std::string &test, const std::string &error)
+{
+	if (error.empty())
+	{
+		s_num_passed++;
+		return;
+	}
+
+	s_num_failed++;
+	std::cout << "FAILED  " << test << ": " << error << std::endl;
+}
+void report_skipped(const std::string &test, const std::string &reason)
+{
+	s_num_skipped++;
+	std::cout << "SKIPPED " << test << ": " << reason << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	const std::filesystem::path corpus_path = argc > 1 ? std::filesystem::u8path(argv[1]) : std::filesystem::path("tests") / "effects";
+
+	if (!run_spirv_optimizer_tests(corpus_path))
+		return 1;
+
+	run_lexer_tests(corpus_path);
+
+	run_constant_folding_tests();
+	run_pointwise_pass_tests();
+
+	std::cout << s_num_passed << " passed, " << s_num_failed << " failed, " << s_num_skipped << " skipped" << std::endl;
+
+	return s_num_failed != 0 ? 1 : 0;
+}
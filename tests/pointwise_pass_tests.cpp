@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "tests.hpp"
+#include "effect_parser.hpp"
+#include "effect_codegen.hpp"
+#include <memory>
+
+// Back buffer sampler, full-screen triangle vertex shader and simple pixel shaders used by the test below
+static const std::string s_common_source = R"(
+	texture2D BackBufferTex : COLOR;
+	sampler2D BackBuffer { Texture = BackBufferTex; };
+	void VS(uint id : SV_VertexID, out float4 position : SV_Position, out float2 texcoord : TEXCOORD)
+	{
+		texcoord.x = (id == 2) ? 2.0 : 0.0;
+		texcoord.y = (id == 1) ? 2.0 : 0.0;
+		position = float4(texcoord * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+	}
+	float4 GrayPS(float4 position : SV_Position, float2 uv : TEXCOORD) : SV_Target
+	{
+		const float4 color = tex2D(BackBuffer, uv);
+		return dot(color.rgb, 1.0 / 3.0).xxxx;
+	}
+	float4 InvertPS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+	{
+		return 1.0 - tex2D(BackBuffer, texcoord);
+	}
+)";
+
+void run_pointwise_pass_tests()
+{
+	// Passes are pointwise if the vertex shader has the signature of one drawing a full-screen triangle, the pixel shader samples only at the texture coordinate it passes through and nothing but the back buffer is written
+	std::unique_ptr<reshadefx::codegen> backend(reshadefx::create_codegen_hlsl(50, false, false));
+
+	reshadefx::parser parser;
+	if (!parser.parse(s_common_source + R"(
+		texture2D TargetTex { Width = 16; Height = 16; };
+		void ExtraOutputVS(uint id : SV_VertexID, out float4 position : SV_Position, out float2 texcoord : TEXCOORD, out float4 extra : TEXCOORD1)
+		{
+			VS(id, position, texcoord);
+			extra = 0.0;
+		}
+		float4 ClipPS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+		{
+			if (texcoord.x > 0.5)
+				discard;
+			return tex2D(BackBuffer, texcoord);
+		}
+		float4 OffsetPS(float4 position : SV_Position, float2 texcoord : TEXCOORD) : SV_Target
+		{
+			return tex2D(BackBuffer, texcoord + 0.5);
+		}
+		technique T
+		{
+			pass { VertexShader = VS; PixelShader = GrayPS; }
+			pass { VertexShader = VS; PixelShader = ClipPS; }
+			pass { VertexShader = VS; PixelShader = OffsetPS; }
+			pass { VertexShader = ExtraOutputVS; PixelShader = InvertPS; }
+			pass { VertexShader = VS; PixelShader = InvertPS; RenderTarget = TargetTex; }
+			pass { VertexShader = VS; PixelShader = InvertPS; BlendEnable = true; }
+		}
+)", backend.get()))
+	{
+		report("pointwise passes", "compilation failed\n" + parser.errors());
+		return;
+	}
+
+	reshadefx::module module;
+	backend->write_result(module);
+
+	const std::vector<reshadefx::pass_info> &passes = module.techniques[0].passes;
+
+	std::string error;
+	if (!passes[0].pointwise)
+		error = "pass sampling at the texture coordinate is not reported as pointwise";
+	else if (passes[1].pointwise || passes[2].pointwise)
+		error = "pass discarding pixels or sampling at a modified texture coordinate is reported as pointwise";
+	else if (passes[3].pointwise)
+		error = "pass with a vertex shader that has more outputs than a full-screen triangle is reported as pointwise";
+	else if (passes[4].pointwise || passes[5].pointwise)
+		error = "pass writing to a render target or blending is reported as pointwise";
+
+	report("pointwise passes", error);
+}
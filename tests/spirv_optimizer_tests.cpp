@@ -0,0 +1,761 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "tests.hpp"
+#include "effect_parser.hpp"
+#include "effect_codegen.hpp"
+#include "effect_preprocessor.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm> // std::sort
+#include <unordered_map>
+
+// Use the C++ variant of the SPIR-V headers
+#include <spirv.hpp>
+namespace spv {
+#include <GLSL.std.450.h>
+}
+
+// Each optimization pass on its own, followed by all of them combined
+static const std::pair<const char *, reshadefx::spirv_optimization> s_optimizations[] = {
+	{ "none", reshadefx::spirv_optimization::none },
+	{ "dead function elimination", reshadefx::spirv_optimization::dead_function_elimination },
+	{ "block merging", reshadefx::spirv_optimization::block_merging },
+	{ "store forwarding", reshadefx::spirv_optimization::store_forwarding },
+	{ "constant folding", reshadefx::spirv_optimization::constant_folding },
+	{ "dead code elimination", reshadefx::spirv_optimization::dead_code_elimination },
+	{ "all", reshadefx::spirv_optimization::all },
+};
+
+static bool is_type_declaration(spv::Op op)
+{
+	switch (op)
+	{
+	case spv::OpTypeVoid:
+	case spv::OpTypeBool:
+	case spv::OpTypeInt:
+	case spv::OpTypeFloat:
+	case spv::OpTypeVector:
+	case spv::OpTypeMatrix:
+	case spv::OpTypeImage:
+	case spv::OpTypeSampler:
+	case spv::OpTypeSampledImage:
+	case spv::OpTypeArray:
+	case spv::OpTypeRuntimeArray:
+	case spv::OpTypeStruct:
+	case spv::OpTypePointer:
+	case spv::OpTypeFunction:
+		return true;
+	default:
+		return false;
+	}
+}
+static bool is_block_terminator(spv::Op op)
+{
+	switch (op)
+	{
+	case spv::OpBranch:
+	case spv::OpBranchConditional:
+	case spv::OpSwitch:
+	case spv::OpReturn:
+	case spv::OpReturnValue:
+	case spv::OpKill:
+	case spv::OpUnreachable:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/// <summary>
+/// Get the word offsets of the result type and result ID of an instruction (zero if it does not have them).
+/// </summary>
+static void get_result_offsets(spv::Op op, uint32_t &type_offset, uint32_t &result_offset)
+{
+	type_offset = 0;
+	result_offset = 0;
+
+	switch (op)
+	{
+	case spv::OpNop:
+	case spv::OpSource:
+	case spv::OpSourceExtension:
+	case spv::OpName:
+	case spv::OpMemberName:
+	case spv::OpLine:
+	case spv::OpExtension:
+	case spv::OpMemoryModel:
+	case spv::OpEntryPoint:
+	case spv::OpExecutionMode:
+	case spv::OpCapability:
+	case spv::OpDecorate:
+	case spv::OpMemberDecorate:
+	case spv::OpStore:
+	case spv::OpSelectionMerge:
+	case spv::OpLoopMerge:
+	case spv::OpBranch:
+	case spv::OpBranchConditional:
+	case spv::OpSwitch:
+	case spv::OpReturn:
+	case spv::OpReturnValue:
+	case spv::OpKill:
+	case spv::OpUnreachable:
+	case spv::OpImageWrite:
+	case spv::OpControlBarrier:
+	case spv::OpMemoryBarrier:
+	case spv::OpFunctionEnd:
+		break;
+	case spv::OpLabel:
+	case spv::OpString:
+	case spv::OpExtInstImport:
+		result_offset = 1;
+		break;
+	default:
+		if (is_type_declaration(op))
+			result_offset = 1;
+		else
+			type_offset = 1, result_offset = 2;
+		break;
+	}
+}
+
+/// <summary>
+/// Call the specified function with every operand of an instruction that is an ID (including the result type, but not the result ID).
+/// </summary>
+template <typename F>
+static void for_each_id_operand(const uint32_t *inst, F func)
+{
+	const spv::Op op = static_cast<spv::Op>(inst[0] & spv::OpCodeMask);
+	const uint32_t num_words = inst[0] >> spv::WordCountShift;
+
+	uint32_t type_offset, result_offset;
+	get_result_offsets(op, type_offset, result_offset);
+
+	if (type_offset != 0)
+		func(inst[type_offset]);
+
+	uint32_t first = result_offset + 1, last = num_words, image_operands = 0;
+
+	switch (op)
+	{
+	case spv::OpCapability:
+	case spv::OpExtension:
+	case spv::OpExtInstImport:
+	case spv::OpMemoryModel:
+	case spv::OpString:
+	case spv::OpSource:
+	case spv::OpSourceExtension:
+	case spv::OpTypeVoid:
+	case spv::OpTypeBool:
+	case spv::OpTypeInt:
+	case spv::OpTypeFloat:
+	case spv::OpTypeSampler:
+	case spv::OpConstant:
+	case spv::OpConstantTrue:
+	case spv::OpConstantFalse:
+	case spv::OpConstantNull:
+	case spv::OpSpecConstant:
+	case spv::OpSpecConstantTrue:
+	case spv::OpSpecConstantFalse:
+	case spv::OpUndef:
+	case spv::OpFunctionParameter:
+		return;
+	case spv::OpEntryPoint:
+		func(inst[2]);
+		// Skip the name string, which is followed by the interface variables
+		for (first = 3; first < num_words; ++first)
+			if ((inst[first] & 0xFF000000) == 0 || (inst[first] & 0xFF0000) == 0 || (inst[first] & 0xFF00) == 0 || (inst[first] & 0xFF) == 0)
+				break;
+		first++;
+		break;
+	case spv::OpExecutionMode:
+	case spv::OpName:
+	case spv::OpMemberName:
+	case spv::OpDecorate:
+	case spv::OpMemberDecorate:
+	case spv::OpLine:
+	case spv::OpSelectionMerge:
+		last = 2;
+		break;
+	case spv::OpLoopMerge:
+		last = 3;
+		break;
+	case spv::OpBranchConditional:
+		last = 4; // Skip branch weights
+		break;
+	case spv::OpSwitch:
+		func(inst[1]);
+		func(inst[2]);
+		for (uint32_t i = 4; i < num_words; i += 2)
+			func(inst[i]); // Skip case literals
+		return;
+	case spv::OpTypeVector:
+	case spv::OpTypeMatrix:
+	case spv::OpTypeImage:
+		last = 3;
+		break;
+	case spv::OpTypePointer:
+		first = 3; // Skip storage class
+		break;
+	case spv::OpVariable:
+		first = 4; // Skip storage class
+		break;
+	case spv::OpFunction:
+		first = 4; // Skip function control
+		break;
+	case spv::OpExtInst:
+		func(inst[3]);
+		first = 5; // Skip extended instruction number
+		break;
+	case spv::OpCompositeExtract:
+		last = 4;
+		break;
+	case spv::OpCompositeInsert:
+	case spv::OpVectorShuffle:
+		last = 5;
+		break;
+	case spv::OpImageFetch:
+	case spv::OpImageRead:
+	case spv::OpImageSampleExplicitLod:
+	case spv::OpImageSampleImplicitLod:
+		image_operands = 5;
+		break;
+	case spv::OpImageGather:
+		image_operands = 6;
+		break;
+	case spv::OpImageWrite:
+		image_operands = 4;
+		break;
+	default:
+		break;
+	}
+
+	// Skip image operands mask
+	if (image_operands != 0 && image_operands < num_words)
+	{
+		for (uint32_t i = first; i < image_operands; ++i)
+			func(inst[i]);
+		first = image_operands + 1;
+	}
+
+	for (uint32_t i = first; i < last && i < num_words; ++i)
+		func(inst[i]);
+}
+
+std::string validate_spirv(const std::vector<uint32_t> &spirv)
+{
+	if (spirv.size() < 5 || spirv[0] != spv::MagicNumber)
+		return "invalid module header";
+
+	const uint32_t bound = spirv[3];
+
+	std::vector<const uint32_t *> insts;
+	for (size_t offset = 5; offset < spirv.size(); offset += spirv[offset] >> spv::WordCountShift)
+	{
+		if ((spirv[offset] >> spv::WordCountShift) == 0 || offset + (spirv[offset] >> spv::WordCountShift) > spirv.size())
+			return "instruction at word " + std::to_string(offset) + " has an invalid word count";
+		insts.push_back(&spirv[offset]);
+	}
+
+	const auto op_of = [](const uint32_t *inst) { return static_cast<spv::Op>(inst[0] & spv::OpCodeMask); };
+	const auto describe = [&op_of](const uint32_t *inst) { return "instruction with opcode " + std::to_string(op_of(inst)); };
+
+	constexpr size_t npos = static_cast<size_t>(-1);
+
+	struct definition
+	{
+		const uint32_t *inst = nullptr;
+		size_t index = npos;
+		size_t function = npos;
+		size_t block = npos;
+	};
+	std::vector<definition> definitions(bound);
+	std::vector<size_t> inst_blocks(insts.size(), npos), inst_functions(insts.size(), npos);
+
+	// Logical layout of a module, see https://www.khronos.org/registry/spir-v/specs/unified1/SPIRV.html#_a_id_logicallayout_a_logical_layout_of_a_module
+	const auto section_of = [](spv::Op op) {
+		switch (op)
+		{
+		case spv::OpCapability:
+			return 0;
+		case spv::OpExtension:
+			return 1;
+		case spv::OpExtInstImport:
+			return 2;
+		case spv::OpMemoryModel:
+			return 3;
+		case spv::OpEntryPoint:
+			return 4;
+		case spv::OpExecutionMode:
+			return 5;
+		case spv::OpString:
+		case spv::OpSource:
+		case spv::OpSourceExtension:
+			return 6;
+		case spv::OpName:
+		case spv::OpMemberName:
+			return 7;
+		case spv::OpDecorate:
+		case spv::OpMemberDecorate:
+			return 8;
+		default:
+			return 9;
+		}
+	};
+
+	enum { outside_function, in_parameters, after_terminator, in_block } state = outside_function;
+	int section = 0;
+	size_t num_memory_models = 0, num_functions = 0, num_blocks = 0;
+	size_t first_block_of_function = npos, first_inst_of_block = npos;
+
+	for (size_t i = 0; i < insts.size(); ++i)
+	{
+		const uint32_t *const inst = insts[i];
+		const spv::Op op = op_of(inst);
+
+		uint32_t type_offset, result_offset;
+		get_result_offsets(op, type_offset, result_offset);
+		if ((inst[0] >> spv::WordCountShift) <= std::max(type_offset, result_offset))
+			return describe(inst) + " is missing its result";
+
+		if (state == outside_function && op != spv::OpFunction && op != spv::OpLine)
+		{
+			if (section_of(op) < section)
+				return describe(inst) + " is out of order in the module layout";
+			section = section_of(op);
+		}
+		if (op == spv::OpMemoryModel)
+			num_memory_models++;
+
+		switch (op)
+		{
+		case spv::OpFunction:
+			if (state != outside_function)
+				return "function is missing its end";
+			state = in_parameters;
+			section = 10;
+			first_block_of_function = npos;
+			num_functions++;
+			break;
+		case spv::OpFunctionParameter:
+			if (state != in_parameters)
+				return "function parameter after the start of the function body";
+			break;
+		case spv::OpLabel:
+			if (state != in_parameters && state != after_terminator)
+				return "block " + std::to_string(inst[1]) + " starts before the previous block was terminated";
+			state = in_block;
+			first_inst_of_block = i;
+			if (first_block_of_function == npos)
+				first_block_of_function = num_blocks;
+			num_blocks++;
+			break;
+		case spv::OpFunctionEnd:
+			if (state != after_terminator)
+				return "function ends without a terminated block";
+			state = outside_function;
+			break;
+		default:
+			// Debug line information may appear anywhere
+			if (state == outside_function || op == spv::OpLine)
+				break;
+			if (state != in_block)
+				return describe(inst) + " is outside of a block";
+
+			if (op == spv::OpVariable)
+			{
+				if (num_blocks - 1 != first_block_of_function)
+					return "function variable " + std::to_string(inst[2]) + " is not declared in the first block";
+				if (inst[3] != spv::StorageClassFunction)
+					return "function variable " + std::to_string(inst[2]) + " does not have function storage class";
+				for (size_t k = first_inst_of_block + 1; k < i; ++k)
+					if (op_of(insts[k]) != spv::OpVariable && op_of(insts[k]) != spv::OpLine)
+						return "function variable " + std::to_string(inst[2]) + " is not declared at the start of the first block";
+			}
+			if (op == spv::OpPhi)
+			{
+				for (size_t k = first_inst_of_block + 1; k < i; ++k)
+					if (op_of(insts[k]) != spv::OpPhi && op_of(insts[k]) != spv::OpLine)
+						return "phi " + std::to_string(inst[2]) + " is not at the start of its block";
+			}
+			if (op == spv::OpSelectionMerge || op == spv::OpLoopMerge)
+			{
+				if (i + 1 >= insts.size() || !is_block_terminator(op_of(insts[i + 1])))
+					return "merge instruction is not followed by a branch";
+			}
+			if (is_block_terminator(op))
+				state = after_terminator;
+			break;
+		}
+
+		if (state != outside_function || op == spv::OpFunctionEnd)
+			inst_functions[i] = num_functions - 1;
+		if (state == in_block || (state == after_terminator && op != spv::OpFunctionEnd))
+			inst_blocks[i] = num_blocks - 1;
+
+		if (result_offset != 0)
+		{
+			const uint32_t id = inst[result_offset];
+			if (id == 0 || id >= bound)
+				return "result ID " + std::to_string(id) + " is outside the bound of the module";
+			if (definitions[id].inst != nullptr)
+				return "ID " + std::to_string(id) + " is defined more than once";
+
+			definitions[id].inst = inst;
+			definitions[id].index = i;
+			// Functions can be referenced from anywhere in the module
+			if (op != spv::OpFunction)
+				definitions[id].function = inst_functions[i],
+				definitions[id].block = inst_blocks[i];
+		}
+	}
+
+	if (state != outside_function)
+		return "last function is missing its end";
+	if (num_memory_models != 1)
+		return "module has to contain exactly one memory model";
+
+	const auto op_of_id = [&](uint32_t id) {
+		return id < bound && definitions[id].inst != nullptr ? op_of(definitions[id].inst) : spv::OpNop;
+	};
+	const auto type_of = [&](uint32_t id) -> uint32_t {
+		if (op_of_id(id) == spv::OpNop)
+			return 0;
+		uint32_t type_offset, result_offset;
+		get_result_offsets(static_cast<spv::Op>(definitions[id].inst[0] & spv::OpCodeMask), type_offset, result_offset);
+		return type_offset != 0 ? definitions[id].inst[type_offset] : 0;
+	};
+	const auto is_label_in_function = [&](uint32_t id, size_t function) {
+		return id < bound && definitions[id].inst != nullptr && op_of(definitions[id].inst) == spv::OpLabel && definitions[id].function == function;
+	};
+
+	// Build the control flow graph, so that the parents of phi instructions can be checked
+	std::unordered_map<uint32_t, std::vector<uint32_t>> predecessors;
+	uint32_t current_label = 0;
+	for (size_t i = 0; i < insts.size(); ++i)
+	{
+		const uint32_t *const inst = insts[i];
+		const uint32_t num_words = inst[0] >> spv::WordCountShift;
+
+		switch (op_of(inst))
+		{
+		case spv::OpLabel:
+			current_label = inst[1];
+			break;
+		case spv::OpBranch:
+			predecessors[inst[1]].push_back(current_label);
+			break;
+		case spv::OpBranchConditional:
+			predecessors[inst[2]].push_back(current_label);
+			if (inst[3] != inst[2])
+				predecessors[inst[3]].push_back(current_label);
+			break;
+		case spv::OpSwitch:
+			predecessors[inst[2]].push_back(current_label);
+			for (uint32_t k = 4; k < num_words; k += 2)
+				if (std::find(predecessors[inst[k]].begin(), predecessors[inst[k]].end(), current_label) == predecessors[inst[k]].end())
+					predecessors[inst[k]].push_back(current_label);
+			break;
+		default:
+			break;
+		}
+	}
+
+	uint32_t current_function_return_type = 0;
+
+	for (size_t i = 0; i < insts.size(); ++i)
+	{
+		const uint32_t *const inst = insts[i];
+		const spv::Op op = op_of(inst);
+		const uint32_t num_words = inst[0] >> spv::WordCountShift;
+
+		std::string error;
+		for_each_id_operand(inst, [&](uint32_t id) {
+			if (!error.empty())
+				return;
+			if (id == 0 || id >= bound || definitions[id].inst == nullptr)
+				error = describe(inst) + " references undefined ID " + std::to_string(id);
+			// Debug information and annotations are global, but may reference IDs inside functions
+			else if (definitions[id].function != npos && definitions[id].function != inst_functions[i] && section_of(op) == 9)
+				error = describe(inst) + " references ID " + std::to_string(id) + " of another function";
+			else if (definitions[id].block != npos && definitions[id].block == inst_blocks[i] && definitions[id].index > i && op != spv::OpPhi)
+				error = describe(inst) + " references ID " + std::to_string(id) + " before it is defined";
+		});
+		if (!error.empty())
+			return error;
+
+		uint32_t type_offset, result_offset;
+		get_result_offsets(op, type_offset, result_offset);
+		if (type_offset != 0 && !is_type_declaration(op_of_id(inst[type_offset])))
+			return describe(inst) + " has a result type that is not a type";
+
+		switch (op)
+		{
+		case spv::OpEntryPoint:
+			if (op_of_id(inst[2]) != spv::OpFunction)
+				return "entry point does not reference a function";
+			break;
+		case spv::OpFunction:
+			if (op_of_id(inst[4]) != spv::OpTypeFunction || definitions[inst[4]].inst[2] != inst[1])
+				return "function " + std::to_string(inst[2]) + " does not match its function type";
+			current_function_return_type = inst[1];
+			break;
+		case spv::OpFunctionCall:
+			if (op_of_id(inst[3]) != spv::OpFunction)
+				return "function call " + std::to_string(inst[2]) + " does not reference a function";
+			if (definitions[inst[3]].inst[1] != inst[1])
+				return "function call " + std::to_string(inst[2]) + " does not match the return type of the function";
+			if (const uint32_t *const function_type = definitions[definitions[inst[3]].inst[4]].inst; (function_type[0] >> spv::WordCountShift) != num_words - 1)
+				return "function call " + std::to_string(inst[2]) + " does not match the parameter count of the function";
+			break;
+		case spv::OpLoad:
+			if (const uint32_t pointer_type = type_of(inst[3]); op_of_id(pointer_type) != spv::OpTypePointer || definitions[pointer_type].inst[3] != inst[1])
+				return "load " + std::to_string(inst[2]) + " does not match the type of the pointer";
+			break;
+		case spv::OpStore:
+			if (const uint32_t pointer_type = type_of(inst[1]); op_of_id(pointer_type) != spv::OpTypePointer || definitions[pointer_type].inst[3] != type_of(inst[2]))
+				return "store to " + std::to_string(inst[1]) + " does not match the type of the pointer";
+			break;
+		case spv::OpReturn:
+			if (op_of_id(current_function_return_type) != spv::OpTypeVoid)
+				return "function without a void return type returns without a value";
+			break;
+		case spv::OpReturnValue:
+			if (type_of(inst[1]) != current_function_return_type)
+				return "returned value " + std::to_string(inst[1]) + " does not match the return type of the function";
+			break;
+		case spv::OpBranch:
+			if (!is_label_in_function(inst[1], inst_functions[i]))
+				return "branch target " + std::to_string(inst[1]) + " is not a block in the same function";
+			break;
+		case spv::OpBranchConditional:
+			if (!is_label_in_function(inst[2], inst_functions[i]) || !is_label_in_function(inst[3], inst_functions[i]))
+				return "branch target is not a block in the same function";
+			break;
+		case spv::OpSwitch:
+			if (!is_label_in_function(inst[2], inst_functions[i]))
+				return "switch target is not a block in the same function";
+			for (uint32_t k = 4; k < num_words; k += 2)
+				if (!is_label_in_function(inst[k], inst_functions[i]))
+					return "switch target is not a block in the same function";
+			break;
+		case spv::OpSelectionMerge:
+			if (!is_label_in_function(inst[1], inst_functions[i]))
+				return "merge target " + std::to_string(inst[1]) + " is not a block in the same function";
+			break;
+		case spv::OpLoopMerge:
+			if (!is_label_in_function(inst[1], inst_functions[i]) || !is_label_in_function(inst[2], inst_functions[i]))
+				return "loop merge or continue target is not a block in the same function";
+			break;
+		case spv::OpPhi:
+		{
+			// Find the label of the block this phi is in
+			size_t label_index = i;
+			while (op_of(insts[label_index]) != spv::OpLabel)
+				label_index--;
+			const std::vector<uint32_t> &parents = predecessors[insts[label_index][1]];
+
+			if ((num_words - 3) / 2 != parents.size())
+				return "phi " + std::to_string(inst[2]) + " does not have exactly one value per predecessor of its block";
+			for (uint32_t k = 3; k + 1 < num_words; k += 2)
+			{
+				if (type_of(inst[k]) != inst[1])
+					return "phi " + std::to_string(inst[2]) + " has a value that does not match its type";
+				if (std::find(parents.begin(), parents.end(), inst[k + 1]) == parents.end())
+					return "phi " + std::to_string(inst[2]) + " references block " + std::to_string(inst[k + 1]) + " which is not a predecessor";
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	return std::string();
+}
+
+/// <summary>
+/// Check that the module contains an "OpExtInst" instruction with the specified extended instruction number.
+/// </summary>
+static bool contains_ext_inst(const std::vector<uint32_t> &spirv, spv::GLSLstd450 ext_inst)
+{
+	for (size_t offset = 5; offset < spirv.size(); offset += spirv[offset] >> spv::WordCountShift)
+		if (static_cast<spv::Op>(spirv[offset] & spv::OpCodeMask) == spv::OpExtInst && spirv[offset + 4] == static_cast<uint32_t>(ext_inst))
+			return true;
+	return false;
+}
+
+/// <summary>
+/// Run an external validator (like "spirv-val") on the module, if one was specified through the "SPIRV_VAL" environment variable.
+/// </summary>
+static std::string validate_spirv_external(const std::vector<uint32_t> &spirv, bool vulkan_semantics)
+{
+	const char *const validator = std::getenv("SPIRV_VAL");
+	if (validator == nullptr || validator[0] == '\0')
+		return std::string();
+
+	std::error_code ec;
+	const std::filesystem::path path = std::filesystem::temp_directory_path(ec) / "reshade_spirv_optimizer_test.spv";
+	std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(spirv.data()), spirv.size() * sizeof(uint32_t));
+
+	const std::string command = '"' + std::string(validator) + "\" " + (vulkan_semantics ? "--target-env vulkan1.0 " : "--target-env opengl4.5 ") + '"' + path.u8string() + '"';
+	if (std::system(command.c_str()) != 0)
+		return "\"" + command + "\" failed";
+
+	return std::string();
+}
+
+static bool compile(const std::string &source, const std::filesystem::path &path, bool vulkan_semantics, bool debug_info, reshadefx::spirv_optimization optimization, reshadefx::module &module, std::string &errors)
+{
+	reshadefx::preprocessor pp;
+	pp.add_macro_definition("BUFFER_WIDTH", "1920");
+	pp.add_macro_definition("BUFFER_HEIGHT", "1080");
+	pp.add_macro_definition("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
+	pp.add_macro_definition("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+
+	if (!path.empty())
+		pp.add_include_path(path.parent_path());
+
+	if (!(path.empty() ? pp.append_string(source) : pp.append_file(path)))
+	{
+		errors = pp.errors();
+		return false;
+	}
+
+	reshadefx::parser parser;
+	std::unique_ptr<reshadefx::codegen> backend(reshadefx::create_codegen_spirv(vulkan_semantics, debug_info, false, false, false, optimization));
+
+	if (!parser.parse(pp.output(), backend.get()))
+	{
+		errors = parser.errors();
+		return false;
+	}
+
+	backend->write_result(module);
+	return true;
+}
+
+/// <summary>
+/// Check that optimizing did not change anything the runtime reflects on.
+/// </summary>
+static std::string compare_reflection(const reshadefx::module &reference, const reshadefx::module &module)
+{
+	if (module.entry_points.size() != reference.entry_points.size())
+		return "number of entry points changed";
+	for (size_t i = 0; i < module.entry_points.size(); ++i)
+		if (module.entry_points[i].name != reference.entry_points[i].name || module.entry_points[i].type != reference.entry_points[i].type)
+			return "entry point \"" + reference.entry_points[i].name + "\" changed";
+
+	if (module.uniforms.size() != reference.uniforms.size() || module.total_uniform_size != reference.total_uniform_size)
+		return "uniform layout changed";
+	for (size_t i = 0; i < module.uniforms.size(); ++i)
+		if (module.uniforms[i].name != reference.uniforms[i].name || module.uniforms[i].offset != reference.uniforms[i].offset || module.uniforms[i].size != reference.uniforms[i].size)
+			return "uniform \"" + reference.uniforms[i].name + "\" changed";
+
+	if (module.textures.size() != reference.textures.size() || module.samplers.size() != reference.samplers.size() || module.storages.size() != reference.storages.size())
+		return "number of textures, samplers or storages changed";
+	for (size_t i = 0; i < module.samplers.size(); ++i)
+		if (module.samplers[i].binding != reference.samplers[i].binding)
+			return "binding of sampler \"" + reference.samplers[i].unique_name + "\" changed";
+
+	if (module.techniques.size() != reference.techniques.size())
+		return "number of techniques changed";
+	for (size_t i = 0; i < module.techniques.size(); ++i)
+		if (module.techniques[i].passes.size() != reference.techniques[i].passes.size())
+			return "number of passes in technique \"" + reference.techniques[i].name + "\" changed";
+
+	return std::string();
+}
+
+/// <summary>
+/// Compile an effect with every optimization pass on its own and all of them combined and validate the result.
+/// </summary>
+template <typename F>
+static void test_optimizations(const std::string &name, const std::string &source, const std::filesystem::path &path, F additional_checks)
+{
+	for (const bool vulkan_semantics : { true, false })
+	{
+		const bool debug_info = !vulkan_semantics;
+
+		reshadefx::module reference;
+		for (const auto &[optimization_name, optimization] : s_optimizations)
+		{
+			const std::string test = name + " [" + optimization_name + (vulkan_semantics ? ", vulkan" : ", opengl, debug info") + ']';
+
+			reshadefx::module module;
+			if (std::string errors; !compile(source, path, vulkan_semantics, debug_info, optimization, module, errors))
+			{
+				report(test, "compilation failed\n" + errors);
+				continue;
+			}
+
+			std::string error = validate_spirv(module.spirv);
+			if (error.empty())
+				error = validate_spirv_external(module.spirv, vulkan_semantics);
+			if (error.empty() && optimization != reshadefx::spirv_optimization::none)
+				error = compare_reflection(reference, module);
+			if (error.empty())
+				error = additional_checks(module);
+
+			report(test, error);
+
+			if (optimization == reshadefx::spirv_optimization::none)
+				reference = std::move(module);
+		}
+	}
+}
+
+bool run_spirv_optimizer_tests(const std::filesystem::path &corpus_path)
+{
+	// Modules are always checked by the built-in validator, so only make it visible that the external one did not run
+	if (const char *const validator = std::getenv("SPIRV_VAL"); validator == nullptr || validator[0] == '\0')
+		report_skipped("external validation of every module", "SPIRV_VAL is not set");
+
+	// Instructions that write through a pointer must be kept, even if their result is unused
+	test_optimizations("unused result of modf and frexp", R"(
+		void VS(uint id : SV_VertexID, out float4 position : SV_Position, out float2 texcoord : TEXCOORD)
+		{
+			texcoord = float2(id == 2 ? 2.0 : 0.0, id == 1 ? 2.0 : 0.0);
+			position = float4(texcoord * float2(2.0, -2.0) + float2(-1.0, 1.0), 0.0, 1.0);
+		}
+		float4 PS(float4 position : SV_Position, float2 uv : TEXCOORD) : SV_Target
+		{
+			float ip;
+			modf(uv.x * 10.0, ip);
+			int e;
+			frexp(uv.y, e);
+			return float4(ip, e, 0.0, 1.0);
+		}
+		technique T { pass { VertexShader = VS; PixelShader = PS; } }
+)", std::filesystem::path(),
+		[](const reshadefx::module &module) -> std::string {
+			if (!contains_ext_inst(module.spirv, spv::GLSLstd450Modf))
+				return "call to modf was removed";
+			if (!contains_ext_inst(module.spirv, spv::GLSLstd450Frexp))
+				return "call to frexp was removed";
+			return std::string();
+		});
+
+	// Every effect in the corpus directory
+	std::vector<std::filesystem::path> effects;
+	if (std::error_code ec; std::filesystem::is_directory(corpus_path, ec))
+		for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(corpus_path, ec))
+			if (entry.path().extension() == ".fx")
+				effects.push_back(entry.path());
+	std::sort(effects.begin(), effects.end());
+
+	if (effects.empty())
+	{
+		std::cout << "error: No effects found in '" << corpus_path.u8string() << "'" << std::endl;
+		return false;
+	}
+
+	for (const std::filesystem::path &path : effects)
+		test_optimizations(path.filename().u8string(), std::string(), path, [](const reshadefx::module &) { return std::string(); });
+
+	return true;
+}
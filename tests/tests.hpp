@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2014 Patrick Mours
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+/// <summary>
+/// Count the result of a test and print the error if it failed.
+/// </summary>
+/// <param name="test">The name of the test.</param>
+/// <param name="error">A description of why the test failed, or an empty string if it passed.</param>
+void report(const std::string &test, const std::string &error);
+/// <summary>
+/// Count a test that could not be run and print why.
+/// </summary>
+/// <param name="test">The name of the test.</param>
+/// <param name="reason">A description of why the test was skipped.</param>
+void report_skipped(const std::string &test, const std::string &reason);
+
+/// <summary>
+/// Check a SPIR-V module for the same kind of errors "spirv-val" reports: Broken module layout, undefined or duplicate IDs, malformed functions and blocks and mismatching types.
+/// </summary>
+/// <returns>A description of the first error that was found, or an empty string if the module is valid.</returns>
+std::string validate_spirv(const std::vector<uint32_t> &spirv);
+
+/// <summary>
+/// Lex the effects in the corpus directory and generated edge cases with every combination of lexer flags and check that vectorized scanning produces the same tokens as looking at every character individually.
+/// </summary>
+void run_lexer_tests(const std::filesystem::path &corpus_path);
+
+/// <summary>
+/// Compile the effects in the corpus directory and some inline ones with every SPIR-V optimization pass and validate the result.
+/// </summary>
+/// <returns><see langword="false"/> if no effects were found in the corpus directory, <see langword="true"/> otherwise.</returns>
+bool run_spirv_optimizer_tests(const std::filesystem::path &corpus_path);
+
+/// <summary>
+/// Check the values intrinsic calls with constant arguments are folded into and that calls with arguments for which the result is undefined are not folded.
+/// </summary>
+void run_constant_folding_tests();
+
+/// <summary>
+/// Compile effects and check which passes are reported as pointwise.
+/// </summary>
+void run_pointwise_pass_tests();
@@ -7,14 +7,79 @@
 #include "effect_codegen.hpp"
 #include "effect_preprocessor.hpp"
 #include "version.h"
+#include <cstdio> // std::snprintf
 #include <cstdlib>
+#include <algorithm> // std::find_if, std::sort
+#include <atomic>
+#include <chrono>
 #include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <new>
+#include <thread>
+
+// Keep track of all heap allocations, so that the memory usage of each compilation phase can be reported
+// This is only enabled with "--time-report", so that other compilations do not pay for the atomic operations
+static std::atomic<bool> s_track_allocations = false;
+static std::atomic<size_t> s_allocation_count = 0;
+static std::atomic<size_t> s_allocated_bytes = 0;
+static std::atomic<size_t> s_peak_allocated_bytes = 0;
+
+void *operator new(size_t size)
+{
+	// Store the tracked size in front of the allocation, so that it is known again when it is freed (zero if the allocation was not tracked)
+	void *const block = std::malloc(sizeof(std::max_align_t) + size);
+	if (block == nullptr)
+		throw std::bad_alloc();
+	*static_cast<size_t *>(block) = 0;
+
+	if (s_track_allocations.load(std::memory_order_relaxed))
+	{
+		*static_cast<size_t *>(block) = size;
+
+		s_allocation_count++;
+		const size_t allocated_bytes = s_allocated_bytes += size;
+		for (size_t peak_allocated_bytes = s_peak_allocated_bytes; allocated_bytes > peak_allocated_bytes && !s_peak_allocated_bytes.compare_exchange_weak(peak_allocated_bytes, allocated_bytes);)
+			continue;
+	}
+
+	return static_cast<char *>(block) + sizeof(std::max_align_t);
+}
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+void operator delete(void *ptr) noexcept
+{
+	if (ptr == nullptr)
+		return;
+
+	void *const block = static_cast<char *>(ptr) - sizeof(std::max_align_t);
+	if (const size_t size = *static_cast<size_t *>(block); size != 0)
+		s_allocated_bytes -= size;
+	std::free(block);
+}
+void operator delete[](void *ptr) noexcept
+{
+	operator delete(ptr);
+}
+void operator delete(void *ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+void operator delete[](void *ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
 
 static void print_usage(const char *path)
 {
 	printf(R"(usage: %s [options] <filename>
+       %s [options] <directory | @listfile | filename...>
+
+Several input files, a directory (all .fx files in it) or a list file (one path per line) compile all effects in parallel and print a summary.
+The "-P", "-E", "-Fo", "--cost-report" and "--time-report" options only apply to a single input file and cannot be used then.
 
 Options:
   -h, --help                Print this help.
@@ -24,11 +89,12 @@ Options:
   -I <path>                 Add directory to include search path.
   -P <path>                 Pre-process to file. If <path> is "-", then result is written to standard output instead.
 
-  -Fo <file>                Output SPIR-V binary to the given file.
+  -E <name>                 Specify an entry point by function name. Only code reachable from it is printed.
+  -Fo <file>                Output SPIR-V binary to the given file. Can be combined with "--glsl" and "--hlsl".
   -Fe <file>                Output warnings and errors to the given file.
 
   --glsl                    Print GLSL code for the previously specified entry point.
-  --hlsl                    Print HLSL code for the previously specified entry point.
+  --hlsl                    Print HLSL code for the previously specified entry point. Printed after GLSL code if both are specified.
   --shader-model <value>    HLSL shader model version. Can be 30, 40, 41, 50, ...
 
   --width <value>           Value of the 'BUFFER_WIDTH' preprocessor macro.
@@ -37,13 +103,151 @@ Options:
   --spec-constants          Convert uniform variables to specialization constants.
   --vulkan-semantics        Generate GLSL/SPIR-V code under Vulkan semantics, instead of OpenGL semantics.
 
+  -O                        Run optimization passes on the generated SPIR-V code.
+  --pack-uniforms           Rearrange uniform variables to reduce padding and print the number of bytes saved.
+  --cost-report             Print a static estimate of the cost of every pass.
   -Zi                       Enable debug information.
-	)", path);
+
+  -j <count>                Number of threads to compile several effects with. Defaults to the number of CPU cores.
+
+  --time-report             Print the time and memory spent in preprocessing, parsing and code generation to standard error.
+  --time-report-json        Same as "--time-report", but print the report as JSON.
+	)", path, path);
+}
+
+struct phase_report
+{
+	std::string name;
+	// What the phase covers, since that depends on how it is split up into work
+	std::string description;
+	double duration = 0.0;
+	size_t allocation_count = 0;
+	// Highest amount of memory allocated during the phase on top of what was already allocated when it started
+	size_t peak_allocated_bytes = 0;
+};
+
+static std::string escape_json_string(const std::string &value)
+{
+	std::string result;
+	for (const char c : value)
+	{
+		switch (c)
+		{
+		case '\\':
+		case '"':
+			result += '\\';
+			result += c;
+			break;
+		case '\n':
+			result += "\\n";
+			break;
+		case '\t':
+			result += "\\t";
+			break;
+		case '\r':
+			result += "\\r";
+			break;
+		default:
+			// Other control characters are not allowed in JSON strings either
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char escaped[7];
+				std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned int>(c));
+				result += escaped;
+			}
+			else
+			{
+				result += c;
+			}
+			break;
+		}
+	}
+	return result;
+}
+
+static void print_time_report(const std::string &filename, const std::vector<phase_report> &phases, size_t token_count, size_t macro_expansion_count, const std::vector<std::pair<std::string, size_t>> &output_sizes, bool json)
+{
+	// Print to standard error, so that the report can be separated from generated code printed to standard output
+	if (json)
+	{
+		std::cerr << "{\n  \"file\": \"" << escape_json_string(filename) << "\",\n  \"phases\": [";
+		for (size_t i = 0; i < phases.size(); ++i)
+			std::cerr << (i != 0 ? "," : "") << "\n    { \"name\": \"" << escape_json_string(phases[i].name) << "\", \"description\": \"" << escape_json_string(phases[i].description) << "\", \"time_ms\": " << std::fixed << std::setprecision(3) << phases[i].duration << ", \"allocations\": " << phases[i].allocation_count << ", \"peak_allocated_bytes\": " << phases[i].peak_allocated_bytes << " }";
+		std::cerr << "\n  ],\n  \"tokens\": " << token_count << ",\n  \"macro_expansions\": " << macro_expansion_count << ",\n  \"output_bytes\": {";
+		for (size_t i = 0; i < output_sizes.size(); ++i)
+			std::cerr << (i != 0 ? ", " : " ") << '"' << output_sizes[i].first << "\": " << output_sizes[i].second;
+		std::cerr << " }\n}" << std::endl;
+	}
+	else
+	{
+		std::cerr << std::left << std::setw(24) << "phase" << std::right << std::setw(12) << "time (ms)" << std::setw(13) << "allocations" << std::setw(22) << "peak allocated bytes" << std::endl;
+		for (const phase_report &phase : phases)
+			std::cerr << std::left << std::setw(24) << phase.name << std::right << std::fixed << std::setprecision(3) << std::setw(12) << phase.duration << std::setw(13) << phase.allocation_count << std::setw(22) << phase.peak_allocated_bytes << std::endl;
+
+		for (const phase_report &phase : phases)
+			std::cerr << phase.name << ": " << phase.description << std::endl;
+
+		std::cerr << "tokens: " << token_count << std::endl;
+		std::cerr << "macro expansions: " << macro_expansion_count << std::endl;
+		for (const std::pair<std::string, size_t> &output_size : output_sizes)
+			std::cerr << output_size.first << " output: " << output_size.second << " bytes" << std::endl;
+	}
+}
+
+static void print_shader_cost(const char *stage, const reshadefx::shader_cost &cost)
+{
+	std::cout << "    " << stage << ": " << cost.alu_instructions << " ALU, " << cost.texture_fetches << " texture fetches";
+	if (cost.dependent_fetch_depth > 1)
+		std::cout << " (dependent fetch depth " << cost.dependent_fetch_depth << ')';
+	if (cost.loop_iterations != 0)
+		std::cout << ", ~" << cost.loop_iterations << " loop iterations";
+	if (cost.unknown_loop_count != 0)
+		std::cout << " (" << cost.unknown_loop_count << " with assumed trip count)";
+	std::cout << std::endl;
+}
+
+static void print_cost_report(const reshadefx::module &module, uint32_t buffer_width, uint32_t buffer_height)
+{
+	for (const reshadefx::technique_info &technique : module.techniques)
+	{
+		std::cout << "technique " << technique.name << std::endl;
+
+		for (size_t pass_index = 0; pass_index < technique.passes.size(); ++pass_index)
+		{
+			const reshadefx::pass_info &pass = technique.passes[pass_index];
+
+			std::cout << "  pass " << pass_index;
+			if (!pass.name.empty())
+				std::cout << ' ' << pass.name;
+			if (pass.pointwise)
+				std::cout << " (pointwise)";
+			std::cout << std::endl;
+
+			if (!pass.cs_entry_point.empty())
+			{
+				print_shader_cost("CS", pass.cs_cost);
+				continue;
+			}
+
+			print_shader_cost("VS", pass.vs_cost);
+			print_shader_cost("PS", pass.ps_cost);
+
+			// Passes without render targets cover the back buffer
+			const uint64_t width = pass.viewport_width != 0 ? pass.viewport_width : buffer_width;
+			const uint64_t height = pass.viewport_height != 0 ? pass.viewport_height : buffer_height;
+			const uint64_t bytes_per_frame = width * height * pass.render_target_bytes_per_pixel;
+
+			std::cout << "    Output: " << pass.render_target_bytes_per_pixel << " bytes per pixel, " << (bytes_per_frame / 1024) << " KiB per frame at " << width << 'x' << height << std::endl;
+		}
+	}
 }
 
 int main(int argc, char *argv[])
 {
-	const char *filename = nullptr;
+	std::vector<std::string> inputs;
+	std::vector<std::string> include_paths;
+	std::vector<std::pair<std::string, std::string>> macros;
+	const char *entry_point = nullptr;
 	const char *preprocess = nullptr;
 	const char *errorfile = nullptr;
 	const char *objectfile = nullptr;
@@ -52,15 +256,16 @@ int main(int argc, char *argv[])
 	bool print_glsl = false;
 	bool print_hlsl = false;
 	bool debug_info = false;
+	bool optimize = false;
+	bool pack_uniforms = false;
+	bool cost_report = false;
+	bool time_report = false;
+	bool time_report_json = false;
 	bool invert_y_axis = false;
 	bool spec_constants = false;
 	bool vulkan_semantics = false;
 	unsigned int shader_model = 50;
-
-	reshadefx::parser parser;
-	reshadefx::preprocessor pp;
-	pp.add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
-	pp.add_macro_definition("__RESHADE_PERFORMANCE_MODE__", "0");
+	unsigned int num_threads = std::thread::hardware_concurrency();
 
 	// Parse command-line arguments
 	for (int i = 1; i < argc; ++i)
@@ -83,22 +288,32 @@ int main(int argc, char *argv[])
 				char *macro = argv[++i];
 				char *value = std::strchr(macro, '=');
 				if (value) *value++ = '\0';
-				pp.add_macro_definition(macro, value ? value : "1");
+				macros.emplace_back(macro, value ? value : "1");
 				continue;
 			}
 
 			if (0 == std::strcmp(arg, "-I"))
 			{
-				pp.add_include_path(argv[++i]);
+				include_paths.push_back(argv[++i]);
 				continue;
 			}
 
-			if (0 == std::strcmp(arg, "-Zi"))
+			if (0 == std::strcmp(arg, "-O"))
+				optimize = true;
+			else if (0 == std::strcmp(arg, "-Zi"))
 				debug_info = true;
 			else if (0 == std::strcmp(arg, "--glsl"))
 				print_glsl = true;
 			else if (0 == std::strcmp(arg, "--hlsl"))
 				print_hlsl = true;
+			else if (0 == std::strcmp(arg, "--pack-uniforms"))
+				pack_uniforms = true;
+			else if (0 == std::strcmp(arg, "--cost-report"))
+				cost_report = true;
+			else if (0 == std::strcmp(arg, "--time-report"))
+				time_report = true;
+			else if (0 == std::strcmp(arg, "--time-report-json"))
+				time_report = time_report_json = true;
 			else if (0 == std::strcmp(arg, "--invert-y"))
 				invert_y_axis = true;
 			else if (0 == std::strcmp(arg, "--spec-constants"))
@@ -108,6 +323,8 @@ int main(int argc, char *argv[])
 
 			if (i + 1 >= argc)
 				continue;
+			else if (0 == std::strcmp(arg, "-E"))
+				entry_point = argv[++i];
 			else if (0 == std::strcmp(arg, "-P"))
 				preprocess = argv[++i];
 			else if (0 == std::strcmp(arg, "-Fe"))
@@ -120,31 +337,236 @@ int main(int argc, char *argv[])
 				buffer_width = argv[++i];
 			else if (0 == std::strcmp(arg, "--height"))
 				buffer_height = argv[++i];
+			else if (0 == std::strcmp(arg, "-j"))
+				num_threads = std::strtoul(argv[++i], nullptr, 10);
 		}
 		else
 		{
-			if (filename != nullptr)
-			{
-				std::cout << "error: More than one input file specified" << std::endl;
-				return 1;
-			}
-
-			filename = arg;
+			inputs.push_back(arg);
 		}
 	}
 
-	if (filename == nullptr)
+	if (inputs.empty())
 	{
 		print_usage(argv[0]);
 		return 1;
 	}
 
-	pp.add_macro_definition("BUFFER_WIDTH", buffer_width);
-	pp.add_macro_definition("BUFFER_HEIGHT", buffer_height);
-	pp.add_macro_definition("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
-	pp.add_macro_definition("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+	const auto setup_preprocessor = [&](reshadefx::preprocessor &pp) {
+		pp.add_macro_definition("__RESHADE__", std::to_string(VERSION_MAJOR * 10000 + VERSION_MINOR * 100 + VERSION_REVISION));
+		pp.add_macro_definition("__RESHADE_PERFORMANCE_MODE__", "0");
+
+		for (const std::pair<std::string, std::string> &macro : macros)
+			pp.add_macro_definition(macro.first, macro.second);
+		for (const std::string &include_path : include_paths)
+			pp.add_include_path(include_path);
+
+		pp.add_macro_definition("BUFFER_WIDTH", buffer_width);
+		pp.add_macro_definition("BUFFER_HEIGHT", buffer_height);
+		pp.add_macro_definition("BUFFER_RCP_WIDTH", "(1.0 / BUFFER_WIDTH)");
+		pp.add_macro_definition("BUFFER_RCP_HEIGHT", "(1.0 / BUFFER_HEIGHT)");
+	};
 
-	if (!pp.append_file(filename))
+	// Code can be generated for several back-ends at once, in which case the effect is only parsed once and the result is replayed into each of them
+	const auto create_backends = [&](std::vector<std::string> *names = nullptr) {
+		std::vector<std::unique_ptr<reshadefx::codegen>> backends;
+		std::vector<std::string> backend_names;
+		if (print_glsl)
+			backends.emplace_back(reshadefx::create_codegen_glsl(vulkan_semantics, debug_info, spec_constants, false, invert_y_axis, pack_uniforms)),
+			backend_names.push_back("glsl");
+		if (print_hlsl)
+			backends.emplace_back(reshadefx::create_codegen_hlsl(shader_model, debug_info, spec_constants, pack_uniforms)),
+			backend_names.push_back("hlsl");
+		if (objectfile != nullptr || backends.empty())
+			backends.emplace_back(reshadefx::create_codegen_spirv(vulkan_semantics, debug_info, spec_constants, false, invert_y_axis, optimize ? reshadefx::spirv_optimization::all : reshadefx::spirv_optimization::none, pack_uniforms)),
+			backend_names.push_back("spirv");
+		if (names != nullptr)
+			*names = std::move(backend_names);
+		return backends;
+	};
+
+	if (inputs.size() > 1 || inputs[0][0] == '@' || std::filesystem::is_directory(inputs[0]))
+	{
+		// These options write or print results for a single effect, so report an error rather than silently ignoring them
+		if (const char *const single_input_option =
+				preprocess != nullptr ? "-P" :
+				entry_point != nullptr ? "-E" :
+				objectfile != nullptr ? "-Fo" :
+				cost_report ? "--cost-report" :
+				time_report ? (time_report_json ? "--time-report-json" : "--time-report") : nullptr;
+			single_input_option != nullptr)
+		{
+			std::cout << "error: Option '" << single_input_option << "' cannot be used with several input files, a directory or a list file" << std::endl;
+			return 1;
+		}
+
+		std::vector<std::filesystem::path> files;
+
+		const auto add_input = [&files](const std::filesystem::path &path) {
+			if (std::error_code ec; std::filesystem::is_directory(path, ec))
+			{
+				std::vector<std::filesystem::path> directory_files;
+				for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(path, std::filesystem::directory_options::skip_permission_denied, ec))
+					if (entry.path().extension() == ".fx")
+						directory_files.push_back(entry.path());
+
+				std::sort(directory_files.begin(), directory_files.end());
+				files.insert(files.end(), directory_files.begin(), directory_files.end());
+			}
+			else
+			{
+				files.push_back(path);
+			}
+		};
+
+		for (const std::string &input : inputs)
+		{
+			if (input[0] == '@')
+			{
+				std::ifstream list_file(input.substr(1));
+				if (!list_file)
+				{
+					std::cout << "error: Could not open list file '" << input.substr(1) << '\'' << std::endl;
+					return 1;
+				}
+
+				for (std::string line; std::getline(list_file, line);)
+				{
+					// Ignore empty lines and trailing carriage returns from files with Windows line endings
+					if (!line.empty() && line.back() == '\r')
+						line.pop_back();
+					if (!line.empty())
+						add_input(line);
+				}
+			}
+			else
+			{
+				add_input(input);
+			}
+		}
+
+		struct compile_result
+		{
+			bool success = false;
+			double duration = 0.0;
+			std::string errors;
+		};
+
+		std::vector<compile_result> results(files.size());
+		std::atomic<size_t> next_file_index = 0;
+		// Headers included by many effects are only read once for the whole batch
+		reshadefx::include_cache include_cache;
+
+		const auto compile_files = [&]() {
+			for (size_t file_index; (file_index = next_file_index++) < files.size();)
+			{
+				compile_result &result = results[file_index];
+				const auto start_time = std::chrono::steady_clock::now();
+
+				reshadefx::preprocessor pp;
+				setup_preprocessor(pp);
+				pp.set_include_cache(&include_cache);
+				// Effects in a shader pack usually start with the same includes, so share the state after those between all of them
+				pp.enable_precompiled_headers();
+
+				if (pp.append_file(files[file_index]))
+				{
+					std::vector<std::unique_ptr<reshadefx::codegen>> backends = create_backends();
+					std::unique_ptr<reshadefx::codegen> ir;
+					if (backends.size() > 1)
+						ir.reset(reshadefx::create_codegen_ir());
+
+					reshadefx::parser parser;
+					result.success = parser.parse(pp.output(), ir != nullptr ? ir.get() : backends[0].get());
+					result.errors = pp.errors() + parser.errors();
+
+					for (size_t i = 0; result.success && i < backends.size(); ++i)
+					{
+						if (ir != nullptr)
+							reshadefx::replay_codegen_ir(ir.get(), backends[i].get());
+
+						reshadefx::module module;
+						backends[i]->write_result(module);
+					}
+				}
+				else
+				{
+					result.errors = pp.errors();
+					// The preprocessor does not report an error if the file itself could not be opened
+					if (result.errors.empty())
+						result.errors = "error: Could not open file '" + files[file_index].u8string() + "'\n";
+				}
+
+				result.duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+			}
+		};
+
+		const auto start_time = std::chrono::steady_clock::now();
+
+		std::vector<std::thread> threads;
+		for (unsigned int i = 1; i < std::min<size_t>(std::max(num_threads, 1u), files.size()); ++i)
+			threads.emplace_back(compile_files);
+		compile_files();
+		for (std::thread &thread : threads)
+			thread.join();
+
+		const double total_duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+
+		size_t num_failed = 0;
+		std::string errors;
+
+		for (size_t file_index = 0; file_index < files.size(); ++file_index)
+		{
+			const compile_result &result = results[file_index];
+			if (!result.success)
+				num_failed++;
+
+			std::cout << (result.success ? "succeeded " : "failed    ") << std::fixed << std::setprecision(3) << std::setw(10) << result.duration << " ms  " << files[file_index].u8string() << std::endl;
+
+			if (!result.errors.empty())
+			{
+				if (errorfile == nullptr)
+					std::cout << result.errors;
+				else
+					errors += result.errors;
+			}
+		}
+
+		std::cout << files.size() - num_failed << " succeeded, " << num_failed << " failed, in " << std::fixed << std::setprecision(3) << total_duration << " ms" << std::endl;
+
+		if (errorfile != nullptr)
+			std::ofstream(errorfile) << errors;
+
+		return num_failed != 0 ? 1 : 0;
+	}
+
+	std::vector<phase_report> phases;
+	s_track_allocations = time_report;
+
+	// Time a compilation phase and record how much memory it allocated
+	const auto measure_phase = [&phases](std::string name, std::string description, const auto &phase) {
+		const size_t allocation_count = s_allocation_count;
+		const size_t allocated_bytes = s_allocated_bytes;
+		s_peak_allocated_bytes = allocated_bytes;
+		const auto start_time = std::chrono::steady_clock::now();
+
+		const auto result = phase();
+
+		phase_report &report = phases.emplace_back();
+		report.name = std::move(name);
+		report.description = std::move(description);
+		report.duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+		report.allocation_count = s_allocation_count - allocation_count;
+		report.peak_allocated_bytes = s_peak_allocated_bytes - allocated_bytes;
+
+		return result;
+	};
+
+	reshadefx::parser parser;
+	reshadefx::preprocessor pp;
+	setup_preprocessor(pp);
+
+	if (!measure_phase("preprocess", "Read the input file and expand include files and macros", [&]() { return pp.append_file(inputs[0]); }))
 	{
 		if (errorfile == nullptr)
 			std::cout << pp.errors() << std::endl;
@@ -162,15 +584,18 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
-	std::unique_ptr<reshadefx::codegen> backend;
-	if (print_glsl)
-		backend.reset(reshadefx::create_codegen_glsl(vulkan_semantics, debug_info, spec_constants, invert_y_axis));
-	else if (print_hlsl)
-		backend.reset(reshadefx::create_codegen_hlsl(shader_model, debug_info, spec_constants));
-	else
-		backend.reset(reshadefx::create_codegen_spirv(vulkan_semantics, debug_info, spec_constants, invert_y_axis));
+	std::vector<std::string> backend_names;
+	std::vector<std::unique_ptr<reshadefx::codegen>> backends = create_backends(&backend_names);
+
+	// Only go through the intermediate representation when it is needed, so that the time report measures the same pipeline as a normal compilation
+	std::unique_ptr<reshadefx::codegen> ir;
+	if (backends.size() > 1)
+		ir.reset(reshadefx::create_codegen_ir());
 
-	if (!parser.parse(pp.output(), backend.get()))
+	if (!measure_phase("parse", ir != nullptr ?
+			"Parse the preprocessed code and record it into the intermediate representation" :
+			"Parse the preprocessed code and generate code with the " + backend_names[0] + " back-end",
+			[&]() { return parser.parse(pp.output(), ir != nullptr ? ir.get() : backends[0].get()); }))
 	{
 		if (errorfile == nullptr)
 			std::cout << pp.errors() << parser.errors() << std::endl;
@@ -179,17 +604,84 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	reshadefx::module module;
-	backend->write_result(module);
+	std::vector<reshadefx::module> modules(backends.size());
+	if (time_report)
+	{
+		// Generate code for one back-end after the other, so that time and memory can be attributed to each of them
+		for (size_t i = 0; i < backends.size(); ++i)
+		{
+			if (ir != nullptr)
+				measure_phase("replay (" + backend_names[i] + ')', "Replay the intermediate representation into the " + backend_names[i] + " back-end", [&]() {
+					reshadefx::replay_codegen_ir(ir.get(), backends[i].get());
+					return true;
+				});
+
+			measure_phase("write_result (" + backend_names[i] + ')', "Finish the code of the " + backend_names[i] + " back-end and write it to the module", [&]() {
+				backends[i]->write_result(modules[i]);
+				return true;
+			});
+		}
+	}
+	else if (ir != nullptr)
+	{
+		// The back-ends do not share any state, so can generate code in parallel
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < backends.size(); ++i)
+			threads.emplace_back([&ir, &backends, &modules, i]() {
+				reshadefx::replay_codegen_ir(ir.get(), backends[i].get());
+				backends[i]->write_result(modules[i]);
+			});
+		for (std::thread &thread : threads)
+			thread.join();
+	}
+	else
+	{
+		backends[0]->write_result(modules[0]);
+	}
+
+	// The cost estimate is gathered while parsing, so is the same for all back-ends
+	if (cost_report)
+		print_cost_report(modules[0], std::strtoul(buffer_width, nullptr, 10), std::strtoul(buffer_height, nullptr, 10));
 
-	if (print_glsl || print_hlsl)
+	for (const reshadefx::module &module : modules)
 	{
-		std::cout << module.hlsl << std::endl;
+		if (pack_uniforms)
+			std::cerr << "info: Uniform storage is " << module.total_uniform_size << " bytes after packing (saved " << module.packed_uniform_bytes_saved << " bytes)" << std::endl;
+
+		if (module.spirv.empty())
+		{
+			if (entry_point != nullptr)
+			{
+				// Accept the function name as written in the effect code, as well as the unique name the code generator gave the entry point
+				const auto it = std::find_if(module.entry_points.begin(), module.entry_points.end(),
+					[entry_point](const reshadefx::entry_point &ep) { return ep.function_name == entry_point || ep.name == entry_point; });
+				if (it == module.entry_points.end())
+				{
+					std::cout << "error: Entry point '" << entry_point << "' not found" << std::endl;
+					return 1;
+				}
+
+				std::cout << it->code << std::endl;
+			}
+			else
+			{
+				std::cout << module.hlsl << std::endl;
+			}
+		}
+		else if (objectfile != nullptr)
+		{
+			std::ofstream(objectfile, std::ios::binary).write(
+				reinterpret_cast<const char *>(module.spirv.data()), module.spirv.size() * sizeof(uint32_t));
+		}
 	}
-	else if (objectfile != nullptr)
+
+	if (time_report)
 	{
-		std::ofstream(objectfile, std::ios::binary).write(
-			reinterpret_cast<const char *>(module.spirv.data()), module.spirv.size() * sizeof(uint32_t));
+		std::vector<std::pair<std::string, size_t>> output_sizes;
+		for (size_t i = 0; i < modules.size(); ++i)
+			output_sizes.emplace_back(backend_names[i], modules[i].spirv.empty() ? modules[i].hlsl.size() : modules[i].spirv.size() * sizeof(uint32_t));
+
+		print_time_report(inputs[0], phases, parser.token_count(), pp.macro_expansion_count(), output_sizes, time_report_json);
 	}
 
 	return 0;